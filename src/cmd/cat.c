@@ -1,44 +1,109 @@
+#include <limits.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <linux/limits.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
+#include "archive.h"
+#include "catalog.h"
 #include "command_handler.h"
 #include "errors.h"
+#include "output.h"
 #include "tar.h"
 #include "path_lib.h"
 #include "utils.h"
 
 #define CMD_NAME "cat"
 
-int cat (char *tar_name, char *filename, char *options)
+/** Files of an archive given to cat_batch() */
+struct cat_files
+{
+  char *tar_name;
+  char **filenames;
+  int ret;
+};
+
+/* Write a hole of a sparse file to the standard output : recreated in a regular file, written as zeros otherwise */
+static int write_hole (size_t count)
 {
-  if (is_empty_string(filename))
+  struct stat st;
+  off_t end;
+
+  // la taille du fichier est lue une fois la sortie vidée
+  if (out_flush(STDOUT_FILENO) == 0 && fstat(STDOUT_FILENO, &st) == 0 && S_ISREG(st.st_mode))
   {
-    errno = EISDIR;
-    error(EISDIR, "%s: %s", CMD_NAME, tar_name);
-    return EXIT_FAILURE;
+    // ftruncate agrandit le fichier sans allouer de blocs, même avec O_APPEND
+    end = (fcntl(STDOUT_FILENO, F_GETFL) & O_APPEND) ? st.st_size + count : lseek(STDOUT_FILENO, count, SEEK_CUR);
+    if (end < 0 || (end > st.st_size && ftruncate(STDOUT_FILENO, end) < 0))
+      return -1;
+    return 0;
   }
-  enum file_type t = type_of_file(tar_name, filename, false);
-  switch(t)
+
+  for (int n; count > 0; count -= n)
   {
-    case REG:
-      break;
-    case DIR:
-      errno = EISDIR;
-    case NONE:
-      tar_error_cmd(CMD_NAME, tar_name, filename);
-      return EXIT_FAILURE;
+    n = count < INT_MAX ? count : INT_MAX;
+    if (out_repeat(STDOUT_FILENO, '\0', n) < 0)
+      return -1;
   }
-  if (tar_cp_file(tar_name, filename, STDOUT_FILENO) != 0)
-    {
-      tar_error_cmd (CMD_NAME, tar_name, filename);
-      return EXIT_FAILURE;
-    }
 
-  return EXIT_SUCCESS;
+  return 0;
+}
+
+static int cat_part (int index, const void *buf, size_t count, int err, void *data)
+{
+  struct cat_files *files = data;
+  int r = buf ? out_write(STDOUT_FILENO, buf, count) : count > 0 ? write_hole(count) : 0;
+
+  if (r < 0)
+  {
+    error_cmd(CMD_NAME, "write error");
+    files->ret = EXIT_FAILURE;
+    return -1;
+  }
+
+  if (err)
+  {
+    errno = err;
+    if (is_empty_string(files->filenames[index]))
+      error(EISDIR, "%s: %s", CMD_NAME, files->tar_name);
+    else
+      tar_error_cmd(CMD_NAME, files->tar_name, files->filenames[index]);
+    files->ret = EXIT_FAILURE;
+  }
+
+  return 0;
+}
+
+int cat_batch (char *tar_name, char **filenames, int nb_files, char *options)
+{
+  struct cat_files files = { tar_name, filenames, EXIT_SUCCESS };
+  const tar_catalog *catalog;
+
+  // le tar est ouvert une seule fois, et les fichiers lus dans l'ordre de l'archive
+  int tar_fd = archive_open(tar_name, O_RDONLY);
+  if (tar_fd < 0 || !(catalog = catalog_get(tar_name)))
+  {
+    tar_error_cmd(CMD_NAME, tar_name, filenames[0]);
+    if (tar_fd >= 0)
+      archive_close(tar_fd);
+    return EXIT_FAILURE;
+  }
+
+  // les erreurs sont affichées par cat_part, à leur place dans la sortie
+  tar_read_members(tar_fd, catalog, filenames, nb_files, cat_part, &files);
+  catalog_release(catalog);
+  out_flush(STDOUT_FILENO);
+  archive_close(tar_fd);
+  return files.ret;
+}
+
+int cat (char *tar_name, char *filename, char *options)
+{
+  return cat_batch(tar_name, &filename, 1, options);
 }
 
 int main (int argc, char *argv[])
@@ -49,7 +114,8 @@ int main (int argc, char *argv[])
       cat,
       false,
       false,
-      ""
+      "",
+      cat_batch
     };
 
   return handle_unary_command (cmd, argc, argv);
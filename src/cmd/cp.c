@@ -18,7 +18,9 @@ int main (int argc, char *argv[])
       cp_tar_to_tar,
       cp_ext_to_tar,
       cp_tar_to_ext,
-      SUPPORT_OPT
+      SUPPORT_OPT,
+      cp_tar_to_tar_batch,
+      cp_tar_to_ext_batch
     };
 
   return handle_binary_command (cmd, argc, argv);
@@ -1,3 +1,4 @@
+#include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdbool.h>
@@ -7,21 +8,25 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "archive.h"
+#include "catalog.h"
 #include "command_handler.h"
 #include "errors.h"
+#include "hashmap.h"
+#include "output.h"
 #include "path_lib.h"
 #include "tar.h"
 #include "utils.h"
 
 /** Supported options by ls */
-#define SUPPORT_OPT "l"
+#define SUPPORT_OPT "lf"
 
 /** Command name */
 #define CMD_NAME "ls"
 
 struct tar_fileinfo
 {
-  struct posix_header header;
+  const tar_member *member; // appartient au catalogue du tar
 
   unsigned int nb_links;
 };
@@ -31,7 +36,7 @@ static int tficmp (const void *lhs, const void *rhs)
   struct tar_fileinfo *ltfi = (struct tar_fileinfo*)lhs;
   struct tar_fileinfo *rtfi = (struct tar_fileinfo*)rhs;
 
-  return strcmp (ltfi->header.name, rtfi->header.name);
+  return strcmp (ltfi->member->name, rtfi->member->name);
 }
 
 static int max_nlink_width;
@@ -39,24 +44,25 @@ static int max_owner_width;
 static int max_group_width;
 static int max_size_width;
 
-static int total_block;
+static off_t total_block;
 
 
 /* utils */
-static char* get_corrected_name (const char *tar_name, const char *filename); 
-static char* get_last_component (char *path);
+static char* get_corrected_name (const tar_catalog *catalog, const char *filename);
+static const char* get_last_component (const char *path);
 
-static int nb_of_digits (unsigned int n);
+static int nb_of_digits (unsigned long long n);
 
 static int print_string (const char *string);
-static int print_unsigned_int (unsigned int n);
+static int print_unsigned_int (unsigned long long n);
 
 /* files array */
 static void init_ls ();
-static void add_header_to_files (array *files, struct posix_header *hd);
+static void add_file_to_files (array *files, const tar_member *member);
 
-static void update_files (array *files, int tar_fd);
-static int count_nb_link (array *all, struct tar_fileinfo *info);
+static void update_files (array *files, const tar_catalog *catalog);
+static void count_nb_links (array *files, const tar_catalog *catalog);
+static void forget_links ();
 static bool is_in_dir(const char *dir_name, const char *filename);
 static void update_widths (struct tar_fileinfo *info);
 static void update_total_block (struct tar_fileinfo *info);
@@ -66,22 +72,23 @@ static void print_padding (int n);
 
 static void print_total_block ();
 static int print_files (array *files, bool long_format);
+static int stream_dir (int tar_fd, const char *dir_name);
 static int print_fileinfo (struct tar_fileinfo *tfi, bool long_format, bool newline);
 
 static int print_filetype (char typeflag);
-static int print_filemode (char mode[8]);
+static int print_filemode (mode_t mode);
 static void print_nb_links (unsigned int nb_links);
-static void print_uname (char uname[32]);
-static void print_gname (char gname[32]);
-static void print_size (char size[12]);
-static void print_mtime (char mtime[12]);
-static int print_filename (char name[100]);
+static void print_uname (const char *uname);
+static void print_gname (const char *gname);
+static void print_size (off_t file_size);
+static void print_mtime (time_t mtime);
+static int print_filename (const char *name);
 
 
 
 
 
-static char *get_corrected_name (const char *tar_name, const char *filename)
+static char *get_corrected_name (const tar_catalog *catalog, const char *filename)
 {  
   char *corrected_name = malloc(strlen(filename)+2); // 2 = 1 (\0 à la fin) + 1 (ajout possible d'un /)
   if (!corrected_name)
@@ -94,13 +101,13 @@ static char *get_corrected_name (const char *tar_name, const char *filename)
     return corrected_name;
   
   // filename existe dans le tar
-  if (tar_access(tar_name, corrected_name, F_OK) > 0)
+  if (members_access(catalog, corrected_name, F_OK) > 0)
     return corrected_name;
 
   strcat(corrected_name, "/");
   
   // filename/ existe dans le tar
-  if (tar_access(tar_name, corrected_name, F_OK) > 0)
+  if (members_access(catalog, corrected_name, F_OK) > 0)
     return corrected_name;
 
   // filename n'existe sous aucune forme dans le tar
@@ -108,9 +115,9 @@ static char *get_corrected_name (const char *tar_name, const char *filename)
   return NULL;
 }
 
-static char *get_last_component(char *path)
+static const char *get_last_component(const char *path)
 {
-  char *ret = strrchr(path, '/');
+  const char *ret = strrchr(path, '/');
 
   // si on ne trouve pas de slash (i.e. un fichier à la racine)
   if (!ret)
@@ -129,7 +136,7 @@ static char *get_last_component(char *path)
 }
 
 
-static int nb_of_digits (unsigned int n)
+static int nb_of_digits (unsigned long long n)
 {
   int nb = 1;
 
@@ -143,16 +150,16 @@ static int nb_of_digits (unsigned int n)
 }
 
 
-static int print_unsigned_int(unsigned int n)
+static int print_unsigned_int(unsigned long long n)
 {
-  char buf[20];
-  snprintf(buf, sizeof(buf), "%u", n);
+  char buf[21];
+  snprintf(buf, sizeof(buf), "%llu", n);
   return print_string(buf);
 }
 
 static int print_string(const char *string)
 {
-  return write(STDOUT_FILENO, string, strlen(string)+1);
+  return out_string(STDOUT_FILENO, string);
 }
 
 
@@ -168,63 +175,113 @@ static void init_ls ()
   total_block = 0;
 }
 
-static void add_header_to_files (array *files, struct posix_header *hd)
+static void add_file_to_files (array *files, const tar_member *member)
 {
-  struct tar_fileinfo tfi = { *hd, 0 };
+  struct tar_fileinfo tfi = { member, 0 };
   array_insert_last (files, &tfi);
 }
 
 
 
-static void update_files (array *files, int tar_fd)
+static void update_files (array *files, const tar_catalog *catalog)
 {
-  array *all = tar_ls_all (tar_fd);
+  count_nb_links (files, catalog);
 
-  struct tar_fileinfo *tfi;
-  struct tar_fileinfo updated_tfi;
-  
-  for (int i=0; i < array_size (files); i++)
+  // les informations sont mises à jour en place
+  ARRAY_FOREACH (struct tar_fileinfo, tfi, files)
     {
-      tfi = array_get (files, i);
-      
-      updated_tfi.header = tfi->header;
-      updated_tfi.nb_links = count_nb_link (all, &updated_tfi);
+      update_widths (tfi);
+      update_total_block (tfi);
+    }
+}
+
+/* Links towards a name, counted in a single pass over the catalog */
+struct link_count
+{
+  unsigned int links;    // membres dont linkname est ce nom
+  unsigned int children; // membres directement dans ce nom
+  unsigned int both;     // membres des deux sortes, comptés une seule fois
+};
 
-      free (array_set (files, i, &updated_tfi));
+// les arguments d'un même lot partagent le comptage, fait une fois par catalogue ;
+// ls_batch tient le catalogue compté jusqu'à forget_links : un autre catalogue ne peut pas prendre son adresse
+static const tar_catalog *counted_catalog = NULL;
+static hashmap *link_counts = NULL; // nom d'un dossier parent ou d'une cible de lien -> struct link_count
 
-      update_widths (&updated_tfi);
-      update_total_block (&updated_tfi);
-      
-      free (tfi);
+static struct link_count *link_count_of (const char *name)
+{
+  struct link_count *count = hashmap_get(link_counts, name);
+
+  if (!count)
+    {
+      count = calloc(1, sizeof(struct link_count));
+      assert(count);
+      hashmap_put(link_counts, name, count);
     }
 
-  array_free (all, false);
+  return count;
 }
 
-static int count_nb_link (array *all, struct tar_fileinfo *info)
+static void count_catalog_links (const tar_catalog *catalog)
 {
-  int nb;
-  tar_file *tf;
+  struct link_count *link, *parent;
+  const tar_member *m;
 
-  nb = 1;  
-  
-  for (int i = 0; i < array_size (all); i++)
+  if (catalog == counted_catalog)
+    return;
+
+  forget_links ();
+  link_counts = hashmap_create();
+  counted_catalog = catalog;
+
+  for (size_t i = 0; i < catalog->nb_members; i++)
     {
-      tf = array_get (all, i);
-      
-      if (!strcmp(tf->header.linkname, info->header.name))
-	{
-	  nb++;
-	}
-      else if (info->header.typeflag == DIRTYPE && is_in_dir(info->header.name, tf->header.name))
-	{
-	  nb++;
-	}
-      
-      free (tf);
+      m = catalog->members + i;
+
+      link = *m->linkname ? link_count_of(m->linkname) : NULL;
+      if (link)
+	link->links++;
+
+      // le dossier parent est le préfixe jusqu'au dernier '/', hors '/' final
+      size_t len = strlen(m->name);
+      size_t end = len > 0 && m->name[len - 1] == '/' ? len - 1 : len;
+      while (end > 0 && m->name[end - 1] != '/')
+	end--;
+      if (end == 0)
+	continue;
+
+      char dir_name[end + 1];
+      memcpy(dir_name, m->name, end);
+      dir_name[end] = '\0';
+
+      parent = link_count_of(dir_name);
+      parent->children++;
+      if (parent == link)
+	parent->both++;
+    }
+}
+
+/* Forget the links counted, before the catalog is released */
+static void forget_links ()
+{
+  hashmap_free(link_counts, true);
+  link_counts = NULL;
+  counted_catalog = NULL;
+}
+
+static void count_nb_links (array *files, const tar_catalog *catalog)
+{
+  struct link_count *link;
+
+  count_catalog_links (catalog);
+
+  ARRAY_FOREACH (struct tar_fileinfo, tfi, files)
+    {
+      link = hashmap_get(link_counts, tfi->member->name);
+      tfi->nb_links = 1 + (link ? link->links : 0);
+      if (link && tfi->member->typeflag == DIRTYPE)
+	tfi->nb_links += link->children - link->both;
     }
-  
-  return nb;
 }
 
 static bool is_in_dir(const char *dir_name, const char *filename)
@@ -244,32 +301,29 @@ static void update_widths (struct tar_fileinfo *info)
   if (max_nlink_width < n)
     max_nlink_width = n;
 
-  n = nb_of_digits (get_file_size(&info->header));
+  n = nb_of_digits (info->member->real_size);
   if (max_size_width < n)
     max_size_width = n;
 
-  n = strlen (info->header.uname);
+  n = strlen (info->member->uname);
   if (max_owner_width < n)
     max_owner_width = n;
 
-  n = strlen (info->header.gname);
+  n = strlen (info->member->gname);
   if (max_group_width < n)
     max_group_width = n;  
 }
 
 static void update_total_block (struct tar_fileinfo *info)
 {
-  unsigned int size = get_file_size (&info->header);
-
-  total_block += number_of_block(size);
+  total_block += number_of_block(info->member->size);
 }
 
 
 
 static void print_padding (int n)
 {
-  for (int i=0; i < n; i++)
-    print_string (" ");
+  out_repeat (STDOUT_FILENO, ' ', n);
 }
 
 static void print_total_block ()
@@ -292,7 +346,7 @@ static int print_files (array *files, bool long_format)
   
   for (i=0; i < array_size(files) - 1; i++)
     {
-      tfi = array_get(files, i);
+      tfi = array_at(files, i);
       
       if (long_format)
 	{
@@ -303,23 +357,59 @@ static int print_files (array *files, bool long_format)
 	  print_fileinfo (tfi, long_format, false);
 	  print_string("  ");
 	}
-      
-      free(tfi);
     }
 
-  tfi = array_get(files, i);
+  tfi = array_at(files, i);
   print_fileinfo (tfi, long_format, true);
-  free(tfi);
   
   return 0;
 }
 
+/* ls -f : the entries of a directory are printed as soon as they are read, unsorted */
+static int stream_dir (int tar_fd, const char *dir_name)
+{
+  bool found = *dir_name == '\0', first = true;
+  tar_iter it;
+  tar_file *tf;
+  int r;
+
+  archive_lseek(tar_fd, 0, SEEK_SET);
+  tar_iter_open(&it, tar_fd);
+
+  while ((r = tar_iter_next(&it, &tf)) == 1)
+    {
+      if (!strcmp(tf->name, dir_name))
+	{
+	  found = true;
+	  continue;
+	}
+      if (!is_in_dir(dir_name, tf->name))
+	continue;
+
+      // un dossier peut n'exister que par son contenu
+      found = true;
+      if (!first)
+	print_string("  ");
+      print_filename(tf->name);
+      first = false;
+    }
+
+  tar_iter_close(&it);
+  if (!first)
+    print_string("\n");
+
+  if (r == 0 && !found)
+    errno = ENOENT;
+
+  return r < 0 || !found ? -1 : 0;
+}
+
 static int print_fileinfo (struct tar_fileinfo *tfi, bool long_format, bool newline)
 {
   if (long_format)
     {      
-      print_filetype (tfi->header.typeflag);
-      print_filemode (tfi->header.mode);
+      print_filetype (tfi->member->typeflag);
+      print_filemode (tfi->member->mode);
 
       print_string (" ");
 
@@ -327,33 +417,33 @@ static int print_fileinfo (struct tar_fileinfo *tfi, bool long_format, bool newl
 
       print_string (" ");
 
-      print_uname (tfi->header.uname);
+      print_uname (tfi->member->uname);
 
       print_string (" ");
 
-      print_gname (tfi->header.gname);
+      print_gname (tfi->member->gname);
 
       print_string (" ");
 
-      print_size (tfi->header.size);
+      print_size (tfi->member->real_size);
 
       print_string (" ");
 
-      print_mtime(tfi->header.mtime);
+      print_mtime(tfi->member->mtime);
 
       print_string (" ");
 	
-      print_filename(tfi->header.name);
+      print_filename(tfi->member->name);
 
-      if (tfi->header.typeflag == SYMTYPE)
+      if (tfi->member->typeflag == SYMTYPE)
 	{
 	  print_string (" -> ");
-	  print_filename(tfi->header.linkname);
+	  print_filename(tfi->member->linkname);
 	}
     }
   else
     {
-      print_filename(tfi->header.name);
+      print_filename(tfi->member->name);
     }
   
   if (newline)
@@ -384,12 +474,9 @@ static int print_filetype(const char typeflag)
   return 0;
 }
 
-static int print_filemode(char mode[8])
+static int print_filemode(mode_t converted_mode)
 {
   char str[10];
-  int converted_mode;
-
-  converted_mode = strtol(mode, NULL, 8);
   
   str[0] = converted_mode & TUREAD  ? 'r' : '-';
   str[1] = converted_mode & TUWRITE ? 'w' : '-';
@@ -414,32 +501,26 @@ static void print_nb_links(unsigned int nb_links)
   print_unsigned_int (nb_links);
 }
 
-static void print_uname(char uname[32])
+static void print_uname(const char *uname)
 {
   print_padding (max_owner_width - strlen(uname));  
   print_string (uname);
 }
 
-static void print_gname(char gname[32])
+static void print_gname(const char *gname)
 {
   print_padding (max_group_width - strlen(gname));  
   print_string (gname);
 }
 
-static void print_size(char size[12])
+static void print_size(off_t file_size)
 {
-  unsigned int file_size = 0;
-  sscanf(size, "%o", &file_size);
-
   print_padding (max_size_width - nb_of_digits(file_size));
   print_unsigned_int (file_size);
 }
 
-static void print_mtime(char mtime[12])
+static void print_mtime(time_t timestamp)
 {
-  unsigned int t;
-  sscanf(mtime, "%o", &t);
-  time_t timestamp = t;
   struct tm *realtime = localtime(&timestamp);
 
   char buffer[20]; // un peu arbitraire...
@@ -448,24 +529,23 @@ static void print_mtime(char mtime[12])
   print_string(buffer);
 }
 
-static int print_filename(char name[100])
+static int print_filename(const char *name)
 {
-  char *filename = get_last_component(name);
+  const char *filename = get_last_component(name);
   return print_string(filename);
 }
 
-/**
- * `ls` command
- */
-int ls (char *tar_name, char *filename, char *options)
+/* List FILENAME of the tar TAR_NAME, whose catalog is CATALOG (NULL if it could not be read) */
+static int ls_member (char *tar_name, const tar_catalog *catalog, char *filename, char *options)
 {
   int tar_fd, ret;
   bool long_format;
   char *corrected_name;
   array *files; // on ajoute dans ce tableau les fichiers à afficher
-      
+  const tar_member *member;
+
   // on vérifie que filename existe dans le tar
-  corrected_name = get_corrected_name(tar_name, filename);
+  corrected_name = catalog ? get_corrected_name(catalog, filename) : NULL;
 
   // n'existe pas
   if (!corrected_name)
@@ -474,61 +554,67 @@ int ls (char *tar_name, char *filename, char *options)
       return -1;
     }
 
-  tar_fd = open(tar_name, O_RDONLY);
-  if (tar_fd < 0)
-    return -1;
-
   
   // On peut enfin initialiser
   ret = EXIT_SUCCESS;
   
   long_format = false;
   
-  if (strchr(options, 'l'))
+  // -f désactive -l, comme pour GNU ls
+  if (strchr(options, 'l') && !strchr(options, 'f'))
     long_format = true;
   
   init_ls ();
   files = array_create(sizeof(struct tar_fileinfo));
   
+  // un dossier avec -f : rien n'est trié, on affiche pendant le parcours
+  if (strchr(options, 'f') && (*corrected_name == '\0' || is_dir_name(corrected_name)))
+    {
+      tar_fd = archive_open(tar_name, O_RDONLY);
+      if (tar_fd < 0 || stream_dir(tar_fd, corrected_name) < 0)
+	{
+	  tar_error_cmd(CMD_NAME, tar_name, filename);
+	  ret = EXIT_FAILURE;
+	}
+      if (tar_fd >= 0)
+	archive_close (tar_fd);
+      goto exit;
+    }
   
   // un dossier
   if (*corrected_name == '\0' || is_dir_name(corrected_name))
-    {      
-      array *arr = tar_ls_dir(tar_fd, corrected_name, false);
-      if (!arr)
+    {
+      // on vérifie qu'il existe bien
+      if (*corrected_name != '\0' && members_access(catalog, corrected_name, F_OK) == -1)
 	{
 	  tar_error_cmd(CMD_NAME, tar_name, filename);
 	  ret = EXIT_FAILURE;
 	  goto exit;
 	}
 
-      // on ajoute les en-têtes à files
-      tar_file *tf;
-      for (int i=0; i < array_size (arr); i++)
+      // on ajoute les fichiers à files
+      for (size_t i=0; i < catalog->nb_members; i++)
 	{
-	  tf = array_get(arr, i);
-	  add_header_to_files (files, &tf->header);
-	  free (tf);
+	  if (is_in_dir (corrected_name, catalog->members[i].name))
+	    add_file_to_files (files, catalog->members + i);
 	}
-      
-      array_free(arr, false);
     }
   // un fichier
   else
     {
-      struct posix_header hd;
-      if (seek_header (tar_fd, corrected_name, &hd) != 1)
+      member = tar_catalog_find (catalog, corrected_name);
+      if (!member)
 	{
 	  tar_error_cmd(CMD_NAME, tar_name, filename);
 	  ret = EXIT_FAILURE;
 	  goto exit;
 	}
 
-      add_header_to_files (files, &hd);
+      add_file_to_files (files, member);
     }
   
   // On peut enfin afficher
-  update_files (files, tar_fd);
+  update_files (files, catalog);
   array_sort (files, tficmp);
   print_files (files, long_format);
 
@@ -537,11 +623,51 @@ int ls (char *tar_name, char *filename, char *options)
   // On fait le ménage
   array_free (files, false);
   free (corrected_name);
-  close (tar_fd);
   
   return ret;
 }
 
+/**
+ * `ls` on several files of the same tar : the catalog is read once, and each file gets its header
+ * (as printed by the command handler) when there are several of them
+ */
+int ls_batch (char *tar_name, char **filenames, int nb_files, char *options)
+{
+  int ret = EXIT_SUCCESS;
+
+  // le même catalogue sert à tous les fichiers, au listing et au nombre de liens
+  const tar_catalog *catalog = catalog_get(tar_name);
+
+  for (int i = 0; i < nb_files; i++)
+    {
+      if (nb_files > 1)
+	{
+	  out_string (STDOUT_FILENO, tar_name);
+	  out_string (STDOUT_FILENO, "/");
+	  out_string (STDOUT_FILENO, filenames[i]);
+	  out_string (STDOUT_FILENO, ": \n");
+	}
+
+      if (ls_member (tar_name, catalog, filenames[i], options) != EXIT_SUCCESS)
+	ret = EXIT_FAILURE;
+
+      if (i < nb_files - 1)
+	out_string (STDOUT_FILENO, "\n");
+    }
+
+  forget_links ();
+  catalog_release (catalog);
+  return ret;
+}
+
+/**
+ * `ls` command
+ */
+int ls (char *tar_name, char *filename, char *options)
+{
+  return ls_batch (tar_name, &filename, 1, options);
+}
+
 int main(int argc, char **argv)
 {
   unary_command cmd =
@@ -550,7 +676,8 @@ int main(int argc, char **argv)
       ls,
       true,
       true,
-      SUPPORT_OPT
+      SUPPORT_OPT,
+      ls_batch
     };
   
   return handle_unary_command (cmd, argc, argv);
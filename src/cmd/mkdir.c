@@ -1,3 +1,4 @@
+#include <assert.h>
 #include <errno.h>
 #include <limits.h>
 #include <stdio.h>
@@ -9,6 +10,7 @@
 
 #include "command_handler.h"
 #include "errors.h"
+#include "hashmap.h"
 #include "path_lib.h"
 #include "tar.h"
 #include "utils.h"
@@ -20,39 +22,71 @@ static void mkdir_error(int new_errno, char *tar_name, char *filename)
   error(new_errno, "%s: cannot create directory \'%s/%s\'", CMD_NAME, tar_name, filename);
 }
 
-int mkdir(char *tar_name, char *filename, char *options)
+int mkdir_batch(char *tar_name, char **filenames, int nb_files, char *options)
 {
-  if (is_empty_string(filename))
-  {
-    mkdir_error(EEXIST, tar_name, filename);
-    return EXIT_FAILURE;
-  }
-  switch(type_of_file(tar_name, filename, true))
+  char **dirs = malloc(nb_files * sizeof(char *)), **names = malloc(nb_files * sizeof(char *));
+  assert(dirs && names);
+  hashmap *created = hashmap_create();
+  int nb_dirs = 0, ret = EXIT_SUCCESS;
+
+  // on vérifie tous les noms, puis les dossiers sont ajoutés ensemble à la fin du tar
+  for (int i = 0; i < nb_files; i++)
   {
-    case REG:
-    case DIR:
-      errno = EEXIST;
+    char *filename = filenames[i];
+    if (is_empty_string(filename))
+    {
       mkdir_error(EEXIST, tar_name, filename);
-      return EXIT_FAILURE;
-    case NONE:
-      if (errno != ENOENT)
-      {
-        if (errno == ENOTDIR)
-          errno = EEXIST;
-        mkdir_error(errno, tar_name, filename);
-        return EXIT_FAILURE;
-      }
-      break;
+      ret = EXIT_FAILURE;
+      continue;
+    }
+    char *dir = append_slash(filename);
+    // un dossier déjà demandé existe pour les noms suivants
+    enum file_type t = hashmap_contains(created, dir) ? DIR : type_of_file(tar_name, filename, true);
+    switch(t)
+    {
+      case REG:
+      case DIR:
+        errno = EEXIST;
+        mkdir_error(EEXIST, tar_name, filename);
+        ret = EXIT_FAILURE;
+        free(dir);
+        continue;
+      case NONE:
+        if (errno != ENOENT)
+        {
+          if (errno == ENOTDIR)
+            errno = EEXIST;
+          mkdir_error(errno, tar_name, filename);
+          ret = EXIT_FAILURE;
+          free(dir);
+          continue;
+        }
+        break;
+    }
+    hashmap_put(created, dir, NULL);
+    names[nb_dirs] = filename;
+    dirs[nb_dirs++] = dir;
   }
-  char *dir = append_slash(filename);
-  if(add_ext_to_tar(tar_name, NULL, dir) != 0)
+
+  if (nb_dirs > 0 && add_dirs_to_tar(tar_name, dirs, nb_dirs) != 0)
   {
-    free(dir);
-    mkdir_error(errno, tar_name, filename);
-    return EXIT_FAILURE;
+    int err = errno;
+    for (int i = 0; i < nb_dirs; i++)
+      mkdir_error(err, tar_name, names[i]);
+    ret = EXIT_FAILURE;
   }
-  free(dir);
-  return EXIT_SUCCESS;
+
+  for (int i = 0; i < nb_dirs; i++)
+    free(dirs[i]);
+  free(dirs);
+  free(names);
+  hashmap_free(created, false);
+  return ret;
+}
+
+int mkdir(char *tar_name, char *filename, char *options)
+{
+  return mkdir_batch(tar_name, &filename, 1, options);
 }
 
 
@@ -62,7 +96,8 @@ int main(int argc, char *argv[]){
     mkdir,
     false,
     false,
-    ""
+    "",
+    mkdir_batch
   };
   return handle_unary_command (cmd, argc, argv);
 }
@@ -24,7 +24,8 @@ int main(int argc, char *argv[])
     rm,
     false,
     false,
-    SUPPORT_OPT
+    SUPPORT_OPT,
+    rm_batch
   };
   return handle_unary_command (cmd, argc, argv);
 }
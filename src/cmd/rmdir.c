@@ -10,6 +10,7 @@
 #include <stdlib.h>
 
 
+#include "archive.h"
 #include "path_lib.h"
 #include "command_handler.h"
 #include "errors.h"
@@ -29,7 +30,7 @@ int rmdir_cmd(char *tar_name, char *filename, char *options)
 {
   char err[PATH_MAX];
   sprintf(err, "%s/%s", tar_name, filename);
-  int tar_fd = open(tar_name, O_RDWR);
+  int tar_fd = archive_open(tar_name, O_RDWR);
   if (tar_fd < 0)
     error_cmd(CMD_NAME, err);
 
@@ -51,8 +52,8 @@ int rmdir_cmd(char *tar_name, char *filename, char *options)
 static int rmdir_err(int tar_fd, char *err, int new_errno, char *to_free, array *array_to_free)
 {
   if (to_free != NULL) free(to_free);
-  if (array_to_free != NULL) array_free(array_to_free, false);
-  close(tar_fd);
+  if (array_to_free != NULL) tar_ls_free(array_to_free);
+  archive_close(tar_fd);
   errno = new_errno;
   error_cmd(CMD_NAME, err);
   return -1;
@@ -62,14 +63,14 @@ static int rm_tar(int tar_fd, char *tar_name)
 {
   if (is_pwd_prefix(tar_name, ""))
   {
-    close(tar_fd);
+    archive_close(tar_fd);
     return pwd_prefix_err(tar_name);
   }
   if (nb_files_in_tar(tar_fd) != 0)
     return rmdir_err(tar_fd, tar_name, ENOTEMPTY, NULL, NULL);
-  if (unlink(tar_name) < 0)
-    return rmdir_err(tar_fd, tar_name, errno, NULL, NULL);
-  close(tar_fd);
+  // fermé avant d'être supprimé : une archive compressée est réécrite à la fermeture
+  if (archive_close(tar_fd) < 0 || unlink(tar_name) < 0)
+    return rmdir_err(-1, tar_name, errno, NULL, NULL);
   return 0;
 }
 
@@ -81,7 +82,7 @@ static int is_empty_tar_dir(int tar_fd, char *dir_cpy, char *err)
   // Vérification qu'il n'y a aucun sous fichiers (y compris via des dossiers sans header)
   if (array_size(sub_files_rec) != 0)
     return rmdir_err(tar_fd, err, ENOTEMPTY, dir_cpy, sub_files_rec);
-  array_free(sub_files_rec, false);
+  tar_ls_free(sub_files_rec);
   return 0;
 }
 
@@ -89,7 +90,7 @@ static int rmdir_case_dir(int tar_fd, char *tar_name, char *filename, char *err)
 {
   if (is_pwd_prefix(tar_name, filename) == -1)
   {
-    close(tar_fd);
+    archive_close(tar_fd);
     return pwd_prefix_err(err);
   }
   char *dir_cpy = append_slash(filename);
@@ -97,7 +98,7 @@ static int rmdir_case_dir(int tar_fd, char *tar_name, char *filename, char *err)
   if (is_empty_tar_dir(tar_fd, dir_cpy, err) != 0) return -1;
   if (tar_rm_dir(tar_fd, dir_cpy) != 0) return -1;
   free(dir_cpy);
-  close(tar_fd);
+  archive_close(tar_fd);
   return 0;
 }
 
@@ -0,0 +1,219 @@
+/**
+ * @file archive.h
+ * Transparent access to compressed archives
+ *
+ * Archives are opened and read through this module, which gives the uncompressed content
+ * of a gzip-compressed archive (`.tar.gz` or `.tgz`) as if it was a regular file.
+ * Functions of this module behave exactly like the system calls they are named after
+ * when the file descriptor does not reference a compressed archive.
+ *
+ * Random access in a compressed archive uses an index of inflate checkpoints, taken every
+ * `GZ_INDEX_SPAN` bytes of uncompressed content (and at the start of each gzip member).
+ * A read at an offset only inflates from the nearest checkpoint before it.
+ * The index is built the first time the archive is opened, and stored next to the archive
+ * in `<archive>.zidx` (or in `/tmp/.tsh/` if the directory of the archive is not writable).
+ * It is rebuilt when the size or the modification time of the archive changes.
+ *
+ * Opening a compressed archive for writing gives an uncompressed copy of its content, which can be
+ * modified like a regular tar. archive_close() then compresses it again, pigz-style : blocks of
+ * `GZ_BLOCK_SIZE` bytes are compressed by a pool of threads into independent gzip members, written in order
+ * in place of the archive, and the start of each member is recorded as a checkpoint of the new index.
+ * The number of threads is the number of online processors, unless the environment variable
+ * `TSH_GZIP_THREADS` is set.
+ *
+ * An archive can also be a member of another archive (`a.tar/b.tar`, `a.tar.gz/dir/b.tar/c.tar`...).
+ * A nested archive is not extracted : it is a window over the content of the archive containing it,
+ * and reads are translated to offsets of the outer archive. Nested archives are read-only, and must
+ * be uncompressed tars stored as regular (non sparse) members.
+ *
+ * Several archives can be merged in a union : a text file named `<name>.union`, holding one archive path
+ * or glob pattern per line (relative to the directory of the file; empty lines and lines starting with `#` are ignored).
+ * Only matches named like archives (`.tar`, `.tar.gz`, `.tgz`) are taken.
+ * A union is read as a single tar holding the members of all its archives. When several archives have a member
+ * with the same name, the last archive wins (as when a tar holding the same name twice is extracted) :
+ * with `logs-*.tar`, matches are taken in alphabetical order and the latest shard hides the older ones.
+ * The merged catalog is built when the union is opened, with one hash lookup per member. The layout of the last
+ * unions opened is kept in memory, with the device, inode, size and modification time of their description and of
+ * each of their archives : the archives of a union are only read again when one of them changes, or when a pattern
+ * matches another set of archives.
+ * Unions are read-only.
+ *
+ * An uncompressed archive opened read-only is mapped in memory : reading and seeking copy from the mapping and move
+ * an offset kept by this module, without system calls. The mapping is advised as randomly accessed, since listing
+ * the members only reads their headers, and archive_view() gives the content of a member straight from the mapping.
+ * The size of the mapping is the size of the archive when it is opened. If the archive is truncated while it is
+ * mapped (another command rewrites it), reading the missing part gives `EIO` instead of a `SIGBUS` : the reads of this
+ * module are guarded, and the content given by archive_view() must be read through archive_view_read().
+ */
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/** Number of bytes of uncompressed content between two checkpoints of an index */
+#define GZ_INDEX_SPAN (4 * 1024 * 1024)
+
+/** Size of the blocks compressed independently when a compressed archive is written */
+#define GZ_BLOCK_SIZE (1024 * 1024)
+
+/** Suffix of the name of a union of archives */
+#define ARCHIVE_UNION_SUFFIX ".union"
+
+/** Suffix of the name of an index */
+#define GZ_INDEX_SUFFIX ".zidx"
+
+/**
+ * Check if a path names a gzip-compressed archive
+ * @param path a null-terminated string
+ * @return `true` if `path` ends with `.tar.gz` or `.tgz`; `false` otherwise
+ */
+bool archive_is_gzip (const char *path);
+
+/**
+ * Check if a path names a union of archives
+ * @param path a null-terminated string
+ * @return `true` if `path` ends with #ARCHIVE_UNION_SUFFIX; `false` otherwise
+ */
+bool archive_is_union (const char *path);
+
+/**
+ * Get the generation of the composition of a union
+ *
+ * The generation changes when the description of the union, the set of archives matching its patterns or one
+ * of these archives (device, inode, size or modification time) changes : what was learnt about the content of
+ * the union is up to date as long as its generation is the same.
+ * Only the description is read and the archives are checked with `stat`, their content is not read.
+ *
+ * @param path path of the union
+ * @param stamp the generation of the union
+ * @return 0 on success; -1 if an error occured and errno is set
+ */
+int archive_union_stamp (const char *path, unsigned long *stamp);
+
+/**
+ * Open an archive
+ *
+ * The index of a compressed archive is loaded, or built if there is no valid index.
+ * An empty file is an empty compressed archive.
+ * If a prefix of `path` is a file, `path` names a nested archive, opened as a window over its outer archive
+ * (`EROFS` if `flags` allows writing).
+ * A union is opened with all its archives (`EROFS` if `flags` allows writing).
+ *
+ * @param path path of the archive
+ * @param flags flags passed to `open`
+ * @return a file descriptor to use with the functions of this module; -1 if an error occured and errno is set
+ */
+int archive_open (const char *path, int flags);
+
+/**
+ * Close a file descriptor, and release the state of the compressed archive it references
+ *
+ * If `fd` references a compressed archive opened for writing, the archive is replaced by its
+ * modified content, compressed.
+ *
+ * @param fd a file descriptor
+ * @return 0 on success; -1 otherwise and errno is set
+ */
+int archive_close (int fd);
+
+/**
+ * Count the opens and closes of archives for writing in the process
+ *
+ * The count changes each time archive_open() gives write access to an archive and each time such an
+ * archive is closed : what was learnt about the content of the archives before may be outdated.
+ *
+ * @return the number of opens and closes for writing
+ */
+unsigned long archive_write_count (void);
+
+/**
+ * Check if a file descriptor references a compressed archive
+ * @param fd a file descriptor
+ * @return `true` if `fd` was opened by archive_open() on a compressed archive for reading; `false` otherwise
+ */
+bool archive_is_compressed (int fd);
+
+/**
+ * Get the file where the content of an archive is stored as is
+ *
+ * The content of a nested archive is stored in the archive containing it, possibly several levels up,
+ * and the content of a union in each of its archives.
+ *
+ * @param fd a file descriptor
+ * @param offset an offset in the content of `fd`, translated to an offset in the returned file descriptor
+ * @param count number of bytes from `offset` which must be stored in the same file
+ * @return a file descriptor which can be read directly (`fd` itself for a regular file); -1 if the content is compressed
+ * or split between several files
+ */
+int archive_backing (int fd, off_t *offset, size_t count);
+
+/**
+ * Get the address of a part of the content of an archive, in its mapping
+ *
+ * The part is advised as sequentially accessed. The address is valid until the archive (or the archive containing it) is closed.
+ *
+ * @param fd a file descriptor
+ * @param offset offset of the part in the content of `fd`
+ * @param count size of the part
+ * @return the address of the part; `NULL` if the archive storing it is not mapped (compressed, opened for writing...)
+ */
+const void *archive_view (int fd, off_t offset, size_t count);
+
+/**
+ * Function reading a part of a mapped archive, given to archive_view_read()
+ * @param buf the part, given by archive_view()
+ * @param count size of the part
+ * @param data the argument given to archive_view_read()
+ * @return 0 on success; -1 otherwise
+ */
+typedef int (*view_reader) (const void *buf, size_t count, void *data);
+
+/**
+ * Read a part of a mapped archive, given by archive_view()
+ *
+ * `reader` is called on the part. If the archive was truncated since it was mapped, the fault raised by reading the
+ * missing part stops `reader` where it is, and -1 is returned with errno set to `EIO`.
+ *
+ * @param view the address of the part
+ * @param count size of the part
+ * @param reader the function reading the part
+ * @param data an argument given to `reader`
+ * @return the value returned by `reader`; -1 with errno set to `EIO` if the part is not in the archive anymore
+ */
+int archive_view_read (const void *view, size_t count, view_reader reader, void *data);
+
+/**
+ * Read the uncompressed content of an archive from its file offset
+ * @param fd a file descriptor
+ * @param buf a buffer of at least `count` bytes
+ * @param count number of bytes to read
+ * @return number of bytes read, 0 at the end of the archive; -1 if an error occured and errno is set
+ */
+ssize_t archive_read (int fd, void *buf, size_t count);
+
+/**
+ * Read the uncompressed content of an archive at a given offset, the file offset is not changed
+ * @param fd a file descriptor
+ * @param buf a buffer of at least `count` bytes
+ * @param count number of bytes to read
+ * @param offset offset in the uncompressed content
+ * @return number of bytes read, 0 at the end of the archive; -1 if an error occured and errno is set
+ */
+ssize_t archive_pread (int fd, void *buf, size_t count, off_t offset);
+
+/**
+ * Move the file offset of an archive, in its uncompressed content
+ *
+ * Nothing is inflated until the next read.
+ *
+ * @param fd a file descriptor
+ * @param offset offset relative to `whence`
+ * @param whence `SEEK_SET`, `SEEK_CUR` or `SEEK_END`
+ * @return the new file offset; -1 if an error occured and errno is set
+ */
+off_t archive_lseek (int fd, off_t offset, int whence);
+
+#endif
@@ -0,0 +1,84 @@
+/**
+ * @file catalog.h
+ * Session cache of archive catalogs
+ *
+ * The catalog of an archive (its members as compact records, see tar_catalog_read()) is kept in memory,
+ * so that path resolution, `cd` and redirections do not rescan the archive on every line of `tsh`.
+ *
+ * An entry is invalidated when its archive changes : an inotify watch is set on the archive, or,
+ * if inotify is not available, the inode, size and modification time of the archive are compared.
+ * Only archives stored as a file on the disk are cached : the content of a nested archive depends on the archive
+ * containing it. The catalog of a union is cached too, and invalidated when the generation of its composition
+ * changes (see archive_union_stamp()).
+ *
+ * The cache is private to a process, a child created by `fork` starts with an empty cache. The catalogs of the compressed
+ * archives and of the archives of at least #CATALOG_SAVE_MIN_SIZE bytes are also saved in `/tmp/.tsh/`, with the inode,
+ * size and modification time of their archive : the commands of `tsh`, which are other processes, read them instead of
+ * scanning the archive again.
+ */
+
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stdbool.h>
+
+#include "tar.h"
+
+/** Maximum number of catalogs kept in the cache */
+#define CATALOG_CACHE_MAX 16
+
+/** Minimum size of an uncompressed archive whose catalog is saved for the other processes, a smaller one is read as fast */
+#define CATALOG_SAVE_MIN_SIZE (1 << 20)
+
+/**
+ * Get the catalog of an archive, it is built (and cached if possible) if it is not in the cache
+ *
+ * The caller holds the catalog until it gives it back with catalog_release() : it must not be modified nor freed,
+ * and it stays valid even if the cache drops it meanwhile (the archive changed, the cache is full or cleared).
+ * A catalog which is not cached (a nested archive, a full cache) belongs to the caller alone.
+ *
+ * @param tar_name path of the archive
+ * @return the catalog; `NULL` if an error occured and errno is set
+ */
+const tar_catalog *catalog_get (const char *tar_name);
+
+/**
+ * Give back a catalog returned by catalog_get(), it is freed if neither the cache nor another caller holds it
+ *
+ * errno is preserved.
+ *
+ * @param catalog the catalog, or `NULL`
+ */
+void catalog_release (const tar_catalog *catalog);
+
+/**
+ * Check if an up to date catalog of an archive is in the cache
+ * @param tar_name path of the archive
+ * @return `true` if catalog_get() would not read the archive; `false` otherwise
+ */
+bool catalog_cached (const char *tar_name);
+
+/**
+ * Check if the catalog of an archive was saved, by this process or another one, for the current content of the archive
+ * @param tar_name path of the archive
+ * @return `true` if catalog_get() would read the saved catalog instead of the archive; `false` otherwise
+ */
+bool catalog_saved (const char *tar_name);
+
+/**
+ * Build the catalog of an archive in a background thread
+ *
+ * Nothing is done if the catalog is already in the cache, or if the cache is full.
+ *
+ * @param tar_name path of the archive
+ */
+void catalog_warm (const char *tar_name);
+
+/**
+ * Empty the cache
+ *
+ * The catalogs still held by callers stay valid until they are released.
+ */
+void catalog_clear (void);
+
+#endif
@@ -16,6 +16,7 @@ typedef struct unary_command
   bool twd_arg; // Indicates if current working directory should be used if there is no arguments
   bool print_multiple_arg; // Indicates if arguments should be printed before launching function (like in ls)
   char *support_opt; // Supported options for this unary_command
+  int (*in_tar_batch) (char *, char **, int, char *); // Inside tar function for several files of the same tar, or NULL ; with print_multiple_arg, it prints the header of each file when it gets several
 } unary_command;
 
 typedef struct arg_info
@@ -35,6 +36,8 @@ typedef struct binary_command
   int (*extern_to_tar)(char *src_file, char *dest_tar, char *dest_file, char *opt);
   int (*tar_to_extern)(char *src_tar, char *src_file, char *dest_file, char *opt);
   char *support_opt; // Supported options for this binary_command
+  int (*tar_to_tar_batch)(char *src_tar, char **src_files, int nb_files, char *dest_tar, char *dest_file, char *opt); // or NULL
+  int (*tar_to_extern_batch)(char *src_tar, char **src_files, int nb_files, char *dest_file, char *opt); // or NULL
 } binary_command;
 
 enum arg_type
@@ -67,6 +70,9 @@ struct arg
  * Handles a unary command (a command such as `cat, ls, rmdir, mkdir, rm`)
  *
  * There is no limitation on the places of the options and the order of the arguments (inside/outside a tar).
+ * If the command has an `in_tar_batch` function, consecutive arguments inside the same tar are given to it together
+ * (`in_tar_batch(tar_name, filenames, nb_files, options)`), so that the tar is opened and read once for all of them.
+ * It is not used when the arguments are printed before the command is launched for each of them.
  **/
 int handle_unary_command (unary_command cmd, int argc, char **argv);
 
@@ -75,6 +81,9 @@ int handle_unary_command (unary_command cmd, int argc, char **argv);
  *
  * There is no limitation on the places of the options and the order of the arguments (inside/outside a tar).
  * In all cases, at least two arguments are needed.
+ * If the command has a `tar_to_tar_batch` function and the last argument is inside a tar, consecutive arguments
+ * inside the same tar are given to it together. So are they to `tar_to_extern_batch`, if the command has one,
+ * when the last argument is outside a tar.
  */
 int handle_binary_command (binary_command cmd, int argc, char **argv);
 
@@ -90,11 +99,14 @@ void invalid_options (char *cmd_name);
 
 /**
  * Gets a `struct arg` array of size `argc` by scanning `argv`.
+ *
+ * The array and its strings are allocated in an arena private to the command, and given back by free_tokens().
+ * The path of a file argument is stored in a buffer of `PATH_MAX` bytes, which the command may modify.
  */
 struct arg *tokenize_args (int *argc, char **argv, arg_info *info);
 
 /**
- * Free a `struct arg` array of size `tokens_size`
+ * Free a `struct arg` array of size `tokens_size`, and everything allocated by tokenize_args()
  */
 void free_tokens (struct arg *tokens, int tokens_size);
 
@@ -112,5 +124,10 @@ int get_nb_valid_file (arg_info *info, char *options);
 /** Checks if there is no argument at all */
 bool no_arg (arg_info *info);
 
+/**
+ * Gets the number of consecutive tokens inside the same tar, from `tokens[start]` (a `TAR_FILE`) up to `tokens[end - 1]`
+ */
+int tar_run_length (struct arg *tokens, int start, int end);
+
 
 #endif
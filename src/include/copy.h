@@ -19,6 +19,21 @@ void set_cmd_name(char *str);
  */
 int cp_tar_to_tar (char *src_tar, char *src_file, char *dest_tar, char *dest_file, char *opt);
 
+/**
+ * Copy several files from a tar to a tar
+ *
+ * Files copied without `-r` into a directory are checked first, then the files they replace are removed
+ * and the copies are added, each in one pass over the tars. Otherwise each file is copied with @ref cp_tar_to_tar.
+ *
+ * @param src_tar path to the source tar
+ * @param src_files paths to the files in `src_tar`
+ * @param nb_files number of files in `src_files`
+ * @param dest_tar path to the dest tar
+ * @param dest_file destination name (in `dest_tar`)
+ * @param opt `NULL` for `cp` or "r" for `cp -r`
+ */
+int cp_tar_to_tar_batch (char *src_tar, char **src_files, int nb_files, char *dest_tar, char *dest_file, char *opt);
+
 /**
  * Copy an extern file to a tar
  * 
@@ -39,4 +54,18 @@ int cp_ext_to_tar (char *src_file, char *dest_tar, char *dest_file, char *opt);
  */
 int cp_tar_to_ext (char *src_tar, char *src_file, char *dest_file, char *opt);
 
+/**
+ * Extract several files of a same tar
+ *
+ * Files copied without `-r` into a directory are checked first, then read together with tar_read_members() :
+ * the tar is read once, in the order of its members. Otherwise each file is copied with @ref cp_tar_to_ext.
+ *
+ * @param src_tar path to the source tar
+ * @param src_files paths to the files in `src_tar`
+ * @param nb_files number of files in `src_files`
+ * @param dest_file destination name
+ * @param opt `NULL` for `cp` or "r" for `cp -r`
+ */
+int cp_tar_to_ext_batch (char *src_tar, char **src_files, int nb_files, char *dest_file, char *opt);
+
 #endif
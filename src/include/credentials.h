@@ -0,0 +1,62 @@
+/**
+ * @file credentials.h
+ * Process-wide cache of the identity of the user and of user and group names
+ *
+ * The ids of the process are read once, and the name of a uid or a gid is asked once
+ * to the system (which may ask a directory service such as LDAP). The ids of a process
+ * are kept by `fork`, so a child uses the cache of its parent.
+ */
+
+#ifndef CREDENTIALS_H
+#define CREDENTIALS_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+/** Identity of the process, used for the access checks */
+typedef struct
+{
+  uid_t uid;        /**< real user id */
+  gid_t gid;        /**< real group id */
+  gid_t *groups;    /**< supplementary groups */
+  int nb_groups;    /**< number of supplementary groups */
+} credentials;
+
+/**
+ * Get the identity of the process
+ *
+ * The identity belongs to the cache : it must not be modified nor freed.
+ *
+ * @return the identity of the process
+ */
+const credentials *get_credentials (void);
+
+/**
+ * Check if the process is in a group
+ * @param creds the identity of the process
+ * @param gid a group id
+ * @return `true` if `gid` is the group of the process or one of its supplementary groups; `false` otherwise
+ */
+bool in_group (const credentials *creds, gid_t gid);
+
+/**
+ * Get the name of a user
+ *
+ * The name belongs to the cache : it must not be modified nor freed.
+ *
+ * @param uid a user id
+ * @return the name of the user; `NULL` if the user has no name
+ */
+const char *user_name (uid_t uid);
+
+/**
+ * Get the name of a group
+ *
+ * The name belongs to the cache : it must not be modified nor freed.
+ *
+ * @param gid a group id
+ * @return the name of the group; `NULL` if the group has no name
+ */
+const char *group_name (gid_t gid);
+
+#endif
@@ -0,0 +1,136 @@
+/**
+ * @file io_engine.h
+ * Batched I/O for bulk archive operations
+ *
+ * Bulk operations (extraction of a directory, import of a directory...) describe all their
+ * I/O up front and let the engine perform it.
+ * Two engines are available and chosen at runtime :
+ * * an `io_uring` engine, using raw syscalls, which submits whole batches with a few syscalls and keeps many requests in flight
+ * * a blocking engine, issuing one syscall per request, used when `io_uring` is not available
+ *
+ * The environment variable `TSH_IO_ENGINE` can be set to `blocking` or `uring` to force an engine.
+ */
+
+#ifndef IO_ENGINE_H
+#define IO_ENGINE_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/** Maximum number of files handled by a single batch (i.e. maximum number of file descriptors opened at once) */
+#define IO_BATCH_MAX 256
+
+/** Maximum number of copies held by a copy queue */
+#define IO_QUEUE_MAX (4 * IO_BATCH_MAX)
+
+/** Available I/O engines */
+enum io_engine_kind
+  {
+    IO_ENGINE_BLOCKING, /**< one blocking syscall per request */
+    IO_ENGINE_URING     /**< batched requests through io_uring */
+  };
+
+/**
+ * Copy request
+ *
+ * `count` bytes are read from `src_fd` at offset `src_off` (or taken from `src_buf` if it is not `NULL`)
+ * and written to `dst_fd` at offset `dst_off`.
+ * Offsets are explicit, the file offsets of the file descriptors are not used nor changed.
+ */
+struct io_copy
+{
+  int src_fd;           /**< file descriptor to read from, ignored if `src_buf` is not `NULL` */
+  off_t src_off;        /**< offset in `src_fd` */
+  const void *src_buf;  /**< if not `NULL`, memory area holding the data to write */
+  int dst_fd;           /**< file descriptor to write to */
+  off_t dst_off;        /**< offset in `dst_fd` */
+  size_t count;         /**< number of bytes to copy */
+};
+
+/**
+ * Get the I/O engine in use
+ *
+ * The engine is chosen at the first call : `io_uring` is used if the kernel supports it
+ * (and `TSH_IO_ENGINE` is not set to `blocking`).
+ *
+ * @return the I/O engine in use
+ */
+enum io_engine_kind io_engine_kind (void);
+
+/**
+ * Open several files relative to a directory
+ *
+ * Same as calling `openat(dir_fd, names[i], flags, mode)` for each name.
+ * For each failed opening, `fds[i]` is set to `-errno`.
+ *
+ * @param dir_fd a file descriptor referencing a directory (or `AT_FDCWD`)
+ * @param names array of `n` paths
+ * @param flags flags passed to each `openat`
+ * @param mode mode passed to each `openat`
+ * @param fds an array of size `n` to store the file descriptors
+ * @param n number of files to open
+ * @return 0 if all files were opened; -1 otherwise
+ */
+int io_openat_batch (int dir_fd, char *const names[], int flags, mode_t mode, int fds[], size_t n);
+
+/**
+ * Get the status of several files relative to a directory
+ *
+ * Same as calling `fstatat(dir_fd, names[i], &st[i], flags)` for each name.
+ * For each failure, `st[i].st_mode` is set to 0.
+ *
+ * @param dir_fd a file descriptor referencing a directory (or `AT_FDCWD`)
+ * @param names array of `n` paths
+ * @param flags 0 or `AT_SYMLINK_NOFOLLOW`
+ * @param st an array of size `n` to store the status
+ * @param n number of files
+ * @return 0 if all status were retrieved; -1 otherwise
+ */
+int io_stat_batch (int dir_fd, char *const names[], int flags, struct stat st[], size_t n);
+
+/**
+ * Perform several copies
+ *
+ * Copies may be performed in any order and concurrently, their destination ranges must not overlap.
+ *
+ * @param copies array of `n` copy requests
+ * @param n number of copies
+ * @return 0 if every byte was copied; -1 otherwise and errno is set
+ */
+int io_copy_batch (const struct io_copy copies[], size_t n);
+
+/**
+ * Queue of copy requests
+ *
+ * Queued copies are given to io_copy_batch() when the queue is full, or when it is flushed.
+ * Memory areas and file descriptors used by queued copies must stay valid until the next io_queue_flush().
+ */
+struct io_copy_queue
+{
+  struct io_copy copies[IO_QUEUE_MAX]; /**< queued copies */
+  size_t n;                            /**< number of queued copies */
+  int status;                          /**< -1 if a copy already given to the engine failed; 0 otherwise */
+};
+
+/**
+ * Initialize an empty copy queue
+ * @param q a copy queue
+ */
+void io_queue_init (struct io_copy_queue *q);
+
+/**
+ * Add a copy to a queue, the queue is performed first if it is full
+ * @param q a copy queue
+ * @param copy the copy request
+ */
+void io_queue_copy (struct io_copy_queue *q, struct io_copy copy);
+
+/**
+ * Perform all the copies of a queue, the queue is then empty
+ * @param q a copy queue
+ * @return 0 if every copy given to the engine since the last flush succeeded; -1 otherwise and errno is set
+ */
+int io_queue_flush (struct io_copy_queue *q);
+
+#endif
@@ -0,0 +1,63 @@
+/**
+ * @file output.h
+ * Buffered output on the standard output and the standard error
+ *
+ * What is written with out_write() on `STDOUT_FILENO` or `STDERR_FILENO` is kept in a buffer,
+ * and written with as few `write` as possible :
+ * * when the buffer is full;
+ * * at the end of a line, if the file descriptor is a terminal (line buffering);
+ * * at the explicit flush points : out_flush() and out_flush_all();
+ * * before a `fork` and at the exit of the process.
+ *
+ * Another file descriptor is not buffered. What is written directly on a buffered file descriptor
+ * (by `write` or by another process) must be preceded by out_flush(), to keep the order of the output.
+ * The buffers are not protected by a lock : only one thread of a process may write with them.
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+
+/** Size of the buffer of a file descriptor */
+#define OUTPUT_BUFFER_SIZE (16 * 1024)
+
+/**
+ * Write bytes to a file descriptor, through its buffer
+ * @param fd a file descriptor
+ * @param buf the bytes to write
+ * @param count number of bytes of `buf`
+ * @return `count` on success; -1 if a write failed and errno is set
+ */
+int out_write (int fd, const void *buf, size_t count);
+
+/**
+ * Write a string to a file descriptor, through its buffer, without its '\0'
+ * @param fd a file descriptor
+ * @param str a null-terminated string
+ * @return the length of `str` on success; -1 if a write failed and errno is set
+ */
+int out_string (int fd, const char *str);
+
+/**
+ * Write a character several times to a file descriptor, through its buffer
+ * @param fd a file descriptor
+ * @param c the character
+ * @param n number of times `c` is written, nothing if `n` is not positive
+ * @return 0 on success; -1 if a write failed and errno is set
+ */
+int out_repeat (int fd, char c, int n);
+
+/**
+ * Write what is in the buffer of a file descriptor
+ * @param fd a file descriptor
+ * @return 0 on success; -1 if a write failed and errno is set
+ */
+int out_flush (int fd);
+
+/**
+ * Write what is in all the buffers, the standard output first
+ */
+void out_flush_all (void);
+
+#endif
@@ -1,6 +1,14 @@
 /**
  * @file path_lib.h
  * Path manipulations
+ *
+ * The resolution of paths keeps what it learns in a cache shared by all the paths resolved by the process
+ * (the arguments of a command, and the commands of the shell) : which files of the disk are archives,
+ * which paths inside an archive are nested archives, and which members exist or not.
+ * An entry is checked against the inode, the size and the date of modification of the file on the disk it depends on
+ * (the archive itself, or the archive on the disk containing it), and forgotten as soon as the process opens or closes
+ * an archive for writing (archive_write_count()). The cache is not protected by a lock : only one thread of a process
+ * may resolve paths.
  */
 
 #ifndef PATH_LIB_H
@@ -8,6 +16,11 @@
 
 #include <stdbool.h>
 
+#include "arena.h"
+
+/** Number of paths kept by the resolution cache, which is emptied when it is full */
+#define PATH_CACHE_MAX 4096
+
 /** Type of file in a tar */
 enum file_type
   {
@@ -17,8 +30,9 @@ enum file_type
   };
 
 /**
- * Split an absolute path after the first tar found
+ * Split an absolute path after the last tar found
  *
+ * Archives can be nested : the path is split after the innermost one (`/tmp/a.tar/b.tar/dir` gives `dir`).
  * In `path`, the `/` following the tar (if there is one) is changed by a `\0` 
  *
  * @examples
@@ -81,10 +95,11 @@ int is_pwd_prefix(const char *tar_name, const char *filename);
  *
  * The returned path looks like : `PWD/path` (if `path` is not already starting with a `/`)
  *
+ * @param mem the arena where the result is allocated, or `NULL` to use malloc
  * @param path a null-terminated string
- * @return a malloc'd absolute version of `path`
+ * @return the absolute version of `path`
  */
-char *make_absolute (const char *path);
+char *make_absolute (arena *mem, const char *path);
 
 /**
  * Check if a path goes through a tar
@@ -22,4 +22,16 @@ void set_remove_cmd_name(const char *str);
   */
 int rm(char *tar_name, char *filename, char *options);
 
+/**
+  * Remove several files of a same tar
+  *
+  * Each file is checked as with @ref rm, then all the files are removed by a single rewrite of the tar.
+  * @param tar_name the tar in which we want to remove the files
+  * @param filenames the files we want to remove
+  * @param nb_files number of files in `filenames`
+  * @param options can be "" or "r"
+  * @return EXIT_SUCCESS if all the files were removed; EXIT_FAILURE otherwise
+  */
+int rm_batch(char *tar_name, char **filenames, int nb_files, char *options);
+
 #endif
@@ -0,0 +1,62 @@
+/**
+ * @file script.h
+ * Execution of the lines of a script, of a string given with `-c`, or of the standard input when it is not a terminal.
+ *
+ * The lines are executed one after the other by the same tsh process, without readline nor prompt : the catalogs of
+ * the archives (see catalog.h) and the resolved paths (see path_lib.h) stay in memory from one line to the next.
+ */
+
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Size of the buffer of a script_reader */
+#define SCRIPT_BUFFER_SIZE 4096
+
+/**
+ * Reader of the lines of a script.
+ */
+typedef struct {
+  int fd; /**< The file descriptor of the script. */
+  bool shared; /**< The commands may read from fd too : nothing after the current line is consumed. */
+  bool seekable; /**< fd is a regular file. */
+  char buf[SCRIPT_BUFFER_SIZE]; /**< What has been read and not given yet. */
+  size_t start; /**< Start of what has not been given in buf. */
+  size_t end; /**< End of what has been read in buf. */
+} script_reader;
+
+/**
+ * Init a reader on a file descriptor.
+ * When `shared` is true (the standard input), the reader gives back to fd what it read after the current line
+ * if fd is a regular file, and reads one byte at a time otherwise, so that the commands of the script find their input.
+ * @param reader the reader.
+ * @param fd the file descriptor of the script.
+ * @param shared `true` if the commands of the script inherit fd.
+ */
+void script_reader_init(script_reader *reader, int fd, bool shared);
+
+/**
+ * Read the next line of a script.
+ * @param reader the reader.
+ * @return the line without its `\n`, allocated with malloc, or `NULL` at the end of the script.
+ */
+char *script_next_line(script_reader *reader);
+
+/**
+ * Execute all the lines of a script.
+ * Empty lines and lines starting with `#` (such as `#!/usr/bin/tsh`) are ignored.
+ * @param reader the reader of the script.
+ * @return the return value of the last executed line.
+ */
+int exec_script(script_reader *reader);
+
+/**
+ * Execute the lines of a string, as given to `tsh -c`.
+ * @param lines the lines, separated by `\n`.
+ * @return the return value of the last executed line.
+ */
+int exec_lines(const char *lines);
+
+#endif
@@ -71,9 +71,23 @@ struct posix_header
 #define DIRTYPE  '5'            /**< directory */
 #define FIFOTYPE '6'            /**< FIFO special */
 #define CONTTYPE '7'            /**< reserved */
+#define XHDTYPE  'x'            /**< PAX extended header, applying to the next member */
+#define XGLTYPE  'g'            /**< PAX global extended header */
+#define GNUTYPE_LONGNAME 'L'    /**< GNU extension, the content is the name of the next member */
+#define GNUTYPE_LONGLINK 'K'    /**< GNU extension, the content is the link name of the next member */
+#define GNUTYPE_SPARSE   'S'    /**< GNU extension, sparse file (old GNU format) */
 
 #define OLDGNU_MAGIC "ustar  "  /**< 7 chars and a null */
 
+/** Greatest size which can be written in octal in the `size` field, bigger sizes are written in base 256 */
+#define MAX_OCTAL_SIZE 077777777777LL
+
+/** Uncompressed archives of at least this size are listed by several threads, see tar_scan_visit() */
+#define TAR_SCAN_MIN_SIZE (64 * 1024 * 1024)
+
+/** Maximum number of threads listing an archive */
+#define TAR_SCAN_THREADS_MAX 64
+
 /* Bits used in the mode field, values in octal.  */
 #define TSUID    04000          /* set UID on execution */
 #define TSGID    02000          /* set GID on execution */
@@ -89,16 +103,46 @@ struct posix_header
 #define TOWRITE  00002          /* write by other */
 #define TOEXEC   00001          /* execute/search by other */
 
+/** Data extent of a sparse file */
+struct sparse_extent
+{
+  off_t offset;               /**< offset of the data in the file */
+  off_t size;                 /**< size of the data */
+};
+
+/**
+ * Layout of a sparse file stored in a tar
+ *
+ * Only the data extents are stored, one after the other, holes are not.
+ * In the PAX format 1.0, the map itself is stored in decimal at the beginning of the content of the member.
+ */
+struct sparse_map
+{
+  off_t real_size;               /**< size of the file, holes included */
+  off_t map_size;                /**< size of the map at the beginning of the content (multiple of #BLOCKSIZE), 0 if it is not stored there */
+  size_t nb_extents;             /**< number of extents */
+  struct sparse_extent extents[]; /**< data extents, in increasing offsets */
+};
+
 /**
  * File with its header and data in a tar.
  *
  * Be extremely careful after any changes (mainly write) on #tar_fd as this structure may not stay coherent.
+ *
+ * #name and #linkname are the full names, reconstructed once when the header is read
+ * from the PAX extended header, the GNU long name entries or the ustar `prefix` field.
+ * They are malloc'd and freed by free_tar_file() (or tar_ls_free() for a whole listing), as #sparse.
  */
 typedef struct
 {
   int tar_fd;                 /**< a file descriptor referencing the tar owning this file */
   struct posix_header header; /**< the posix header for this file */
   off_t file_start;           /**< the beginning of the header of this file in #tar_fd */
+  off_t ext_start;            /**< the beginning of the extended headers of this file, #file_start if there are none */
+  char *name;                 /**< full name of this file */
+  char *linkname;             /**< full name of the file targeted, if the file is a link */
+  off_t data_start;           /**< the beginning of the content of this file in #tar_fd, the member ends #BLOCKSIZE aligned after `get_file_size(&header)` bytes */
+  struct sparse_map *sparse;  /**< layout of the file if it is a sparse file; `NULL` otherwise */
 
 } tar_file;
 
@@ -123,6 +167,12 @@ int check_checksum (struct posix_header *hd);
 /**
  * Check if a file is a valid tar
  *
+ * The name of a tar ends with `.tar`, or `.tar.gz` and `.tgz` for a gzip-compressed tar (see archive.h).
+ * Only the first header of a compressed tar is checked.
+ * A union of archives (`.union`, see archive.h) is a tar if its description is a regular file, its archives are checked when it is opened.
+ * An uncompressed tar of at least #TAR_SCAN_MIN_SIZE bytes is checked by building its catalog (see catalog.h) with tar_scan_visit() :
+ * its first header must be correct, and the chain of headers must be complete.
+ *
  * @param path the file to check
  * @return
  * * 1 if all headers are correct
@@ -152,19 +202,193 @@ int is_tar (const char *path);
  */
 int seek_header (int tar_fd, const char *filename, struct posix_header *header);
 
+/**
+ * Read the next member of a tar
+ *
+ * Extended headers preceding a member are read too and applied to it :
+ * * PAX `size`, `path` and `linkpath` records (a size read there is also set in the header, see get_file_size())
+ * * GNU long name and long link name entries
+ * * sparse maps (old GNU format, PAX formats 0.0, 0.1 and 1.0)
+ *
+ * PAX global headers are skipped.
+ *
+ * @param tar_fd the file descriptor of the tar, at the beginning of a header
+ * @param tf the address to store the member, its names must be freed with free_tar_file()
+ * @return
+ * * 1 if a member was read, the file offset is then at the beginning of its content (#data_start)
+ * * 0 at the end of the tar
+ * * -1 if there is any kind of error
+ */
+int read_member (int tar_fd, tar_file *tf);
+
+/**
+ * Iterator over the members of a tar
+ *
+ * The members are read one at a time, with constant memory : the current member belongs to the iterator
+ * and is freed when the next one is read, unless it is kept with tar_iter_keep().
+ * The iterator keeps the offset of the next member, so the content of the current member can be read
+ * from `tar_fd` between two calls to tar_iter_next().
+ *
+ * @code
+ * tar_iter it;
+ * tar_file *tf;
+ * int r;
+ *
+ * tar_iter_open(&it, tar_fd);
+ * while ((r = tar_iter_next(&it, &tf)) == 1)
+ *   puts(tf->name);
+ * tar_iter_close(&it);
+ * @endcode
+ */
+typedef struct
+{
+  int tar_fd;      /**< the tar iterated over */
+  off_t next;      /**< the offset of the next member */
+  tar_file member; /**< the current member */
+} tar_iter;
+
+/**
+ * Start an iteration over the members of a tar, from the current file offset of `tar_fd`
+ * @param it the iterator
+ * @param tar_fd the file descriptor of the tar, at the beginning of a header
+ */
+void tar_iter_open (tar_iter *it, int tar_fd);
+
+/**
+ * Read the next member of an iteration
+ * @param it the iterator
+ * @param tf the address to store a pointer to the member, valid until the next call to tar_iter_next() or tar_iter_close()
+ * @return same as read_member()
+ */
+int tar_iter_next (tar_iter *it, tar_file **tf);
+
+/**
+ * Take the current member of an iteration : its names and sparse map are no longer freed by the iterator,
+ * but by the caller with free_tar_file()
+ * @param it the iterator
+ */
+void tar_iter_keep (tar_iter *it);
+
+/**
+ * End an iteration, the current member is freed
+ * @param it the iterator
+ */
+void tar_iter_close (tar_iter *it);
+
+/**
+ * Read the next header of a tar
+ *
+ * Same as read_member() when only the header is needed.
+ *
+ * @param tar_fd the file descriptor of the tar, at the beginning of a header
+ * @param header the address to store the header of the member
+ * @param member_start if not `NULL`, the address to store the offset of the first block of the member (i.e. of its first extended header)
+ * @return same as read_member()
+ */
+int read_header (int tar_fd, struct posix_header *header, off_t *member_start);
+
+/**
+ * Seek a member in a tar
+ *
+ * Same as seek_header(), but `filename` is compared to the full names and the whole member is given.
+ *
+ * @param tar_fd the file descriptor of the tar to look in
+ * @param filename the file name to seek in the tar
+ * @param tf the address to store the member, its names must be freed with free_tar_file() if it was found
+ * @return same as seek_header()
+ */
+int seek_member (int tar_fd, const char *filename, tar_file *tf);
+
+/**
+ * Free the names and sparse map of a member
+ * @param tf a member read by read_member() or seek_member()
+ */
+void free_tar_file (tar_file *tf);
+
+/**
+ * Get the size of a member, holes of a sparse file included
+ * @param tf a member
+ * @return the size of the file once extracted
+ */
+off_t tar_file_size (const tar_file *tf);
+
+/**
+ * Add an extent at the end of a sparse map
+ * @param map a map returned by this function, or `NULL` to create one
+ * @param offset offset of the data in the file
+ * @param size size of the data
+ * @return the reallocated map
+ */
+struct sparse_map *sparse_map_add (struct sparse_map *map, off_t offset, off_t size);
+
+/**
+ * Set the header of a sparse file (PAX format 1.0)
+ *
+ * The header gets a placeholder name and the size of its stored content : the map (returned in `map`)
+ * followed by the data of the extents. The real name and size are written in a PAX extended header,
+ * which must be written just before the header.
+ *
+ * @param hd the header, its other fields must already be set (the checksum is updated)
+ * @param name the name of the member
+ * @param sparse the layout of the file, its `map_size` is set
+ * @param ext an address to store the malloc'd extended header
+ * @param map an address to store the malloc'd map, to write at the beginning of the content
+ * @return the size in bytes of `*ext` (a multiple of #BLOCKSIZE); -1 on error
+ */
+ssize_t set_sparse_header (struct posix_header *hd, const char *name, struct sparse_map *sparse, char **ext, char **map);
+
+/**
+ * Write the content of a member to a file descriptor
+ *
+ * Holes of a sparse file are recreated with `lseek` if `fd` is a regular file, they are written as zeros otherwise.
+ *
+ * @param tf a member
+ * @param fd a file descriptor to write to, at the offset where the content must begin
+ * @return 0 on success; -1 otherwise
+ */
+int write_member_content (const tar_file *tf, int fd);
+
+/**
+ * Set the names of a header
+ *
+ * If `name` or `linkname` does not fit in the header, they are truncated in the header and
+ * a PAX extended header holding the full names is built. It must be written just before the header.
+ *
+ * @param hd the header, its other fields must already be set (the checksum is updated)
+ * @param name the name of the member
+ * @param linkname the name of the file targeted, or `NULL`
+ * @param ext an address to store the malloc'd extended header, `NULL` if none is needed
+ * @return the size in bytes of `*ext` (a multiple of #BLOCKSIZE); -1 on error
+ */
+ssize_t set_header_names (struct posix_header *hd, const char *name, const char *linkname, char **ext);
+
 /**
  * Converts a positive integer to a number of blocks
  * @param filesize the integer to be converted
  * @return `filesize` converted in blocks
  */
-unsigned int number_of_block(unsigned int filesize);
+off_t number_of_block(off_t filesize);
 
 /**
- * Gets the file size in base 10 from a posix header
+ * Gets the file size from a posix header
+ *
+ * The `size` field may be written in octal or in base 256 (GNU extension, for sizes greater than #MAX_OCTAL_SIZE).
+ *
  * @param hd a pointer to a posix header from which the size must be read
  * @return the file size read
  */
-unsigned int get_file_size(const struct posix_header *hd);
+off_t get_file_size(const struct posix_header *hd);
+
+/**
+ * Sets the file size of a posix header
+ *
+ * The size is written in octal if possible, and in base 256 otherwise.
+ * The checksum is not updated.
+ *
+ * @param hd a pointer to a posix header
+ * @param size the file size
+ */
+void set_file_size(struct posix_header *hd, off_t size);
 
 /**
  * Skip file content in a tar 
@@ -176,7 +400,7 @@ unsigned int get_file_size(const struct posix_header *hd);
  * @param hd file header whose content must be skipped
  * @return on success, the offset location as measured in bytes from the beginning of the file; -1 otherwise 
  */
-int skip_file_content(int tar_fd, struct posix_header *hd);
+off_t skip_file_content(int tar_fd, struct posix_header *hd);
 
 /**
  * Return the number of files in a tar referenced by a file descriptor
@@ -232,10 +456,164 @@ array* tar_ls_all (int tar_fd);
  * Lists all files passing a predicate in a tar.
  *
  * @param tar_fd the file descriptor referencing a tar
- * @param predicate a predicate for a posix_header
+ * @param predicate a predicate for a file of the tar
  * @return a malloc'd pointer to an array of tar_file; `NULL` if there are errors
  */
-array* tar_ls_if (int tar_fd, bool (*predicate)(const struct posix_header *));
+array* tar_ls_if (int tar_fd, bool (*predicate)(const tar_file *));
+
+/**
+ * Function called on each member of a tar by tar_visit()
+ *
+ * @param tf the member, read by read_member()
+ * @param data the pointer given to tar_visit()
+ * @return `true` if the function takes the names and sparse map of `tf` (they are freed by the caller of tar_visit() otherwise)
+ */
+typedef bool (*tar_visitor)(tar_file *tf, void *data);
+
+/**
+ * Call a function on every member of a tar, in order
+ *
+ * Nothing is kept in memory but the current member (see tar_iter), unless the archive is listed by several threads
+ * (see tar_scan_visit()).
+ *
+ * @param tar_fd the file descriptor referencing a tar
+ * @param visit the function called on each member
+ * @param data passed to `visit`
+ * @return 0 on success; -1 if there are errors
+ */
+int tar_visit (int tar_fd, tar_visitor visit, void *data);
+
+/**
+ * Call a function on every member of a tar, in order, with several threads
+ *
+ * The chain of headers of a tar is sequential : the offset of a header is known once the previous one is read.
+ * The archive is split in one chunk per thread, and each thread looks for the first block of its chunk which
+ * looks like a header (`ustar` magic and valid checksum), then follows the chain from there to the end of its chunk.
+ * A block of data can look like a header (a tar stored in the tar...), so the chains are then stitched from the offset 0 :
+ * the chain of a chunk is only taken from a header reached by the true chain, and the headers of the chunks
+ * where no chain is reached are read one by one.
+ *
+ * tar_visit() calls this function for the uncompressed archives stored in a file of at least #TAR_SCAN_MIN_SIZE bytes.
+ * The members visited are the same as with tar_visit().
+ *
+ * @param tar_fd the file descriptor referencing a tar, the content must be stored in the file as is (see archive_backing())
+ * @param visit the function called on each member, only by the calling thread
+ * @param data passed to `visit`
+ * @param nb_threads number of threads (and of chunks)
+ * @return 0 on success; -1 if there are errors
+ */
+int tar_scan_visit (int tar_fd, tar_visitor visit, void *data, int nb_threads);
+
+/**
+ * Number of threads listing a big archive
+ * @return the number of online processors, or the value of the environment variable `TSH_SCAN_THREADS`, at most #TAR_SCAN_THREADS_MAX
+ */
+int tar_scan_threads (void);
+
+/**
+ * Free a listing of a tar
+ *
+ * The names of the files are freed too.
+ *
+ * @param arr an array of tar_file returned by tar_ls_if(), tar_ls_all() or tar_ls_dir()
+ */
+void tar_ls_free (array *arr);
+
+/**
+ * Member of a tar, as kept in a catalog (see tar_catalog_read())
+ *
+ * A compact record (less than 100 bytes, instead of a #tar_file and its 512 bytes header) : the numeric fields
+ * of the header are parsed once, and the strings are stored in the arena of the catalog, the names of owners
+ * and groups only once. The full member is read again with tar_member_read() when it is needed.
+ */
+typedef struct
+{
+  const char *name;     /**< full name of the file */
+  const char *linkname; /**< full name of the file targeted, an empty string if the file is not a link */
+  const char *uname;    /**< name of the owner */
+  const char *gname;    /**< name of the group */
+  off_t ext_start;      /**< the beginning of the extended headers of the member, as #tar_file */
+  off_t data_start;     /**< the beginning of the content of the member */
+  off_t size;           /**< size of the content stored in the tar, see get_file_size() */
+  off_t real_size;      /**< size of the file once extracted, see tar_file_size() */
+  time_t mtime;         /**< modification time */
+  uid_t uid;            /**< owner */
+  gid_t gid;            /**< group */
+  mode_t mode;          /**< permission bits */
+  char typeflag;        /**< type of the file, as in the header */
+} tar_member;
+
+/** Storage of the strings of a catalog */
+struct string_arena;
+
+/** Effective rights of the current user on the names of a catalog, see members_access() */
+struct tar_permissions;
+
+/**
+ * Catalog of a tar : all its members, in order, as compact records
+ */
+typedef struct
+{
+  tar_member *members;          /**< the members */
+  size_t nb_members;            /**< number of members */
+  struct string_arena *strings; /**< the strings of the members */
+  struct tar_permissions *permissions; /**< the rights of the user, built by the first access check; `NULL` before */
+  unsigned int refs;            /**< number of holders of the catalog, 1 when it is read, see catalog_release() */
+} tar_catalog;
+
+/**
+ * Build the catalog of a tar
+ *
+ * The members are read with tar_visit(), a single #tar_file is in memory at a time.
+ *
+ * @param tar_fd the file descriptor referencing a tar
+ * @return a malloc'd catalog, to free with tar_catalog_free(); `NULL` if there are errors
+ */
+tar_catalog *tar_catalog_read (int tar_fd);
+
+/**
+ * Write a catalog in a file, so that another process reads it with tar_catalog_load() instead of scanning the tar
+ *
+ * @param catalog a catalog
+ * @param fd the file descriptor of the file, written from its current offset
+ * @return 0 on success; -1 if there are errors
+ */
+int tar_catalog_save (const tar_catalog *catalog, int fd);
+
+/**
+ * Read a catalog written by tar_catalog_save()
+ *
+ * @param fd the file descriptor of the file, read from its current offset
+ * @return a malloc'd catalog, to free with tar_catalog_free(); `NULL` if the file is not a valid catalog
+ */
+tar_catalog *tar_catalog_load (int fd);
+
+/**
+ * Free a catalog and its strings
+ * @param catalog a catalog returned by tar_catalog_read(), or `NULL`
+ */
+void tar_catalog_free (tar_catalog *catalog);
+
+/**
+ * Find a member in a catalog
+ *
+ * If several members have the same name, the last one is returned (it replaces the others when the tar is extracted).
+ *
+ * @param catalog a catalog
+ * @param name the full name of the file
+ * @return the member; `NULL` if there is no file called `name`
+ */
+const tar_member *tar_catalog_find (const tar_catalog *catalog, const char *name);
+
+/**
+ * Read the full member (header, names and sparse map) of a record of a catalog
+ *
+ * @param tar_fd the file descriptor referencing the tar of the catalog
+ * @param member a member of the catalog
+ * @param tf the address to store the member, its names must be freed with free_tar_file()
+ * @return same as read_member()
+ */
+int tar_member_read (int tar_fd, const tar_member *member, tar_file *tf);
 
 /**
  * Read the content of a file from a tar and write it to a file descriptor
@@ -249,6 +627,68 @@ array* tar_ls_if (int tar_fd, bool (*predicate)(const struct posix_header *));
  */
 int tar_cp_file(const char *tar_name, const char *filename, int fd);
 
+/**
+ * Read the content of a file from a tar and write it to a file descriptor
+ *
+ * Same as @ref tar_cp_file but uses the catalog of a tar and a file descriptor referencing it, already opened
+ * (by archive_open()) : the files of a same tar are copied without opening nor scanning it again.
+ *
+ * @param catalog the catalog of the tar
+ * @param tar_fd the file descriptor referencing the tar
+ * @param filename the file we want to read
+ * @param fd a file descriptor to write to
+ * @return 0 on success; -1 otherwise
+ */
+int members_cp_file(const tar_catalog *catalog, int tar_fd, const char *filename, int fd);
+
+/**
+ * Receiver of the content of the members read by tar_read_members()
+ *
+ * The members are given one after the other, in the order of the names asked. For a member, the sink is called :
+ * * with the parts of its content (`buf` is not `NULL`);
+ * * with its holes, if it is a sparse file (`buf` is `NULL` and `count` is the size of the hole);
+ * * once at its end (`buf` is `NULL` and `count` is 0), `err` is then 0 if the whole member was given, or the errno of the failure.
+ *
+ * @param index index of the member in the names given to tar_read_members()
+ * @param buf a part of the content, valid only during the call
+ * @param count number of bytes of the part or of the hole
+ * @param err 0, or the errno of the failure at the end of a member
+ * @param data the data given to tar_read_members()
+ * @return 0 to go on; -1 to stop the reading
+ */
+typedef int (*member_sink)(int index, const void *buf, size_t count, int err, void *data);
+
+/** Maximum number of bytes of content kept by tar_read_members() for the members read before their turn */
+#define TAR_READ_BUFFER_MAX (16 * 1024 * 1024)
+
+/** Size of the reads of tar_read_members() */
+#define TAR_READ_CHUNK (256 * 1024)
+
+/** Number of bytes after the current read announced to the kernel by tar_read_members() */
+#define TAR_READ_AHEAD (8 * 1024 * 1024)
+
+/**
+ * Read the content of several files of a tar
+ *
+ * All the files are found in the catalog first, then their contents are read in the order of their offsets in the tar,
+ * in one forward pass : the kernel is told which parts of the archive come next (`posix_fadvise`), so the archive
+ * is read sequentially instead of one seek per file. The contents are still given to `sink` in the order of `filenames` :
+ * a member read before its turn is kept in memory, up to #TAR_READ_BUFFER_MAX bytes for all the members kept ; a member
+ * which does not fit is skipped by the pass and read on its own when its turn comes.
+ *
+ * The files must be readable regular files (or links), with the same errors as members_cp_file().
+ * A file which is a directory only through its content fails with EISDIR, as the tar itself (an empty name).
+ *
+ * @param tar_fd the file descriptor referencing the tar, opened by archive_open()
+ * @param catalog the catalog of the tar
+ * @param filenames the files to read
+ * @param nb_files number of files
+ * @param sink function receiving the contents
+ * @param data data given to each call of `sink`
+ * @return 0 if every file was given to `sink`; -1 if a file failed or `sink` stopped the reading
+ */
+int tar_read_members(int tar_fd, const tar_catalog *catalog, char *const filenames[], int nb_files, member_sink sink, void *data);
+
 /**
  * Extract a file from a tar.
  *
@@ -278,6 +718,19 @@ int tar_extract (const char *tar_name, const char *filename, const char *dest);
  */
 int tar_rm(const char *tar_name, const char *filename);
 
+/**
+ * Remove several files from a tar
+ *
+ * Each file is removed as with @ref tar_rm, but the tar is read and compacted once : a kept member is moved at most
+ * once, whatever the number of files removed before it. A file which is not in the tar is ignored.
+ *
+ * @param tar_name the path to the tar
+ * @param filenames the files to remove from the tar
+ * @param nb_files number of files in `filenames`
+ * @return 0 on success; -1 if a system call failed
+ */
+int tar_rm_files(const char *tar_name, char *const filenames[], int nb_files);
+
 /** 
  * Remove a directory recursively from a tar
  * 
@@ -307,6 +760,8 @@ int tar_mv_file(const char *tar_name, const char *filename, int fd);
  * F_OK tests for the existence of the file.
  * R_OK, W_OK, and X_OK test whether the file exists and grants read, write, and execute permissions, respectively.
  *
+ * The members of `tar_name` are taken from the catalog cache (see catalog.h).
+ *
  * @param tar_name path to the tar
  * @param file_name path to the file in `tar_name`
  * @param mode explained above
@@ -331,6 +786,22 @@ int tar_access(const char *tar_name, const char *file_name, int mode);
  */
 int ftar_access(int tar_fd, const char *file_name, int mode);
 
+/**
+ * Check user's permissions for file in a tar
+ *
+ * Same as @ref tar_access but uses the catalog of a tar, already built (by tar_catalog_read() or catalog_get()).
+ *
+ * The first check computes the rights of the user on every name of the catalog, with the right to traverse
+ * its parent directories, and keeps them in the catalog : the next checks are lookups in a table.
+ */
+int members_access(const tar_catalog *catalog, const char *file_name, int mode);
+
+/**
+ * Free the rights of the user on the names of a catalog
+ * @param permissions the rights built by members_access(), or `NULL`
+ */
+void tar_permissions_free (struct tar_permissions *permissions);
+
 /**
  * Add an extern file to a tar
  *
@@ -347,6 +818,18 @@ int ftar_access(int tar_fd, const char *file_name, int mode);
  */
 int add_ext_to_tar(const char *tar_name, const char *source, const char *filename);
 
+/**
+ * Create several empty directories in a tar
+ *
+ * Same as @ref add_ext_to_tar without source, for directories, but the end of the tar is searched once.
+ *
+ * @param tar_name path to the tar
+ * @param dirnames names inside the tar, ending with a `/`
+ * @param nb_dirs number of names in `dirnames`
+ * @return 0 if all the directories were added; -1 if not
+ */
+int add_dirs_to_tar(const char *tar_name, char *const dirnames[], int nb_dirs);
+
 /**
  * Add an extern directory recursively to a tar
  *
@@ -375,6 +858,21 @@ int add_ext_to_tar_rec(const char *tar_name, const char *filename, const char *i
  */
 int add_tar_to_tar(const char *tar_name_src, char *tar_name_dest, const char *source, const char *dest);
 
+/**
+ * Add several files from a tar to a tar
+ *
+ * Same as @ref add_tar_to_tar for each file, but each tar is opened once, the source files are found
+ * with the catalog of `tar_name_src` and the end of `tar_name_dest` is searched once.
+ *
+ * @param tar_name_src path to the source tar
+ * @param tar_name_dest path to the dest tar
+ * @param sources paths to the files (in `tar_name_src`) we want to copy
+ * @param dests destination names (in `tar_name_dest`), one for each file of `sources`
+ * @param nb_files number of files in `sources`
+ * @return 0 on success; -1 on error
+ */
+int add_tar_members_to_tar(const char *tar_name_src, char *tar_name_dest, char *const sources[], char *const dests[], int nb_files);
+
 /**
  * Add a directory recursively from a tar to a tar
  *
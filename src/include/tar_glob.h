@@ -0,0 +1,67 @@
+/**
+ * @file tar_glob.h
+ * Expansion of glob patterns inside a tar
+ *
+ * A pattern is matched against the names of the catalog of the tar (see catalog.h), in a single pass over its members,
+ * instead of listing the directories of the pattern one by one. The directories which only exist through their content
+ * are matched too. In a component of a pattern :
+ * * `*` matches any string, `?` any character, and `[...]` one of the characters of the set
+ *   (ranges such as `a-z` are accepted, a set starting with `!` or `^` is negated);
+ * * `\` takes the next character literally;
+ * * `**`, as a whole component, matches zero or more components.
+ *
+ * A name starting with a `.` is only matched by a component starting with a `.` (`**` does not enter such directories).
+ * Matching is case sensitive, unless #TAR_GLOB_NOCASE is given (the shell gives it when the environment variable
+ * `TSH_NOCASEGLOB` is set). The matches are sorted in byte order, so the expansion does not depend on the order of
+ * the members in the tar nor on the locale.
+ */
+
+#ifndef TAR_GLOB_H
+#define TAR_GLOB_H
+
+#include <stdbool.h>
+
+#include "arena.h"
+#include "array.h"
+#include "tar.h"
+
+/** Flag of tar_glob() and tar_glob_match() : letters match regardless of their case */
+#define TAR_GLOB_NOCASE 1
+
+/**
+ * Check if a string holds characters of a glob pattern (`*`, `?` or `[`)
+ * @param str a null-terminated string
+ * @return `true` if `str` must be expanded
+ */
+bool has_glob (const char *str);
+
+/**
+ * Remove the `\` quoting the characters of a word, as the shell does for a word which is not expanded
+ * @param str a null-terminated string, modified in place
+ */
+void glob_unescape (char *str);
+
+/**
+ * Match a name of a tar against a pattern
+ * @param pattern a pattern, its components are separated by `/`
+ * @param name a path inside a tar, without a trailing `/`
+ * @param flags 0 or #TAR_GLOB_NOCASE
+ * @return `true` if `name` matches `pattern`
+ */
+bool tar_glob_match (const char *pattern, const char *name, int flags);
+
+/**
+ * Get the names of a tar matching a pattern
+ *
+ * Only the names the user may reach (see members_access()) are given. If `pattern` ends with a `/`,
+ * only the directories are matched, and they are given with a trailing `/`.
+ *
+ * @param mem the arena where the array and the names are allocated, or `NULL` to use malloc
+ * @param catalog the catalog of the tar
+ * @param pattern a pattern relative to the root of the tar
+ * @param flags 0 or #TAR_GLOB_NOCASE
+ * @return an array of `char *`, the matching names sorted in byte order (empty if nothing matches)
+ */
+array *tar_glob (arena *mem, const tar_catalog *catalog, const char *pattern, int flags);
+
+#endif
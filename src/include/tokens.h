@@ -55,6 +55,26 @@ int count_words(const char *str);
  */
 list *tokenize(char *user_input);
 
+/**
+ * Same as tokenize(), but the list and the arrays are allocated in an arena.
+ * free_tokens_list() then only gives back what is not in the arena.
+ * @param mem The arena, or NULL to use malloc.
+ * @param user_input The string.
+ * @return The list of array of tokens.
+ */
+list *tokenize_in(arena *mem, char *user_input);
+
+/**
+ * Expand the glob patterns of the arguments which are inside a tar (see tar_glob.h).
+ * A pattern is replaced by the matching names, sorted, written as the argument was typed
+ * (`a.tar/logs/x*.gz` gives `a.tar/logs/x1.gz`...). A pattern outside a tar, a pattern which matches
+ * nothing and the file of a redirection are kept as they are.
+ * Matching is case insensitive if the environment variable `TSH_NOCASEGLOB` is set.
+ * @param mem The arena of the tokens, where the expansions are allocated.
+ * @param cmds The list of array of tokens returned by tokenize_in().
+ */
+void expand_globs(arena *mem, list *cmds);
+
 /**
  * Execute a line with its pipe, redirections and command.
  * It will create the necessary number of process.
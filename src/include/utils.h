@@ -70,14 +70,6 @@ int is_empty_string(const char *str);
  */
 int fmemmove(int fd, off_t whence, size_t size, off_t where);
 
-/** 
- * Write a string to a file descriptor.
- * @param fd a file descriptor to write to
- * @param str a null-terminated string
- * @return On success, the number of bytes written is returned. On error, -1.
- */
-int write_string (int fd, const char *str);
-
 /**
  * Copy a string
  * @param str a null-terminated string
@@ -0,0 +1,2002 @@
+#include "archive.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <libgen.h>
+#include <linux/limits.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "hashmap.h"
+#include "tar.h"
+
+/** Size of the window needed to resume inflating in the middle of a deflate stream */
+#define GZ_WINSIZE 32768
+
+/** Size of the buffer of compressed data */
+#define GZ_CHUNK (64 * 1024)
+
+/** Maximum number of compressor threads */
+#define GZ_THREADS_MAX 64
+
+/** First bytes of an index file */
+#define GZ_INDEX_MAGIC "TSHZIDX1"
+
+/** Directory of the indexes that cannot be stored next to their archive */
+#define GZ_INDEX_DIR "/tmp/.tsh/"
+
+/** Maximum number of unions whose layout is kept in memory */
+#define UNION_CACHE_MAX 8
+
+
+/** Checkpoint of an index */
+struct gz_point
+{
+  int64_t out;         // offset dans le contenu décompressé
+  int64_t in;          // offset dans l'archive du premier octet entier à donner à inflate
+  int64_t window;      // offset de la fenêtre dans l'index
+  int32_t window_size; // taille de la fenêtre (moins de GZ_WINSIZE au début de l'archive)
+  int32_t bits;        // nombre de bits de l'octet in-1 à utiliser, -1 au début d'un membre gzip
+};
+
+/** Header of an index file, followed by the windows and the table of the checkpoints */
+struct gz_index_header
+{
+  char magic[8];
+  int64_t archive_size;       // l'index n'est valide que pour cette taille
+  int64_t archive_mtime;      // et cette date de modification
+  int64_t archive_mtime_nsec;
+  int64_t size;               // taille du contenu décompressé
+  int64_t nb_points;
+  int64_t table;              // offset de la table des points
+};
+
+/** State of an opened compressed archive */
+struct gz_reader
+{
+  int index_fd;              // les fenêtres sont lues dans l'index à la demande
+  struct gz_index_header hd;
+  struct gz_point *points;
+
+  z_stream strm;
+  bool active;               // strm est initialisé
+  bool raw;                  // strm décode un flux deflate brut, sans en-tête gzip
+  off_t in;                  // offset du prochain morceau de l'archive à lire
+  off_t out;                 // offset du prochain octet décompressé
+  off_t skip;                // octets de la fin d'un membre gzip encore à sauter
+  off_t pos;                 // offset utilisé par archive_read et archive_lseek
+
+  unsigned char input[GZ_CHUNK];
+};
+
+
+/** Member of an archive read as an archive itself */
+struct tar_window
+{
+  int parent; // descripteur de l'archive qui contient le membre
+  off_t base; // offset du contenu du membre dans parent
+  off_t size;
+  off_t pos;  // offset utilisé par archive_read et archive_lseek
+};
+
+/** Uncompressed archive opened read-only, mapped in memory */
+struct tar_map
+{
+  char *data;
+  off_t size; // taille à l'ouverture, seule cette partie est projetée
+  off_t pos;  // offset utilisé par archive_read et archive_lseek
+};
+
+/** Members of one of the archives of a union, copied as is in the content of the union */
+struct union_extent
+{
+  size_t shard; // archive qui contient les membres (indice dans fds)
+  off_t src;  // offset du premier membre (en-têtes d'extension compris) dans fd
+  off_t dst;  // offset dans le contenu de l'union
+  off_t size;
+};
+
+/** Union of several archives, read as a single tar holding the members visible in the union */
+struct tar_union
+{
+  int *fds;                      // archives de l'union, dans l'ordre de priorité croissante
+  size_t nb_fds;
+  struct union_extent *extents;  // triés par dst
+  size_t nb_extents;
+  off_t size;                    // les extents, puis les deux blocs de fin d'archive
+  off_t pos;
+};
+
+/** File read by a union (its description or one of its archives), as it was when its layout was computed */
+struct union_shard
+{
+  char *path;
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  struct timespec mtime;
+};
+
+/** Composition of a union, and the layout of its content once its archives have been read */
+struct union_layout
+{
+  char *path;                    // NULL si l'entrée est libre
+  struct union_shard desc;       // le fichier de description (sans chemin)
+  struct union_shard *shards;    // archives de l'union, dans l'ordre de priorité croissante
+  size_t nb_shards;
+  struct union_extent *extents;  // NULL tant que les archives n'ont pas été lues
+  size_t nb_extents;
+  off_t size;
+  unsigned long generation;      // change avec la composition de l'union
+  unsigned long last_use;
+};
+
+/** State of a file descriptor opened by archive_open() */
+struct archive_slot
+{
+  struct gz_reader *reader;  // lecture d'une archive compressée
+  char *gz_path;             // écriture : l'archive compressée à réécrire à la fermeture
+  struct tar_window *window; // lecture d'une archive imbriquée
+  struct tar_union *merged;  // lecture d'un union d'archives
+  struct tar_map *map;       // lecture d'une archive non compressée, projetée en mémoire
+};
+
+/** Arguments shared by the compressor threads */
+struct gz_job
+{
+  int src_fd;
+  off_t size;
+  size_t nb_blocks;
+
+  pthread_mutex_t lock;
+  pthread_cond_t compressed; // un bloc est compressé
+  pthread_cond_t written;    // un bloc est écrit, sa place est libre
+  size_t next_block;         // prochain bloc à compresser
+  size_t next_write;         // prochain bloc à écrire
+  int error;                 // errno de la première erreur
+
+  struct gz_block
+  {
+    unsigned char *data;
+    size_t size;
+    bool ready;
+  } *blocks;                 // blocs compressés pas encore écrits, indexés modulo nb_slots
+  size_t nb_slots;
+};
+
+
+// état des descripteurs, indexé par descripteur
+static struct archive_slot *slots = NULL;
+static int nb_slots = 0;
+
+// la table peut être agrandie par un autre thread (préchauffage du cache des catalogues)
+static pthread_rwlock_t slots_lock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_once_t slots_once = PTHREAD_ONCE_INIT;
+
+// ouvertures et fermetures pour écrire, vues par les caches de ce qui est dans les archives
+static unsigned long write_count = 0;
+
+// lecture protégée de la projection d'une archive, propre à chaque thread
+static __thread sigjmp_buf *map_guard = NULL;
+static pthread_once_t map_guard_once = PTHREAD_ONCE_INIT;
+
+// composition des derniers unions ouverts : leurs archives ne sont relues que si l'une d'elles change
+static struct union_layout layouts[UNION_CACHE_MAX];
+static unsigned long layouts_generation = 0, layouts_clock = 0;
+static pthread_mutex_t layouts_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+
+/* Index */
+
+static int write_at (int fd, const void *buf, size_t count, off_t offset)
+{
+  ssize_t r = pwrite(fd, buf, count, offset);
+
+  if (r >= 0 && (size_t) r != count)
+    errno = EIO;
+
+  return r >= 0 && (size_t) r == count ? 0 : -1;
+}
+
+
+static void add_point (struct gz_reader *gz, size_t *capacity, struct gz_point point)
+{
+  if ((size_t) gz->hd.nb_points == *capacity)
+    {
+      *capacity = *capacity ? 2 * *capacity : 64;
+      gz->points = realloc(gz->points, *capacity * sizeof(struct gz_point));
+      assert(gz->points);
+    }
+
+  gz->points[gz->hd.nb_points++] = point;
+}
+
+
+/* Write in PATHS the two possible locations of the index of the archive PATH */
+static void index_paths (const char *path, const struct stat *st, char paths[2][PATH_MAX])
+{
+  snprintf(paths[0], PATH_MAX, "%s%s", path, GZ_INDEX_SUFFIX);
+  snprintf(paths[1], PATH_MAX, "%s%llx-%llx%s", GZ_INDEX_DIR,
+	   (unsigned long long) st->st_dev, (unsigned long long) st->st_ino, GZ_INDEX_SUFFIX);
+}
+
+
+static int load_index (const char *index_path, const struct stat *st, struct gz_reader *gz)
+{
+  int fd = open(index_path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+
+  if (pread(fd, &gz->hd, sizeof(gz->hd), 0) != sizeof(gz->hd)
+      || memcmp(gz->hd.magic, GZ_INDEX_MAGIC, sizeof(gz->hd.magic))
+      || gz->hd.archive_size != st->st_size
+      || gz->hd.archive_mtime != st->st_mtim.tv_sec
+      || gz->hd.archive_mtime_nsec != st->st_mtim.tv_nsec
+      || gz->hd.nb_points <= 0)
+    goto invalid;
+
+  size_t table_size = gz->hd.nb_points * sizeof(struct gz_point);
+  gz->points = malloc(table_size);
+  if (!gz->points || pread(fd, gz->points, table_size, gz->hd.table) != table_size)
+    goto invalid;
+
+  gz->index_fd = fd;
+  return 0;
+
+ invalid:
+  free(gz->points);
+  gz->points = NULL;
+  memset(&gz->hd, 0, sizeof(gz->hd));
+  close(fd);
+  return -1;
+}
+
+
+/* Inflate the whole archive FD to find its checkpoints, their windows are written in INDEX_FD from *INDEX_END */
+static int build_index (int fd, int index_fd, struct gz_reader *gz, off_t *index_end)
+{
+  unsigned char window[GZ_WINSIZE];
+  z_stream strm;
+  off_t totin = 0, totout = 0, last = 0, read_size = 0;
+  size_t capacity = 0;
+  bool member_end = false;
+  int ret;
+
+  memset(&strm, 0, sizeof(strm));
+  if (inflateInit2(&strm, 31) != Z_OK)
+    {
+      errno = ENOMEM;
+      return -1;
+    }
+
+  add_point(gz, &capacity, (struct gz_point) { 0, 0, 0, 0, -1 });
+
+  // on décompresse dans une fenêtre circulaire, qui contient toujours les GZ_WINSIZE derniers octets
+  while (1)
+    {
+      if (strm.avail_in == 0)
+	{
+	  ssize_t n = pread(fd, gz->input, GZ_CHUNK, read_size);
+	  if (n < 0)
+	    goto error;
+	  if (n == 0)
+	    break;
+	  read_size += n;
+	  strm.next_in = gz->input;
+	  strm.avail_in = n;
+	}
+
+      if (member_end)
+	{
+	  // un autre membre gzip peut suivre (archive compressée par morceaux, concaténation...)
+	  if (strm.next_in[0] != 0x1f)
+	    break;
+	  inflateReset(&strm);
+	  add_point(gz, &capacity, (struct gz_point) { totout, totin, 0, 0, -1 });
+	  last = totout;
+	  member_end = false;
+	}
+
+      if (strm.avail_out == 0)
+	{
+	  strm.next_out = window;
+	  strm.avail_out = GZ_WINSIZE;
+	}
+
+      unsigned avail_in = strm.avail_in, avail_out = strm.avail_out;
+      ret = inflate(&strm, Z_BLOCK);
+      totin += avail_in - strm.avail_in;
+      totout += avail_out - strm.avail_out;
+
+      if (ret == Z_STREAM_END)
+	{
+	  member_end = true;
+	  continue;
+	}
+      if (ret != Z_OK && ret != Z_BUF_ERROR)
+	{
+	  errno = ret == Z_MEM_ERROR ? ENOMEM : EIO;
+	  goto error;
+	}
+
+      // à la fin d'un bloc deflate qui n'est pas le dernier du membre
+      if ((strm.data_type & 128) && !(strm.data_type & 64) && totout - last >= GZ_INDEX_SPAN)
+	{
+	  size_t pos = GZ_WINSIZE - strm.avail_out;
+	  size_t window_size = totout < GZ_WINSIZE ? totout : GZ_WINSIZE;
+
+	  // les octets les plus anciens de la fenêtre sont après pos
+	  if (window_size == GZ_WINSIZE)
+	    {
+	      if (write_at(index_fd, window + pos, GZ_WINSIZE - pos, *index_end) < 0
+		  || write_at(index_fd, window, pos, *index_end + GZ_WINSIZE - pos) < 0)
+		goto error;
+	    }
+	  else if (write_at(index_fd, window + pos - window_size, window_size, *index_end) < 0)
+	    goto error;
+
+	  add_point(gz, &capacity, (struct gz_point) { totout, totin, *index_end, window_size, strm.data_type & 7 });
+	  *index_end += window_size;
+	  last = totout;
+	}
+    }
+
+  inflateEnd(&strm);
+
+  // archive tronquée (un fichier vide est une archive vide)
+  if (!member_end && read_size > 0)
+    {
+      errno = EIO;
+      return -1;
+    }
+
+  gz->hd.size = totout;
+  return 0;
+
+ error:
+  inflateEnd(&strm);
+  return -1;
+}
+
+
+/* Write the index of the archive FD, in the first location of PATHS where it can be written.
+   If SCAN is true, the checkpoints are found by inflating the archive; otherwise they are already in GZ. */
+static int create_index (int fd, const struct stat *st, char paths[2][PATH_MAX], struct gz_reader *gz, bool scan)
+{
+  char tmp[PATH_MAX];
+  int index_fd = -1, i;
+  off_t index_end = sizeof(struct gz_index_header);
+
+  // l'index est écrit à côté, puis renommé : un autre processus ne voit jamais un index incomplet
+  for (i = 0; i < 2 && index_fd < 0; i++)
+    {
+      if (i == 1)
+	mkdir(GZ_INDEX_DIR, 0777);
+      snprintf(tmp, PATH_MAX, "%s.XXXXXX", paths[i]);
+      index_fd = mkstemp(tmp);
+    }
+
+  // aucun emplacement accessible en écriture : l'index ne sert qu'à ce processus
+  if (index_fd < 0)
+    {
+      strcpy(tmp, "/tmp/tsh-index.XXXXXX");
+      if ((index_fd = mkstemp(tmp)) < 0)
+	return -1;
+      unlink(tmp);
+      i = 0;
+    }
+
+  memcpy(gz->hd.magic, GZ_INDEX_MAGIC, sizeof(gz->hd.magic));
+  gz->hd.archive_size = st->st_size;
+  gz->hd.archive_mtime = st->st_mtim.tv_sec;
+  gz->hd.archive_mtime_nsec = st->st_mtim.tv_nsec;
+
+  if (scan && build_index(fd, index_fd, gz, &index_end) < 0)
+    goto error;
+
+  // la table des points est après les fenêtres
+  gz->hd.table = index_end;
+  if (write_at(index_fd, gz->points, gz->hd.nb_points * sizeof(struct gz_point), index_end) < 0
+      || write_at(index_fd, &gz->hd, sizeof(gz->hd), 0) < 0
+      || (i > 0 && (fchmod(index_fd, 0644) < 0 || rename(tmp, paths[i - 1]) < 0)))
+    goto error;
+
+  gz->index_fd = index_fd;
+  return 0;
+
+ error:
+  {
+    int err = errno;
+    if (i > 0)
+      unlink(tmp);
+    close(index_fd);
+    errno = err;
+  }
+  return -1;
+}
+
+
+
+
+/* Reader */
+
+static void free_reader (struct gz_reader *gz)
+{
+  if (!gz)
+    return;
+
+  if (gz->active)
+    inflateEnd(&gz->strm);
+  if (gz->index_fd >= 0)
+    close(gz->index_fd);
+  free(gz->points);
+  free(gz);
+}
+
+
+static struct gz_reader *gz_open (int fd, const char *path)
+{
+  struct stat st;
+  char paths[2][PATH_MAX];
+
+  if (fstat(fd, &st) < 0)
+    return NULL;
+
+  struct gz_reader *gz = calloc(1, sizeof(struct gz_reader));
+  if (!gz)
+    return NULL;
+  gz->index_fd = -1;
+
+  index_paths(path, &st, paths);
+  for (int i = 0; i < 2; i++)
+    {
+      if (load_index(paths[i], &st, gz) == 0)
+	return gz;
+    }
+
+  if (create_index(fd, &st, paths, gz, true) == 0)
+    return gz;
+
+  free_reader(gz);
+  return NULL;
+}
+
+
+/* Copy of the state of FD */
+static struct archive_slot slot_of (int fd)
+{
+  struct archive_slot slot = { 0 };
+
+  pthread_rwlock_rdlock(&slots_lock);
+  if (fd >= 0 && fd < nb_slots)
+    slot = slots[fd];
+  pthread_rwlock_unlock(&slots_lock);
+
+  return slot;
+}
+
+
+static struct gz_reader *reader_of (int fd)
+{
+  return slot_of(fd).reader;
+}
+
+
+static struct tar_window *window_of (int fd)
+{
+  return slot_of(fd).window;
+}
+
+
+static struct tar_union *union_of (int fd)
+{
+  return slot_of(fd).merged;
+}
+
+
+static struct tar_map *map_of (int fd)
+{
+  return slot_of(fd).map;
+}
+
+
+static void free_map (struct tar_map *m)
+{
+  if (!m)
+    return;
+
+  munmap(m->data, m->size);
+  free(m);
+}
+
+
+static void free_union (struct tar_union *u)
+{
+  if (!u)
+    return;
+
+  free(u->fds);
+  free(u->extents);
+  free(u);
+}
+
+
+/* A fork must not happen while another thread holds the table */
+static void lock_slots (void)
+{
+  pthread_rwlock_wrlock(&slots_lock);
+}
+
+static void unlock_slots (void)
+{
+  pthread_rwlock_unlock(&slots_lock);
+}
+
+// le fils n'a pas le même tid : le verrou est réinitialisé plutôt que relâché
+static void reset_slots_lock (void)
+{
+  pthread_rwlock_init(&slots_lock, NULL);
+}
+
+static void lock_layouts (void)
+{
+  pthread_mutex_lock(&layouts_lock);
+}
+
+static void unlock_layouts (void)
+{
+  pthread_mutex_unlock(&layouts_lock);
+}
+
+static void reset_layouts_lock (void)
+{
+  pthread_mutex_init(&layouts_lock, NULL);
+}
+
+static void register_fork_handlers (void)
+{
+  pthread_atfork(lock_slots, unlock_slots, reset_slots_lock);
+  pthread_atfork(lock_layouts, unlock_layouts, reset_layouts_lock);
+}
+
+
+/* Set the state of FD, its previous state is released */
+static int set_slot (int fd, struct archive_slot slot)
+{
+  struct archive_slot old;
+
+  if (fd < 0)
+    return 0;
+
+  pthread_once(&slots_once, register_fork_handlers);
+  pthread_rwlock_wrlock(&slots_lock);
+
+  if (fd >= nb_slots)
+    {
+      if (!slot.reader && !slot.gz_path && !slot.window && !slot.merged && !slot.map)
+	{
+	  pthread_rwlock_unlock(&slots_lock);
+	  return 0;
+	}
+
+      int n = fd + 1 > 2 * nb_slots ? fd + 1 : 2 * nb_slots;
+      struct archive_slot *new_slots = realloc(slots, n * sizeof(struct archive_slot));
+      if (!new_slots)
+	{
+	  pthread_rwlock_unlock(&slots_lock);
+	  return -1;
+	}
+      memset(new_slots + nb_slots, 0, (n - nb_slots) * sizeof(struct archive_slot));
+      slots = new_slots;
+      nb_slots = n;
+    }
+
+  old = slots[fd];
+  slots[fd] = slot;
+  pthread_rwlock_unlock(&slots_lock);
+
+  // l'état d'un descripteur fermé sans archive_close
+  if (old.reader != slot.reader)
+    free_reader(old.reader);
+  if (old.gz_path != slot.gz_path)
+    free(old.gz_path);
+  if (old.window != slot.window)
+    free(old.window);
+  if (old.merged != slot.merged)
+    free_union(old.merged);
+  if (old.map != slot.map)
+    free_map(old.map);
+
+  return 0;
+}
+
+
+/* Last checkpoint before OFFSET */
+static const struct gz_point *nearest_point (const struct gz_reader *gz, off_t offset)
+{
+  int64_t lo = 0, hi = gz->hd.nb_points - 1;
+
+  while (lo < hi)
+    {
+      int64_t mid = (lo + hi + 1) / 2;
+      if (gz->points[mid].out <= offset)
+	lo = mid;
+      else
+	hi = mid - 1;
+    }
+
+  return gz->points + lo;
+}
+
+
+/* Start inflating the archive FD from the checkpoint P */
+static int gz_restart (struct gz_reader *gz, int fd, const struct gz_point *p)
+{
+  unsigned char window[GZ_WINSIZE];
+
+  if (gz->active)
+    inflateEnd(&gz->strm);
+  gz->active = false;
+
+  memset(&gz->strm, 0, sizeof(gz->strm));
+  if (inflateInit2(&gz->strm, p->bits < 0 ? 31 : -15) != Z_OK)
+    {
+      errno = ENOMEM;
+      return -1;
+    }
+  gz->active = true;
+  gz->raw = p->bits >= 0;
+  gz->in = p->in;
+  gz->out = p->out;
+  gz->skip = 0;
+
+  if (!gz->raw)
+    return 0;
+
+  // le point peut être au milieu d'un octet
+  if (p->bits > 0)
+    {
+      unsigned char byte;
+      if (pread(fd, &byte, 1, p->in - 1) != 1)
+	goto error;
+      inflatePrime(&gz->strm, p->bits, byte >> (8 - p->bits));
+    }
+
+  if (pread(gz->index_fd, window, p->window_size, p->window) != p->window_size)
+    goto error;
+  inflateSetDictionary(&gz->strm, window, p->window_size);
+
+  return 0;
+
+ error:
+  if (errno == 0)
+    errno = EIO;
+  return -1;
+}
+
+
+/* Inflate the next COUNT bytes of the archive FD in BUF */
+static ssize_t gz_inflate (struct gz_reader *gz, int fd, unsigned char *buf, size_t count)
+{
+  z_stream *strm = &gz->strm;
+
+  strm->next_out = buf;
+  strm->avail_out = count;
+
+  while (strm->avail_out > 0 && gz->out + (off_t) (count - strm->avail_out) < gz->hd.size)
+    {
+      if (strm->avail_in == 0)
+	{
+	  ssize_t n = pread(fd, gz->input, GZ_CHUNK, gz->in);
+	  if (n <= 0)
+	    goto error;
+	  gz->in += n;
+	  strm->next_in = gz->input;
+	  strm->avail_in = n;
+	}
+
+      // en-queue (CRC et taille) du membre précédent
+      if (gz->skip > 0)
+	{
+	  size_t skip = gz->skip < strm->avail_in ? gz->skip : strm->avail_in;
+	  strm->next_in += skip;
+	  strm->avail_in -= skip;
+	  gz->skip -= skip;
+	  continue;
+	}
+
+      int ret = inflate(strm, Z_NO_FLUSH);
+
+      if (ret == Z_STREAM_END)
+	{
+	  // le membre suivant commence par son en-tête gzip
+	  if (gz->raw)
+	    gz->skip = 8;
+	  inflateReset2(strm, 31);
+	  gz->raw = false;
+	}
+      else if (ret != Z_OK && ret != Z_BUF_ERROR)
+	goto error;
+    }
+
+  gz->out += count - strm->avail_out;
+  return count - strm->avail_out;
+
+ error:
+  // l'état du flux est perdu, la prochaine lecture repartira d'un point
+  inflateEnd(strm);
+  gz->active = false;
+  if (errno == 0)
+    errno = EIO;
+  return -1;
+}
+
+
+static ssize_t gz_pread (struct gz_reader *gz, int fd, void *buf, size_t count, off_t offset)
+{
+  if (offset < 0)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+  if (offset >= gz->hd.size)
+    return 0;
+  if ((off_t) count > gz->hd.size - offset)
+    count = gz->hd.size - offset;
+
+  errno = 0;
+  const struct gz_point *p = nearest_point(gz, offset);
+
+  // le flux en cours est continué, sauf si un point est plus proche de offset
+  if (!gz->active || offset < gz->out || p->out > gz->out)
+    {
+      if (gz_restart(gz, fd, p) < 0)
+	return -1;
+    }
+
+  while (gz->out < offset)
+    {
+      unsigned char discard[GZ_WINSIZE];
+      size_t len = offset - gz->out < GZ_WINSIZE ? offset - gz->out : GZ_WINSIZE;
+
+      if (gz_inflate(gz, fd, discard, len) < 0)
+	return -1;
+    }
+
+  return gz_inflate(gz, fd, buf, count);
+}
+
+
+
+
+/* Writer */
+
+/* Number of compressor threads */
+static int gz_threads (void)
+{
+  char *forced = getenv("TSH_GZIP_THREADS");
+  long n = forced ? strtol(forced, NULL, 10) : sysconf(_SC_NPROCESSORS_ONLN);
+
+  return n < 1 ? 1 : n > GZ_THREADS_MAX ? GZ_THREADS_MAX : n;
+}
+
+
+/* Compress SIZE bytes of IN in a complete gzip member */
+static int compress_block (const unsigned char *in, size_t size, struct gz_block *block)
+{
+  z_stream strm;
+
+  memset(&strm, 0, sizeof(strm));
+  if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+      errno = ENOMEM;
+      return -1;
+    }
+
+  size_t bound = deflateBound(&strm, size);
+  block->data = malloc(bound);
+  if (!block->data)
+    {
+      deflateEnd(&strm);
+      errno = ENOMEM;
+      return -1;
+    }
+
+  strm.next_in = (unsigned char *) in;
+  strm.avail_in = size;
+  strm.next_out = block->data;
+  strm.avail_out = bound;
+  int ret = deflate(&strm, Z_FINISH);
+  block->size = bound - strm.avail_out;
+  deflateEnd(&strm);
+
+  if (ret != Z_STREAM_END)
+    {
+      free(block->data);
+      block->data = NULL;
+      errno = EIO;
+      return -1;
+    }
+
+  return 0;
+}
+
+
+/* Compressor thread : compress the blocks of a job, in any order */
+static void *compressor (void *arg)
+{
+  struct gz_job *job = arg;
+  unsigned char *input = malloc(GZ_BLOCK_SIZE);
+
+  pthread_mutex_lock(&job->lock);
+  while (!job->error && job->next_block < job->nb_blocks)
+    {
+      size_t b = job->next_block;
+
+      // la mémoire est bornée : au plus nb_slots blocs compressés attendent d'être écrits
+      if (b >= job->next_write + job->nb_slots)
+	{
+	  pthread_cond_wait(&job->written, &job->lock);
+	  continue;
+	}
+      job->next_block++;
+      pthread_mutex_unlock(&job->lock);
+
+      struct gz_block block = { NULL, 0, true };
+      off_t offset = (off_t) b * GZ_BLOCK_SIZE;
+      size_t size = job->size - offset < GZ_BLOCK_SIZE ? job->size - offset : GZ_BLOCK_SIZE;
+      int err = 0;
+
+      errno = 0;
+      if (!input)
+	err = ENOMEM;
+      else if (pread(job->src_fd, input, size, offset) != size)
+	err = errno ? errno : EIO;
+      else if (compress_block(input, size, &block) < 0)
+	err = errno;
+
+      pthread_mutex_lock(&job->lock);
+      if (err && !job->error)
+	job->error = err;
+      job->blocks[b % job->nb_slots] = block;
+      pthread_cond_broadcast(&job->compressed);
+      // les compresseurs qui attendent une écriture s'arrêtent aussi
+      if (job->error)
+	pthread_cond_broadcast(&job->written);
+    }
+  pthread_mutex_unlock(&job->lock);
+
+  free(input);
+  return NULL;
+}
+
+
+/* Write the content of SRC_FD compressed in independent gzip members, with its index, in place of the archive PATH */
+static int gz_compress (int src_fd, const char *path)
+{
+  struct gz_job job;
+  struct stat st, out_st;
+  char tmp[PATH_MAX], paths[2][PATH_MAX];
+  pthread_t threads[GZ_THREADS_MAX];
+  int nb_threads = gz_threads(), started = 0, out_fd;
+  size_t capacity = 0;
+  off_t out_off = 0;
+
+  if (fstat(src_fd, &st) < 0)
+    return -1;
+
+  struct gz_reader *gz = calloc(1, sizeof(struct gz_reader));
+  if (!gz)
+    return -1;
+  gz->index_fd = -1;
+
+  // la nouvelle archive est écrite à côté, puis renommée
+  snprintf(tmp, PATH_MAX, "%s.XXXXXX", path);
+  if ((out_fd = mkstemp(tmp)) < 0)
+    {
+      free_reader(gz);
+      return -1;
+    }
+
+  memset(&job, 0, sizeof(job));
+  job.src_fd = src_fd;
+  job.size = st.st_size;
+  job.nb_blocks = (st.st_size + GZ_BLOCK_SIZE - 1) / GZ_BLOCK_SIZE;
+  job.nb_slots = 2 * nb_threads;
+  job.blocks = calloc(job.nb_slots, sizeof(struct gz_block));
+  pthread_mutex_init(&job.lock, NULL);
+  pthread_cond_init(&job.compressed, NULL);
+  pthread_cond_init(&job.written, NULL);
+
+  if (!job.blocks)
+    job.error = ENOMEM;
+  for (; !job.error && started < nb_threads; started++)
+    {
+      if (pthread_create(threads + started, NULL, compressor, &job) != 0)
+	break;
+    }
+  if (started == 0 && !job.error)
+    job.error = EAGAIN;
+
+  add_point(gz, &capacity, (struct gz_point) { 0, 0, 0, 0, -1 });
+
+  // les blocs sont écrits dans l'ordre, chacun est un membre gzip et donc un point de reprise sans fenêtre
+  for (size_t b = 0; b < job.nb_blocks; b++)
+    {
+      struct gz_block *slot = job.blocks + b % job.nb_slots;
+
+      pthread_mutex_lock(&job.lock);
+      while (!slot->ready && !job.error)
+	pthread_cond_wait(&job.compressed, &job.lock);
+      if (job.error)
+	{
+	  pthread_cond_broadcast(&job.written);
+	  pthread_mutex_unlock(&job.lock);
+	  break;
+	}
+      struct gz_block block = *slot;
+      slot->ready = false;
+      slot->data = NULL;
+      job.next_write = b + 1;
+      pthread_cond_broadcast(&job.written);
+      pthread_mutex_unlock(&job.lock);
+
+      if (b > 0)
+	add_point(gz, &capacity, (struct gz_point) { (off_t) b * GZ_BLOCK_SIZE, out_off, 0, 0, -1 });
+
+      int r = write_at(out_fd, block.data, block.size, out_off);
+      free(block.data);
+      out_off += block.size;
+
+      if (r < 0)
+	{
+	  pthread_mutex_lock(&job.lock);
+	  job.error = errno;
+	  pthread_cond_broadcast(&job.written);
+	  pthread_mutex_unlock(&job.lock);
+	  break;
+	}
+    }
+
+  for (int i = 0; i < started; i++)
+    pthread_join(threads[i], NULL);
+  for (size_t i = 0; job.blocks && i < job.nb_slots; i++)
+    free(job.blocks[i].data);
+  free(job.blocks);
+  pthread_mutex_destroy(&job.lock);
+  pthread_cond_destroy(&job.compressed);
+  pthread_cond_destroy(&job.written);
+
+  // l'archive garde ses droits
+  if (!job.error && (stat(path, &st) < 0 || fchmod(out_fd, st.st_mode & 07777) < 0
+		     || fstat(out_fd, &out_st) < 0 || rename(tmp, path) < 0))
+    job.error = errno;
+
+  if (job.error)
+    {
+      unlink(tmp);
+      close(out_fd);
+      free_reader(gz);
+      errno = job.error;
+      return -1;
+    }
+
+  // sans index, il serait reconstruit à la prochaine lecture
+  gz->hd.size = job.size;
+  index_paths(path, &out_st, paths);
+  create_index(out_fd, &out_st, paths, gz, false);
+
+  close(out_fd);
+  free_reader(gz);
+  return 0;
+}
+
+
+/* Open a compressed archive for writing : its content is modified in an uncompressed copy,
+   compressed again by archive_close() */
+static int gz_open_write (const char *path, int flags)
+{
+  char tmp[PATH_MAX];
+  unsigned char buffer[GZ_CHUNK];
+  int src_fd, fd, err;
+  ssize_t r = 0;
+  off_t offset = 0;
+
+  // mêmes droits que pour modifier l'archive sur place
+  if ((fd = open(path, O_WRONLY)) < 0)
+    return -1;
+  close(fd);
+
+  if ((src_fd = archive_open(path, O_RDONLY)) < 0)
+    return -1;
+
+  // la copie est un fichier anonyme, à côté de l'archive
+  snprintf(tmp, PATH_MAX, "%s.XXXXXX", path);
+  if ((fd = mkstemp(tmp)) < 0)
+    {
+      err = errno;
+      archive_close(src_fd);
+      errno = err;
+      return -1;
+    }
+  unlink(tmp);
+
+  while (!(flags & O_TRUNC) && (r = archive_pread(src_fd, buffer, sizeof(buffer), offset)) > 0)
+    {
+      if (write_at(fd, buffer, r, offset) < 0)
+	{
+	  r = -1;
+	  break;
+	}
+      offset += r;
+    }
+  err = errno;
+  archive_close(src_fd);
+
+  char *gz_path = r < 0 ? NULL : strdup(path);
+  if (!gz_path || set_slot(fd, (struct archive_slot) { .gz_path = gz_path }) < 0)
+    {
+      if (r >= 0)
+	err = ENOMEM;
+      free(gz_path);
+      close(fd);
+      errno = err;
+      return -1;
+    }
+
+  if (flags & O_APPEND)
+    fcntl(fd, F_SETFL, O_APPEND);
+
+  return fd;
+}
+
+
+
+
+/* Nested archives */
+
+static bool has_suffix (const char *s, size_t len, const char *suffix)
+{
+  size_t suffix_len = strlen(suffix);
+
+  return len >= suffix_len && !strncmp(s + len - suffix_len, suffix, suffix_len);
+}
+
+
+/* Find the regular file MEMBER in the archive PARENT, and set the bounds of its content */
+static int find_window (int parent, const char *member, off_t *base, off_t *size)
+{
+  tar_file tf;
+  int r;
+
+  if (archive_lseek(parent, 0, SEEK_SET) < 0 || (r = seek_member(parent, member, &tf)) < 0)
+    return -1;
+  if (r == 0)
+    return 0;
+
+  // le contenu d'un fichier creux n'est pas d'un seul tenant
+  r = (tf.header.typeflag == REGTYPE || tf.header.typeflag == AREGTYPE) && !tf.sparse;
+  *base = tf.data_start;
+  *size = get_file_size(&tf.header);
+  free_tar_file(&tf);
+
+  return r;
+}
+
+
+/* Open the window [BASE, BASE + SIZE) of the archive PARENT, which is then owned by the window */
+static int window_open (int parent, off_t base, off_t size)
+{
+  struct tar_window *w = malloc(sizeof(struct tar_window));
+  int fd = -1;
+
+  // le descripteur ne sert qu'à réserver un numéro : tout est lu dans parent
+  if (!w || (fd = dup(parent)) < 0 || set_slot(fd, (struct archive_slot) { .window = w }) < 0)
+    {
+      int err = w ? errno : ENOMEM;
+      free(w);
+      if (fd >= 0)
+	close(fd);
+      errno = err;
+      return -1;
+    }
+
+  *w = (struct tar_window) { parent, base, size, 0 };
+  return fd;
+}
+
+
+/* Open PATH, an archive stored in another archive (a.tar/b.tar, a.tar.gz/dir/b.tar/c.tar...) */
+static int nested_open (const char *path, int flags)
+{
+  char buf[PATH_MAX];
+  struct stat st;
+  char *slash, *member, *c;
+  int fd, err;
+
+  if (strlen(path) >= PATH_MAX)
+    {
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+  strcpy(buf, path);
+
+  // l'archive sur le disque est le premier préfixe qui n'est pas un répertoire
+  for (slash = strchr(buf + 1, '/'); slash; slash = strchr(slash + 1, '/'))
+    {
+      *slash = '\0';
+      if (stat(buf, &st) < 0)
+	return -1;
+      if (!S_ISDIR(st.st_mode))
+	break;
+      *slash = '/';
+    }
+
+  if (!slash || !(has_suffix(buf, slash - buf, ".tar") || archive_is_gzip(buf) || archive_is_union(buf)))
+    {
+      errno = ENOTDIR;
+      return -1;
+    }
+  if ((fd = archive_open(buf, O_RDONLY)) < 0)
+    return -1;
+
+  // chaque membre dont le nom finit par .tar descend d'un niveau, les autres sont des répertoires
+  for (member = c = slash + 1; ; c++)
+    {
+      if (*c != '/' && *c != '\0')
+	continue;
+
+      bool last = *c == '\0';
+      off_t base, size;
+      int found = 0;
+
+      *c = '\0';
+      if (has_suffix(member, c - member, ".tar") && (found = find_window(fd, member, &base, &size)) < 0)
+	break;
+
+      if (found)
+	{
+	  int window_fd = window_open(fd, base, size);
+	  if (window_fd < 0)
+	    break;
+	  fd = window_fd;
+	  member = c + 1;
+	}
+      else if (last)
+	{
+	  errno = ENOENT;
+	  break;
+	}
+
+      if (last)
+	{
+	  // le membre n'est lu que dans une copie de l'archive qui le contient
+	  if ((flags & O_ACCMODE) == O_RDONLY)
+	    return fd;
+	  errno = EROFS;
+	  break;
+	}
+      *c = '/';
+    }
+
+  err = errno;
+  archive_close(fd);
+  errno = err;
+  return -1;
+}
+
+
+
+
+/* Mapped archives */
+
+/* SIGBUS handler : a page of a mapping beyond the end of an archive truncated since it was mapped */
+static void map_fault (int sig)
+{
+  if (map_guard)
+    siglongjmp(*map_guard, 1);
+
+  // une faute hors d'une lecture protégée garde le comportement par défaut
+  signal(SIGBUS, SIG_DFL);
+  raise(SIGBUS);
+}
+
+static void install_map_guard (void)
+{
+  struct sigaction sa;
+
+  // SA_NODEFER : le signal n'est pas bloqué après siglongjmp, sigsetjmp n'a pas à sauver le masque
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = map_fault;
+  sa.sa_flags = SA_NODEFER;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGBUS, &sa, NULL);
+}
+
+
+/* Map the uncompressed archive FD, opened read-only ; NULL if it cannot be mapped (an empty file, a pipe...) */
+static struct tar_map *map_open (int fd)
+{
+  struct tar_map *m;
+  struct stat st;
+  void *data;
+
+  if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+    return NULL;
+  pthread_once(&map_guard_once, install_map_guard);
+  if ((data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    return NULL;
+
+  // lister les membres ne lit que les en-têtes : la lecture anticipée du noyau serait perdue
+  madvise(data, st.st_size, MADV_RANDOM);
+
+  if (!(m = malloc(sizeof(struct tar_map))))
+    {
+      munmap(data, st.st_size);
+      return NULL;
+    }
+
+  *m = (struct tar_map) { data, st.st_size, 0 };
+  return m;
+}
+
+
+static int copy_view (const void *view, size_t count, void *buf)
+{
+  memcpy(buf, view, count);
+  return 0;
+}
+
+
+static ssize_t map_pread (const struct tar_map *m, void *buf, size_t count, off_t offset)
+{
+  if (offset < 0)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+  if (offset >= m->size)
+    return 0;
+  if ((off_t) count > m->size - offset)
+    count = m->size - offset;
+
+  return archive_view_read(m->data + offset, count, copy_view, buf) < 0 ? -1 : (ssize_t) count;
+}
+
+
+
+
+/* Unions */
+
+/* Extent of U holding the byte at OFFSET; NULL if it is in the end of archive blocks */
+static const struct union_extent *union_extent_at (const struct tar_union *u, off_t offset)
+{
+  size_t lo = 0, hi = u->nb_extents;
+
+  while (lo < hi)
+    {
+      size_t mid = (lo + hi) / 2;
+      if (u->extents[mid].dst + u->extents[mid].size <= offset)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  return lo < u->nb_extents && u->extents[lo].dst <= offset ? u->extents + lo : NULL;
+}
+
+
+/* Add the members of the archive SHARD of U at the end of U, CATALOG gives the extent of each visible name */
+static int union_add (struct tar_union *u, size_t shard, hashmap *catalog, size_t *capacity)
+{
+  int fd = u->fds[shard];
+  tar_iter it;
+  tar_file *tf;
+  int r;
+
+  if (archive_lseek(fd, 0, SEEK_SET) < 0)
+    return -1;
+
+  tar_iter_open(&it, fd);
+  while ((r = tar_iter_next(&it, &tf)) == 1)
+    {
+      if (u->nb_extents == *capacity)
+	{
+	  *capacity = *capacity ? 2 * *capacity : 64;
+	  u->extents = realloc(u->extents, *capacity * sizeof(struct union_extent));
+	  assert(u->extents);
+	}
+      u->extents[u->nb_extents++] = (struct union_extent) { shard, tf->ext_start, 0, it.next - tf->ext_start };
+
+      // une archive plus prioritaire cache le membre du même nom
+      void *hidden = hashmap_put(catalog, tf->name, (void *) (uintptr_t) u->nb_extents);
+      if (hidden)
+	u->extents[(uintptr_t) hidden - 1].size = 0;
+    }
+  tar_iter_close(&it);
+
+  return r;
+}
+
+
+/* Read the archives of U, and lay out their visible members one after the other */
+static int union_scan (struct tar_union *u)
+{
+  hashmap *catalog = hashmap_create();
+  size_t capacity = 0, n = 0;
+
+  for (size_t i = 0; i < u->nb_fds; i++)
+    {
+      if (union_add(u, i, catalog, &capacity) < 0)
+	{
+	  hashmap_free(catalog, false);
+	  return -1;
+	}
+    }
+  hashmap_free(catalog, false);
+
+  // les membres cachés sont retirés, les autres sont placés bout à bout
+  for (size_t i = 0; i < u->nb_extents; i++)
+    {
+      if (u->extents[i].size == 0)
+	continue;
+      // deux membres consécutifs d'une même archive forment un seul extent
+      if (n > 0 && u->extents[n - 1].shard == u->extents[i].shard
+	  && u->extents[n - 1].src + u->extents[n - 1].size == u->extents[i].src)
+	{
+	  u->extents[n - 1].size += u->extents[i].size;
+	  u->size += u->extents[i].size;
+	  continue;
+	}
+      u->extents[n] = u->extents[i];
+      u->extents[n].dst = u->size;
+      u->size += u->extents[n].size;
+      n++;
+    }
+  u->nb_extents = n;
+  u->size += 2 * BLOCKSIZE;
+
+  return 0;
+}
+
+
+static void free_shards (struct union_shard *shards, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    free(shards[i].path);
+  free(shards);
+}
+
+
+static bool same_shard (const struct union_shard *a, const struct union_shard *b)
+{
+  return a->dev == b->dev && a->ino == b->ino && a->size == b->size
+    && a->mtime.tv_sec == b->mtime.tv_sec && a->mtime.tv_nsec == b->mtime.tv_nsec
+    && (!a->path || !strcmp(a->path, b->path));
+}
+
+
+/* Add the archives matching PATTERN (relative to DIR) to SHARDS */
+static int add_shards (const char *dir, const char *pattern, struct union_shard **shards, size_t *nb)
+{
+  char full[PATH_MAX];
+  struct stat st;
+  glob_t g;
+  int r;
+
+  if (pattern[0] == '/')
+    snprintf(full, PATH_MAX, "%s", pattern);
+  else
+    snprintf(full, PATH_MAX, "%s/%s", dir, pattern);
+
+  // un motif qui ne correspond à rien (pas encore d'archive du jour...) n'est pas une erreur
+  if ((r = glob(full, 0, NULL, &g)) == GLOB_NOMATCH)
+    return 0;
+  if (r != 0)
+    {
+      errno = r == GLOB_NOSPACE ? ENOMEM : EIO;
+      return -1;
+    }
+
+  for (size_t i = 0; i < g.gl_pathc; i++)
+    {
+      // logs-* ne prend pas les index .zidx rangés à côté des archives
+      const char *match = g.gl_pathv[i];
+      if (!has_suffix(match, strlen(match), ".tar") && !archive_is_gzip(match))
+	continue;
+
+      if (stat(match, &st) < 0)
+	{
+	  globfree(&g);
+	  return -1;
+	}
+
+      *shards = realloc(*shards, (*nb + 1) * sizeof(struct union_shard));
+      assert(*shards);
+      (*shards)[(*nb)++] = (struct union_shard) { strdup(match), st.st_dev, st.st_ino, st.st_size, st.st_mtim };
+      assert((*shards)[*nb - 1].path);
+    }
+
+  globfree(&g);
+  return 0;
+}
+
+
+/* Read the description PATH of a union : DESC gets the state of the description, SHARDS the archives of the union */
+static int union_shards (const char *path, struct union_shard *desc, struct union_shard **shards, size_t *nb)
+{
+  char dir[PATH_MAX], *line = NULL;
+  size_t line_size = 0;
+  ssize_t len;
+  struct stat st;
+  FILE *f;
+
+  *shards = NULL;
+  *nb = 0;
+
+  if (!(f = fopen(path, "re")))
+    return -1;
+  if (fstat(fileno(f), &st) < 0)
+    {
+      fclose(f);
+      return -1;
+    }
+  *desc = (struct union_shard) { NULL, st.st_dev, st.st_ino, st.st_size, st.st_mtim };
+
+  snprintf(dir, PATH_MAX, "%s", path);
+  dirname(dir);
+
+  // les lignes vides et celles qui commencent par # sont ignorées
+  while ((len = getline(&line, &line_size, f)) > 0)
+    {
+      if (line[len - 1] == '\n')
+	line[--len] = '\0';
+      if (len == 0 || line[0] == '#')
+	continue;
+      if (add_shards(dir, line, shards, nb) < 0)
+	break;
+    }
+  bool failed = len > 0 || ferror(f);
+  int err = errno;
+  free(line);
+  fclose(f);
+
+  if (failed)
+    {
+      free_shards(*shards, *nb);
+      *shards = NULL;
+      *nb = 0;
+      errno = err;
+      return -1;
+    }
+
+  return 0;
+}
+
+
+/* Layout of the union PATH if its description and its archives have not changed ; the lock must be held */
+static struct union_layout *find_layout (const char *path, const struct union_shard *desc,
+					 const struct union_shard *shards, size_t nb)
+{
+  for (int i = 0; i < UNION_CACHE_MAX; i++)
+    {
+      struct union_layout *l = layouts + i;
+
+      if (!l->path || strcmp(l->path, path))
+	continue;
+      if (!same_shard(&l->desc, desc) || l->nb_shards != nb)
+	return NULL;
+      for (size_t j = 0; j < nb; j++)
+	{
+	  if (!same_shard(l->shards + j, shards + j))
+	    return NULL;
+	}
+      return l;
+    }
+
+  return NULL;
+}
+
+
+/* Record a new composition of the union PATH, the least recently used entry is replaced ; the lock must be held */
+static struct union_layout *store_layout (const char *path, const struct union_shard *desc,
+					  struct union_shard *shards, size_t nb)
+{
+  struct union_layout *l = NULL;
+
+  for (int i = 0; i < UNION_CACHE_MAX; i++)
+    {
+      // l'ancienne composition du même union est remplacée
+      if (layouts[i].path && !strcmp(layouts[i].path, path))
+	{
+	  l = layouts + i;
+	  break;
+	}
+      if (!l || (l->path && (!layouts[i].path || layouts[i].last_use < l->last_use)))
+	l = layouts + i;
+    }
+
+  free(l->path);
+  free_shards(l->shards, l->nb_shards);
+  free(l->extents);
+
+  *l = (struct union_layout) { strdup(path), *desc, shards, nb, NULL, 0, 0, ++layouts_generation, ++layouts_clock };
+  assert(l->path);
+
+  return l;
+}
+
+
+int archive_union_stamp (const char *path, unsigned long *stamp)
+{
+  struct union_shard desc, *shards;
+  struct union_layout *l;
+  size_t nb;
+
+  if (union_shards(path, &desc, &shards, &nb) < 0)
+    return -1;
+
+  pthread_once(&slots_once, register_fork_handlers);
+  pthread_mutex_lock(&layouts_lock);
+  if ((l = find_layout(path, &desc, shards, nb)))
+    free_shards(shards, nb);
+  else
+    l = store_layout(path, &desc, shards, nb);
+  l->last_use = ++layouts_clock;
+  *stamp = l->generation;
+  pthread_mutex_unlock(&layouts_lock);
+
+  return 0;
+}
+
+
+/* Open the union described by the file PATH : one archive path or glob pattern per line */
+static int union_open (const char *path, int flags)
+{
+  struct union_shard desc, *shards;
+  struct union_layout *l;
+  size_t nb;
+  int fd, err;
+
+  if ((flags & O_ACCMODE) != O_RDONLY)
+    {
+      errno = EROFS;
+      return -1;
+    }
+
+  if ((fd = open(path, flags)) < 0)
+    return -1;
+
+  struct tar_union *u = calloc(1, sizeof(struct tar_union));
+  if (!u)
+    {
+      err = ENOMEM;
+      goto error;
+    }
+  if (union_shards(path, &desc, &shards, &nb) < 0)
+    {
+      err = errno;
+      goto error;
+    }
+
+  u->fds = malloc((nb > 0 ? nb : 1) * sizeof(int));
+  assert(u->fds);
+  for (; u->nb_fds < nb; u->nb_fds++)
+    {
+      if ((u->fds[u->nb_fds] = archive_open(shards[u->nb_fds].path, O_RDONLY)) < 0)
+	{
+	  err = errno;
+	  free_shards(shards, nb);
+	  goto error;
+	}
+    }
+
+  pthread_once(&slots_once, register_fork_handlers);
+  pthread_mutex_lock(&layouts_lock);
+  l = find_layout(path, &desc, shards, nb);
+
+  // les archives n'ont pas changé depuis la dernière ouverture : elles ne sont pas relues
+  if (l && l->extents)
+    {
+      u->extents = malloc((l->nb_extents > 0 ? l->nb_extents : 1) * sizeof(struct union_extent));
+      assert(u->extents);
+      memcpy(u->extents, l->extents, l->nb_extents * sizeof(struct union_extent));
+      u->nb_extents = l->nb_extents;
+      u->size = l->size;
+      l->last_use = ++layouts_clock;
+      pthread_mutex_unlock(&layouts_lock);
+      free_shards(shards, nb);
+    }
+  else
+    {
+      pthread_mutex_unlock(&layouts_lock);
+
+      if (union_scan(u) < 0)
+	{
+	  err = errno;
+	  free_shards(shards, nb);
+	  goto error;
+	}
+
+      // la composition lue avant les archives, si elle n'a pas changé entre temps, reçoit leur contenu
+      pthread_mutex_lock(&layouts_lock);
+      if ((l = find_layout(path, &desc, shards, nb)))
+	free_shards(shards, nb);
+      else
+	l = store_layout(path, &desc, shards, nb);
+      if (!l->extents)
+	{
+	  l->extents = malloc((u->nb_extents > 0 ? u->nb_extents : 1) * sizeof(struct union_extent));
+	  assert(l->extents);
+	  memcpy(l->extents, u->extents, u->nb_extents * sizeof(struct union_extent));
+	  l->nb_extents = u->nb_extents;
+	  l->size = u->size;
+	}
+      l->last_use = ++layouts_clock;
+      pthread_mutex_unlock(&layouts_lock);
+    }
+
+  if (set_slot(fd, (struct archive_slot) { .merged = u }) < 0)
+    {
+      err = ENOMEM;
+      goto error;
+    }
+
+  return fd;
+
+ error:
+  for (size_t i = 0; u && i < u->nb_fds; i++)
+    archive_close(u->fds[i]);
+  free_union(u);
+  close(fd);
+  errno = err;
+  return -1;
+}
+
+
+static ssize_t union_pread (const struct tar_union *u, void *buf, size_t count, off_t offset)
+{
+  size_t done = 0;
+
+  if (offset < 0)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  while (done < count && offset + (off_t) done < u->size)
+    {
+      off_t at = offset + done;
+      const struct union_extent *e = union_extent_at(u, at);
+      size_t n = count - done;
+
+      if (!e)
+	{
+	  // fin de l'archive : des blocs nuls
+	  if ((off_t) n > u->size - at)
+	    n = u->size - at;
+	  memset((char *) buf + done, 0, n);
+	}
+      else
+	{
+	  if ((off_t) n > e->dst + e->size - at)
+	    n = e->dst + e->size - at;
+	  ssize_t r = archive_pread(u->fds[e->shard], (char *) buf + done, n, e->src + at - e->dst);
+	  if (r <= 0)
+	    {
+	      // une archive raccourcie depuis l'ouverture de l'union
+	      if (r == 0)
+		errno = EIO;
+	      return done > 0 ? (ssize_t) done : -1;
+	    }
+	  n = r;
+	}
+
+      done += n;
+    }
+
+  return done;
+}
+
+
+
+
+bool archive_is_gzip (const char *path)
+{
+  size_t len = strlen(path);
+
+  return (len >= 7 && !strcmp(path + len - 7, ".tar.gz"))
+    || (len >= 4 && !strcmp(path + len - 4, ".tgz"));
+}
+
+
+bool archive_is_union (const char *path)
+{
+  return has_suffix(path, strlen(path), ARCHIVE_UNION_SUFFIX);
+}
+
+
+int archive_open (const char *path, int flags)
+{
+  int fd;
+
+  if ((flags & O_ACCMODE) != O_RDONLY)
+    __atomic_add_fetch(&write_count, 1, __ATOMIC_RELAXED);
+
+  if (archive_is_union(path))
+    return union_open(path, flags);
+
+  if (!archive_is_gzip(path))
+    {
+      // sans projection, l'archive est lue par des appels système, comme un fichier
+      if ((fd = open(path, flags)) >= 0)
+	{
+	  struct tar_map *m = (flags & O_ACCMODE) == O_RDONLY ? map_open(fd) : NULL;
+	  if (set_slot(fd, (struct archive_slot) { .map = m }) < 0)
+	    free_map(m);
+	}
+      // un préfixe du chemin est un fichier : une archive dans une archive
+      else if (errno == ENOTDIR)
+	return nested_open(path, flags);
+      return fd;
+    }
+
+  if ((flags & O_ACCMODE) != O_RDONLY)
+    return gz_open_write(path, flags);
+
+  if ((fd = open(path, flags)) < 0)
+    return -1;
+
+  struct gz_reader *gz = gz_open(fd, path);
+  if (!gz || set_slot(fd, (struct archive_slot) { .reader = gz }) < 0)
+    {
+      int err = errno;
+      free_reader(gz);
+      close(fd);
+      errno = err;
+      return -1;
+    }
+
+  return fd;
+}
+
+
+int archive_close (int fd)
+{
+  char *gz_path = NULL;
+  int ret = 0, flags;
+
+  // ce qui a été lu pendant que l'archive était modifiée n'est plus à jour
+  if ((flags = fcntl(fd, F_GETFL)) >= 0 && (flags & O_ACCMODE) != O_RDONLY)
+    __atomic_add_fetch(&write_count, 1, __ATOMIC_RELAXED);
+
+  pthread_rwlock_wrlock(&slots_lock);
+  if (fd >= 0 && fd < nb_slots)
+    {
+      gz_path = slots[fd].gz_path;
+      slots[fd].gz_path = NULL;
+    }
+  pthread_rwlock_unlock(&slots_lock);
+
+  // le contenu modifié remplace l'archive compressée
+  if (gz_path)
+    {
+      ret = gz_compress(fd, gz_path);
+      free(gz_path);
+    }
+
+  // une archive imbriquée ferme celle qui la contient, un union ferme toutes les siennes
+  struct tar_window *w = window_of(fd);
+  struct tar_union *u = union_of(fd);
+  if (w && archive_close(w->parent) < 0)
+    ret = -1;
+  for (size_t i = 0; u && i < u->nb_fds; i++)
+    {
+      if (archive_close(u->fds[i]) < 0)
+	ret = -1;
+    }
+
+  set_slot(fd, (struct archive_slot) { 0 });
+  if (close(fd) < 0)
+    return -1;
+
+  return ret;
+}
+
+
+unsigned long archive_write_count (void)
+{
+  return __atomic_load_n(&write_count, __ATOMIC_RELAXED);
+}
+
+
+bool archive_is_compressed (int fd)
+{
+  return reader_of(fd) != NULL;
+}
+
+
+int archive_backing (int fd, off_t *offset, size_t count)
+{
+  struct tar_window *w;
+  struct tar_union *u;
+
+  while (1)
+    {
+      if ((w = window_of(fd)))
+	{
+	  if (*offset + (off_t) count > w->size)
+	    return -1;
+	  *offset += w->base;
+	  fd = w->parent;
+	}
+      else if ((u = union_of(fd)))
+	{
+	  const struct union_extent *e = union_extent_at(u, *offset);
+	  if (!e || *offset + (off_t) count > e->dst + e->size)
+	    return -1;
+	  *offset += e->src - e->dst;
+	  fd = u->fds[e->shard];
+	}
+      else
+	return reader_of(fd) ? -1 : fd;
+    }
+}
+
+
+const void *archive_view (int fd, off_t offset, size_t count)
+{
+  int backing = archive_backing(fd, &offset, count);
+  struct tar_map *m = backing >= 0 ? map_of(backing) : NULL;
+
+  if (!m || offset < 0 || offset + (off_t) count > m->size)
+    return NULL;
+
+  // le contenu d'un membre est lu d'un bout à l'autre
+  long page = sysconf(_SC_PAGESIZE);
+  off_t start = offset - offset % page;
+  if (count > 0)
+    madvise(m->data + start, offset + count - start, MADV_SEQUENTIAL);
+
+  return m->data + offset;
+}
+
+
+int archive_view_read (const void *view, size_t count, view_reader reader, void *data)
+{
+  sigjmp_buf guard, *outer = map_guard;
+  int ret;
+
+  if (sigsetjmp(guard, 0))
+    {
+      map_guard = outer;
+      errno = EIO;
+      return -1;
+    }
+
+  map_guard = &guard;
+  ret = reader(view, count, data);
+  map_guard = outer;
+
+  return ret;
+}
+
+
+/* Offset used by archive_read and archive_lseek, and size of the content; NULL if FD is a regular file */
+static off_t *virtual_pos (int fd, off_t *size)
+{
+  struct archive_slot slot = slot_of(fd);
+  struct gz_reader *gz = slot.reader;
+  struct tar_window *w = slot.window;
+  struct tar_union *u = slot.merged;
+  struct tar_map *m = slot.map;
+
+  if (gz)
+    {
+      *size = gz->hd.size;
+      return &gz->pos;
+    }
+  if (m)
+    {
+      *size = m->size;
+      return &m->pos;
+    }
+  if (w)
+    {
+      *size = w->size;
+      return &w->pos;
+    }
+  if (u)
+    {
+      *size = u->size;
+      return &u->pos;
+    }
+
+  return NULL;
+}
+
+
+ssize_t archive_read (int fd, void *buf, size_t count)
+{
+  off_t size, *pos = virtual_pos(fd, &size);
+
+  if (!pos)
+    return read(fd, buf, count);
+
+  ssize_t r = archive_pread(fd, buf, count, *pos);
+  if (r > 0)
+    *pos += r;
+
+  return r;
+}
+
+
+ssize_t archive_pread (int fd, void *buf, size_t count, off_t offset)
+{
+  struct archive_slot slot = slot_of(fd);
+  struct gz_reader *gz = slot.reader;
+  struct tar_window *w = slot.window;
+  struct tar_union *u = slot.merged;
+  struct tar_map *m = slot.map;
+
+  if (u)
+    return union_pread(u, buf, count, offset);
+  if (m)
+    return map_pread(m, buf, count, offset);
+  if (!w)
+    return gz ? gz_pread(gz, fd, buf, count, offset) : pread(fd, buf, count, offset);
+
+  if (offset < 0)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+  if (offset >= w->size)
+    return 0;
+  if ((off_t) count > w->size - offset)
+    count = w->size - offset;
+
+  return archive_pread(w->parent, buf, count, w->base + offset);
+}
+
+
+off_t archive_lseek (int fd, off_t offset, int whence)
+{
+  off_t size, *pos = virtual_pos(fd, &size);
+  off_t base;
+
+  if (!pos)
+    return lseek(fd, offset, whence);
+
+  switch (whence)
+    {
+    case SEEK_SET: base = 0; break;
+    case SEEK_CUR: base = *pos; break;
+    case SEEK_END: base = size; break;
+    default:
+      errno = EINVAL;
+      return -1;
+    }
+
+  if (base + offset < 0)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  *pos = base + offset;
+  return *pos;
+}
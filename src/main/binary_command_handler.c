@@ -14,6 +14,7 @@
 
 #include "tar.h"
 #include "errors.h"
+#include "output.h"
 #include "utils.h"
 #include "path_lib.h"
 
@@ -22,6 +23,7 @@ static char** arg_info_to_argv (arg_info *info, char *arg, char *last);
 
 static int handle_arg (binary_command *cmd, struct arg *token, struct arg *last_token, char *options, arg_info *info);
 static int handle_reg_file (binary_command *cmd, arg_info *info, char *arg, char *last);
+static int handle_tar_batch (binary_command *cmd, struct arg *tokens, int nb_tokens, struct arg *last_token, char *options);
 static int handle_tokens (binary_command *cmd, struct arg *tokens, int argc, arg_info *info, char *options);
 
 static void free_all (struct arg *tokens, int argc, arg_info *info, char *options);
@@ -106,6 +108,20 @@ static int handle_arg (binary_command *cmd, struct arg *token, struct arg *last_
   return ret;
 }
 
+/** Launches the batch function of `cmd` on `nb_tokens` tokens inside the same tar */
+static int handle_tar_batch (binary_command *cmd, struct arg *tokens, int nb_tokens, struct arg *last_token, char *options)
+{
+  char *src_files[nb_tokens];
+
+  for (int i = 0; i < nb_tokens; i++)
+    src_files[i] = tokens[i].tf.filename;
+
+  if (last_token->type == REG_FILE)
+    return cmd->tar_to_extern_batch (tokens->tf.tar_name, src_files, nb_tokens, last_token->value, options);
+
+  return cmd->tar_to_tar_batch (tokens->tf.tar_name, src_files, nb_tokens, last_token->tf.tar_name, last_token->tf.filename, options);
+}
+
 static int handle_tokens (binary_command *cmd, struct arg *tokens, int argc, arg_info *info, char *options)
 {
   int ret = EXIT_SUCCESS;
@@ -125,6 +141,15 @@ static int handle_tokens (binary_command *cmd, struct arg *tokens, int argc, arg
 	case TAR_FILE:
 	  if (!options)
 	    break;
+	  // les sources d'un même tar sont copiées ensemble
+	  if ((cmd->tar_to_tar_batch && last_token->type == TAR_FILE) || (cmd->tar_to_extern_batch && last_token->type == REG_FILE))
+	    {
+	      int n = tar_run_length (tokens, i, argc - 1);
+
+	      ret = handle_tar_batch (cmd, tokens + i, n, last_token, options);
+	      i += n - 1;
+	      break;
+	    }
 	  // Attention on peut encore continuer
 	case REG_FILE:
 	  ret = handle_arg (cmd, tokens + i, last_token, options, info);
@@ -238,9 +263,10 @@ int handle_binary_command (binary_command cmd, int argc, char **argv)
   if (nb_valid_file <= 1)
     {
       if (tar_options)
-	write_string (STDERR_FILENO, "At least 2 valid arguments are needed !\n");
+	out_string (STDERR_FILENO, "At least 2 valid arguments are needed !\n");
       else
-	write_string (STDERR_FILENO, "Invalid option and can't recover from error !\n");
+	out_string (STDERR_FILENO, "Invalid option and can't recover from error !\n");
+      out_flush (STDERR_FILENO);
 
       ret = EXIT_FAILURE;
     }
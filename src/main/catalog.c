@@ -0,0 +1,558 @@
+#include "catalog.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "archive.h"
+#include "tar.h"
+
+/** Events on an archive which invalidate its catalog */
+#define CATALOG_EVENTS (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF)
+
+/** Directory of the saved catalogs */
+#define CATALOG_DIR "/tmp/.tsh/"
+
+/** Suffix of a saved catalog */
+#define CATALOG_SUFFIX ".catalog"
+
+
+/** The archive of a saved catalog, written before it */
+struct saved_key
+{
+  int64_t dev;
+  int64_t ino;
+  int64_t size;   // le catalogue n'est valide que pour cette taille
+  int64_t mtime;  // et cette date de modification
+  int64_t mtime_nsec;
+};
+
+
+/** Entry of the cache */
+struct catalog_entry
+{
+  char *tar_name;         // NULL si l'entrée est libre
+  tar_catalog *catalog;
+  bool building;          // le catalogue est construit, sans le verrou, par un autre appel
+  bool stale;             // l'archive a changé pendant la construction
+  int wd;                 // surveillance inotify ; -1 si on compare l'inode, la taille et la date
+  bool merged;            // un union : on compare la génération de sa composition
+  unsigned long generation;
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  struct timespec mtime;
+  unsigned long last_use;
+};
+
+
+static struct catalog_entry entries[CATALOG_CACHE_MAX];
+static unsigned long use_clock = 0;
+static int inotify_fd = -2;    // -2 tant qu'il n'est pas ouvert, -1 si inotify n'est pas disponible
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t built = PTHREAD_COND_INITIALIZER;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+
+
+
+static bool is_watched (int wd)
+{
+  for (int i = 0; i < CATALOG_CACHE_MAX; i++)
+    {
+      if (entries[i].tar_name && entries[i].wd == wd)
+	return true;
+    }
+
+  return false;
+}
+
+
+/* Give back a hold on CATALOG, which is freed by the last holder ; the lock must be held */
+static void unref (tar_catalog *catalog)
+{
+  if (catalog && --catalog->refs == 0)
+    tar_catalog_free(catalog);
+}
+
+
+static void clear_entry (struct catalog_entry *e)
+{
+  int wd = e->wd;
+
+  free(e->tar_name);
+  // les appelants qui tiennent encore le catalogue le gardent
+  unref(e->catalog);
+  *e = (struct catalog_entry) { .wd = -1 };
+
+  // deux chemins d'un même fichier partagent la surveillance
+  if (wd >= 0 && !is_watched(wd))
+    inotify_rm_watch(inotify_fd, wd);
+}
+
+
+/* Fork handlers : the child does not share the inotify instance nor the threads of its parent */
+static void fork_prepare (void)
+{
+  pthread_mutex_lock(&lock);
+}
+
+static void fork_parent (void)
+{
+  pthread_mutex_unlock(&lock);
+}
+
+static void fork_child (void)
+{
+  // la surveillance appartient au parent : le fils ne doit ni la lire ni la retirer
+  if (inotify_fd >= 0)
+    close(inotify_fd);
+  inotify_fd = -2;
+
+  for (int i = 0; i < CATALOG_CACHE_MAX; i++)
+    {
+      entries[i].wd = -1;
+      if (entries[i].building)
+	entries[i].catalog = NULL;
+      if (entries[i].tar_name)
+	clear_entry(entries + i);
+    }
+
+  pthread_cond_init(&built, NULL);
+  pthread_mutex_init(&lock, NULL);
+}
+
+static void init (void)
+{
+  pthread_atfork(fork_prepare, fork_parent, fork_child);
+}
+
+
+/* Invalidate the entries whose archive got an inotify event, the lock must be held */
+static void read_events (void)
+{
+  char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  ssize_t n;
+
+  if (inotify_fd == -2)
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd < 0)
+    return;
+
+  while ((n = read(inotify_fd, buffer, sizeof(buffer))) > 0)
+    {
+      const struct inotify_event *event;
+
+      for (char *p = buffer; p < buffer + n; p += sizeof(struct inotify_event) + event->len)
+	{
+	  event = (const struct inotify_event *) p;
+
+	  for (int i = 0; i < CATALOG_CACHE_MAX; i++)
+	    {
+	      if (!entries[i].tar_name || entries[i].wd != event->wd)
+		continue;
+	      if (entries[i].building)
+		entries[i].stale = true;
+	      else
+		clear_entry(entries + i);
+	    }
+	}
+    }
+}
+
+
+static bool up_to_date (const struct catalog_entry *e)
+{
+  struct stat st;
+
+  unsigned long generation;
+
+  if (e->stale)
+    return false;
+  if (e->merged)
+    return archive_union_stamp(e->tar_name, &generation) == 0 && generation == e->generation;
+  if (e->wd >= 0)
+    return true;
+
+  return stat(e->tar_name, &st) == 0 && st.st_dev == e->dev && st.st_ino == e->ino && st.st_size == e->size
+    && st.st_mtim.tv_sec == e->mtime.tv_sec && st.st_mtim.tv_nsec == e->mtime.tv_nsec;
+}
+
+
+/* Find the entry of TAR_NAME, after waiting for the end of its construction ; the lock must be held */
+static struct catalog_entry *find_entry (const char *tar_name)
+{
+  struct catalog_entry *e = NULL;
+
+  do
+    {
+      e = NULL;
+      for (int i = 0; i < CATALOG_CACHE_MAX && !e; i++)
+	{
+	  if (entries[i].tar_name && !strcmp(entries[i].tar_name, tar_name))
+	    e = entries + i;
+	}
+    }
+  while (e && e->building && !pthread_cond_wait(&built, &lock));
+
+  return e;
+}
+
+
+/* Take an entry for TAR_NAME, the least recently used one if the cache is full ; the lock must be held */
+static struct catalog_entry *reserve_entry (const char *tar_name)
+{
+  struct catalog_entry *e = NULL;
+  bool merged = archive_is_union(tar_name);
+  unsigned long generation = 0;
+  struct stat st;
+
+  // le contenu d'une archive imbriquée dépend de l'archive qui la contient
+  if (stat(tar_name, &st) < 0 || !S_ISREG(st.st_mode))
+    return NULL;
+  // celui d'un union, de ses archives : la génération est prise avant la lecture
+  if (merged && archive_union_stamp(tar_name, &generation) < 0)
+    return NULL;
+
+  for (int i = 0; i < CATALOG_CACHE_MAX; i++)
+    {
+      if (!entries[i].tar_name)
+	{
+	  e = entries + i;
+	  break;
+	}
+      if (!entries[i].building && (!e || entries[i].last_use < e->last_use))
+	e = entries + i;
+    }
+
+  if (!e)
+    return NULL;
+  if (e->tar_name)
+    clear_entry(e);
+
+  e->tar_name = strdup(tar_name);
+  if (!e->tar_name)
+    return NULL;
+
+  // la surveillance commence avant la lecture : un changement pendant la construction est vu
+  e->building = true;
+  e->wd = inotify_fd >= 0 && !merged ? inotify_add_watch(inotify_fd, tar_name, CATALOG_EVENTS) : -1;
+  e->merged = merged;
+  e->generation = generation;
+  e->dev = st.st_dev;
+  e->ino = st.st_ino;
+  e->size = st.st_size;
+  e->mtime = st.st_mtim;
+  e->last_use = ++use_clock;
+
+  return e;
+}
+
+
+/* Key of the archive of status ST ; PATH gets the place of its saved catalog, private to the user */
+static struct saved_key saved_key_of (const struct stat *st, char path[PATH_MAX])
+{
+  snprintf(path, PATH_MAX, "%s%llx-%llx-%u%s", CATALOG_DIR, (unsigned long long) st->st_dev,
+	   (unsigned long long) st->st_ino, (unsigned) geteuid(), CATALOG_SUFFIX);
+
+  return (struct saved_key) { st->st_dev, st->st_ino, st->st_size, st->st_mtim.tv_sec, st->st_mtim.tv_nsec };
+}
+
+
+/* Check if the catalog of TAR_NAME may be saved, ST gets the status of the archive */
+static bool savable (const char *tar_name, struct stat *st)
+{
+  // le contenu d'une archive imbriquée ou d'un union ne dépend pas que de son fichier
+  return !archive_is_union(tar_name) && stat(tar_name, st) == 0 && S_ISREG(st->st_mode)
+    && (st->st_size >= CATALOG_SAVE_MIN_SIZE || archive_is_gzip(tar_name));
+}
+
+
+/* Open the catalog saved for the archive of status ST, after its key ; -1 if there is none or if the archive changed */
+static int open_saved (const struct stat *st)
+{
+  char path[PATH_MAX];
+  struct saved_key key = saved_key_of(st, path), saved;
+  struct stat file_st;
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+
+  // seul un catalogue écrit par l'utilisateur est cru
+  if (fstat(fd, &file_st) == 0 && file_st.st_uid == geteuid()
+      && read(fd, &saved, sizeof(saved)) == sizeof(saved) && !memcmp(&saved, &key, sizeof(key)))
+    return fd;
+
+  close(fd);
+  return -1;
+}
+
+
+/* Catalog saved for the archive of status ST, NULL if there is none or if the archive changed since */
+static tar_catalog *load_saved (const struct stat *st)
+{
+  int fd = open_saved(st);
+  if (fd < 0)
+    return NULL;
+
+  tar_catalog *catalog = tar_catalog_load(fd);
+  close(fd);
+  return catalog;
+}
+
+
+/* Save CATALOG, read from the archive of status ST, for the other processes */
+static void save_catalog (const tar_catalog *catalog, const struct stat *st)
+{
+  char path[PATH_MAX], tmp[PATH_MAX];
+  struct saved_key key = saved_key_of(st, path);
+  int err = errno;
+
+  // écrit à côté puis renommé : un autre processus ne lit jamais un catalogue incomplet
+  mkdir(CATALOG_DIR, 0777);
+  int fd = snprintf(tmp, PATH_MAX, "%s.XXXXXX", path) < PATH_MAX ? mkstemp(tmp) : -1;
+  if (fd < 0)
+    {
+      errno = err;
+      return;
+    }
+
+  if (write(fd, &key, sizeof(key)) != sizeof(key) || tar_catalog_save(catalog, fd) < 0 || rename(tmp, path) < 0)
+    unlink(tmp);
+
+  close(fd);
+  errno = err;
+}
+
+
+static bool same_archive (const struct stat *a, const struct stat *b)
+{
+  return a->st_dev == b->st_dev && a->st_ino == b->st_ino && a->st_size == b->st_size
+    && a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+
+static tar_catalog *read_catalog (const char *tar_name)
+{
+  struct stat before, after;
+  bool saved = savable(tar_name, &before);
+  tar_catalog *catalog = saved ? load_saved(&before) : NULL;
+  if (catalog)
+    return catalog;
+
+  int fd = archive_open(tar_name, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+
+  catalog = tar_catalog_read(fd);
+  int err = errno;
+  archive_close(fd);
+
+  // un catalogue n'est gardé que si l'archive n'a pas changé pendant sa lecture
+  if (catalog && saved && stat(tar_name, &after) == 0 && same_archive(&before, &after))
+    save_catalog(catalog, &before);
+
+  errno = err;
+  return catalog;
+}
+
+
+/* Build the catalog of the entry E, reserved for TAR_NAME, without holding the lock ;
+   the catalog is held by the cache, and by the caller too if HOLD */
+static const tar_catalog *build_entry (struct catalog_entry *e, const char *tar_name, bool hold)
+{
+  tar_catalog *catalog = read_catalog(tar_name);
+  int err = errno;
+
+  pthread_mutex_lock(&lock);
+  e->building = false;
+  e->catalog = catalog;
+  if (!catalog)
+    clear_entry(e);
+  else if (hold)
+    catalog->refs++;
+  pthread_cond_broadcast(&built);
+  pthread_mutex_unlock(&lock);
+
+  errno = err;
+  return catalog;
+}
+
+
+/* Arguments of a warming thread */
+struct warm_job
+{
+  struct catalog_entry *entry;
+  char *tar_name;
+};
+
+static void *warm (void *arg)
+{
+  struct warm_job *job = arg;
+
+  build_entry(job->entry, job->tar_name, false);
+  free(job->tar_name);
+  free(job);
+
+  return NULL;
+}
+
+
+
+
+const tar_catalog *catalog_get (const char *tar_name)
+{
+  struct catalog_entry *e;
+
+  pthread_once(&once, init);
+  pthread_mutex_lock(&lock);
+  read_events();
+
+  if ((e = find_entry(tar_name)))
+    {
+      if (up_to_date(e))
+	{
+	  e->last_use = ++use_clock;
+	  e->catalog->refs++;
+	  pthread_mutex_unlock(&lock);
+	  return e->catalog;
+	}
+      clear_entry(e);
+    }
+
+  e = reserve_entry(tar_name);
+  pthread_mutex_unlock(&lock);
+
+  if (e)
+    return build_entry(e, tar_name, true);
+
+  // pas de place, ou une archive qui ne peut pas être mise en cache : le catalogue n'appartient qu'à l'appelant
+  return read_catalog(tar_name);
+}
+
+
+void catalog_release (const tar_catalog *catalog)
+{
+  int err = errno;
+
+  if (!catalog)
+    return;
+
+  pthread_once(&once, init);
+  pthread_mutex_lock(&lock);
+  // seul le cache modifie le compteur, toujours sous le verrou
+  unref((tar_catalog *) catalog);
+  pthread_mutex_unlock(&lock);
+
+  errno = err;
+}
+
+
+bool catalog_cached (const char *tar_name)
+{
+  struct catalog_entry *e;
+  bool cached = false;
+
+  pthread_once(&once, init);
+  pthread_mutex_lock(&lock);
+  read_events();
+
+  if ((e = find_entry(tar_name)))
+    {
+      cached = up_to_date(e);
+      if (!cached)
+	clear_entry(e);
+    }
+
+  pthread_mutex_unlock(&lock);
+  return cached;
+}
+
+
+bool catalog_saved (const char *tar_name)
+{
+  struct stat st;
+  int fd;
+
+  if (!savable(tar_name, &st) || (fd = open_saved(&st)) < 0)
+    return false;
+
+  close(fd);
+  return true;
+}
+
+
+void catalog_warm (const char *tar_name)
+{
+  struct catalog_entry *e;
+  struct warm_job *job;
+  pthread_attr_t attr;
+  pthread_t thread;
+
+  pthread_once(&once, init);
+  pthread_mutex_lock(&lock);
+  read_events();
+
+  if ((e = find_entry(tar_name)) && up_to_date(e))
+    {
+      pthread_mutex_unlock(&lock);
+      return;
+    }
+  if (e)
+    clear_entry(e);
+
+  if (!(e = reserve_entry(tar_name)))
+    {
+      pthread_mutex_unlock(&lock);
+      return;
+    }
+  pthread_mutex_unlock(&lock);
+
+  job = malloc(sizeof(struct warm_job));
+  if (job && (job->tar_name = strdup(tar_name)))
+    {
+      job->entry = e;
+      pthread_attr_init(&attr);
+      pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+      int r = pthread_create(&thread, &attr, warm, job);
+      pthread_attr_destroy(&attr);
+      if (r == 0)
+	return;
+      free(job->tar_name);
+    }
+  free(job);
+
+  // sans thread, le catalogue sera construit au prochain catalog_get
+  pthread_mutex_lock(&lock);
+  e->building = false;
+  clear_entry(e);
+  pthread_cond_broadcast(&built);
+  pthread_mutex_unlock(&lock);
+}
+
+
+void catalog_clear (void)
+{
+  pthread_once(&once, init);
+  pthread_mutex_lock(&lock);
+
+  for (int i = 0; i < CATALOG_CACHE_MAX; i++)
+    {
+      while (entries[i].building)
+	pthread_cond_wait(&built, &lock);
+      if (entries[i].tar_name)
+	clear_entry(entries + i);
+    }
+
+  pthread_mutex_unlock(&lock);
+}
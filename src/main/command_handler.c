@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <getopt.h>
+#include <linux/limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,6 +9,7 @@
 #include "command_handler.h"
 
 #include "errors.h"
+#include "output.h"
 #include "path_lib.h"
 #include "tar.h"
 #include "utils.h"
@@ -15,6 +17,9 @@
 
 static void init_arg_info_options (arg_info *info, struct arg *tokens, int tokens_size);
 
+/* Arguments of the command, given back by free_tokens */
+static arena *args_mem = NULL;
+
 
 char *check_options (int argc, char **argv, char *optstring)
 {
@@ -47,23 +52,31 @@ char *check_options (int argc, char **argv, char *optstring)
 
 void invalid_options (char *cmd_name)
 {
-  write_string (STDERR_FILENO, cmd_name);
-  write_string (STDERR_FILENO, ": invalid option -- '");
+  char opt = optopt;
+
+  out_string (STDERR_FILENO, cmd_name);
+  out_string (STDERR_FILENO, ": invalid option -- '");
 
-  write(STDERR_FILENO, &optopt, 1);
+  out_write (STDERR_FILENO, &opt, 1);
 
-  write_string (STDERR_FILENO, "' with tarball, skipping files inside tarball\n");
+  out_string (STDERR_FILENO, "' with tarball, skipping files inside tarball\n");
+  out_flush (STDERR_FILENO);
 }
 
 
 
 struct arg *tokenize_args (int *argc, char **argv, arg_info *info)
 {
-  struct arg *tokens = malloc(*argc * sizeof(struct arg));
-  assert(tokens);
+  char resolved[PATH_MAX];
+
+  if (!args_mem)
+    args_mem = arena_create();
+
+  // les arguments et leurs chemins sont tous alloués dans l'arène de la commande
+  struct arg *tokens = arena_alloc(args_mem, *argc * sizeof(struct arg));
 
   // Par définition, le premier argument est la commande
-  tokens[0].value = copy_string(argv[0]);
+  tokens[0].value = arena_strdup(args_mem, argv[0]);
   tokens[0].type = CMD;
 
   int j = 1;
@@ -72,7 +85,7 @@ struct arg *tokenize_args (int *argc, char **argv, arg_info *info)
       // OPTION
       if (*argv[i] == '-')
 	{
-	  tokens[j].value = copy_string (argv[i]);
+	  tokens[j].value = arena_strdup (args_mem, argv[i]);
 	  tokens[j++].type = OPTION;
 	}
       // ERROR ou TAR_FILE ou REG_FILE
@@ -80,11 +93,16 @@ struct arg *tokenize_args (int *argc, char **argv, arg_info *info)
 	{
 	  char *abs, *reduce, *in_tar;
 
-	  abs = make_absolute(argv[i]);
-	  reduce = reduce_abs_path(abs, NULL);
-	  in_tar = split_tar_abs_path (reduce);
+	  arena_mark mark = arena_save(args_mem);
+	  abs = make_absolute(args_mem, argv[i]);
+	  reduce = reduce_abs_path(abs, resolved);
+	  arena_restore(args_mem, mark);
 
-	  free(abs);
+	  // les commandes complètent le chemin sur place (un '/' final, un nom de destination) :
+	  // il garde un buffer de PATH_MAX
+	  if (reduce)
+	    reduce = strcpy(arena_alloc(args_mem, PATH_MAX), resolved);
+	  in_tar = split_tar_abs_path (reduce);
 
 	  // ERROR
 	  if (!reduce)
@@ -115,19 +133,8 @@ struct arg *tokenize_args (int *argc, char **argv, arg_info *info)
 
 void free_tokens (struct arg *tokens, int argc)
 {
-  for (int i=0; i < argc; i++)
-    {
-      if (tokens[i].type == TAR_FILE)
-	{
-	  free( tokens[i].tf.tar_name);
-	}
-      else
-	{
-	  free (tokens[i].value);
-	}
-    }
-
-  free(tokens);
+  // tout est dans l'arène de la commande
+  arena_reset(args_mem);
 }
 
 int execvp_tokens (char *cmd_name, struct arg *tokens, int tokens_size)
@@ -154,6 +161,7 @@ int execvp_tokens (char *cmd_name, struct arg *tokens, int tokens_size)
 
   argv[i] = NULL;
 
+  out_flush_all();
   return execvp(argv[0], argv);
 }
 
@@ -209,3 +217,13 @@ bool no_arg (arg_info *info)
 {
   return info->nb_tar_file == 0 && info->nb_reg_file == 0;
 }
+
+int tar_run_length (struct arg *tokens, int start, int end)
+{
+  int i = start + 1;
+
+  while (i < end && tokens[i].type == TAR_FILE && !strcmp (tokens[i].tf.tar_name, tokens[start].tf.tar_name))
+    i++;
+
+  return i - start;
+}
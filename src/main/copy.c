@@ -1,6 +1,8 @@
+#include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -9,8 +11,11 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "archive.h"
+#include "catalog.h"
 #include "copy.h"
 #include "errors.h"
+#include "hashmap.h"
 #include "path_lib.h"
 #include "tar.h"
 #include "utils.h"
@@ -166,7 +171,8 @@ static void end_of_path_filename(char *path, char *the_end_of_path)
   free(end_ofpath);
 }
 
-static int when_is_dir_dest(char *src_tar, char *src_file, char *dest_tar, char *dest_file)
+//name in the directory DEST_FILE of a copy of SRC_FILE, DEST_FILE is ended by a slash
+static void name_in_dest_dir(char *src_file, char *dest_file, char *name)
 {
   char buf[100];
   if(nb_of_words(src_file) > 1){
@@ -178,13 +184,18 @@ static int when_is_dir_dest(char *src_tar, char *src_file, char *dest_tar, char
   {
     strcpy(buf, src_file);
   }
-  char buf2[PATH_MAX];
   if(!is_empty_string(dest_file)){
     append_slash_filename(dest_file);
-    sprintf(buf2, "%s%s", dest_file, buf);
+    sprintf(name, "%s%s", dest_file, buf);
   }
   else
-    sprintf(buf2, "%s", buf);
+    sprintf(name, "%s", buf);
+}
+
+static int when_is_dir_dest(char *src_tar, char *src_file, char *dest_tar, char *dest_file)
+{
+  char buf2[PATH_MAX];
+  name_in_dest_dir(src_file, dest_file, buf2);
   if(has_rights_dest(dest_tar, dest_file) < 0)
     return -1;
   if(exist(dest_tar, buf2, 1) == 0)
@@ -402,6 +413,100 @@ int cp_tar_to_tar(char *src_tar, char *src_file, char *dest_tar, char *dest_file
   return 0;
 }
 
+int cp_tar_to_tar_batch(char *src_tar, char **src_files, int nb_files, char *dest_tar, char *dest_file, char *opt)
+{
+  int ret = 0;
+
+  //with -r, or in a file, each file is copied on its own
+  if(nb_files == 1 || !is_empty_string(opt) || !is_dir(dest_tar, dest_file))
+  {
+    for(int i = 0; i < nb_files; i++)
+    {
+      if(cp_tar_to_tar(src_tar, src_files[i], dest_tar, dest_file, opt) < 0)
+        ret = -1;
+    }
+    return ret;
+  }
+
+  if(!is_empty_string(dest_file))
+    append_slash_filename(dest_file);
+  if(has_rights_dest(dest_tar, dest_file) < 0)
+    return -1;
+
+  char **sources = malloc(nb_files * sizeof(char *)), **dests = malloc(nb_files * sizeof(char *));
+  char **to_remove = malloc(nb_files * sizeof(char *));
+  assert(sources && dests && to_remove);
+  hashmap *copies = hashmap_create(); //name in the destination -> index of the copy + 1
+  int nb_copies = 0, nb_to_remove = 0;
+
+  //all the files are checked, then removed from the destination and added in one pass each
+  for(int i = 0; i < nb_files; i++)
+  {
+    char *src_file = src_files[i];
+    char dest_name[PATH_MAX];
+
+    if(strcmp(dest_tar, src_tar) == 0 && strcmp(src_file, dest_file) == 0)
+    {
+      error(0, "%s: \'%s\' and \'%s\' identify the same file\n", cmd_name_copy, src_tar, src_file, dest_tar, dest_file);
+      ret = -1;
+      continue;
+    }
+    if(is_dir(src_tar, src_file))
+    {
+      error(0, "%s : -r not specified ; omission of the directory \'%s/%s\'\n", cmd_name_copy, src_tar, src_file);
+      ret = -1;
+      continue;
+    }
+    if(exist(src_tar, src_file, 1) < 0)
+    {
+      errno = ENOENT;
+      error(errno, "%s : Impossible to evaluate \'%s/%s\'", cmd_name_copy, src_tar, src_file);
+      ret = -1;
+      continue;
+    }
+    if(has_rights_src(src_tar, src_file) < 0)
+    {
+      ret = -1;
+      continue;
+    }
+
+    name_in_dest_dir(src_file, dest_file, dest_name);
+    //a later file of the same name replaces the copy of an earlier one
+    intptr_t index = (intptr_t) hashmap_get(copies, dest_name);
+    if(index > 0)
+    {
+      sources[index - 1] = src_file;
+      continue;
+    }
+    if(exist(dest_tar, dest_name, 1) == 0)
+      to_remove[nb_to_remove++] = copy_string(dest_name);
+    sources[nb_copies] = src_file;
+    dests[nb_copies++] = copy_string(dest_name);
+    hashmap_put(copies, dest_name, (void *) (intptr_t) nb_copies);
+  }
+
+  if(nb_to_remove > 0 && tar_rm_files(dest_tar, to_remove, nb_to_remove) < 0)
+  {
+    error(0, "%s: Problems on removing the file of the same name\n", cmd_name_copy);
+    ret = -1;
+  }
+  else if(nb_copies > 0 && add_tar_members_to_tar(src_tar, dest_tar, sources, dests, nb_copies) < 0)
+  {
+    error(0, "%s: Problems at the add of file\n", cmd_name_copy);
+    ret = -1;
+  }
+
+  for(int i = 0; i < nb_copies; i++)
+    free(dests[i]);
+  for(int i = 0; i < nb_to_remove; i++)
+    free(to_remove[i]);
+  free(sources);
+  free(dests);
+  free(to_remove);
+  hashmap_free(copies, false);
+  return ret;
+}
+
 
 static int cp_ett_without_r(char *src_file, char *dest_tar, char *dest_file)
 {
@@ -807,8 +912,13 @@ static int cp_r_tte(char *src_tar, char *src_file, char *dest_file)
 
     char buf2[PATH_MAX];
     sprintf(buf2, "%s/%s", dest_file, tmp);
+    // le dossier est extrait sous son dernier composant (src_file finit par un /)
+    int last_end = strlen(src_file) - 1;
+    int last_start = last_end;
+    while (last_start > 0 && src_file[last_start - 1] != '/')
+      last_start--;
     char buf3[PATH_MAX];
-    sprintf(buf3, "%s/%s", dest_file, src_file);
+    sprintf(buf3, "%s/%.*s", dest_file, last_end - last_start, src_file + last_start);
     if(rename(buf3, buf2) != 0)return -1;
   }
   else
@@ -835,3 +945,164 @@ int cp_tar_to_ext (char *src_tar, char *src_file, char *dest_file, char *opt)
 
   return 0;
 }
+
+/** Destinations of the files extracted together by cp_tar_to_ext_batch() */
+struct extracted_files
+{
+  char **dests;   //name of the copy of each file, NULL if the file is not copied
+  mode_t *modes;  //mode of each file in the tar, given to open which applies the umask
+  int fd;         //copy being written, -1 if none
+  int ret;
+};
+
+//write a part of a file to the copy being written, the holes of a sparse file are skipped
+static int write_extracted_part(int fd, const void *buf, size_t count)
+{
+  if(!buf)
+    return lseek(fd, count, SEEK_CUR) < 0 ? -1 : 0;
+
+  for(ssize_t w; count > 0; count -= w, buf = (const char *) buf + w)
+  {
+    if((w = write(fd, buf, count)) < 0)
+    {
+      if(errno != EINTR)
+        return -1;
+      w = 0;
+    }
+  }
+  return 0;
+}
+
+static int extracted_part(int index, const void *buf, size_t count, int err, void *data)
+{
+  struct extracted_files *files = data;
+  char *dest = files->dests[index];
+
+  if(!dest)
+    return 0;
+
+  if(files->fd < 0)
+  {
+    files->fd = open(dest, O_WRONLY | O_CREAT | O_TRUNC, files->modes[index]);
+    if(files->fd < 0)
+    {
+      error_cmd(cmd_name_copy, dest);
+      files->dests[index] = NULL;
+      files->ret = -1;
+      return 0;
+    }
+  }
+
+  if(buf || count > 0)
+  {
+    if(write_extracted_part(files->fd, buf, count) == 0)
+      return 0;
+    err = errno;
+  }
+
+  //a file ending with a hole gets its size with ftruncate
+  if(!err && ftruncate(files->fd, lseek(files->fd, 0, SEEK_CUR)) < 0)
+    err = errno;
+  close(files->fd);
+  files->fd = -1;
+  files->dests[index] = NULL;
+
+  if(err)
+  {
+    errno = err;
+    error(0, "%s: Problems at the add of file\n", cmd_name_copy);
+    files->ret = -1;
+  }
+  return 0;
+}
+
+int cp_tar_to_ext_batch(char *src_tar, char **src_files, int nb_files, char *dest_file, char *opt)
+{
+  int ret = 0;
+
+  //with -r, or in a file, each file is copied on its own
+  if(nb_files == 1 || !is_empty_string(opt) || !is_dir_ext(dest_file))
+  {
+    for(int i = 0; i < nb_files; i++)
+    {
+      if(cp_tar_to_ext(src_tar, src_files[i], dest_file, opt) < 0)
+        ret = -1;
+    }
+    return ret;
+  }
+
+  char **sources = malloc(nb_files * sizeof(char *)), **dests = malloc(nb_files * sizeof(char *));
+  char **names = malloc(nb_files * sizeof(char *));
+  mode_t *modes = malloc(nb_files * sizeof(mode_t));
+  assert(sources && dests && names && modes);
+  struct extracted_files files = { names, modes, -1, 0 };
+  int nb_copies = 0;
+
+  remove_last_slash(dest_file);
+
+  //all the files are checked, then the tar is read once for all of them
+  for(int i = 0; i < nb_files; i++)
+  {
+    char *src_file = src_files[i];
+    char src_path[PATH_MAX];
+
+    if(is_dir(src_tar, src_file))
+    {
+      error(0, "%s : -r not specified ; omission of the directory \'%s/%s\'\n", cmd_name_copy, src_tar, src_file);
+      ret = -1;
+      continue;
+    }
+    if(exist(src_tar, src_file, 1) == -1)
+    {
+      errno = ENOENT;
+      error(errno, "%s : Impossible to evaluate \'%s/%s\'", cmd_name_copy, src_tar, src_file);
+      ret = -1;
+      continue;
+    }
+    if(has_rights_src(src_tar, src_file) < 0)
+    {
+      ret = -1;
+      continue;
+    }
+
+    sprintf(src_path, "%s/%s", src_tar, src_file);
+    char *name = end_of_path(src_path);
+    dests[nb_copies] = malloc(strlen(dest_file) + strlen(name) + 2);
+    assert(dests[nb_copies]);
+    sprintf(dests[nb_copies], "%s/%s", dest_file, name);
+    names[nb_copies] = dests[nb_copies];
+    sources[nb_copies++] = src_file;
+    free(name);
+  }
+
+  int tar_fd = nb_copies > 0 ? archive_open(src_tar, O_RDONLY) : -1;
+  const tar_catalog *catalog = tar_fd < 0 ? NULL : catalog_get(src_tar);
+  if(nb_copies > 0 && !catalog)
+  {
+    error_cmd(cmd_name_copy, src_tar);
+    ret = -1;
+  }
+  else if(nb_copies > 0)
+  {
+    //the copies keep the permissions of the files, the target of a symbolic link has its own
+    for(int i = 0; i < nb_copies; i++)
+    {
+      const tar_member *member = tar_catalog_find(catalog, sources[i]);
+      modes[i] = member && member->typeflag != SYMTYPE ? member->mode & 07777 : 0666;
+    }
+    tar_read_members(tar_fd, catalog, sources, nb_copies, extracted_part, &files);
+    if(files.ret < 0)
+      ret = -1;
+  }
+
+  catalog_release(catalog);
+  if(tar_fd >= 0)
+    archive_close(tar_fd);
+  for(int i = 0; i < nb_copies; i++)
+    free(dests[i]);
+  free(sources);
+  free(dests);
+  free(names);
+  free(modes);
+  return ret;
+}
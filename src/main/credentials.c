@@ -0,0 +1,118 @@
+#include "credentials.h"
+
+#include <assert.h>
+#include <grp.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hashmap.h"
+#include "utils.h"
+
+
+static credentials creds;
+static hashmap *user_names = NULL;    // uid en décimal -> nom, NULL si l'utilisateur n'a pas de nom
+static hashmap *group_names = NULL;   // gid en décimal -> nom, NULL si le groupe n'a pas de nom
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+
+
+
+static void init (void)
+{
+  creds.uid = getuid();
+  creds.gid = getgid();
+
+  // le nombre de groupes peut changer entre les deux appels
+  int n = getgroups(0, NULL);
+  creds.groups = malloc((n > 0 ? n : 1) * sizeof(gid_t));
+  assert(creds.groups);
+  creds.nb_groups = n > 0 ? getgroups(n, creds.groups) : 0;
+  if (creds.nb_groups < 0)
+    creds.nb_groups = 0;
+
+  user_names = hashmap_create();
+  group_names = hashmap_create();
+}
+
+
+/* Name of ID in NAMES, asked with LOOKUP the first time */
+static const char *cached_name (hashmap *names, unsigned long id, char *(*lookup)(unsigned long))
+{
+  char key[24];
+  char *name;
+
+  snprintf(key, sizeof(key), "%lu", id);
+
+  pthread_mutex_lock(&lock);
+  if (hashmap_contains(names, key))
+    {
+      name = hashmap_get(names, key);
+    }
+  else
+    {
+      // une absence de nom est gardée aussi
+      name = lookup(id);
+      hashmap_put(names, key, name);
+    }
+  pthread_mutex_unlock(&lock);
+
+  return name;
+}
+
+
+static char *lookup_user (unsigned long uid)
+{
+  struct passwd *pw = getpwuid(uid);
+  return pw ? copy_string(pw->pw_name) : NULL;
+}
+
+
+static char *lookup_group (unsigned long gid)
+{
+  struct group *gr = getgrgid(gid);
+  return gr ? copy_string(gr->gr_name) : NULL;
+}
+
+
+
+
+const credentials *get_credentials (void)
+{
+  pthread_once(&once, init);
+  return &creds;
+}
+
+
+bool in_group (const credentials *creds, gid_t gid)
+{
+  if (gid == creds->gid)
+    return true;
+
+  for (int i = 0; i < creds->nb_groups; i++)
+    {
+      if (creds->groups[i] == gid)
+	return true;
+    }
+
+  return false;
+}
+
+
+const char *user_name (uid_t uid)
+{
+  pthread_once(&once, init);
+  return cached_name(user_names, uid, lookup_user);
+}
+
+
+const char *group_name (gid_t gid)
+{
+  pthread_once(&once, init);
+  return cached_name(group_names, gid, lookup_group);
+}
@@ -6,18 +6,42 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "archive.h"
 #include "errors.h"
+#include "output.h"
 
 static int print_error_string (const char *str)
 {
-  return write (STDERR_FILENO, str, strlen(str));
+  return out_string (STDERR_FILENO, str);
+}
+
+/* Start an error message : what is waiting on the standard output is written before it */
+static void begin_error (void)
+{
+  int err = errno;
+
+  out_flush (STDOUT_FILENO);
+  errno = err;
+}
+
+/* Same as perror, through the buffer of the standard error */
+static void print_perror (const char *msg)
+{
+  const char *reason = strerror (errno);
+
+  begin_error ();
+  print_error_string (msg);
+  print_error_string (": ");
+  print_error_string (reason);
+  print_error_string ("\n");
+  out_flush (STDERR_FILENO);
 }
 
 static void close_fds (int fds[], int length_fds)
 {
   for (int i = 0; i < length_fds; i++)
     {
-      close(fds[i]);
+      archive_close(fds[i]);
     }
 }
 
@@ -56,7 +80,7 @@ void error_cmd (const char *cmd_name, const char *msg)
   strcpy(buf + cmd_len, ": ");
   strcpy(buf + cmd_len + 2, msg);
   
-  perror(buf);
+  print_perror(buf);
 }
 
 void tar_error_cmd (const char *cmd_name, const char *tar_name, const char *filename)
@@ -86,7 +110,7 @@ void tar_error_cmd (const char *cmd_name, const char *tar_name, const char *file
 
   strcpy(dst, filename);
   
-  perror(buf);
+  print_perror(buf);
 }
 
 void error (int errnum, const char *msg, ...)
@@ -110,7 +134,8 @@ void error (int errnum, const char *msg, ...)
   vsprintf (buffer, msg, args);
   va_end(args);  
   
-  write (STDERR_FILENO, buffer, required_size + 1);
+  begin_error ();
+  out_write (STDERR_FILENO, buffer, required_size);
 
   if (errnum > 0)
     {
@@ -118,6 +143,7 @@ void error (int errnum, const char *msg, ...)
       print_error_string (strerror(errnum));
       print_error_string ("\n");
     }
+  out_flush (STDERR_FILENO);
 
   free (buffer);  
 }
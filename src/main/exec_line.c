@@ -15,18 +15,28 @@
 #include "array.h"
 #include "pipe.h"
 #include "errors.h"
+#include "arena.h"
+
+/* Tokens of the current line, given back when the next line is executed */
+static arena *line_mem = NULL;
 
 
 
 int exec_line(char *line)
 {
-  list *tokens = tokenize(line);
+  if (line_mem)
+    arena_reset(line_mem);
+  else
+    line_mem = arena_create();
+
+  list *tokens = tokenize_in(line_mem, line);
   if (!parse_tokens(tokens))
   {
     free_tokens_list(tokens);
     free(line);
     return -1;
   }
+  expand_globs(line_mem, tokens);
   int nb_cmd = list_size(tokens);
   if (nb_cmd > 1)
   {
@@ -52,10 +62,9 @@ int exec_line(char *line)
       reset_redirs();
       return EXIT_SUCCESS;
     }
-    token *first_tok = array_get(cmd_arr, 0);
+    token *first_tok = array_at(cmd_arr, 0);
     char *cmd_name = first_tok -> val.arg;
     int is_special = special_command(cmd_name);
-    free(first_tok);
     if (is_special == TSH_FUNC)
     {
       char **argv = cmd_array_to_argv(cmd_arr);
@@ -79,7 +88,7 @@ int exec_line(char *line)
         {
           array_free(cmd_arr, false);
           reset_redirs();
-          return EXIT_FAILURE;
+          exit(EXIT_FAILURE); // Le fils ne doit pas exécuter la suite d'un script
         }
         remove_all_redir_tokens(cmd_arr);
         exec_cmd_array(cmd_arr);
@@ -134,7 +143,7 @@ int exec_red_array(array *cmd)
   int size = array_size(cmd);
   for (int i = 0; i < size - 1; i++) // Dernier élément est de type PIPE
   {
-    cur = array_get(cmd, i);
+    cur = array_at(cmd, i);
 
     if (cur -> type == REDIR)
     {
@@ -148,17 +157,13 @@ int exec_red_array(array *cmd)
       {
         if (launch_redir(prev -> val.red, cur -> val.arg) != 0)
         {
-          free(cur);
-          free(prev);
           return -1;
         }
       }
       prev_is_redir = false;
     }
-    if (prev != NULL) free(prev);
     prev = cur;
   }
-  free(cur);
   return 0;
 }
 
@@ -169,11 +174,10 @@ void remove_all_redir_tokens(array *cmd)
   bool prev_is_redir = false;
   for (int i = 0; i < size; i++)
   {
-    if ((tok = array_get(cmd, i)) -> type == REDIR)
+    if ((tok = array_at(cmd, i)) -> type == REDIR)
     {
       prev_is_redir = true;
-      free(tok);
-      tok = array_remove(cmd, i--);
+      free(array_remove(cmd, i--));
       size--;
     }
     else if (prev_is_redir)
@@ -182,6 +186,5 @@ void remove_all_redir_tokens(array *cmd)
       prev_is_redir = false;
       size--;
     }
-    free(tok);
   }
 }
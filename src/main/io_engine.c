@@ -0,0 +1,691 @@
+#include "io_engine.h"
+#include "archive.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/** Number of entries of the submission queue */
+#define URING_DEPTH 64
+
+/** Number of copy chunks in flight (each one uses a read and a write entry) */
+#define COPY_SLOTS (URING_DEPTH / 2)
+
+/** Size of the buffer of a copy chunk */
+#define COPY_CHUNK (64 * 1024)
+
+
+/** A mapped io_uring instance */
+struct uring
+{
+  int fd;
+
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  struct io_uring_sqe *sqes;
+  unsigned sq_local_tail; // entrées préparées mais pas encore publiées
+
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  struct io_uring_cqe *cqes;
+
+  unsigned to_submit;     // entrées publiées mais pas encore soumises
+  unsigned in_flight;     // entrées soumises dont on attend la complétion
+};
+
+/** A copy chunk in flight */
+struct copy_slot
+{
+  char *buf;
+  size_t count;
+  int expected; // nombre de complétions attendues pour ce morceau
+  bool used;
+};
+
+
+static struct uring ring;
+static int engine = -1;
+
+
+static int uring_setup (struct uring *r, unsigned entries);
+static struct io_uring_sqe *uring_get_sqe (struct uring *r);
+static int uring_submit_and_wait (struct uring *r, unsigned wait_nr);
+static struct io_uring_cqe *uring_peek_cqe (struct uring *r);
+static void uring_cqe_seen (struct uring *r);
+static bool uring_drain (struct uring *r, void (*seen) (const struct io_uring_cqe *cqe, void *data), void *data);
+
+static int uring_openat_batch (int dir_fd, char *const names[], int flags, mode_t mode, int fds[], size_t n);
+static int uring_stat_batch (int dir_fd, char *const names[], int flags, struct stat st[], size_t n);
+static int uring_copy_batch (const struct io_copy copies[], size_t n);
+
+static int blocking_copy (const struct io_copy *copy);
+static void statx_to_stat (const struct statx *stx, struct stat *st);
+
+
+
+
+/* io_uring */
+
+static int uring_setup (struct uring *r, unsigned entries)
+{
+  struct io_uring_params p;
+  size_t sq_size, cq_size;
+  char *sq_ptr = MAP_FAILED, *cq_ptr = MAP_FAILED;
+
+  memset(&p, 0, sizeof(p));
+  r->fd = syscall(__NR_io_uring_setup, entries, &p);
+  if (r->fd < 0)
+    return -1;
+
+  sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    sq_size = cq_size = sq_size > cq_size ? sq_size : cq_size;
+
+  sq_ptr = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+  if (sq_ptr == MAP_FAILED)
+    goto error;
+
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+      cq_ptr = sq_ptr;
+    }
+  else
+    {
+      cq_ptr = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+      if (cq_ptr == MAP_FAILED)
+	goto error;
+    }
+
+  r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+		 MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+  if (r->sqes == MAP_FAILED)
+    goto error;
+
+  r->sq_head  = (unsigned *)(sq_ptr + p.sq_off.head);
+  r->sq_tail  = (unsigned *)(sq_ptr + p.sq_off.tail);
+  r->sq_mask  = (unsigned *)(sq_ptr + p.sq_off.ring_mask);
+  r->sq_array = (unsigned *)(sq_ptr + p.sq_off.array);
+  r->sq_local_tail = *r->sq_tail;
+
+  r->cq_head = (unsigned *)(cq_ptr + p.cq_off.head);
+  r->cq_tail = (unsigned *)(cq_ptr + p.cq_off.tail);
+  r->cq_mask = (unsigned *)(cq_ptr + p.cq_off.ring_mask);
+  r->cqes    = (struct io_uring_cqe *)(cq_ptr + p.cq_off.cqes);
+
+  r->to_submit = 0;
+  r->in_flight = 0;
+
+  return 0;
+
+ error:
+  // les anneaux déjà projetés sont rendus
+  if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+    munmap(cq_ptr, cq_size);
+  if (sq_ptr != MAP_FAILED)
+    munmap(sq_ptr, sq_size);
+  close(r->fd);
+  return -1;
+}
+
+/* Get a free submission entry, NULL if the submission queue is full */
+static struct io_uring_sqe *uring_get_sqe (struct uring *r)
+{
+  unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+
+  if (r->sq_local_tail - head >= URING_DEPTH)
+    return NULL;
+
+  unsigned index = r->sq_local_tail & *r->sq_mask;
+  struct io_uring_sqe *sqe = r->sqes + index;
+
+  memset(sqe, 0, sizeof(*sqe));
+  r->sq_array[index] = index;
+  r->sq_local_tail++;
+  r->to_submit++;
+
+  return sqe;
+}
+
+/* Submit all prepared entries and wait for at least WAIT_NR completions */
+static int uring_submit_and_wait (struct uring *r, unsigned wait_nr)
+{
+  int ret;
+
+  __atomic_store_n(r->sq_tail, r->sq_local_tail, __ATOMIC_RELEASE);
+
+  do
+    {
+      ret = syscall(__NR_io_uring_enter, r->fd, r->to_submit, wait_nr,
+		    wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    }
+  while (ret < 0 && errno == EINTR);
+
+  if (ret < 0)
+    return -1;
+
+  r->in_flight += ret;
+  r->to_submit -= ret;
+
+  return 0;
+}
+
+/* Get the next completion, NULL if there is none yet */
+static struct io_uring_cqe *uring_peek_cqe (struct uring *r)
+{
+  unsigned head = *r->cq_head;
+
+  if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+    return NULL;
+
+  return r->cqes + (head & *r->cq_mask);
+}
+
+static void uring_cqe_seen (struct uring *r)
+{
+  __atomic_store_n(r->cq_head, *r->cq_head + 1, __ATOMIC_RELEASE);
+  r->in_flight--;
+}
+
+/*
+ * After a failure of io_uring_enter, take back the entries the kernel did not consume and wait for the ones in flight,
+ * each completion is given to SEEN (if not NULL). Return false if the ring could not be drained : the entries
+ * in flight may still use the buffers of the batch, and the ring is not used anymore.
+ */
+static bool uring_drain (struct uring *r, void (*seen) (const struct io_uring_cqe *cqe, void *data), void *data)
+{
+  struct io_uring_cqe *cqe;
+  unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+
+  // sans SQPOLL, le noyau ne lit la file qu'à l'appel d'io_uring_enter : les entrées restantes peuvent être retirées
+  r->in_flight += r->to_submit - (r->sq_local_tail - head);
+  r->to_submit = 0;
+  r->sq_local_tail = head;
+  __atomic_store_n(r->sq_tail, head, __ATOMIC_RELEASE);
+
+  do
+    {
+      while ((cqe = uring_peek_cqe(r)))
+	{
+	  if (seen)
+	    seen(cqe, data);
+	  uring_cqe_seen(r);
+	}
+    }
+  while (r->in_flight > 0 && uring_submit_and_wait(r, 1) == 0);
+
+  if (r->in_flight > 0)
+    {
+      engine = IO_ENGINE_BLOCKING;
+      return false;
+    }
+
+  return true;
+}
+
+
+/* Close a file opened by an entry drained after a failure */
+static void close_opened (const struct io_uring_cqe *cqe, void *data)
+{
+  if (cqe->res >= 0)
+    close(cqe->res);
+}
+
+static int uring_openat_batch (int dir_fd, char *const names[], int flags, mode_t mode, int fds[], size_t n)
+{
+  struct io_uring_sqe *sqe;
+  struct io_uring_cqe *cqe;
+  size_t submitted = 0, completed = 0;
+  int ret = 0;
+
+  for (size_t i = 0; i < n; i++)
+    fds[i] = -ECANCELED;
+
+  while (completed < n)
+    {
+      // on remplit la file autant que possible...
+      while (submitted < n && ring.in_flight + ring.to_submit < URING_DEPTH && (sqe = uring_get_sqe(&ring)))
+	{
+	  sqe->opcode = IORING_OP_OPENAT;
+	  sqe->fd = dir_fd;
+	  sqe->addr = (uintptr_t) names[submitted];
+	  sqe->len = mode;
+	  sqe->open_flags = flags | O_CLOEXEC;
+	  sqe->user_data = submitted++;
+	}
+
+      // ... puis on attend au moins une complétion
+      if (uring_submit_and_wait(&ring, 1) < 0)
+	{
+	  // aucune ouverture n'est gardée : le lot échoue en entier
+	  int err = errno;
+
+	  uring_drain(&ring, close_opened, NULL);
+	  for (size_t i = 0; i < n; i++)
+	    {
+	      if (fds[i] >= 0)
+		close(fds[i]);
+	      fds[i] = -err;
+	    }
+	  errno = err;
+	  return -1;
+	}
+
+      while ((cqe = uring_peek_cqe(&ring)))
+	{
+	  fds[cqe->user_data] = cqe->res;
+	  if (cqe->res < 0)
+	    {
+	      errno = -cqe->res;
+	      ret = -1;
+	    }
+
+	  uring_cqe_seen(&ring);
+	  completed++;
+	}
+    }
+
+  return ret;
+}
+
+static int uring_stat_batch (int dir_fd, char *const names[], int flags, struct stat st[], size_t n)
+{
+  struct io_uring_sqe *sqe;
+  struct io_uring_cqe *cqe;
+  struct statx *stx;
+  size_t submitted = 0, completed = 0;
+  int ret = 0;
+
+  stx = malloc(n * sizeof(struct statx));
+  if (!stx)
+    return -1;
+
+  for (size_t i = 0; i < n; i++)
+    st[i].st_mode = 0;
+
+  while (completed < n)
+    {
+      while (submitted < n && ring.in_flight + ring.to_submit < URING_DEPTH && (sqe = uring_get_sqe(&ring)))
+	{
+	  sqe->opcode = IORING_OP_STATX;
+	  sqe->fd = dir_fd;
+	  sqe->addr = (uintptr_t) names[submitted];
+	  sqe->len = STATX_BASIC_STATS;
+	  sqe->statx_flags = flags;
+	  sqe->off = (uintptr_t) (stx + submitted);
+	  sqe->user_data = submitted++;
+	}
+
+      if (uring_submit_and_wait(&ring, 1) < 0)
+	{
+	  // le noyau peut encore écrire dans stx tant que des entrées sont en cours
+	  int err = errno;
+
+	  if (uring_drain(&ring, NULL, NULL))
+	    free(stx);
+	  errno = err;
+	  return -1;
+	}
+
+      while ((cqe = uring_peek_cqe(&ring)))
+	{
+	  if (cqe->res < 0)
+	    {
+	      st[cqe->user_data].st_mode = 0;
+	      errno = -cqe->res;
+	      ret = -1;
+	    }
+	  else
+	    {
+	      statx_to_stat(stx + cqe->user_data, st + cqe->user_data);
+	    }
+
+	  uring_cqe_seen(&ring);
+	  completed++;
+	}
+    }
+
+  free(stx);
+  return ret;
+}
+
+/*
+ * Each copy is cut in chunks of COPY_CHUNK bytes.
+ * A chunk read from a file uses a read entry linked to a write entry, so both are submitted at once
+ * and the write starts only when the read succeeded. A chunk taken from memory only needs a write entry.
+ * The user_data of an entry is the index of its slot.
+ */
+static int uring_copy_batch (const struct io_copy copies[], size_t n)
+{
+  struct copy_slot slots[COPY_SLOTS];
+  struct io_uring_sqe *sqe;
+  struct io_uring_cqe *cqe;
+  size_t i = 0, done = 0; // copie courante et nombre d'octets déjà planifiés pour celle-ci
+  int used = 0, err = 0, s;
+
+  memset(slots, 0, sizeof(slots));
+
+  while ((i < n && !err) || used > 0)
+    {
+      // on planifie tant qu'il y a des morceaux libres
+      for (s = 0; s < COPY_SLOTS && i < n && !err; s++)
+	{
+	  if (slots[s].used)
+	    continue;
+
+	  const struct io_copy *c = copies + i;
+	  size_t count = c->count - done < COPY_CHUNK ? c->count - done : COPY_CHUNK;
+
+	  if (count == 0)
+	    {
+	      i++;
+	      done = 0;
+	      s--;
+	      continue;
+	    }
+
+	  slots[s].count = count;
+	  slots[s].used = true;
+	  used++;
+
+	  if (c->src_buf)
+	    {
+	      sqe = uring_get_sqe(&ring);
+	      sqe->opcode = IORING_OP_WRITE;
+	      sqe->fd = c->dst_fd;
+	      sqe->addr = (uintptr_t) ((const char *)c->src_buf + done);
+	      sqe->len = count;
+	      sqe->off = c->dst_off + done;
+	      sqe->user_data = s;
+	      slots[s].expected = 1;
+	    }
+	  else
+	    {
+	      if (!slots[s].buf && !(slots[s].buf = malloc(COPY_CHUNK)))
+		{
+		  err = errno;
+		  slots[s].used = false;
+		  used--;
+		  break;
+		}
+
+	      sqe = uring_get_sqe(&ring);
+	      sqe->opcode = IORING_OP_READ;
+	      sqe->fd = c->src_fd;
+	      sqe->addr = (uintptr_t) slots[s].buf;
+	      sqe->len = count;
+	      sqe->off = c->src_off + done;
+	      sqe->flags = IOSQE_IO_LINK; // une lecture incomplète annule l'écriture
+	      sqe->user_data = s;
+
+	      sqe = uring_get_sqe(&ring);
+	      sqe->opcode = IORING_OP_WRITE;
+	      sqe->fd = c->dst_fd;
+	      sqe->addr = (uintptr_t) slots[s].buf;
+	      sqe->len = count;
+	      sqe->off = c->dst_off + done;
+	      sqe->user_data = s;
+	      slots[s].expected = 2;
+	    }
+
+	  done += count;
+	  if (done == c->count)
+	    {
+	      i++;
+	      done = 0;
+	    }
+	}
+
+      if (used == 0)
+	break;
+
+      if (uring_submit_and_wait(&ring, 1) < 0)
+	{
+	  err = errno;
+	  break;
+	}
+
+      while ((cqe = uring_peek_cqe(&ring)))
+	{
+	  s = cqe->user_data;
+
+	  if (cqe->res < 0)
+	    err = -cqe->res;
+	  else if ((size_t) cqe->res != slots[s].count)
+	    err = EIO;
+
+	  if (--slots[s].expected == 0)
+	    {
+	      slots[s].used = false;
+	      used--;
+	    }
+
+	  uring_cqe_seen(&ring);
+	}
+    }
+
+  // en cas d'erreur d'io_uring_enter, on attend quand même les requêtes utilisant nos tampons
+  if (ring.in_flight > 0 || ring.to_submit > 0)
+    {
+      if (!uring_drain(&ring, NULL, NULL))
+	{
+	  errno = err;
+	  return -1;
+	}
+    }
+
+  for (s = 0; s < COPY_SLOTS; s++)
+    free(slots[s].buf);
+
+  if (err)
+    {
+      errno = err;
+      return -1;
+    }
+
+  return 0;
+}
+
+
+static void statx_to_stat (const struct statx *stx, struct stat *st)
+{
+  memset(st, 0, sizeof(*st));
+
+  st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+  st->st_ino = stx->stx_ino;
+  st->st_mode = stx->stx_mode;
+  st->st_nlink = stx->stx_nlink;
+  st->st_uid = stx->stx_uid;
+  st->st_gid = stx->stx_gid;
+  st->st_rdev = makedev(stx->stx_rdev_major, stx->stx_rdev_minor);
+  st->st_size = stx->stx_size;
+  st->st_blksize = stx->stx_blksize;
+  st->st_blocks = stx->stx_blocks;
+  st->st_atim.tv_sec = stx->stx_atime.tv_sec;
+  st->st_atim.tv_nsec = stx->stx_atime.tv_nsec;
+  st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+  st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+  st->st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+  st->st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+}
+
+
+
+
+/* Blocking engine */
+
+static int blocking_copy (const struct io_copy *copy)
+{
+  char buffer[COPY_CHUNK];
+  size_t done, count;
+  ssize_t r;
+
+  for (done = 0; done < copy->count; done += count)
+    {
+      count = copy->count - done < COPY_CHUNK ? copy->count - done : COPY_CHUNK;
+
+      if (copy->src_buf)
+	{
+	  r = pwrite(copy->dst_fd, (const char *)copy->src_buf + done, count, copy->dst_off + done);
+	}
+      else
+	{
+	  r = archive_pread(copy->src_fd, buffer, count, copy->src_off + done);
+	  if (r >= 0 && (size_t) r == count)
+	    r = pwrite(copy->dst_fd, buffer, count, copy->dst_off + done);
+	}
+
+      if (r < 0)
+	return -1;
+
+      if ((size_t) r != count)
+	{
+	  errno = EIO;
+	  return -1;
+	}
+    }
+
+  return 0;
+}
+
+
+
+
+enum io_engine_kind io_engine_kind (void)
+{
+  if (engine >= 0)
+    return engine;
+
+  char *forced = getenv("TSH_IO_ENGINE");
+
+  if (forced && !strcmp(forced, "blocking"))
+    engine = IO_ENGINE_BLOCKING;
+  else // io_uring peut être absent du noyau ou interdit (seccomp)
+    engine = uring_setup(&ring, URING_DEPTH) == 0 ? IO_ENGINE_URING : IO_ENGINE_BLOCKING;
+
+  return engine;
+}
+
+
+int io_openat_batch (int dir_fd, char *const names[], int flags, mode_t mode, int fds[], size_t n)
+{
+  if (io_engine_kind() == IO_ENGINE_URING)
+    return uring_openat_batch(dir_fd, names, flags, mode, fds, n);
+
+  int ret = 0;
+
+  for (size_t i = 0; i < n; i++)
+    {
+      fds[i] = openat(dir_fd, names[i], flags | O_CLOEXEC, mode);
+      if (fds[i] < 0)
+	{
+	  fds[i] = -errno;
+	  ret = -1;
+	}
+    }
+
+  return ret;
+}
+
+
+int io_stat_batch (int dir_fd, char *const names[], int flags, struct stat st[], size_t n)
+{
+  if (io_engine_kind() == IO_ENGINE_URING)
+    return uring_stat_batch(dir_fd, names, flags, st, n);
+
+  int ret = 0;
+
+  for (size_t i = 0; i < n; i++)
+    {
+      if (fstatat(dir_fd, names[i], st + i, flags) < 0)
+	{
+	  st[i].st_mode = 0;
+	  ret = -1;
+	}
+    }
+
+  return ret;
+}
+
+
+int io_copy_batch (const struct io_copy copies[], size_t n)
+{
+  bool indirect = false;
+
+  // le contenu d'une archive compressée ou imbriquée est lu par archive_pread, pas directement par le noyau
+  for (size_t i = 0; i < n && !indirect; i++)
+    {
+      off_t offset = copies[i].src_off;
+      indirect = !copies[i].src_buf && archive_backing(copies[i].src_fd, &offset, copies[i].count) != copies[i].src_fd;
+    }
+
+  if (!indirect && io_engine_kind() == IO_ENGINE_URING)
+    return uring_copy_batch(copies, n);
+
+  for (size_t i = 0; i < n; i++)
+    {
+      if (blocking_copy(copies + i) < 0)
+	return -1;
+    }
+
+  return 0;
+}
+
+
+void io_queue_init (struct io_copy_queue *q)
+{
+  q->n = 0;
+  q->status = 0;
+}
+
+
+void io_queue_copy (struct io_copy_queue *q, struct io_copy copy)
+{
+  if (q->n == IO_QUEUE_MAX)
+    {
+      if (io_copy_batch(q->copies, q->n) < 0)
+	q->status = -1;
+      q->n = 0;
+    }
+
+  // une archive imbriquée (ou un union) est lue directement dans le fichier qui la contient
+  if (!copy.src_buf)
+    {
+      off_t offset = copy.src_off;
+      int fd = archive_backing(copy.src_fd, &offset, copy.count);
+      if (fd >= 0)
+	{
+	  copy.src_fd = fd;
+	  copy.src_off = offset;
+	}
+    }
+
+  q->copies[q->n++] = copy;
+}
+
+
+int io_queue_flush (struct io_copy_queue *q)
+{
+  if (q->n > 0 && io_copy_batch(q->copies, q->n) < 0)
+    q->status = -1;
+
+  int ret = q->status;
+  io_queue_init(q);
+
+  return ret;
+}
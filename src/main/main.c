@@ -4,6 +4,8 @@
 #include <unistd.h>
 #include <readline/history.h>
 #include <linux/limits.h>
+#include <fcntl.h>
+#include <string.h>
 
 
 #include "tsh.h"
@@ -11,8 +13,10 @@
 #include "tar.h"
 #include "errors.h"
 #include "tokens.h"
+#include "script.h"
 
 static void init_tsh();
+static int interactive();
 
 char prompt[PATH_MAX + 16];
 
@@ -27,10 +31,8 @@ static void init_tsh()
 }
 
 
-int main (int argc, char *argv[])
+static int interactive()
 {
-  init_tsh ();
-
   char *buf;
   while ((buf = readline(set_prompt(prompt))))
   {
@@ -45,3 +47,49 @@ int main (int argc, char *argv[])
 
   return 0;
 }
+
+
+int main (int argc, char *argv[])
+{
+  script_reader reader;
+
+  init_tsh ();
+
+  if (argc > 1 && strcmp(argv[1], "-c") == 0) // tsh -c 'cmd'
+  {
+    if (argc == 2)
+    {
+      error (0, "tsh: -c: option requires an argument\n");
+      return 2;
+    }
+    return exec_lines(argv[2]);
+  }
+
+  if (argc > 1 && argv[1][0] == '-')
+  {
+    error (0, "tsh: %s: invalid option\n", argv[1]);
+    return 2;
+  }
+
+  if (argc > 1) // tsh script.tsh
+  {
+    int fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+      error_cmd("tsh", argv[1]);
+      return 127;
+    }
+    script_reader_init(&reader, fd, false);
+    int ret = exec_script(&reader);
+    close(fd);
+    return ret;
+  }
+
+  if (!isatty(STDIN_FILENO)) // Commandes lues sur l'entrée standard, sans invite
+  {
+    script_reader_init(&reader, STDIN_FILENO, true);
+    return exec_script(&reader);
+  }
+
+  return interactive();
+}
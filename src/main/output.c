@@ -0,0 +1,140 @@
+#include "output.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** Buffer of a file descriptor */
+struct out_buffer
+{
+  char data[OUTPUT_BUFFER_SIZE];
+  size_t used;
+  int line_buffered;    // -1 tant qu'on ne sait pas si c'est un terminal
+};
+
+
+static struct out_buffer buffers[2] = { { .line_buffered = -1 }, { .line_buffered = -1 } };
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+
+
+
+static void init (void)
+{
+  // le fils d'un fork ne doit pas écrire une seconde fois ce que le parent n'a pas encore écrit
+  pthread_atfork(out_flush_all, NULL, NULL);
+  atexit(out_flush_all);
+}
+
+
+/* Buffer of FD ; NULL if FD is not buffered */
+static struct out_buffer *get_buffer (int fd)
+{
+  struct out_buffer *b;
+
+  if (fd != STDOUT_FILENO && fd != STDERR_FILENO)
+    return NULL;
+
+  pthread_once(&once, init);
+
+  b = buffers + (fd - STDOUT_FILENO);
+  if (b->line_buffered < 0)
+    b->line_buffered = isatty(fd);
+
+  return b;
+}
+
+
+static int write_all (int fd, const char *buf, size_t count)
+{
+  ssize_t n;
+
+  while (count > 0)
+    {
+      if ((n = write(fd, buf, count)) < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  return -1;
+	}
+
+      buf += n;
+      count -= n;
+    }
+
+  return 0;
+}
+
+
+
+
+int out_write (int fd, const void *buf, size_t count)
+{
+  struct out_buffer *b = get_buffer(fd);
+
+  if (!b)
+    return write_all(fd, buf, count) < 0 ? -1 : (int) count;
+
+  if (count > OUTPUT_BUFFER_SIZE - b->used && out_flush(fd) < 0)
+    return -1;
+
+  // ce qui ne tient pas dans le buffer vide est écrit directement
+  if (count >= OUTPUT_BUFFER_SIZE)
+    return write_all(fd, buf, count) < 0 ? -1 : (int) count;
+
+  memcpy(b->data + b->used, buf, count);
+  b->used += count;
+
+  if (b->line_buffered && memchr(buf, '\n', count) && out_flush(fd) < 0)
+    return -1;
+
+  return count;
+}
+
+
+int out_string (int fd, const char *str)
+{
+  return out_write(fd, str, strlen(str));
+}
+
+
+int out_repeat (int fd, char c, int n)
+{
+  char chunk[64];
+
+  memset(chunk, c, sizeof(chunk));
+
+  for (; n > 0; n -= sizeof(chunk))
+    {
+      if (out_write(fd, chunk, n < sizeof(chunk) ? n : sizeof(chunk)) < 0)
+	return -1;
+    }
+
+  return 0;
+}
+
+
+int out_flush (int fd)
+{
+  struct out_buffer *b = get_buffer(fd);
+  size_t used;
+
+  if (!b || b->used == 0)
+    return 0;
+
+  // le buffer est vidé même si l'écriture échoue, pour ne pas la répéter à chaque appel
+  used = b->used;
+  b->used = 0;
+
+  return write_all(fd, b->data, used);
+}
+
+
+void out_flush_all (void)
+{
+  out_flush(STDOUT_FILENO);
+  out_flush(STDERR_FILENO);
+}
@@ -9,9 +9,14 @@
 #include "tokens.h"
 #include "list.h"
 #include "array.h"
+#include "catalog.h"
+#include "path_lib.h"
+#include "tar_glob.h"
 
 static bool well_formatted(void *a);
 static token char_to_token(char *w);
+static array *expand_arg(arena *mem, char *arg, int flags);
+static void expand_cmd(arena *mem, array *cmd, int flags);
 
 int count_words(const char *str)
 {
@@ -68,10 +73,15 @@ static token char_to_token(char *w)
 
 
 list *tokenize(char *user_input)
+{
+  return tokenize_in(NULL, user_input);
+}
+
+list *tokenize_in(arena *mem, char *user_input)
 {
   const char delim[] = " ";
-  list *res = list_create();
-  array *cur_arr = array_create(sizeof(token));
+  list *res = list_create_in(mem);
+  array *cur_arr = array_create_in(mem, sizeof(token));
   token cur_tok = char_to_token(strtok(user_input, delim));
   array_insert_last(cur_arr, &cur_tok);
   list_insert_last(res, cur_arr);
@@ -80,7 +90,7 @@ list *tokenize(char *user_input)
   {
     if (cur_tok.type == PIPE)
     {
-      cur_arr = array_create(sizeof(token));
+      cur_arr = array_create_in(mem, sizeof(token));
       list_insert_last(res, cur_arr);
     }
     cur_tok = char_to_token(iter);
@@ -89,7 +99,7 @@ list *tokenize(char *user_input)
   // Pourt garder une cohérence on ajoute un pipe à la fin, chaque cellule finit donc par un pipe
   if (cur_tok.type == PIPE)
   {
-    cur_arr = array_create(sizeof(token));
+    cur_arr = array_create_in(mem, sizeof(token));
     array_insert_last(cur_arr, &cur_tok);
     list_insert_last(res, cur_arr);
   }
@@ -100,6 +110,107 @@ list *tokenize(char *user_input)
   return res;
 }
 
+/* Expansion of ARG, as typed without its \ ; NULL if ARG is not a pattern inside a tar or if nothing matches */
+static array *expand_arg(arena *mem, char *arg, int flags)
+{
+  char path[PATH_MAX], dir[PATH_MAX], pattern[PATH_MAX];
+  char *component = arg;
+
+  if (!has_glob(arg))
+    return NULL;
+
+  // le chemin est gardé tel quel jusqu'au composant qui contient le premier motif
+  for (char *s = arg; *s && *s != '*' && *s != '?' && *s != '['; s++)
+  {
+    if (*s == '/')
+      component = s + 1;
+    else if (*s == '\\' && s[1])
+      s++;
+  }
+  size_t prefix_len = component - arg;
+
+  char *prefix = arena_strndup(mem, arg, prefix_len);
+  glob_unescape(prefix);
+  prefix_len = strlen(prefix);
+  if (!reduce_abs_path(make_absolute(mem, prefix_len > 0 ? prefix : "."), path))
+    return NULL;
+
+  // seuls les motifs dans un tar sont développés
+  char *in_tar = split_tar_abs_path(path);
+  if (!in_tar)
+    return NULL;
+
+  // le motif est relatif à la racine du tar
+  size_t dir_len = strlen(in_tar);
+  snprintf(dir, sizeof(dir), "%s%s", in_tar, dir_len > 0 && in_tar[dir_len - 1] != '/' ? "/" : "");
+  dir_len = strlen(dir);
+  if (snprintf(pattern, sizeof(pattern), "%s%s", dir, component) >= sizeof(pattern))
+    return NULL;
+
+  const tar_catalog *catalog = catalog_get(path);
+  if (!catalog)
+    return NULL;
+
+  array *matches = tar_glob(mem, catalog, pattern, flags);
+  catalog_release(catalog);
+  if (array_size(matches) == 0)
+    return NULL;
+
+  // le début du chemin tapé est remis devant chaque nom trouvé
+  for (int i = 0; i < array_size(matches); i++)
+  {
+    char **match = array_at(matches, i);
+    char *expanded = arena_alloc(mem, prefix_len + strlen(*match + dir_len) + 1);
+    sprintf(expanded, "%s%s", prefix, *match + dir_len);
+    *match = expanded;
+  }
+
+  return matches;
+}
+
+/* Replace the patterns of the arguments of CMD by their expansions, the files of redirections are not expanded ;
+   the words which are not expanded lose their \ */
+static void expand_cmd(arena *mem, array *cmd, int flags)
+{
+  bool prev_is_redir = false;
+
+  for (int i = 0; i < array_size(cmd); i++)
+  {
+    token *tok = array_at(cmd, i);
+    array *matches;
+
+    if (tok -> type == ARG && !prev_is_redir && (matches = expand_arg(mem, tok -> val.arg, flags)))
+    {
+      free(array_remove(cmd, i));
+      for (int j = 0; j < array_size(matches); j++)
+      {
+        token expanded = { .val.arg = *(char **) array_at(matches, j), .type = ARG };
+        array_insert(cmd, i + j, &expanded);
+      }
+      i += array_size(matches) - 1;
+      prev_is_redir = false;
+      continue;
+    }
+
+    if (tok -> type == ARG)
+      glob_unescape(tok -> val.arg);
+    prev_is_redir = tok -> type == REDIR;
+  }
+}
+
+void expand_globs(arena *mem, list *cmds)
+{
+  int flags = getenv("TSH_NOCASEGLOB") ? TAR_GLOB_NOCASE : 0;
+
+  // chaque commande est reprise puis remise à la fin de la liste
+  for (int i = list_size(cmds); i > 0; i--)
+  {
+    array *cmd = list_remove_first(cmds);
+    expand_cmd(mem, cmd, flags);
+    list_insert_last(cmds, cmd);
+  }
+}
+
 char **array_to_argv(array *arr)
 {
   int size = array_size(arr);
@@ -124,9 +235,8 @@ char **cmd_array_to_argv(array *cmd_arr)
   token *it;
   for (int i = 0; i < size-1; i++)
   {
-    it = array_get(cmd_arr, i);
+    it = array_at(cmd_arr, i);
     argv[i] = it -> val.arg;
-    free(it);
   }
   argv[size-1] = NULL;
   return argv;
@@ -145,18 +255,16 @@ static bool well_formatted(void *a)
   token *cur;
   for (int i = 0; i < size; i++)
   {
-    cur = array_get(arr, i);
+    cur = array_at(arr, i);
     if (prev_is_redir)
     {
       if (cur -> type != ARG)
       {
-        free(cur);
         write(STDERR_FILENO, "tsh: syntax error: unexpected token after redirection\n", 54);
         return false;
       }
     }
     prev_is_redir = cur -> type == REDIR;
-    free(cur);
   }
   return true;
 }
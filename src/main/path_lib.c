@@ -10,14 +10,17 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "archive.h"
+#include "catalog.h"
+#include "hashmap.h"
 #include "path_lib.h"
 #include "tar.h"
 #include "utils.h"
 
 //static char *end_of_path(char *path);
 static void remove_last_slashs(char *path);
-static enum file_type is_dir_type(int tar_fd, const char *filename);
-static enum file_type is_reg_type(int tar_fd, const char *filename);
+static enum file_type is_dir_type(const tar_catalog *catalog, const char *filename);
+static enum file_type is_reg_type(const tar_catalog *catalog, const char *filename);
 
 /* Return a malloc'd pointer of the last file in path, NULL if it end by . or ..
    the last file will also be detahced of path */
@@ -62,33 +65,210 @@ static void remove_last_slashs(char *path)
     }
 }
 
-char *split_tar_abs_path(char *path)
+/* What is known of a path, valid while the file stamped (the file itself, or the archive on the disk containing it)
+   is unchanged, and no archive was written by the process */
+struct path_entry
 {
-  if (path == NULL || path[0] != '/')
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  struct timespec mtime;
+  unsigned long writes;   // archive_write_count() quand l'entrée a été remplie
+  unsigned long generation; // composition de l'union qui contient le chemin, 0 hors d'un union
+  bool stamped;           // faux tant que l'entrée n'a jamais été remplie
+  signed char tar;        // 1 si c'est une archive, 0 sinon, -1 si on ne sait pas
+  signed char exists;     // 1 si le membre existe, 0 sinon (errno dans err), -1 si on ne sait pas
+  int err;
+};
+
+/* Walk along the prefixes of a path */
+struct walk
+{
+  size_t tar_end;      // longueur du préfixe qui est l'archive la plus imbriquée, 0 s'il n'y en a pas
+  struct stat outer;   // l'archive sur le disque qui contient le reste du chemin
+  unsigned long generation; // composition de l'union sur le disque, 0 si ce n'en est pas un
+  bool cacheable;      // faux pour un union dont la composition n'a pas pu être lue
+  bool dir;            // le dernier préfixe sur le disque est un dossier
+};
+
+static hashmap *path_cache = NULL;
+
+
+static void free_entry (const char *key, void *val, void *data)
+{
+  free(val);
+}
+
+
+/* Entry of PATH, whose stamp is ST and GENERATION ; emptied if it was filled with another stamp */
+static struct path_entry *cache_entry (const char *path, const struct stat *st, unsigned long generation)
+{
+  struct path_entry *e;
+  unsigned long writes = archive_write_count();
+
+  if (!path_cache)
+    path_cache = hashmap_create();
+
+  if ((e = hashmap_get(path_cache, path)) == NULL)
     {
-      return NULL;
+      // le cache est vidé plutôt que de grossir sans fin
+      if (hashmap_size(path_cache) >= PATH_CACHE_MAX)
+	{
+	  hashmap_iter(path_cache, free_entry, NULL);
+	  hashmap_free(path_cache, false);
+	  path_cache = hashmap_create();
+	}
+      e = malloc(sizeof(struct path_entry));
+      assert(e);
+      e->stamped = false;
+      hashmap_put(path_cache, path, e);
     }
 
-  char *chr = path+1;
+  if (!e->stamped || e->dev != st->st_dev || e->ino != st->st_ino || e->size != st->st_size
+      || e->mtime.tv_sec != st->st_mtim.tv_sec || e->mtime.tv_nsec != st->st_mtim.tv_nsec
+      || e->writes != writes || e->generation != generation)
+    {
+      e->dev = st->st_dev;
+      e->ino = st->st_ino;
+      e->size = st->st_size;
+      e->mtime = st->st_mtim;
+      e->writes = writes;
+      e->generation = generation;
+      e->stamped = true;
+      e->tar = -1;
+      e->exists = -1;
+    }
+
+  return e;
+}
+
+
+static bool has_tar_suffix (const char *path)
+{
+  size_t len = strlen(path);
+  return archive_is_union(path) || archive_is_gzip(path) || (len >= 4 && !strcmp(path + len - 4, ".tar"));
+}
+
+
+/* is_tar() of PATH, through the entry E if there is one */
+static bool cached_is_tar (struct path_entry *e, const char *path)
+{
+  if (!e)
+    return is_tar(path) == 1;
 
-  while (*chr)
+  if (e->tar < 0)
+    e->tar = is_tar(path) == 1;
+
+  return e->tar;
+}
+
+
+/* Follow the prefix of length LEN of PATH, after its shorter prefixes
+   Return 1 if it is an archive, 0 if it is not, -1 if it is not on the disk (errno is set) */
+static int walk_prefix (struct walk *w, char *path, size_t len)
+{
+  char c = path[len];
+  struct stat st;
+  int ret = 0;
+
+  path[len] = '\0';
+
+  if (w->tar_end > 0)
     {
-      if(*chr == '/')
+      // dans une archive : une archive imbriquée
+      if (has_tar_suffix(path))
+	ret = cached_is_tar(w->cacheable ? cache_entry(path, &w->outer, w->generation) : NULL, path);
+    }
+  else if (stat(path, &st) < 0)
+    {
+      ret = -1;
+    }
+  else
+    {
+      w->dir = S_ISDIR(st.st_mode);
+      if (S_ISREG(st.st_mode) && has_tar_suffix(path) && cached_is_tar(cache_entry(path, &st, 0), path))
 	{
-	  *chr = '\0';
-	  if (is_tar(path) == 1)
-	    {
-	      return chr + 1;
-	    }
-	  *chr = '/';
+	  w->outer = st;
+	  w->generation = 0;
+	  // ce qui est dans un union dépend aussi de ses archives
+	  w->cacheable = !archive_is_union(path) || archive_union_stamp(path, &w->generation) == 0;
+	  ret = 1;
 	}
-      chr++;
     }
 
-  if (is_tar(path) == 1)
-    return chr;
+  path[len] = c;
 
-  return NULL;
+  if (ret == 1)
+    w->tar_end = len;
+
+  return ret;
+}
+
+
+/* Walk along the prefixes of the LEN first characters of PATH, up to the innermost archive */
+static void walk_path (struct walk *w, char *path, size_t len)
+{
+  w->tar_end = 0;
+
+  for (size_t i = 1; i <= len; i++)
+    {
+      if ((i == len || path[i] == '/') && path[i - 1] != '/')
+	{
+	  // rien ne peut exister sous un chemin absent du disque
+	  if (walk_prefix(w, path, i) < 0 && w->tar_end == 0)
+	    return;
+	}
+    }
+}
+
+
+/* tar_access() with F_OK of the member of the innermost archive of W, which ends PATH */
+static int member_exists (struct walk *w, char *path)
+{
+  struct path_entry *e = w->cacheable ? cache_entry(path, &w->outer, w->generation) : NULL;
+  int ret;
+
+  if (e && e->exists >= 0)
+    {
+      errno = e->err;
+      return e->exists ? 0 : -1;
+    }
+
+  path[w->tar_end] = '\0';
+  ret = tar_access(path, path + w->tar_end + 1, F_OK);
+  path[w->tar_end] = '/';
+
+  if (e)
+    {
+      e->exists = ret >= 0;
+      e->err = ret >= 0 ? 0 : errno;
+    }
+
+  return ret < 0 ? -1 : 0;
+}
+
+
+char *split_tar_abs_path(char *path)
+{
+  if (path == NULL || path[0] != '/')
+    {
+      return NULL;
+    }
+
+  struct walk w;
+  size_t len = strlen(path);
+
+  // on va jusqu'à l'archive la plus imbriquée
+  walk_path(&w, path, len);
+
+  if (w.tar_end == 0)
+    return NULL;
+
+  if (w.tar_end == len)
+    return path + len;
+
+  path[w.tar_end] = '\0';
+  return path + w.tar_end + 1;
 }
 
 
@@ -107,7 +287,8 @@ char *reduce_abs_path(const char *path, char *resolved)
       return NULL;
     }
 
-  char *ret, *dest, *ret_end, *in_tar;
+  char *ret, *dest, *ret_end;
+  struct walk w = { .tar_end = 0 };
 
   if (resolved == NULL)
     {
@@ -124,7 +305,6 @@ char *reduce_abs_path(const char *path, char *resolved)
   ret[0] = '/';
   dest = ret + 1;
   ret_end = ret + PATH_MAX;
-  in_tar = NULL;
 
   const char *name_start, *name_end;
   for (name_start = (name_end = path_cpy + 1); name_start[0] != '\0'; name_start = name_end)
@@ -149,6 +329,10 @@ char *reduce_abs_path(const char *path, char *resolved)
 	      dest--;
 	      while (dest[-1] != '/') // on fait revenir en arrière DEST
 		dest--;
+
+	      // on est sorti de l'archive : on cherche celle qui contient encore le chemin
+	      if (dest - ret <= w.tar_end)
+		walk_path(&w, ret, dest - ret - 1);
 	    }
 	}
       else
@@ -182,34 +366,22 @@ char *reduce_abs_path(const char *path, char *resolved)
 	  dest += name_size; // on place dest à la fin du mot
 	  dest[0] = '\0';
 
-	  in_tar = split_tar_abs_path (ret);
+	  // seul le nouveau mot est vérifié, les préfixes déjà parcourus restent dans W
+	  int res = walk_prefix(&w, ret, name_end[0] == '/' ? dest - ret - 1 : dest - ret);
 
-	  struct stat st;
-	  if (stat(ret, &st) < 0)
+	  if (w.tar_end == 0 && res < 0)
 	    goto error;
 
-	  if (in_tar == NULL && !S_ISDIR (st.st_mode) && name_end[0] != '\0') // pas de tar en jeu
+	  if (res == 0 && w.tar_end == 0 && !w.dir && name_end[0] != '\0') // pas de tar en jeu
 	    {
 	      errno = ENOTDIR;
 	      goto error;
 	    }
-	  else if (in_tar != NULL)
-	    {
-	      if (in_tar[0] != '\0')
-		{
-		  if (tar_access(ret, in_tar, F_OK) < 0)
-		    goto error;
-		  in_tar[-1] = '/';
-		}
-	      else if (in_tar[-1] == '\0')
-		in_tar[-1] = '/';
-	    }
+	  else if (res == 0 && w.tar_end > 0 && member_exists(&w, ret) < 0)
+	    goto error;
 	}
     }
 
-  /* if (dest > ret + 1 && dest[-1] == '/' && in_tar != NULL && in_tar[0] == '\0') */
-  /*   --dest; */
-
   dest[0] = '\0';
   if (end)
     {
@@ -226,19 +398,20 @@ char *reduce_abs_path(const char *path, char *resolved)
   return NULL;
 }
 
-char *make_absolute (const char *path)
+char *make_absolute (arena *mem, const char *path)
 {
   char *abs;
   size_t path_len = strlen(path);
 
   if (*path == '/')
     {
-      abs = copy_string(path);
+      abs = mem ? arena_strdup(mem, path) : copy_string(path);
     }
   else
     {
       char *pwd = getenv("PWD");
-      abs = malloc(path_len + 2 + strlen(pwd));
+      size_t size = path_len + 2 + strlen(pwd);
+      abs = mem ? arena_alloc(mem, size) : malloc(size);
       assert(abs);
       sprintf(abs, "%s/%s", pwd, path);
     }
@@ -251,91 +424,85 @@ int is_tar_path (char *path)
   if (path == NULL || *path != '/')
     return -1;
 
+  struct walk w;
+  walk_path(&w, path, strlen(path));
 
-  char *chr = path+1;
-  bool tar_path = false;
-
-  while (*chr && !tar_path)
-    {
-      if(*chr == '/')
-	{
-	  *chr = '\0';
-
-	  if (is_tar(path) == 1)
-	    tar_path = true;
-
-	  *chr = '/';
-	}
-      chr++;
-    }
-
-  if (is_tar(path) == 1)
-    tar_path = true;
-
-  return tar_path;
+  return w.tar_end > 0;
 }
 
-enum file_type ftype_of_file(int tar_fd, const char *filename, bool dir_priority)
+/* Type of FILENAME among the members of the CATALOG of a tar */
+static enum file_type members_type_of_file(const tar_catalog *catalog, const char *filename, bool dir_priority)
 {
   if (is_dir_name(filename))
     {
-      if (ftar_access(tar_fd, filename, F_OK) > 0)
+      if (members_access(catalog, filename, F_OK) > 0)
         return DIR;
       else
       {
         char filename_not_dir[PATH_MAX];
         strncpy(filename_not_dir, filename, strlen(filename) - 1);
         strcat(filename_not_dir, "");
-        if (ftar_access(tar_fd, filename_not_dir, F_OK) > 0)
+        if (members_access(catalog, filename_not_dir, F_OK) > 0)
           errno = ENOTDIR;
         return NONE;
       }
     }
   enum file_type res;
-  if (tar_fd < 0)
-    return NONE;
   if (dir_priority)
     {
-      res = is_dir_type(tar_fd, filename);
+      res = is_dir_type(catalog, filename);
       if (res == DIR) return DIR;
       else if (res == NONE && errno == ENOENT)
 	{
-	  return is_reg_type(tar_fd, filename);
+	  return is_reg_type(catalog, filename);
 	}
       else return NONE;
     }
   else {
-    res = is_reg_type(tar_fd, filename);
+    res = is_reg_type(catalog, filename);
     if (res == REG) return REG;
     else if (res == NONE && errno == ENOENT)
       {
-	return is_dir_type(tar_fd, filename);
+	return is_dir_type(catalog, filename);
       }
     else return NONE;
   }
 }
 
+enum file_type ftype_of_file(int tar_fd, const char *filename, bool dir_priority)
+{
+  if (tar_fd < 0)
+    return NONE;
+  // le tar n'est lu qu'une fois pour tous les tests
+  tar_catalog *catalog = tar_catalog_read(tar_fd);
+  if (!catalog)
+    return NONE;
+  enum file_type res = members_type_of_file(catalog, filename, dir_priority);
+  tar_catalog_free(catalog);
+  return res;
+}
+
 enum file_type type_of_file(const char *tar_name, const char *filename, bool dir_priority)
 {
-  int tar_fd = open(tar_name, O_RDONLY);
-  if (tar_fd < 0) return NONE;
-  enum file_type res = ftype_of_file(tar_fd, filename, dir_priority);
-  close(tar_fd);
+  const tar_catalog *catalog = catalog_get(tar_name);
+  if (!catalog) return NONE;
+  enum file_type res = members_type_of_file(catalog, filename, dir_priority);
+  catalog_release(catalog);
   return res;
 }
 
 /* Return DIR if filename reference a directory, else NONE and errno is set accordingly */
-static enum file_type is_dir_type(int tar_fd, const char *filename)
+static enum file_type is_dir_type(const tar_catalog *catalog, const char *filename)
 {
   char dir[PATH_MAX];
   sprintf(dir, "%s/", filename);
-  return (ftar_access(tar_fd, dir, F_OK) > 0) ? DIR: NONE;
+  return (members_access(catalog, dir, F_OK) > 0) ? DIR: NONE;
 }
 
 /* Return REG if filename reference a regular file, else NONE and errno is set accordingly */
-static enum file_type is_reg_type(int tar_fd, const char *filename)
+static enum file_type is_reg_type(const tar_catalog *catalog, const char *filename)
 {
-  return (ftar_access(tar_fd, filename, F_OK) == 1) ? REG : NONE;
+  return (members_access(catalog, filename, F_OK) == 1) ? REG : NONE;
 }
 
 int is_pwd_prefix(const char *tar_name, const char *filename)
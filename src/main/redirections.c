@@ -10,6 +10,7 @@
 #include <stdbool.h>
 #include <sys/wait.h>
 
+#include "archive.h"
 #include "redirection.h"
 #include "tsh.h"
 #include "path_lib.h"
@@ -24,7 +25,7 @@ struct reset_redir {
   pid_t pid;
 };
 
-static int get_required_blocks(size_t old_size, size_t read_size, int *padding);
+static off_t get_required_blocks(off_t old_size, size_t read_size, int *padding);
 static int redir(char *s, int fd, redir_type r);
 static int tar_redir(char *tar_name, char *in_tar, int fd, bool append);
 static int stdout_redir(char *s);
@@ -39,6 +40,8 @@ static int handle_outside_tar_redir(int fd, char *filename, int open_flags);
 static int handle_inside_tar_stdin_redir(char *tar_name, char *filename);
 static int stdin_tar_redir(char *tar_name, char *filename);
 static int remove_content_tar_file(char *tar_name, char *in_tar);
+static int remove_content_sparse_file(int tar_fd, tar_file *tf);
+static int is_sparse_file(char *tar_name, char *in_tar);
 
 
 stack *reset_fds;
@@ -136,7 +139,7 @@ static int redir(char *s, int fd, redir_type r)
 }
 
 /* Returns the number of required blocks to add content, and set padding to then current padding of file */
-static int get_required_blocks(size_t old_size, size_t read_size, int *padding)
+static off_t get_required_blocks(off_t old_size, size_t read_size, int *padding)
 {
   *padding = BLOCKSIZE - (old_size % BLOCKSIZE);
   if (*padding == BLOCKSIZE) *padding = 0;
@@ -209,6 +212,12 @@ static int tar_redir(char *tar_name, char *in_tar, int fd, bool append)
       {
         remove_content_tar_file(tar_name, in_tar);
       }
+      else if (is_sparse_file(tar_name, in_tar) == 1)
+      {
+        // la carte d'un fichier creux ne peut pas être agrandie sur place
+        errno = EOPNOTSUPP;
+        goto error;
+      }
       break;
   }
   // On vérifie si le fichier existe déjà et si oui si on peut écrire dedans
@@ -241,49 +250,54 @@ static int tar_redir(char *tar_name, char *in_tar, int fd, bool append)
 /* Launch redirections on linked file if in_tar is a link, else returns -2 */
 static int launch_redir_tar_link(char *tar_name, char *in_tar, redir_type r)
 {
-  int tar_fd = open(tar_name, O_RDONLY);
+  int tar_fd = archive_open(tar_name, O_RDONLY);
   if (tar_fd < 0)
     return -1;
-  struct posix_header hd;
-  seek_header(tar_fd, in_tar, &hd);
-  if (hd.typeflag == LNKTYPE || hd.typeflag == SYMTYPE)
+  tar_file tf;
+  if (seek_member(tar_fd, in_tar, &tf) != 1)
+  {
+    archive_close(tar_fd);
+    return -2;
+  }
+  if (tf.header.typeflag == LNKTYPE || tf.header.typeflag == SYMTYPE)
   {
     char arg[PATH_MAX];
-    if (hd.linkname[0] != '/')
+    if (tf.linkname[0] != '/')
     {
-      char *last_slash = strrchr(hd.name, '/');
+      char *last_slash = strrchr(tf.name, '/');
       if (last_slash)
       {
         last_slash[1] = '\0';
-        sprintf(arg, "%s/%s%s", tar_name, hd.name, hd.linkname);
+        snprintf(arg, PATH_MAX, "%s/%s%s", tar_name, tf.name, tf.linkname);
       }
       else
       {
-        sprintf(arg, "%s/%s", tar_name, hd.linkname);
+        snprintf(arg, PATH_MAX, "%s/%s", tar_name, tf.linkname);
       }
     }
     else
     {
-      strcpy(arg, hd.linkname);
+      snprintf(arg, PATH_MAX, "%s", tf.linkname);
     }
-    close(tar_fd);
+    free_tar_file(&tf);
+    archive_close(tar_fd);
     return launch_redir(r, arg);
   }
-  close(tar_fd);
+  free_tar_file(&tf);
+  archive_close(tar_fd);
   return -2;
 }
 
 static void update_size(struct posix_header *hd)
 {
-  int size = get_file_size(hd);
-  long unsigned int new_size = size + update_size_func_read_size;
-  sprintf(hd -> size, "%011lo", new_size);
+  off_t new_size = get_file_size(hd) + update_size_func_read_size;
+  set_file_size(hd, new_size);
 }
 
 
 static int append_tar_file(char *tar_name, char *in_tar, int read_fd)
 {
-  int tar_fd = open(tar_name, O_RDWR);
+  int tar_fd = archive_open(tar_name, O_RDWR);
   ssize_t read_size;
   char buff[4096];
   struct posix_header hd;
@@ -295,9 +309,11 @@ static int append_tar_file(char *tar_name, char *in_tar, int read_fd)
     {
       case -1:
         perror("read on pipe");
+        archive_close(tar_fd);
         return -1;
       case 0:
-        exit(EXIT_SUCCESS);
+        // une archive compressée est réécrite à la fermeture
+        exit(archive_close(tar_fd) < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
         break;
       default:
       {
@@ -306,9 +322,9 @@ static int append_tar_file(char *tar_name, char *in_tar, int read_fd)
         update_header(&hd, tar_fd, in_tar, update_size);
 
         // Calcul du décalage nécessaire
-        int old_size = get_file_size(&hd) - read_size;
+        off_t old_size = get_file_size(&hd) - read_size;
         int padding;
-        int required_blocks = get_required_blocks(old_size, read_size, &padding);
+        off_t required_blocks = get_required_blocks(old_size, read_size, &padding);
 
         // On crée un espace en blocs pour pouvoir écrire ce qui a été lu
         off_t beg = lseek(tar_fd, old_size, SEEK_CUR);
@@ -316,7 +332,7 @@ static int append_tar_file(char *tar_name, char *in_tar, int read_fd)
         if (required_blocks > 0)
         {
           if (fmemmove(tar_fd, beg + padding, tar_size - (beg + padding), beg + padding + required_blocks*BLOCKSIZE)) {
-            close(tar_fd);
+            archive_close(tar_fd);
             return -1;
           }
         }
@@ -429,12 +445,8 @@ static int handle_inside_tar_stdin_redir(char *tar_name, char *filename)
     // Le procesus fils écrit dans le tube
     {
       close(pipefd[0]);
-      int tar_fd = open(tar_name, O_RDONLY);
-      struct posix_header hd;
-      seek_header(tar_fd, filename, &hd);
-      ssize_t read_size = get_file_size(&hd);
-      read_write_buf_by_buf(tar_fd, pipefd[1], read_size, 4096);
-      exit(EXIT_SUCCESS);
+      int ex = tar_cp_file(tar_name, filename, pipefd[1]) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+      exit(ex);
     }
     default: // Parent
     {
@@ -479,22 +491,74 @@ static void no_contents_header_update(struct posix_header *hd)
   strcpy(hd -> size, "00000000000");
 }
 
+/* Return 1 if in_tar is a sparse file, 0 if it is not, -1 on error */
+static int is_sparse_file(char *tar_name, char *in_tar)
+{
+  int tar_fd = archive_open(tar_name, O_RDONLY);
+  if (tar_fd < 0)
+    return -1;
+  tar_file tf;
+  int r = seek_member(tar_fd, in_tar, &tf);
+  archive_close(tar_fd);
+  if (r != 1)
+    return -1;
+  r = tf.sparse != NULL;
+  free_tar_file(&tf);
+  return r;
+}
+
+/* A sparse file emptied becomes a regular file : its extended header and its map are removed */
+static int remove_content_sparse_file(int tar_fd, tar_file *tf)
+{
+  struct posix_header hd = tf->header;
+  char *ext;
+  set_file_size(&hd, 0);
+  set_hd_time(&hd);
+  ssize_t ext_size = set_header_names(&hd, tf->name, NULL, &ext);
+  if (ext_size < 0)
+    return -1;
+
+  off_t tar_size = lseek(tar_fd, 0, SEEK_END);
+  off_t member_end = tf->data_start + number_of_block(get_file_size(&tf->header)) * BLOCKSIZE;
+  off_t new_end = tf->ext_start + ext_size + BLOCKSIZE;
+  int r = 0;
+  if (fmemmove(tar_fd, member_end, tar_size - member_end, new_end) != 0
+      || (ext_size > 0 && pwrite(tar_fd, ext, ext_size, tf->ext_start) < 0)
+      || pwrite(tar_fd, &hd, BLOCKSIZE, tf->ext_start + ext_size) < 0
+      || ftruncate(tar_fd, tar_size - (member_end - new_end)) < 0)
+    r = -1;
+  free(ext);
+  return r;
+}
+
 static int remove_content_tar_file(char *tar_name, char *in_tar)
 {
-  int tar_fd = open(tar_name, O_RDWR);
+  int tar_fd = archive_open(tar_name, O_RDWR);
   if (tar_fd < 0)
     return -1;
+  tar_file tf;
+  int r = seek_member(tar_fd, in_tar, &tf);
+  if (r == 1 && tf.sparse)
+  {
+    r = remove_content_sparse_file(tar_fd, &tf);
+    free_tar_file(&tf);
+    archive_close(tar_fd);
+    return r;
+  }
+  if (r == 1)
+    free_tar_file(&tf);
+  lseek(tar_fd, 0, SEEK_SET);
   struct posix_header hd;
   seek_header(tar_fd, in_tar, &hd);
   off_t tar_size = lseek(tar_fd, 0, SEEK_END);
 
-  int filesize = number_of_block(get_file_size(&hd)) * BLOCKSIZE;
+  off_t filesize = number_of_block(get_file_size(&hd)) * BLOCKSIZE;
   if (update_header(&hd, tar_fd, in_tar, no_contents_header_update) != 0)
     return -1;
   off_t cur = lseek(tar_fd, 0, SEEK_CUR);
   if (fmemmove(tar_fd, lseek(tar_fd, cur + filesize, SEEK_SET), tar_size - cur, cur) != 0)
     return -1;
-  close(tar_fd);
+  archive_close(tar_fd);
   return 0;
 
 }
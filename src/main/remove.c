@@ -1,5 +1,7 @@
+#include <assert.h>
 #include <errno.h>
 #include <limits.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -7,6 +9,7 @@
 
 #include "command_handler.h"
 #include "errors.h"
+#include "hashmap.h"
 #include "path_lib.h"
 #include "remove.h"
 #include "tar.h"
@@ -115,10 +118,9 @@ static int rm_r(char *tar_name, char *filename)
 }
 
 
-int rm(char *tar_name, char *filename, char *options)
+/* Check that FILENAME can be removed from TAR_NAME, its name as removed is copied in NEW_FILENAME */
+static int rm_check(char *tar_name, char *filename, char *new_filename)
 {
-
-  char new_filename[PATH_MAX];
   strcpy(new_filename, filename);
   //Check if the file isn't prefix on the path of pwd
 
@@ -148,5 +150,103 @@ int rm(char *tar_name, char *filename, char *options)
       return EXIT_FAILURE;
   }
 
+  return EXIT_SUCCESS;
+}
+
+//check if FILENAME is one of the REMOVED names, or is in one of them
+static bool already_removed(hashmap *removed, const char *filename)
+{
+  char prefix[strlen(filename) + 1];
+  strcpy(prefix, filename);
+
+  if(hashmap_contains(removed, prefix))
+    return true;
+
+  for(char *slash = strchr(prefix, '/'); slash; slash = strchr(slash + 1, '/'))
+  {
+    char c = slash[1];
+    slash[1] = '\0';
+    bool found = hashmap_contains(removed, prefix);
+    slash[1] = c;
+    if(found)
+      return true;
+  }
+  return false;
+}
+
+
+int rm(char *tar_name, char *filename, char *options)
+{
+  char new_filename[PATH_MAX];
+
+  if(rm_check(tar_name, filename, new_filename) != EXIT_SUCCESS)
+    return EXIT_FAILURE;
+
   return (strchr(options, 'r'))? rm_r(tar_name, new_filename) : rm_(tar_name, new_filename);
 }
+
+
+int rm_batch(char *tar_name, char **filenames, int nb_files, char *options)
+{
+  char **to_remove = malloc(nb_files * sizeof(char *));
+  assert(to_remove);
+  hashmap *removed = hashmap_create();
+  int nb_to_remove = 0, ret = EXIT_SUCCESS;
+  bool whole_tar = false;
+
+  //the checks are done first, the tar is then rewritten once for all the files
+  for(int i = 0; i < nb_files; i++)
+  {
+    char new_filename[PATH_MAX];
+
+    if(rm_check(tar_name, filenames[i], new_filename) != EXIT_SUCCESS)
+    {
+      ret = EXIT_FAILURE;
+      continue;
+    }
+    if(whole_tar || already_removed(removed, new_filename))
+    {
+      errno = ENOENT;
+      tar_error_cmd (cmd_name_remove, tar_name, filenames[i]);
+      ret = EXIT_FAILURE;
+      continue;
+    }
+    if(!strchr(options, 'r') && (is_dir_name(new_filename) || is_empty_string(new_filename)))
+    {
+      errno = EISDIR;
+      tar_error_cmd (cmd_name_remove, tar_name, new_filename);
+      ret = EXIT_FAILURE;
+      continue;
+    }
+
+    //the tar itself is removed at the end
+    if(is_empty_string(new_filename))
+      whole_tar = true;
+    else
+    {
+      to_remove[nb_to_remove] = copy_string(new_filename);
+      hashmap_put(removed, to_remove[nb_to_remove++], NULL);
+    }
+  }
+
+  if(nb_to_remove > 0 && tar_rm_files(tar_name, to_remove, nb_to_remove) == -1)
+  {
+    errno = EINTR;
+    for(int i = 0; i < nb_to_remove; i++)
+      tar_error_cmd (cmd_name_remove, tar_name, to_remove[i]);
+    ret = EXIT_FAILURE;
+  }
+
+  for(int i = 0; i < nb_to_remove; i++)
+    free(to_remove[i]);
+  free(to_remove);
+  hashmap_free(removed, false);
+
+  if(whole_tar)
+  {
+    char empty[1] = "";
+    return rm_r(tar_name, empty) == EXIT_SUCCESS ? ret : EXIT_FAILURE;
+  }
+
+  return ret;
+}
@@ -0,0 +1,132 @@
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "script.h"
+#include "tokens.h"
+#include "tsh.h"
+
+
+
+void script_reader_init(script_reader *reader, int fd, bool shared)
+{
+  struct stat st;
+
+  reader->fd = fd;
+  reader->shared = shared;
+  reader->seekable = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+  reader->start = 0;
+  reader->end = 0;
+}
+
+
+char *script_next_line(script_reader *reader)
+{
+  char *line = NULL;
+  size_t len = 0, size = 0;
+  bool eol = false;
+
+  while (!eol)
+  {
+    if (reader->start == reader->end)
+    {
+      // sans retour en arrière possible, rien n'est lu après la ligne
+      size_t count = reader->shared && !reader->seekable ? 1 : SCRIPT_BUFFER_SIZE;
+      ssize_t n;
+
+      while ((n = read(reader->fd, reader->buf, count)) < 0 && errno == EINTR);
+      if (n <= 0)
+      {
+        if (!line)
+          return NULL;
+        break;
+      }
+      reader->start = 0;
+      reader->end = n;
+    }
+
+    char *from = reader->buf + reader->start;
+    char *nl = memchr(from, '\n', reader->end - reader->start);
+    size_t count = nl ? (size_t) (nl - from) : reader->end - reader->start;
+
+    if (len + count + 1 > size)
+    {
+      size = 2 * size > len + count + 1 ? 2 * size : len + count + 1;
+      line = realloc(line, size);
+      assert(line);
+    }
+    memcpy(line + len, from, count);
+    len += count;
+    line[len] = '\0';
+
+    reader->start += count;
+    if (nl)
+    {
+      reader->start++;
+      eol = true;
+    }
+  }
+
+  // ce qui suit la ligne est rendu aux commandes qui lisent le même fichier
+  if (reader->shared && reader->seekable && reader->start < reader->end)
+  {
+    lseek(reader->fd, -(off_t) (reader->end - reader->start), SEEK_CUR);
+    reader->start = reader->end;
+  }
+
+  return line;
+}
+
+
+/* Execute LINE, unless it is empty or a comment ; LINE is freed */
+static void exec_script_line(char *line, int *ret)
+{
+  const char *s = line;
+
+  while (isspace(*s))
+    s++;
+
+  if (*s == '\0' || *s == '#')
+  {
+    free(line);
+    return;
+  }
+
+  *ret = exec_line(line);
+  set_ret_value(*ret);
+}
+
+
+int exec_script(script_reader *reader)
+{
+  int ret = EXIT_SUCCESS;
+  char *line;
+
+  while ((line = script_next_line(reader)))
+    exec_script_line(line, &ret);
+
+  return ret;
+}
+
+
+int exec_lines(const char *lines)
+{
+  int ret = EXIT_SUCCESS;
+
+  for (const char *start = lines; *start; )
+  {
+    const char *nl = strchr(start, '\n');
+    size_t len = nl ? (size_t) (nl - start) : strlen(start);
+    char *line = strndup(start, len);
+
+    assert(line);
+    exec_script_line(line, &ret);
+    start += nl ? len + 1 : len;
+  }
+
+  return ret;
+}
@@ -1,4 +1,6 @@
+#include <assert.h>
 #include <errno.h>
+#include <stdbool.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
@@ -9,6 +11,8 @@
 #include <time.h>
 #include <stdlib.h>
 
+#include "archive.h"
+#include "catalog.h"
 #include "tar.h"
 #include "path_lib.h"
 #include "errors.h"
@@ -22,7 +26,7 @@ void set_checksum(struct posix_header *hd)
 {
   memset(hd->chksum, ' ', 8);
   unsigned int sum = 0;
-  char *p = (char *)hd;
+  unsigned char *p = (unsigned char *)hd;
   for (int i = 0; i < BLOCKSIZE; i++) {
     sum += p[i];
   }
@@ -33,139 +37,892 @@ void set_checksum(struct posix_header *hd)
 int check_checksum(struct posix_header *hd) {
   unsigned int checksum = 0;
   sscanf(hd->chksum, "%o ", &checksum);
-  unsigned int sum = 0;
-  char *p = (char *)hd;
+  // d'anciennes archives ont été écrites avec une somme d'octets signés (base 256, noms non ASCII...)
+  unsigned int sum = 0, signed_sum = 0;
+  unsigned char *p = (unsigned char *)hd, *c = (unsigned char *)hd->chksum;
   for (int i = 0; i < BLOCKSIZE; i++) {
     sum += p[i];
+    signed_sum += (signed char) p[i];
   }
   for (int i = 0; i < 8; i++) {
-    sum += ' ' - hd->chksum[i];
+    sum += ' ' - c[i];
+    signed_sum += ' ' - (signed char) c[i];
   }
-  return (checksum == sum);
+  return (checksum == sum || checksum == signed_sum);
+}
+
+
+/* Old GNU format : the map of a sparse file is in the header, and in extension blocks if needed */
+#define OLDGNU_SPARSE_OFFSET     386 // 4 entries
+#define OLDGNU_ISEXTENDED_OFFSET 482
+#define OLDGNU_REALSIZE_OFFSET   483
+#define OLDGNU_HEADER_ENTRIES    4
+#define OLDGNU_EXT_ENTRIES       21  // isextended at the offset 504 of an extension block
+#define OLDGNU_ENTRY_SIZE        24  // offset[12] and numbytes[12]
+
+
+/* Read a number written in octal or in base 256 in the field FIELD of size LEN */
+static off_t parse_number(const char *field, size_t len)
+{
+  const unsigned char *digits = (const unsigned char *) field;
+  off_t number = 0;
+  size_t i = 0;
+
+  // en base 256, le bit de poids fort du premier octet est à 1
+  if (digits[0] & 0x80)
+    {
+      number = digits[0] & 0x3f;
+      for (i = 1; i < len; i++)
+	number = (number << 8) | digits[i];
+      return number;
+    }
+
+  while (i < len && digits[i] == ' ')
+    i++;
+  for (; i < len && digits[i] >= '0' && digits[i] <= '7'; i++)
+    number = (number << 3) | (digits[i] - '0');
+
+  return number;
+}
+
+
+/* Add the entries of an old GNU sparse map to MAP, returns false at the first empty entry */
+static bool add_gnu_sparse_entries(struct sparse_map **map, const char *entries, int nb)
+{
+  for (int i = 0; i < nb; i++, entries += OLDGNU_ENTRY_SIZE)
+    {
+      if (entries[0] == '\0')
+	return false;
+      *map = sparse_map_add(*map, parse_number(entries, 12), parse_number(entries + 12, 12));
+    }
+
+  return true;
+}
+
+
+/* Read the map of the sparse file of header HD (old GNU format), the file offset is moved after the extension blocks */
+static int read_gnu_sparse(int tar_fd, const struct posix_header *hd, struct sparse_map **map)
+{
+  const char *block = (const char *) hd;
+  char ext_block[BLOCKSIZE];
+  bool extended = block[OLDGNU_ISEXTENDED_OFFSET];
+
+  add_gnu_sparse_entries(map, block + OLDGNU_SPARSE_OFFSET, OLDGNU_HEADER_ENTRIES);
+
+  while (extended)
+    {
+      ssize_t size_read = archive_read(tar_fd, ext_block, BLOCKSIZE);
+      if (size_read != BLOCKSIZE)
+	{
+	  if (size_read >= 0)
+	    errno = EIO;
+	  return -1;
+	}
+      add_gnu_sparse_entries(map, ext_block, OLDGNU_EXT_ENTRIES);
+      extended = ext_block[OLDGNU_EXT_ENTRIES * OLDGNU_ENTRY_SIZE];
+    }
+
+  // un fichier entièrement creux n'a aucune entrée
+  if (!*map)
+    *map = sparse_map_add(NULL, 0, 0);
+  (*map)->real_size = parse_number(block + OLDGNU_REALSIZE_OFFSET, 12);
+
+  return 0;
+}
+
+
+/* Read the map stored at offset START in the tar, at the beginning of the content of a sparse file (PAX format 1.0).
+   The file offset is not moved. */
+static int read_sparse_map(int tar_fd, off_t start, struct sparse_map **map)
+{
+  char block[BLOCKSIZE];
+  long long nb_numbers = -1, read_numbers = 0;
+  off_t number = 0, extent_offset = 0, pos = start;
+
+  // "<nombre d'extents>\n" puis "<offset>\n<taille>\n" pour chaque extent, un nombre peut être à cheval sur deux blocs
+  while (nb_numbers < 0 || read_numbers < nb_numbers)
+    {
+      ssize_t size_read = archive_pread(tar_fd, block, BLOCKSIZE, pos);
+      if (size_read != BLOCKSIZE)
+	goto error;
+      pos += BLOCKSIZE;
+
+      for (int i = 0; i < BLOCKSIZE && (nb_numbers < 0 || read_numbers < nb_numbers); i++)
+	{
+	  if (block[i] >= '0' && block[i] <= '9')
+	    {
+	      number = number * 10 + block[i] - '0';
+	      continue;
+	    }
+	  if (block[i] != '\n')
+	    goto error;
+
+	  if (nb_numbers < 0)
+	    nb_numbers = 2 * number;
+	  else if (read_numbers++ % 2 == 0)
+	    extent_offset = number;
+	  else
+	    *map = sparse_map_add(*map, extent_offset, number);
+	  number = 0;
+	}
+    }
+
+  if (!*map)
+    *map = sparse_map_add(NULL, 0, 0);
+  (*map)->map_size = pos - start;
+
+  return 0;
+
+ error:
+  errno = EIO;
+  return -1;
 }
 
 
 int is_tar(const char *path)
 {
+  // les archives d'un union ne sont ouvertes qu'avec lui, pas à chaque chemin
+  if (archive_is_union(path))
+  {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) ? 1 : -1;
+  }
+
   int len = strlen(path);
-  if (len < 4)
-    return -1;
-  if (path[len-4] != '.' || path[len-3] != 't' || path[len-2] != 'a' || path[len-1] != 'r')
+  bool compressed = archive_is_gzip(path);
+  if (!compressed && (len < 4 || strcmp(path + len - 4, ".tar")))
     return -1;
 
-  int tar_fd = open(path, O_RDONLY);
+  // une archive dont le catalogue est en cache, ou sauvegardé par un autre processus, a déjà été lue en entier
+  if (catalog_cached(path) || catalog_saved(path))
+    return 1;
+
+  int tar_fd = archive_open(path, O_RDONLY);
   if (tar_fd < 0)
     return -1;
-  if (lseek(tar_fd, 0, SEEK_END) % BLOCKSIZE != 0)
+  off_t size = archive_lseek(tar_fd, 0, SEEK_END);
+  if (size % BLOCKSIZE != 0)
   {
+    archive_close(tar_fd);
     return -1;
   }
-  lseek(tar_fd, 0, SEEK_SET);
+  archive_lseek(tar_fd, 0, SEEK_SET);
   struct posix_header file_header;
   int fail = 0, read_size;
 
+  // une grande archive est vérifiée par plusieurs threads, et son catalogue sert ensuite à la résolution des chemins
+  if (!compressed && size >= TAR_SCAN_MIN_SIZE)
+  {
+    read_size = archive_read(tar_fd, &file_header, BLOCKSIZE);
+    archive_close(tar_fd);
+    if (read_size != BLOCKSIZE || (file_header.name[0] != '\0' && !check_checksum(&file_header)))
+      return 0;
+    const tar_catalog *catalog = catalog_get(path);
+    catalog_release(catalog);
+    return catalog ? 1 : 0;
+  }
+
   while( !fail )
     {
-    if((read_size=read(tar_fd, &file_header, BLOCKSIZE)) < 0)
+    if((read_size=archive_read(tar_fd, &file_header, BLOCKSIZE)) < 0)
     {
-      close(tar_fd);
+      archive_close(tar_fd);
       return -1;
     }
 
+    // une archive compressée vide peut être remplie par tsh
+    if (read_size == 0 && compressed)
+      break;
     if( read_size != BLOCKSIZE )
       fail = 1;
     else if (file_header.name[0] == '\0')
       break;
     else if( !check_checksum(&file_header) )
       fail = 1;
+    // le flux gzip est vérifié par son index : on ne décompresse pas toute l'archive à chaque chemin
+    else if (compressed)
+      break;
     else
+    {
+      if (file_header.typeflag == GNUTYPE_SPARSE)
+      {
+        // les blocs d'extension de la carte précèdent le contenu
+        struct sparse_map *map = NULL;
+        if (read_gnu_sparse(tar_fd, &file_header, &map) < 0)
+          fail = 1;
+        free(map);
+      }
       skip_file_content(tar_fd, &file_header);
+    }
   }
 
-  close(tar_fd);
+  archive_close(tar_fd);
   return !fail;
 }
 
 
-int seek_header(int tar_fd, const char *filename, struct posix_header *header)
+/* Names, size and sparse map given by the extended headers of a member */
+struct ext_info
+{
+  off_t size;                // -1 si absente
+  char *name;                // NULL si absent
+  char *linkname;            // NULL si absent
+
+  char *sparse_name;         // GNU.sparse.name, prioritaire sur name
+  long sparse_major;         // version du format des fichiers creux, -1 si ce n'en est pas un
+  off_t real_size;           // taille du fichier creux, trous compris
+  off_t sparse_offset;       // format 0.0 : offset de l'extent en cours
+  struct sparse_map *sparse; // formats 0.0 et 0.1 : la carte est dans l'en-tête étendu
+};
+
+
+static void free_ext_info(struct ext_info *ext)
+{
+  free(ext->name);
+  free(ext->linkname);
+  free(ext->sparse_name);
+  free(ext->sparse);
+}
+
+
+/* Read the content of the extended header HD, the file offset is moved to the next header */
+static char *read_ext_data(int tar_fd, const struct posix_header *hd)
 {
+  off_t data_size = get_file_size(hd);
+  char *data = malloc(data_size + 1);
+  if (!data)
+    return NULL;
+
+  ssize_t size_read = archive_read(tar_fd, data, data_size);
+  if (size_read != data_size || archive_lseek(tar_fd, number_of_block(data_size) * BLOCKSIZE - data_size, SEEK_CUR) < 0)
+    {
+      free(data);
+      if (size_read >= 0 && size_read != data_size)
+	errno = EIO;
+      return NULL;
+    }
+  data[data_size] = '\0';
+
+  return data;
+}
+
+
+static void replace_string(char **dest, char *str)
+{
+  free(*dest);
+  *dest = str;
+}
+
+
+/* Read the PAX extended header HD of the next member and update EXT */
+static int read_pax_header(int tar_fd, const struct posix_header *hd, struct ext_info *ext)
+{
+  char *data = read_ext_data(tar_fd, hd);
+  if (!data)
+    return -1;
+
+  char *data_end = data + get_file_size(hd);
+
+  // chaque enregistrement est de la forme "<longueur> <clé>=<valeur>\n"
+  for (char *record = data; record < data_end; )
+    {
+      char *key, *value;
+      long len = strtol(record, &key, 10);
+
+      if (len <= 0 || record + len > data_end || *key != ' ')
+	break;
+      key++;
+
+      value = memchr(key, '=', record + len - key);
+      if (!value)
+	break;
+      *value++ = '\0';
+      record[len - 1] = '\0'; // le '\n' final
+
+      if (!strcmp(key, "size"))
+	ext->size = strtoll(value, NULL, 10);
+      else if (!strcmp(key, "path"))
+	replace_string(&ext->name, copy_string(value));
+      else if (!strcmp(key, "linkpath"))
+	replace_string(&ext->linkname, copy_string(value));
+      // fichiers creux (formats 0.0, 0.1 et 1.0 de GNU)
+      else if (!strcmp(key, "GNU.sparse.name"))
+	replace_string(&ext->sparse_name, copy_string(value));
+      else if (!strcmp(key, "GNU.sparse.major"))
+	ext->sparse_major = strtol(value, NULL, 10);
+      else if (!strcmp(key, "GNU.sparse.realsize") || !strcmp(key, "GNU.sparse.size"))
+	{
+	  ext->real_size = strtoll(value, NULL, 10);
+	  if (ext->sparse_major < 0)
+	    ext->sparse_major = 0;
+	}
+      else if (!strcmp(key, "GNU.sparse.offset"))
+	ext->sparse_offset = strtoll(value, NULL, 10);
+      else if (!strcmp(key, "GNU.sparse.numbytes"))
+	ext->sparse = sparse_map_add(ext->sparse, ext->sparse_offset, strtoll(value, NULL, 10));
+      else if (!strcmp(key, "GNU.sparse.map"))
+	{
+	  // "offset,taille,offset,taille..."
+	  char *end = value;
+	  while (*end)
+	    {
+	      off_t offset = strtoll(end, &end, 10);
+	      if (*end++ != ',')
+		break;
+	      ext->sparse = sparse_map_add(ext->sparse, offset, strtoll(end, &end, 10));
+	      if (*end == ',')
+		end++;
+	    }
+	}
+
+      record += len;
+    }
+
+  free(data);
+  return 0;
+}
+
+
+/* Return the malloc'd name given by a header, joined to the ustar prefix if any */
+static char *header_name(const struct posix_header *hd)
+{
+  size_t name_len = strnlen(hd->name, sizeof(hd->name)), prefix_len = 0;
+
+  // le champ prefix n'existe pas dans l'ancien format de GNU
+  if (!memcmp(hd->magic, TMAGIC, TMAGLEN))
+    prefix_len = strnlen(hd->prefix, sizeof(hd->prefix));
+
+  char *name = malloc(prefix_len + name_len + 2);
+  assert(name);
+
+  if (prefix_len > 0)
+    {
+      memcpy(name, hd->prefix, prefix_len);
+      name[prefix_len++] = '/';
+    }
+  memcpy(name + prefix_len, hd->name, name_len);
+  name[prefix_len + name_len] = '\0';
+
+  return name;
+}
+
+
+int read_member(int tar_fd, tar_file *tf)
+{
+  struct ext_info ext = { -1, NULL, NULL, NULL, -1, -1, 0, NULL };
+  ssize_t size_read;
+  char *data;
+
+  tf->tar_fd = tar_fd;
+  tf->ext_start = archive_lseek(tar_fd, 0, SEEK_CUR);
+
   while (1)
+    {
+      size_read = archive_read(tar_fd, &tf->header, BLOCKSIZE);
+      if (size_read < 0)
+	goto error;
+      if (size_read == 0 || tf->header.name[0] == '\0')
+	{
+	  free_ext_info(&ext);
+	  return 0;
+	}
+      if (size_read != BLOCKSIZE)
+	{
+	  errno = EIO;
+	  goto error;
+	}
+
+      switch (tf->header.typeflag)
+	{
+	case XHDTYPE:
+	  if (read_pax_header(tar_fd, &tf->header, &ext) < 0)
+	    goto error;
+	  break;
+
+	case GNUTYPE_LONGNAME:
+	case GNUTYPE_LONGLINK:
+	  if (!(data = read_ext_data(tar_fd, &tf->header)))
+	    goto error;
+	  replace_string(tf->header.typeflag == GNUTYPE_LONGNAME ? &ext.name : &ext.linkname, data);
+	  break;
+
+	case XGLTYPE:
+	  skip_file_content(tar_fd, &tf->header);
+	  break;
+
+	default:
+	  if (ext.size >= 0)
+	    set_file_size(&tf->header, ext.size);
+
+	  tf->file_start = archive_lseek(tar_fd, 0, SEEK_CUR) - BLOCKSIZE;
+
+	  // un fichier creux est un fichier régulier dont seuls les extents de données sont stockés
+	  if (tf->header.typeflag == GNUTYPE_SPARSE)
+	    {
+	      if (read_gnu_sparse(tar_fd, &tf->header, &ext.sparse) < 0)
+		goto error;
+	      tf->header.typeflag = REGTYPE;
+	    }
+	  else if (ext.sparse_major == 1 && read_sparse_map(tar_fd, tf->file_start + BLOCKSIZE, &ext.sparse) < 0)
+	    goto error;
+	  else if (ext.sparse_major == 0 && !ext.sparse)
+	    ext.sparse = sparse_map_add(NULL, 0, 0);
+
+	  if (ext.sparse && ext.sparse_major >= 0 && ext.real_size >= 0)
+	    ext.sparse->real_size = ext.real_size;
+
+	  tf->data_start = archive_lseek(tar_fd, 0, SEEK_CUR);
+	  tf->sparse = ext.sparse;
+	  if (ext.sparse_name)
+	    replace_string(&ext.name, ext.sparse_name);
+	  tf->name = ext.name ? ext.name : header_name(&tf->header);
+	  tf->linkname = ext.linkname ? ext.linkname : strndup(tf->header.linkname, sizeof(tf->header.linkname));
+	  assert(tf->linkname);
+
+	  // les noms de dossiers finissent toujours par un '/'
+	  if (tf->header.typeflag == DIRTYPE && !is_dir_name(tf->name))
+	    {
+	      char *dir_name = append_slash(tf->name);
+	      replace_string(&tf->name, dir_name);
+	    }
+	  return 1;
+	}
+    }
+
+ error:
+  free_ext_info(&ext);
+  return -1;
+}
+
+
+void free_tar_file(tar_file *tf)
+{
+  free(tf->name);
+  free(tf->linkname);
+  free(tf->sparse);
+  tf->name = NULL;
+  tf->linkname = NULL;
+  tf->sparse = NULL;
+}
+
+
+off_t tar_file_size(const tar_file *tf)
+{
+  return tf->sparse ? tf->sparse->real_size : get_file_size(&tf->header);
+}
+
+
+struct sparse_map *sparse_map_add(struct sparse_map *map, off_t offset, off_t size)
+{
+  size_t nb = map ? map->nb_extents : 0;
+
+  // la capacité double à chaque puissance de 2
+  if (!map || (nb & (nb - 1)) == 0)
+    {
+      map = realloc(map, sizeof(struct sparse_map) + (nb ? 2 * nb : 1) * sizeof(struct sparse_extent));
+      assert(map);
+      if (nb == 0)
+	{
+	  map->real_size = 0;
+	  map->map_size = 0;
+	  map->nb_extents = 0;
+	}
+    }
+
+  map->extents[nb].offset = offset;
+  map->extents[nb].size = size;
+  map->nb_extents++;
+  if (offset + size > map->real_size)
+    map->real_size = offset + size;
+
+  return map;
+}
+
+
+int read_header(int tar_fd, struct posix_header *header, off_t *member_start)
+{
+  tar_file tf;
+  int r = read_member(tar_fd, &tf);
+
+  *header = tf.header;
+  if (member_start)
+    *member_start = tf.ext_start;
+  if (r == 1)
+    free_tar_file(&tf);
+
+  return r;
+}
+
+
+void tar_iter_open(tar_iter *it, int tar_fd)
+{
+  *it = (tar_iter) { .tar_fd = tar_fd, .next = archive_lseek(tar_fd, 0, SEEK_CUR) };
+}
+
+
+int tar_iter_next(tar_iter *it, tar_file **tf)
+{
+  int r;
+
+  free_tar_file(&it->member);
+  if (it->next < 0 || archive_lseek(it->tar_fd, it->next, SEEK_SET) < 0)
+    return -1;
+
+  if ((r = read_member(it->tar_fd, &it->member)) != 1)
+  {
+    // read_member ne remplit pas le membre à la fin du tar
+    it->member = (tar_file) { .tar_fd = it->tar_fd };
+    return r;
+  }
+
+  it->next = it->member.data_start + number_of_block(get_file_size(&it->member.header)) * BLOCKSIZE;
+  *tf = &it->member;
+  return 1;
+}
+
+
+void tar_iter_keep(tar_iter *it)
+{
+  it->member.name = NULL;
+  it->member.linkname = NULL;
+  it->member.sparse = NULL;
+}
+
+
+void tar_iter_close(tar_iter *it)
+{
+  free_tar_file(&it->member);
+}
+
+
+int seek_member(int tar_fd, const char *filename, tar_file *tf)
+{
+  tar_iter it;
+  tar_file *member;
+  int r;
+
+  tar_iter_open(&it, tar_fd);
+  while ((r = tar_iter_next(&it, &member)) == 1)
   {
-    if( read(tar_fd, header, BLOCKSIZE) < 0)
+    if (strcmp(filename, member->name) == 0)
     {
-      return -1;
+      *tf = *member;
+      tar_iter_keep(&it);
+      break;
+    }
+  }
+  tar_iter_close(&it);
+
+  return r;
+}
+
+
+int seek_header(int tar_fd, const char *filename, struct posix_header *header)
+{
+  tar_file tf;
+  int r = seek_member(tar_fd, filename, &tf);
+
+  *header = tf.header;
+  if (r == 1)
+    free_tar_file(&tf);
+
+  return r;
+}
+
+
+/* Length of the PAX record "<length> KEY=VALUE\n", its own length included */
+static size_t pax_record_len(const char *key, const char *value)
+{
+  size_t len = strlen(key) + strlen(value) + 3; // ' ', '=' et '\n'
+  size_t total = len + 1;
+
+  // la longueur affichée compte ses propres chiffres
+  for (size_t prev = 0; prev != total; )
+    {
+      char digits[24];
+      prev = total;
+      total = len + sprintf(digits, "%zu", prev);
+    }
+
+  return total;
+}
+
+
+/* Build in *EXT the PAX extended header of HD holding the NB records KEYS[i]=VALUES[i] */
+static ssize_t build_pax_header(const struct posix_header *hd, const char *keys[], const char *values[], int nb, char **ext)
+{
+  struct posix_header ext_hd;
+  size_t records_len = 0;
+  char *records;
+
+  for (int i = 0; i < nb; i++)
+    records_len += pax_record_len(keys[i], values[i]);
+
+  // l'en-tête étendu reprend les champs de l'en-tête du membre
+  ext_hd = *hd;
+  memset(ext_hd.name, '\0', sizeof(ext_hd.name));
+  strcpy(ext_hd.name, "././@PaxHeader");
+  memset(ext_hd.linkname, '\0', sizeof(ext_hd.linkname));
+  ext_hd.typeflag = XHDTYPE;
+  set_file_size(&ext_hd, records_len);
+  set_checksum(&ext_hd);
+
+  size_t ext_size = BLOCKSIZE + number_of_block(records_len) * BLOCKSIZE;
+  *ext = calloc(1, ext_size + 1);
+  if (!*ext)
+    return -1;
+
+  memcpy(*ext, &ext_hd, BLOCKSIZE);
+  records = *ext + BLOCKSIZE;
+  for (int i = 0; i < nb; i++)
+    records += sprintf(records, "%zu %s=%s\n", pax_record_len(keys[i], values[i]), keys[i], values[i]);
+
+  return ext_size;
+}
+
+
+/* Copy NAME in the field FIELD of size LEN, truncated if needed */
+static void set_name_field(char *field, size_t len, const char *name)
+{
+  size_t name_len = name ? strlen(name) : 0;
+
+  memset(field, '\0', len);
+  if (name)
+    memcpy(field, name, name_len < len ? name_len : len - 1);
+}
+
+
+ssize_t set_header_names(struct posix_header *hd, const char *name, const char *linkname, char **ext)
+{
+  const char *keys[2], *values[2];
+  int nb = 0;
+
+  *ext = NULL;
+
+  // les noms sont tronqués dans l'en-tête, pour les lecteurs ne connaissant pas PAX
+  set_name_field(hd->name, sizeof(hd->name), name);
+  set_name_field(hd->linkname, sizeof(hd->linkname), linkname);
+  set_checksum(hd);
+
+  if (strlen(name) >= sizeof(hd->name))
+    {
+      keys[nb] = "path";
+      values[nb++] = name;
+    }
+  if (linkname && strlen(linkname) >= sizeof(hd->linkname))
+    {
+      keys[nb] = "linkpath";
+      values[nb++] = linkname;
+    }
+
+  return nb > 0 ? build_pax_header(hd, keys, values, nb, ext) : 0;
+}
+
+
+ssize_t set_sparse_header(struct posix_header *hd, const char *name, struct sparse_map *sparse, char **ext, char **map)
+{
+  char placeholder[PATH_MAX], real_size[24];
+  const char *last_slash = strrchr(name, '/');
+  off_t stored_size = 0;
+  char *p;
+
+  *ext = NULL;
+
+  // la carte : "<nombre d'extents>\n" puis "<offset>\n<taille>\n" pour chaque extent (au plus 20 caractères par nombre)
+  for (size_t i = 0; i < sparse->nb_extents; i++)
+    stored_size += sparse->extents[i].size;
+  *map = calloc(1, number_of_block(20 * (1 + 2 * sparse->nb_extents)) * BLOCKSIZE + 1);
+  if (!*map)
+    return -1;
+  p = *map + sprintf(*map, "%zu\n", sparse->nb_extents);
+  for (size_t i = 0; i < sparse->nb_extents; i++)
+    p += sprintf(p, "%lld\n%lld\n", (long long) sparse->extents[i].offset, (long long) sparse->extents[i].size);
+  sparse->map_size = number_of_block(p - *map) * BLOCKSIZE;
+
+  // comme GNU tar, un nom de remplacement pour les lecteurs ne connaissant pas ce format
+  if (last_slash)
+    snprintf(placeholder, PATH_MAX, "%.*s/GNUSparseFile.0/%s", (int) (last_slash - name), name, last_slash + 1);
+  else
+    snprintf(placeholder, PATH_MAX, "GNUSparseFile.0/%s", name);
+  set_name_field(hd->name, sizeof(hd->name), placeholder);
+  set_name_field(hd->linkname, sizeof(hd->linkname), NULL);
+  hd->typeflag = REGTYPE;
+  set_file_size(hd, sparse->map_size + stored_size);
+  set_checksum(hd);
+
+  snprintf(real_size, sizeof(real_size), "%lld", (long long) sparse->real_size);
+  const char *keys[] = { "GNU.sparse.major", "GNU.sparse.minor", "GNU.sparse.name", "GNU.sparse.realsize" };
+  const char *values[] = { "1", "0", name, real_size };
+
+  ssize_t ext_size = build_pax_header(hd, keys, values, 4, ext);
+  if (ext_size < 0)
+    {
+      free(*map);
+      *map = NULL;
     }
-    else if (header->name[0] == '\0')
+
+  return ext_size;
+}
+
+
+/* Move the end of the content written in FD of SIZE bytes, *WRITTEN bytes were written from offset BASE */
+static int write_hole(int fd, bool seekable, off_t base, off_t *written, off_t size)
+{
+  static const char zeros[BLOCKSIZE];
+
+  // pas de trou dans un tube ou un terminal : les zéros sont écrits
+  if (!seekable)
     {
+      for (off_t done = 0; done < size; )
+	{
+	  ssize_t r = write(fd, zeros, size - done < BLOCKSIZE ? size - done : BLOCKSIZE);
+	  if (r < 0)
+	    return -1;
+	  done += r;
+	}
+      *written += size;
       return 0;
     }
-    else if (strcmp(filename, header->name) == 0)
+
+  *written += size;
+  struct stat st;
+  if (fstat(fd, &st) < 0)
+    return -1;
+  // ftruncate agrandit le fichier sans allouer de blocs, même si fd est ouvert avec O_APPEND
+  if (st.st_size < base + *written && ftruncate(fd, base + *written) < 0)
+    return -1;
+
+  return lseek(fd, base + *written, SEEK_SET) < 0 ? -1 : 0;
+}
+
+
+/* Write SIZE bytes of the content of TAR_FD, from its file offset, to FD : straight from the mapping of the archive if it is mapped */
+static int copy_content(int tar_fd, int fd, off_t size)
+{
+  off_t offset = archive_lseek(tar_fd, 0, SEEK_CUR);
+  const char *data = offset < 0 ? NULL : archive_view(tar_fd, offset, size);
+  ssize_t w;
+
+  if (!data)
+    return read_write_buf_by_buf(tar_fd, fd, size, BLOCKSIZE);
+
+  for (off_t done = 0; done < size; done += w)
     {
-      return 1;
+      if ((w = write(fd, data + done, size - done)) < 0)
+	{
+	  // write ne lit pas la partie d'une archive raccourcie depuis sa projection
+	  if (errno == EFAULT)
+	    errno = EIO;
+	  if (errno != EINTR)
+	    return -1;
+	  w = 0;
+	}
     }
-    else
+
+  return archive_lseek(tar_fd, offset + size, SEEK_SET) < 0 ? -1 : 0;
+}
+
+
+int write_member_content(const tar_file *tf, int fd)
+{
+  const struct sparse_map *sparse = tf->sparse;
+
+  if (!sparse)
     {
-      skip_file_content(tar_fd, header);
+      if (archive_lseek(tf->tar_fd, tf->data_start, SEEK_SET) < 0)
+	return -1;
+      return copy_content(tf->tar_fd, fd, get_file_size(&tf->header));
     }
-  }
-  return -1;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0)
+    return -1;
+  bool seekable = S_ISREG(st.st_mode);
+  off_t base = (fcntl(fd, F_GETFL) & O_APPEND) ? st.st_size : lseek(fd, 0, SEEK_CUR);
+  off_t written = 0;
+
+  if (archive_lseek(tf->tar_fd, tf->data_start + sparse->map_size, SEEK_SET) < 0)
+    return -1;
+
+  // les données des extents sont stockées à la suite
+  for (size_t i = 0; i < sparse->nb_extents; i++)
+    {
+      const struct sparse_extent *extent = sparse->extents + i;
+
+      if (extent->offset > written && write_hole(fd, seekable, base, &written, extent->offset - written) < 0)
+	return -1;
+      if (copy_content(tf->tar_fd, fd, extent->size) < 0)
+	return -1;
+      written += extent->size;
+    }
+
+  if (sparse->real_size > written)
+    return write_hole(fd, seekable, base, &written, sparse->real_size - written);
+
+  return 0;
 }
 
 
 /* Convert FILESIZE into a number of blocks */
-unsigned int number_of_block(unsigned int filesize)
+off_t number_of_block(off_t filesize)
 {
   return (filesize + BLOCKSIZE - 1) >> BLOCKBITS;
 }
 
 
 /* Return the file size from a given header */
-unsigned int get_file_size(const struct posix_header *hd)
+off_t get_file_size(const struct posix_header *hd)
 {
-  unsigned int file_size = 0;
-  sscanf(hd->size, "%o", &file_size);
-  return file_size;
+  return parse_number(hd->size, sizeof(hd->size));
+}
+
+
+void set_file_size(struct posix_header *hd, off_t size)
+{
+  if (size <= MAX_OCTAL_SIZE)
+    {
+      snprintf(hd->size, sizeof(hd->size), "%011llo", (unsigned long long) size);
+      return;
+    }
+
+  for (int i = sizeof(hd->size) - 1; i > 0; i--, size >>= 8)
+    hd->size[i] = size & 0xff;
+  hd->size[0] = 0x80;
 }
 
 
 /* Increment the file offset of TAR_FD by file size given in HD */
-int skip_file_content(int tar_fd, struct posix_header *hd)
+off_t skip_file_content(int tar_fd, struct posix_header *hd)
 {
-  size_t file_size = get_file_size(hd);
-  return lseek(tar_fd, number_of_block(file_size) * BLOCKSIZE, SEEK_CUR);
+  off_t file_size = get_file_size(hd);
+  return archive_lseek(tar_fd, number_of_block(file_size) * BLOCKSIZE, SEEK_CUR);
 }
 
 /* Count the number of file in the tar referenced by TAR_FD */
 int nb_files_in_tar(int tar_fd)
 {
-  ssize_t size_read;
-  int nb = 0;
-  struct posix_header header;
+  int nb = 0, r;
+  tar_iter it;
+  tar_file *tf;
 
-  while ((size_read = read(tar_fd, &header, BLOCKSIZE)) > 0 )
-    {
-      if(size_read != BLOCKSIZE)
-	return -1;
-      if(header.name[0] == '\0')
-	break;
-      else
-	nb++;
+  tar_iter_open(&it, tar_fd);
+  while ((r = tar_iter_next(&it, &tf)) == 1)
+    nb++;
+  tar_iter_close(&it);
 
-      skip_file_content(tar_fd, &header);
-    }
+  if (r < 0)
+    return -1;
 
-  lseek(tar_fd, 0, SEEK_SET);
+  archive_lseek(tar_fd, 0, SEEK_SET);
   return nb;
 }
 
 int nb_files_in_tar_c(char *tar_name){
-  int tar_fd = open(tar_name, O_RDONLY);
-  if (tar_fd < 0){
-    close(tar_fd);
+  int tar_fd = archive_open(tar_name, O_RDONLY);
+  if (tar_fd < 0)
     return -1;
-  }
   int nb = nb_files_in_tar(tar_fd);
-  close(tar_fd);
+  archive_close(tar_fd);
   return nb;
 }
 
@@ -178,14 +935,19 @@ void set_hd_time(struct posix_header *hd) {
 int update_header(struct posix_header *hd, int tar_fd, char *filename, void (*update)(struct posix_header *hd))
 {
 
+  tar_file tf;
+
   if (lseek(tar_fd, 0, SEEK_SET) != 0)
     return -1;
-  if (seek_header(tar_fd, filename, hd) != 1)
+  if (seek_member(tar_fd, filename, &tf) != 1)
     return -1;
+  free_tar_file(&tf);
+  *hd = tf.header;
   update(hd);
   set_hd_time(hd);
   set_checksum(hd);
-  if (lseek(tar_fd, -BLOCKSIZE, SEEK_CUR) < 0 || write(tar_fd, hd, BLOCKSIZE) < 0)
+  // l'en-tête est réécrit à sa place, le fichier reste au début du contenu
+  if (pwrite(tar_fd, hd, BLOCKSIZE, tf.file_start) < 0 || lseek(tar_fd, tf.data_start, SEEK_SET) < 0)
     return -1;
   return 0;
 }
@@ -1,18 +1,24 @@
 #include "tar.h"
 
+#include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
-#include <grp.h>
 #include <linux/limits.h>
-#include <pwd.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "arena.h"
+#include "archive.h"
 #include "array.h"
+#include "catalog.h"
+#include "credentials.h"
 #include "errors.h"
+#include "hashmap.h"
 #include "utils.h"
 
 static int is_mode_correct(int mode)
@@ -21,144 +27,216 @@ static int is_mode_correct(int mode)
 }
 
 
-/* Get the type of user according to HD,
+/* Get the type of user according to MEMBER,
    Returns:
-   0 if current user is the user in hd
-   1 if current groupe is the same of hd
+   0 if current user is the owner of member
+   1 if current groupe is the same of member
    2 else
 */
-static int type_of_user(struct posix_header hd, struct passwd *pwd, gid_t *groups, int nb_groups)
+static int type_of_user(const tar_member *member, const credentials *creds)
 {
-
-  uid_t uid = strtol(hd.uid, NULL, 8);
-  if (uid == pwd -> pw_uid)
+  if (member -> uid == creds -> uid)
     return 0;
-  gid_t gid =strtol(hd.gid, NULL, 8);
-  for (int i = 0; i < nb_groups; i++)
-    {
-      if (gid == groups[i])
-	return 1;
-    }
-  /* Test current gid because: it is unspecified whether the effective group ID
-     of the calling process is included in the returned list (getgroups man page)*/
-  if (pwd -> pw_gid == groups[1])
+  /* in_group tests the current gid too because: it is unspecified whether the effective group ID
+     of the calling process is included in the list of getgroups (getgroups man page)*/
+  if (in_group(creds, member -> gid))
     return 1;
   return 2;
 }
-/* Returns 0 if current user has the rights that are in MODE in the header HD */
-static int has_rights(struct posix_header hd, struct passwd *pwd, int mode)
-{
-  int nb_groups = getgroups(0, NULL);
-  gid_t *groups = malloc(nb_groups * sizeof(gid_t));
-  getgroups(nb_groups, groups);
 
-  int type_u = type_of_user(hd, pwd, groups, nb_groups);
+/* Returns the rights of the current user on MEMBER, as a mask of R_OK, W_OK and X_OK */
+static int effective_rights(const tar_member *member, const credentials *creds)
+{
+  int type_u = type_of_user(member, creds);
   int rights[] =
   {
-    hd.mode[4] - '0',
-    hd.mode[5] - '0',
-    hd.mode[6] - '0'
+    (member -> mode >> 6) & 07,
+    (member -> mode >> 3) & 07,
+    member -> mode & 07
   };
-  free(groups);
-  if ( (mode & R_OK && !(R_OK & rights[type_u]))
-       ||   (mode & W_OK && !(W_OK & rights[type_u]))
-       ||   (mode & X_OK && !(X_OK & rights[type_u])) )
+  return rights[type_u];
+}
+
+
+/* Rights of the current user on a name of the tar */
+struct name_rights
+{
+  struct name_rights *parent; // dossier parent, NULL à la racine du tar
+  unsigned char rights;       // masque de R_OK, W_OK et X_OK
+  bool member;                // membre du tar ; sinon dossier qui n'existe que par son contenu
+  signed char reachable;      // les dossiers parents sont traversables : 1 oui, 0 non, -1 pas encore calculé
+};
+
+/** Effective rights of the current user on all the names of a catalog */
+struct tar_permissions
+{
+  hashmap *names;  // nom -> struct name_rights
+  arena *mem;
+};
+
+static pthread_mutex_t permissions_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* Length of the name of the parent directory of NAME (with its '/'), 0 at the root of the tar */
+static size_t parent_length (const char *name, size_t len)
+{
+  if (len > 0 && name[len - 1] == '/')
+    len--;
+  while (len > 0 && name[len - 1] != '/')
+    len--;
+  return len;
+}
+
+
+static struct name_rights *add_name (struct tar_permissions *perms, const char *name)
+{
+  struct name_rights *nr = arena_alloc(perms -> mem, sizeof(struct name_rights));
+  *nr = (struct name_rights) { NULL, R_OK | W_OK | X_OK, false, -1 };
+  hashmap_put(perms -> names, name, nr);
+  return nr;
+}
+
+
+/* Link NR to its parent directories, they are added if they exist only through their content */
+static void link_parents (struct tar_permissions *perms, struct name_rights *nr, const char *name)
+{
+  size_t len = strlen(name);
+  char dir[len + 1];
+  struct name_rights *parent;
+
+  memcpy(dir, name, len + 1);
+  for (len = parent_length(dir, len); len > 0; len = parent_length(dir, len))
     {
-      errno = EACCES;
-      return -1;
+      dir[len] = '\0';
+      // les parents d'un nom déjà connu sont déjà liés
+      if ((parent = hashmap_get(perms -> names, dir)))
+	{
+	  nr -> parent = parent;
+	  return;
+	}
+
+      nr = nr -> parent = add_name(perms, dir);
     }
-  return 0;
 }
 
-/* Try to access file inside tar without trying to access to parent directory
-   Returns -1 if file is not found or has not the rights in mode
-   1 if file was found and has the rights
-   2 if file is a dir and has beeen found in his subfile
-*/
-static int simple_tar_access(const char *filename, array *headers, struct passwd *pwd, int mode)
+
+static bool is_reachable (struct name_rights *nr)
 {
-  int r;
-  int found = 0;
-  int index = -1;
-  int is_dir = is_dir_name(filename);
-  tar_file *tf = NULL;
+  if (nr -> reachable < 0)
+    nr -> reachable = !nr -> parent || (is_reachable(nr -> parent) && (nr -> parent -> rights & X_OK));
+  return nr -> reachable;
+}
 
-  for (int i = 0; i < array_size(headers); i++)
+
+static void compute_reachable (const char *name, void *val, void *data)
+{
+  is_reachable(val);
+}
+
+
+/* Build the rights of the current user on all the names of CATALOG, the last member of a name gives its rights */
+static struct tar_permissions *build_permissions (const tar_catalog *catalog, const credentials *creds)
+{
+  struct tar_permissions *perms = malloc(sizeof(struct tar_permissions));
+  assert(perms);
+  perms -> names = hashmap_create();
+  perms -> mem = arena_create();
+
+  for (size_t i = 0; i < catalog -> nb_members; i++)
     {
-      tf = array_get(headers, i);
+      const tar_member *member = catalog -> members + i;
+      struct name_rights *nr = hashmap_get(perms -> names, member -> name);
 
-      if (!strcmp(tf->header.name, filename))
-	{
-	  found = 1;
-	  index = i;
-	}
-      else if (is_dir && is_prefix(filename, tf->header.name) && found != 1)
+      if (!nr)
 	{
-	  found = 2;
+	  nr = add_name(perms, member -> name);
+	  link_parents(perms, nr, member -> name);
 	}
 
-      free(tf);
+      nr -> member = true;
+      nr -> rights = effective_rights(member, creds);
     }
 
-  if (!found)
-    {
-      errno = ENOENT;
-      return -1;
-    }
-  else if (mode == F_OK || found == 2)
-    {
-      return found;
-    }
-  // else found == 1
+  // le droit de traverser les dossiers parents, une fois pour toutes
+  hashmap_iter(perms -> names, compute_reachable, NULL);
+
+  return perms;
+}
+
 
-  tf = array_get(headers, index);
-  r = has_rights(tf->header, pwd, mode);
-  free(tf);
+void tar_permissions_free (struct tar_permissions *perms)
+{
+  if (!perms)
+    return;
 
-  return r == 0 ? 1 : -1;
+  hashmap_free(perms -> names, false);
+  arena_free(perms -> mem);
+  free(perms);
 }
 
-/* Check user's permissions for every parent directory of FILENAME and FILENAME itself */
-static int tar_access_all(const char *filename, array *headers, struct passwd *pwd, int mode)
+
+/* Rights of CATALOG, built by the first check */
+static const struct tar_permissions *get_permissions (const tar_catalog *catalog, const credentials *creds)
 {
-  size_t filename_len = strlen(filename);
-  char *cpy = malloc(filename_len + 1);
-  memmove(cpy, filename, filename_len + 1);
-  char *it = cpy;
-  char tmp;
-  while ((it = strchr(it, '/')) != NULL && it[1] != '\0')
-  {
-    tmp = it[1];
-    it[1] = '\0';
-    if (simple_tar_access(cpy, headers, pwd, X_OK) == -1) // Test if parent dir is executable
+  tar_catalog *c = (tar_catalog *) catalog;
+
+  pthread_mutex_lock(&permissions_lock);
+  if (!c -> permissions)
+    c -> permissions = build_permissions(catalog, creds);
+  pthread_mutex_unlock(&permissions_lock);
+
+  return c -> permissions;
+}
+
+
+/* Error of a name which is not in the tar : EACCES if one of its parents can't be traversed, ENOENT otherwise */
+static int missing_name (const struct tar_permissions *perms, const char *file_name)
+{
+  size_t len = strlen(file_name);
+  char dir[len + 1];
+  struct name_rights *nr;
+
+  memcpy(dir, file_name, len + 1);
+  for (len = parent_length(dir, len); len > 0; len = parent_length(dir, len))
     {
-      it[1] = tmp;
-      free(cpy);
-      return -1;
+      dir[len] = '\0';
+      // le plus profond parent existant décide
+      if ((nr = hashmap_get(perms -> names, dir)))
+	return error_pt(NULL, 0, is_reachable(nr) && (nr -> rights & X_OK) ? ENOENT : EACCES);
     }
-    it[1] = tmp;
-    it++;
-  }
-  int res = simple_tar_access(cpy, headers, pwd, mode);
-  free(cpy);
-  return res;
+
+  return error_pt(NULL, 0, ENOENT);
 }
 
 /* Check user's permissions for file FILE_NAME in tar at path TAR_NAME */
 int tar_access(const char *tar_name, const char *file_name, int mode)
 {
-  int tar_fd = open(tar_name, O_RDONLY);
-  if (tar_fd <0)
+  // le catalogue reste en cache entre deux appels, tant que l'archive ne change pas
+  const tar_catalog *catalog = catalog_get(tar_name);
+  if (!catalog)
     return -1;
 
-  int r = ftar_access(tar_fd, file_name, mode);
+  int found = members_access(catalog, file_name, mode);
+  catalog_release(catalog);
 
-  close(tar_fd);
-  return r;
+  return found;
 }
 
 /* identical to tar_access except that the tar about which information is to be retrieved is specified by the file descriptor tar_fd.*/
 int ftar_access(int tar_fd, const char *file_name, int mode)
+{
+  tar_catalog *catalog = tar_catalog_read(tar_fd);
+  if (!catalog)
+    return -1;
+
+  int found = members_access(catalog, file_name, mode);
+
+  tar_catalog_free(catalog);
+
+  return found;
+}
+
+int members_access(const tar_catalog *catalog, const char *file_name, int mode)
 {
   if (!is_mode_correct(mode))
     {
@@ -166,19 +244,26 @@ int ftar_access(int tar_fd, const char *file_name, int mode)
       return -1;
     }
 
-  array *headers = tar_ls_all(tar_fd);
-  if (!headers)
-    return -1;
+  // l'identité du processus est lue une seule fois, les droits sur le tar une fois par catalogue
+  const credentials *creds = get_credentials();
+  const struct tar_permissions *perms = get_permissions(catalog, creds);
+  struct name_rights *nr = hashmap_get(perms -> names, file_name);
 
-  struct passwd *pwd = getpwuid(getuid());
-  int found;
+  if (creds -> uid == 0)
+    return nr ? (nr -> member ? 1 : 2) : error_pt(NULL, 0, ENOENT);
 
-  if (pwd -> pw_uid == 0)
-    found = simple_tar_access(file_name, headers, pwd, F_OK);
-  else
-    found = tar_access_all(file_name, headers, pwd, mode);
+  if (!nr)
+    return missing_name(perms, file_name);
 
-  array_free(headers, false);
+  // chaque dossier parent doit être traversable
+  if (!nr -> reachable)
+    return error_pt(NULL, 0, EACCES);
 
-  return found;
+  if (!nr -> member)
+    return 2;
+
+  if (mode != F_OK && (mode & ~nr -> rights & (R_OK | W_OK | X_OK)))
+    return error_pt(NULL, 0, EACCES);
+
+  return 1;
 }
@@ -1,3 +1,6 @@
+#define _GNU_SOURCE // SEEK_DATA et SEEK_HOLE
+
+#include <assert.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,34 +10,29 @@
 #include <time.h>
 #include <unistd.h>
 #include <errno.h>
-#include <grp.h>
-#include <pwd.h>
 #include <dirent.h>
 #include <linux/limits.h>
 
+#include "arena.h"
+#include "archive.h"
+#include "array.h"
+#include "catalog.h"
+#include "credentials.h"
 #include "errors.h"
+#include "io_engine.h"
 #include "tar.h"
 #include "utils.h"
 
 
 static int seek_end_of_tar(int tar_fd) {
   struct posix_header hd;
-  ssize_t read_size;
-  while(1) {
-    read_size = read(tar_fd, &hd, BLOCKSIZE);
-    if (read_size != BLOCKSIZE)
-      {
-	if (read_size < 0)
-	  return -1;
-	else
-	  return error_pt(NULL, 0, EPERM);
-      }
-    if (hd.name[0] != '\0')
-      skip_file_content(tar_fd, &hd);
-    else
-      break;
-  }
-  lseek(tar_fd, -BLOCKSIZE, SEEK_CUR);
+  off_t member_start;
+  int r;
+  while((r = read_header(tar_fd, &hd, &member_start)) == 1)
+    skip_file_content(tar_fd, &hd);
+  if (r < 0)
+    return -1;
+  lseek(tar_fd, member_start, SEEK_SET);
   return 0;
 }
 
@@ -77,26 +75,18 @@ static void init_mode(struct posix_header *hd, struct stat *s) {
 }
 
 static int get_u_and_g_name(struct posix_header *hd, struct stat *s){
+  // les noms sont mis en cache : un import ne les demande qu'une fois par propriétaire
+  const credentials *creds = get_credentials();
   //récupérer le g-name
-  struct group *g_name;
-  if(s!=NULL)
-    g_name = getgrgid(s->st_gid);
-  else
-    g_name = getgrgid(getgid());
+  const char *g_name = group_name(s != NULL ? s->st_gid : creds->gid);
   if(g_name != NULL){
-    strncpy(hd->gname, g_name->gr_name, 32);
+    strncpy(hd->gname, g_name, 32);
     hd->gname[31] = '\0';
   }
   //pour récupérer le u-name
-  struct passwd *pw;
-  uid_t uid;
-  if(s == NULL)
-    uid = getuid();
-  else
-    uid = s->st_uid;
-  pw = getpwuid (uid);
-  if (pw){
-    strncpy(hd->uname, pw->pw_name, 32);
+  const char *u_name = user_name(s != NULL ? s->st_uid : creds->uid);
+  if (u_name){
+    strncpy(hd->uname, u_name, 32);
     hd->uname[31] = '\0';
   }
   else return -1;
@@ -104,64 +94,44 @@ static int get_u_and_g_name(struct posix_header *hd, struct stat *s){
   return 0;
 }
 
-static void adapt_len_char_for_size(struct posix_header *hd, int length, off_t si){
-  char tmp[length];
-  tmp[length - 1] = '\0';
-  char size[length];
-  size[length - 1] = '\0';
-  sprintf(tmp, "%011lo", si);
-  int len = strlen(tmp), i;
-  for(i = 0; i < 12-len-1; i++){
-    size[i] = '0';
-  }
-  for(int j = 0; j < len; j++){
-    size[i+j] = tmp[j];
-  }
-  strcpy(hd -> size, size);
+/* Fill a header from the status of a file, `link` is the target of a symbolic link (or NULL).
+   Returns the size of the extended header stored in *EXT (see set_header_names) */
+static ssize_t init_header_from_stat(struct posix_header *hd, struct stat *s, const char *link, const char *filename, char **ext) {
+  memset(hd, '\0', BLOCKSIZE);
+  init_mode(hd, s);
+  sprintf(hd -> uid, "%07o", s -> st_uid);
+  sprintf(hd -> gid, "%07o" ,s -> st_gid);
+  init_type(hd, s);
+  set_file_size(hd, hd->typeflag == REGTYPE ? s -> st_size : 0);
+  strcpy(hd -> magic, TMAGIC);
+  set_hd_time(hd);
+  hd -> version[0] = '0';
+  hd -> version[1] = '0';
+  get_u_and_g_name(hd, s);
+  return set_header_names(hd, filename, link, ext);
 }
 
 
-static int init_header(struct posix_header *hd, const char *source, const char *filename) {
+static ssize_t init_header(struct posix_header *hd, const char *source, const char *filename, char **ext) {
   struct stat s;
   if (lstat(source, &s) < 0) {
     return -1;
   }
 
-  strncpy(hd -> name, filename, 100);
-  hd->name[99] ='\0';
-  init_mode(hd, &s);
-  sprintf(hd -> uid, "%07o", s.st_uid);
-  sprintf(hd -> gid, "%07o" ,s.st_gid);
-  if(S_ISDIR(s.st_mode)) strcpy(hd -> size, "00000000000");
-  else adapt_len_char_for_size(hd, 12, s.st_size);
-  init_type(hd, &s);
-  char buf[100];
-  memset(buf, '\0', 100);
-  if(readlink(source, buf, 100) > 0){
-    strncpy(hd -> linkname, buf, 100);
-    hd->linkname[99] = '\0';
-  }
-  else {
-    if(hd->typeflag == DIRTYPE || hd->typeflag == SYMTYPE) sprintf(hd -> size, "%011o", 0);
-    else sprintf(hd -> size, "%011lo", s.st_size);
-  }
-  strcpy(hd -> magic, TMAGIC);
-  set_hd_time(hd);
-  hd -> version[0] = '0';
-  hd -> version[1] = '0';
-  get_u_and_g_name(hd, &s);
-  set_checksum(hd);
-  return 0;
+  char buf[PATH_MAX];
+  memset(buf, '\0', PATH_MAX);
+  if(S_ISLNK(s.st_mode) && readlink(source, buf, PATH_MAX - 1) < 0)
+    return -1;
+
+  return init_header_from_stat(hd, &s, S_ISLNK(s.st_mode) ? buf : NULL, filename, ext);
 }
 
 
-static int init_header_empty_file(struct posix_header *hd, const char *filename, int is_dir){
-  strncpy(hd -> name, filename, 100);
-  hd->name[99] = '\0';
+static ssize_t init_header_empty_file(struct posix_header *hd, const char *filename, int is_dir, char **ext){
   if(is_dir) sprintf(hd -> mode, "%07o", 0777 & ~getumask());
   else sprintf(hd -> mode, "%07o", 0666 & ~getumask());
-  sprintf(hd -> uid, "%07o", getuid());
-  sprintf(hd -> gid, "%07o", getgid());
+  sprintf(hd -> uid, "%07o", get_credentials() -> uid);
+  sprintf(hd -> gid, "%07o", get_credentials() -> gid);
   strcpy(hd -> size, "00000000000");
   set_hd_time(hd);
   hd -> typeflag = (is_dir)? DIRTYPE : REGTYPE;
@@ -170,10 +140,73 @@ static int init_header_empty_file(struct posix_header *hd, const char *filename,
   hd -> version[1] = '0';
   get_u_and_g_name(hd, NULL);
   //devmajor devminor prefix junk
-  set_checksum(hd);
+  return set_header_names(hd, filename, NULL, ext);
+}
+
+/* Map of the data extents of the regular file FD of status ST, NULL if it has no hole */
+static struct sparse_map *find_data_extents(int fd, const struct stat *st)
+{
+  struct sparse_map *map = NULL;
+  off_t data = 0, hole;
+
+  // un fichier sans trou a tous ses blocs alloués : pas besoin de le parcourir
+  if (st->st_size == 0 || (off_t) st->st_blocks * 512 >= st->st_size)
+    return NULL;
+
+  while ((data = lseek(fd, data, SEEK_DATA)) >= 0)
+    {
+      if ((hole = lseek(fd, data, SEEK_HOLE)) < 0 || hole > st->st_size)
+	hole = st->st_size;
+      map = sparse_map_add(map, data, hole - data);
+      data = hole;
+    }
+
+  // ENXIO : plus de données après l'offset, sinon SEEK_DATA n'est pas supporté
+  if (errno != ENXIO || (map && map->nb_extents == 1 && map->extents[0].size == st->st_size))
+    {
+      free(map);
+      return NULL;
+    }
+
+  // un trou final est marqué par un extent vide, comme le fait GNU tar
+  if (!map || map->extents[map->nb_extents - 1].offset + map->extents[map->nb_extents - 1].size < st->st_size)
+    map = sparse_map_add(map, st->st_size, 0);
+
+  return map;
+}
+
+/* Write the data extents of the file SRC_FD described by MAP, followed by the padding of the last block */
+static int write_data_extents(int src_fd, int tar_fd, const struct sparse_map *map)
+{
+  static const char zeros[BLOCKSIZE];
+  off_t stored = 0;
+
+  for (size_t i = 0; i < map->nb_extents; i++)
+    {
+      if (lseek(src_fd, map->extents[i].offset, SEEK_SET) < 0
+	  || read_write_buf_by_buf(src_fd, tar_fd, map->extents[i].size, BLOCKSIZE) < 0)
+	return -1;
+      stored += map->extents[i].size;
+    }
+
+  off_t padding = number_of_block(stored) * BLOCKSIZE - stored;
+  if (padding > 0 && write(tar_fd, zeros, padding) < 0)
+    return -1;
+
   return 0;
 }
 
+/* Write the extended header EXT of size EXT_SIZE (if any) and then HD, EXT is freed */
+static int write_header(int tar_fd, const struct posix_header *hd, char *ext, ssize_t ext_size) {
+  int r = 0;
+  if (ext_size > 0 && write(tar_fd, ext, ext_size) < 0)
+    r = -1;
+  else if (write(tar_fd, hd, BLOCKSIZE) < 0)
+    r = -1;
+  free(ext);
+  return r;
+}
+
 /* Add two empty blocks at the end of a tar file */
 static int add_empty_block(int tar_fd) {
   int size = 2 * BLOCKSIZE;
@@ -185,77 +218,127 @@ static int add_empty_block(int tar_fd) {
   return 0;
 }
 
-static int modif_header(struct posix_header *hd, const char *dest)
+static ssize_t modif_header(struct posix_header *hd, const char *dest, const char *linkname, char **ext)
 {
-  strcpy(hd -> name, dest);
   set_hd_time(hd);
-  set_checksum(hd);
-  return 0;
+  return set_header_names(hd, dest, linkname, ext);
 }
 
-static int exists_in_tar(const char *name_to_comp, struct posix_header *hd, int size){
-  for(int i = 0; i < size; i++){
-    if(strcmp(hd[i].name, name_to_comp) == 0){
+static int exists_in_tar(const char *name_to_comp, array *files){
+  ARRAY_FOREACH (tar_file, tf, files){
+    if(strcmp(tf->name, name_to_comp) == 0){
       return 1;
     }
   }
   return 0;
 }
 
-static int read_and_write(int fd_src, int fd_dest, struct posix_header hd){
+// liste les fichiers du tar tar_name, avec leur nom complet
+static array *tar_ls_name(const char *tar_name){
+  int tar_fd = archive_open(tar_name, O_RDONLY);
+  if(tar_fd < 0)
+    return NULL;
+  array *files = tar_ls_all(tar_fd);
+  archive_close(tar_fd);
+  return files;
+}
+
+/* Write HD (with its extended header EXT) at the position of FD_DEST, followed by the map MAP of a sparse file if any,
+   and then the content read in FD_SRC. EXT and MAP are freed */
+static int write_member(int fd_src, int fd_dest, struct posix_header hd, char *ext, ssize_t ext_size, char *map, off_t map_size){
   //écriture du header
-  if (seek_end_of_tar(fd_dest) < 0)
-    return -1;
-  if (write(fd_dest, &hd, BLOCKSIZE) < 0)
-    return -1;
+  if (write_header(fd_dest, &hd, ext, ext_size) < 0)
+    {
+      free(map);
+      return -1;
+    }
+  if (map_size > 0 && write(fd_dest, map, map_size) < 0)
+    {
+      free(map);
+      return -1;
+    }
+  free(map);
 
   //écriture du contenu du header
-  if(read_write_buf_by_buf(fd_src, fd_dest, number_of_block(get_file_size(&hd))*BLOCKSIZE, BLOCKSIZE) < 0)
-    return -1;
-  char buffer[BLOCKSIZE];
-  memset(buffer, '\0', BLOCKSIZE);
-  if(write(fd_dest, buffer, BLOCKSIZE) < 0)
+  if(read_write_buf_by_buf(fd_src, fd_dest, number_of_block(get_file_size(&hd))*BLOCKSIZE - map_size, BLOCKSIZE) < 0)
     return -1;
   return 0;
 }
 
+/* Write the member TF of the tar FD_SRC, read up to its content, at the position of FD_DEST, named DEST */
+static int copy_member(int fd_src, int fd_dest, const tar_file *tf, const char *dest)
+{
+  struct posix_header hd = tf->header;
+  char *ext;
+  ssize_t ext_size;
+  char *map = NULL;
+  off_t map_size = 0;
+  if (tf->sparse)
+    {
+      // les extents sont recopiés tels quels, derrière une nouvelle carte
+      archive_lseek(fd_src, tf->data_start + tf->sparse->map_size, SEEK_SET);
+      set_hd_time(&hd);
+      ext_size = set_sparse_header(&hd, dest, tf->sparse, &ext, &map);
+      map_size = tf->sparse->map_size;
+    }
+  else
+    ext_size = modif_header(&hd, dest, tf->linkname, &ext);
+  if (ext_size < 0)
+    return -1;
+  return write_member(fd_src, fd_dest, hd, ext, ext_size, map, map_size);
+}
+
 int add_tar_to_tar_rec(const char *tar_name_src, char *tar_name_dest, const char *source, const char *dest){
-  int s = 0;
-  struct posix_header *header = tar_ls(tar_name_src, &s);
-  int s_2 = 0;
-  struct posix_header *header_2 = tar_ls(tar_name_dest, &s_2);
+  array *files = tar_ls_name(tar_name_src);
+  if(!files)
+    return -1;
+  array *files_2 = tar_ls_name(tar_name_dest);
+  if(!files_2)
+    {
+      tar_ls_free(files);
+      return -1;
+    }
+  int s = array_size(files);
+  int ret = 0, nb_copies = 0;
+  char **sources = malloc((s + 1) * sizeof(char *)), **dests = malloc((s + 1) * sizeof(char *));
+  assert(sources && dests);
 
   //check if dont already exist
-  if(exists_in_tar(dest, header_2, s_2))
-    return error_pt(NULL, 0, errno);
+  if(exists_in_tar(dest, files_2))
+    {
+      errno = EEXIST;
+      ret = -1;
+      goto exit;
+    }
 
   //We look all the file of tar_name_src
   if(!is_empty_string(source))
     {
       for(int i = 0; i < s; i++){
+	const char *name = ((tar_file *) array_at(files, i))->name;
 	char copy[PATH_MAX];
 	int j = 0;
-	while(header[i].name[j] == source[j] && j < strlen(source))
+	while(name[j] == source[j] && j < strlen(source))
 	  {
 	    copy[j] = source[j];
 	    j++;
 	  }
 	copy[j] = '\0';
 	//if the copy and source are equals
-	if(strcmp(copy, source) == 0 && (header[i].name[j] == '\0' || header[i].name[j-1] == '/')){
+	if(strcmp(copy, source) == 0 && (name[j] == '\0' || name[j-1] == '/')){
 	  char copy2[PATH_MAX];
 	  int k = 0;
 	  for(k = 0; k < strlen(dest); k++){copy2[k] = dest[k];}
 	  copy2[k] = '\0';
 	  int l = 0;
-	  for(l = 0; l < strlen(header[i].name) - strlen(copy); l++){
-	    copy2[strlen(dest)+l] = header[i].name[strlen(copy)+l];
+	  for(l = 0; l < strlen(name) - strlen(copy); l++){
+	    copy2[strlen(dest)+l] = name[strlen(copy)+l];
 	  }
 	  copy2[strlen(dest)+l] = '\0';
 
-	  //Add Source or a file of source in tar_name_dest as copy2
-	  if(add_tar_to_tar(tar_name_src, tar_name_dest, header[i].name, copy2)<0)
-	    return error_pt(NULL, 0, errno);
+	  //Source or a file of source is added in tar_name_dest as copy2
+	  sources[nb_copies] = (char *) name;
+	  dests[nb_copies++] = copy_string(copy2);
 	}
       }
     }
@@ -263,15 +346,26 @@ int add_tar_to_tar_rec(const char *tar_name_src, char *tar_name_dest, const char
     {
       for(int i = 0; i < s; i++)
 	{
+	  const char *name = ((tar_file *) array_at(files, i))->name;
 	  char copy[PATH_MAX];
-	  sprintf(copy, "%s%s", dest, header[i].name);
-	  if(add_tar_to_tar(tar_name_src, tar_name_dest, header[i].name, copy)<0)
-	    return error_pt(NULL, 0, errno);
+	  sprintf(copy, "%s%s", dest, name);
+	  sources[nb_copies] = (char *) name;
+	  dests[nb_copies++] = copy_string(copy);
 	}
     }
-  free(header);
-  free(header_2);
-  return 0;
+
+  // les fichiers sont copiés ensemble : chaque tar n'est ouvert qu'une fois
+  if (nb_copies > 0 && add_tar_members_to_tar(tar_name_src, tar_name_dest, sources, dests, nb_copies) < 0)
+    ret = -1;
+
+  for (int i = 0; i < nb_copies; i++)
+    free(dests[i]);
+ exit:
+  free(sources);
+  free(dests);
+  tar_ls_free(files);
+  tar_ls_free(files_2);
+  return ret;
 }
 
 int add_tar_to_tar(const char *tar_name_src, char *tar_name_dest, const char *source, const char *dest)
@@ -285,35 +379,92 @@ int add_tar_to_tar(const char *tar_name_src, char *tar_name_dest, const char *so
     {
       return -1;
     }
-  int tar_src_fd = open(tar_name_src, O_RDONLY);
+  int tar_src_fd = archive_open(tar_name_src, O_RDONLY);
   if (tar_src_fd < 0)
     return -1;
-  struct posix_header hd;
-  if (seek_header(tar_src_fd, source, &hd) < 0)
+  tar_file tf;
+  int r = seek_member(tar_src_fd, source, &tf);
+  if (r != 1)
+    {
+      return error_pt(&tar_src_fd, 1, r == 0 ? ENOENT : errno);
+    }
+  int tar_dest_fd = archive_open(tar_name_dest, O_RDWR);
+  if (tar_dest_fd < 0)
     {
+      free_tar_file(&tf);
       return error_pt(&tar_src_fd, 1, errno);
     }
-  modif_header(&hd, dest);
-  int tar_dest_fd = open(tar_name_dest, O_RDWR);
+  int fds[2] = {tar_src_fd, tar_dest_fd};
+  r = seek_end_of_tar(tar_dest_fd) < 0 || copy_member(tar_src_fd, tar_dest_fd, &tf, dest) < 0 || add_empty_block(tar_dest_fd) < 0;
+  free_tar_file(&tf);
+  if (r)
+    return error_pt(fds, 2, errno);
+  archive_close(tar_src_fd);
+  archive_close(tar_dest_fd);
+  return 0;
+
+}
+
+/* Copy the members SOURCES of the tar TAR_NAME_SRC, whose catalog is CATALOG, at the end of TAR_NAME_DEST as DESTS */
+static int copy_members(const tar_catalog *catalog, const char *tar_name_src, char *tar_name_dest,
+			char *const sources[], char *const dests[], int nb_files)
+{
+  int tar_src_fd = archive_open(tar_name_src, O_RDONLY);
+  if (tar_src_fd < 0)
+    return -1;
+  int tar_dest_fd = archive_open(tar_name_dest, O_RDWR);
   if (tar_dest_fd < 0)
     return error_pt(&tar_src_fd, 1, errno);
-  seek_end_of_tar(tar_dest_fd);
-  if (read_and_write(tar_src_fd, tar_dest_fd, hd) != 0)
+  int fds[2] = {tar_src_fd, tar_dest_fd};
+  if (seek_end_of_tar(tar_dest_fd) < 0)
+    return error_pt(fds, 2, errno);
+  for (int i = 0; i < nb_files; i++)
     {
-      close(tar_src_fd);
-      close(tar_dest_fd);
-      return -1;
+      const tar_member *member = tar_catalog_find(catalog, sources[i]);
+      tar_file tf;
+      int r;
+      if (!member)
+	return error_pt(fds, 2, ENOENT);
+      if ((r = tar_member_read(tar_src_fd, member, &tf)) != 1)
+	return error_pt(fds, 2, r == 0 ? EIO : errno);
+      r = copy_member(tar_src_fd, tar_dest_fd, &tf, dests[i]);
+      free_tar_file(&tf);
+      if (r < 0)
+	return error_pt(fds, 2, errno);
     }
-  add_empty_block(tar_dest_fd);
-  close(tar_src_fd);
-  close(tar_dest_fd);
+  if (add_empty_block(tar_dest_fd) < 0)
+    return error_pt(fds, 2, errno);
+  archive_close(tar_src_fd);
+  archive_close(tar_dest_fd);
   return 0;
+}
 
+int add_tar_members_to_tar(const char *tar_name_src, char *tar_name_dest, char *const sources[], char *const dests[], int nb_files)
+{
+  for (int i = 0; i < nb_files; i++)
+    {
+      if (tar_access(tar_name_dest, dests[i], F_OK) > 0)
+	{ // File already exists
+	  errno = EEXIST;
+	  return -1;
+	}
+      else if (errno != ENOENT)
+	{
+	  return -1;
+	}
+    }
+  // les membres sont cherchés dans le catalogue, et non par un parcours du tar pour chacun
+  const tar_catalog *catalog = catalog_get(tar_name_src);
+  if (!catalog)
+    return -1;
+  int r = copy_members(catalog, tar_name_src, tar_name_dest, sources, dests, nb_files);
+  catalog_release(catalog);
+  return r;
 }
 
 int add_ext_to_tar(const char *tar_name, const char *source, const char *filename)
 {
-  int tar_fd = open(tar_name, O_RDWR);
+  int tar_fd = archive_open(tar_name, O_RDWR);
   if ( tar_fd < 0) {
     return error_pt(NULL, 0, errno);
   }
@@ -328,16 +479,40 @@ int add_ext_to_tar(const char *tar_name, const char *source, const char *filenam
       return error_pt(&tar_fd, 1, errno);
     }
     int fds[2] = {src_fd, tar_fd};
-    if(init_header(&hd, source, filename) < 0){
+    char *ext;
+    ssize_t ext_size = init_header(&hd, source, filename, &ext);
+    if(ext_size < 0){
       return error_pt(fds, 2, errno);
     }
-    if (write(tar_fd, &hd, BLOCKSIZE) < 0) {
+
+    // seuls les extents de données d'un fichier creux sont stockés
+    struct stat st;
+    struct sparse_map *map = NULL;
+    char *map_text = NULL;
+    if (hd.typeflag == REGTYPE && fstat(src_fd, &st) == 0 && (map = find_data_extents(src_fd, &st))) {
+      free(ext);
+      if ((ext_size = set_sparse_header(&hd, filename, map, &ext, &map_text)) < 0) {
+        free(map);
+        return error_pt(fds, 2, errno);
+      }
+    }
+    if (write_header(tar_fd, &hd, ext, ext_size) < 0) {
+      free(map);
+      free(map_text);
       return error_pt(fds, 2, errno);
     }
 
     char buffer[BLOCKSIZE];
     ssize_t read_size;
-    if(hd.typeflag != DIRTYPE && hd.typeflag != SYMTYPE){
+    if (map) {
+      int r = (write(tar_fd, map_text, map->map_size) < 0 || write_data_extents(src_fd, tar_fd, map) < 0) ? -1 : 0;
+      free(map);
+      free(map_text);
+      if (r < 0) {
+        return error_pt(fds, 2, errno);
+      }
+    }
+    else if(hd.typeflag != DIRTYPE && hd.typeflag != SYMTYPE){
       while((read_size = read(src_fd, buffer, BLOCKSIZE)) > 0 ) {
         if (read_size < 0) {
           int fds[2] ={src_fd, tar_fd};
@@ -357,77 +532,280 @@ int add_ext_to_tar(const char *tar_name, const char *source, const char *filenam
 
   else
     {
-      if(filename[strlen(filename)-1] == '/')
-	init_header_empty_file(&hd, filename, 1);
-      else
-	init_header_empty_file(&hd, filename, 0);
-      if (write(tar_fd, &hd, BLOCKSIZE) < 0) {
+      char *ext;
+      ssize_t ext_size = init_header_empty_file(&hd, filename, filename[strlen(filename)-1] == '/', &ext);
+      if (ext_size < 0 || write_header(tar_fd, &hd, ext, ext_size) < 0) {
 	return error_pt(&tar_fd, 1, errno);
       }
     }
-  close(tar_fd);
+  archive_close(tar_fd);
   return 0;
 }
 
-int add_ext_to_tar_rec(const char *tar_name, const char *filename, const char *inside_tar_name, int it){
-  //it est toujours initialisé à 0;
-  if(it++ == 0)add_ext_to_tar(tar_name, filename, inside_tar_name);
+int add_dirs_to_tar(const char *tar_name, char *const dirnames[], int nb_dirs)
+{
+  int tar_fd = archive_open(tar_name, O_RDWR);
+  if (tar_fd < 0) {
+    return error_pt(NULL, 0, errno);
+  }
+  if (seek_end_of_tar(tar_fd) < 0) {
+    return error_pt(&tar_fd, 1, errno);
+  }
+  // les en-têtes sont écrits à la suite, la fin du tar n'est cherchée qu'une fois
+  for (int i = 0; i < nb_dirs; i++) {
+    struct posix_header hd;
+    char *ext;
+    memset(&hd, '\0', BLOCKSIZE);
+    ssize_t ext_size = init_header_empty_file(&hd, dirnames[i], 1, &ext);
+    if (ext_size < 0 || write_header(tar_fd, &hd, ext, ext_size) < 0) {
+      return error_pt(&tar_fd, 1, errno);
+    }
+  }
+  if (add_empty_block(tar_fd) < 0) {
+    return error_pt(&tar_fd, 1, errno);
+  }
+  archive_close(tar_fd);
+  return 0;
+}
+
+/* Size of a member inside a tar (header and padded content) */
+static off_t member_size(const struct posix_header *hd)
+{
+  return BLOCKSIZE * (1 + number_of_block(get_file_size(hd)));
+}
+
+/* Memory of a recursive import : nothing is malloc'd per entry */
+struct import_mem
+{
+  arena *names; // noms d'un lot, rendus après le lot
+  arena *dirs;  // sous-dossiers d'un dossier, rendus quand il est fini
+};
+
+/*
+ * Import a batch of entries of a directory at offset *end of a tar.
+ * Status, openings and copies of the batch are all given to the I/O engine at once.
+ * The subdirectories of the batch are appended to subdirs, their names are allocated in mem->dirs.
+ */
+static int import_batch(int tar_fd, off_t *end, int dir_fd, char *const names[], size_t n,
+			const char *inside_tar_name, array *subdirs, struct import_mem *mem)
+{
+  static const char zeros[BLOCKSIZE];
+  struct stat st[IO_BATCH_MAX];
+  int fds[IO_BATCH_MAX];
+  char *reg_names[IO_BATCH_MAX];
+  struct io_copy_queue queue;
+  struct posix_header *headers = malloc(n * sizeof(struct posix_header));
+  char **exts = calloc(n, sizeof(char *));
+  char **maps = calloc(n, sizeof(char *));
+  size_t nb_reg = 0;
+  int ret = 0;
+
+  if (!headers || !exts || !maps)
+    {
+      free(headers);
+      free(exts);
+      free(maps);
+      return -1;
+    }
+  io_queue_init(&queue);
+
+  if (io_stat_batch(dir_fd, names, AT_SYMLINK_NOFOLLOW, st, n) < 0)
+    ret = -1;
+
+  // seuls les fichiers réguliers ont un contenu à copier
+  for (size_t i = 0; i < n; i++)
+    {
+      if (S_ISREG(st[i].st_mode))
+	reg_names[nb_reg++] = names[i];
+    }
+  if (io_openat_batch(dir_fd, reg_names, O_RDONLY, 0, fds, nb_reg) < 0)
+    ret = -1;
+
+  nb_reg = 0;
+  for (size_t i = 0; i < n; i++)
+    {
+      char link[PATH_MAX];
+      char inside[PATH_MAX];
+      ssize_t ext_size;
+      struct sparse_map *map = NULL;
+      int src_fd = -1;
+
+      if (st[i].st_mode == 0)
+	continue;
+
+      if (S_ISREG(st[i].st_mode) && (src_fd = fds[nb_reg++]) < 0)
+	continue;
+
+      memset(link, '\0', sizeof(link));
+      if (S_ISLNK(st[i].st_mode) && readlinkat(dir_fd, names[i], link, sizeof(link) - 1) < 0)
+	{
+	  ret = -1;
+	  continue;
+	}
+
+      snprintf(inside, PATH_MAX, "%s%s%s%s", inside_tar_name,
+	       is_empty_string(inside_tar_name) || inside_tar_name[strlen(inside_tar_name) - 1] == '/' ? "" : "/",
+	       names[i], S_ISDIR(st[i].st_mode) ? "/" : "");
+
+      ext_size = init_header_from_stat(headers + i, st + i, S_ISLNK(st[i].st_mode) ? link : NULL, inside, exts + i);
+      if (ext_size >= 0 && src_fd >= 0 && (map = find_data_extents(src_fd, st + i)))
+	{
+	  free(exts[i]);
+	  ext_size = set_sparse_header(headers + i, inside, map, exts + i, maps + i);
+	}
+      if (ext_size < 0)
+	{
+	  free(map);
+	  ret = -1;
+	  continue;
+	}
+
+      // en-tête étendu, header, puis contenu, puis bourrage jusqu'à la fin du bloc
+      if (ext_size > 0)
+	{
+	  io_queue_copy(&queue, (struct io_copy) { -1, 0, exts[i], tar_fd, *end, ext_size });
+	  *end += ext_size;
+	}
+      io_queue_copy(&queue, (struct io_copy) { -1, 0, headers + i, tar_fd, *end, BLOCKSIZE });
 
+      off_t content_size = get_file_size(headers + i);
+      off_t padding = member_size(headers + i) - BLOCKSIZE - content_size;
+      if (map)
+	{
+	  // un fichier creux : la carte, puis les extents de données à la suite
+	  off_t stored = *end + BLOCKSIZE;
+	  io_queue_copy(&queue, (struct io_copy) { -1, 0, maps[i], tar_fd, stored, map->map_size });
+	  stored += map->map_size;
+	  for (size_t j = 0; j < map->nb_extents; j++)
+	    {
+	      if (map->extents[j].size > 0)
+		io_queue_copy(&queue, (struct io_copy) { src_fd, map->extents[j].offset, NULL, tar_fd, stored, map->extents[j].size });
+	      stored += map->extents[j].size;
+	    }
+	  free(map);
+	}
+      else if (src_fd >= 0 && content_size > 0)
+	io_queue_copy(&queue, (struct io_copy) { src_fd, 0, NULL, tar_fd, *end + BLOCKSIZE, content_size });
+      if (padding > 0)
+	io_queue_copy(&queue, (struct io_copy) { -1, 0, zeros, tar_fd, *end + BLOCKSIZE + content_size, padding });
+      *end += member_size(headers + i);
+
+      if (S_ISDIR(st[i].st_mode))
+	{
+	  char *dir_names[2] = { arena_strdup(mem->dirs, names[i]), arena_strdup(mem->dirs, inside) };
+	  array_insert_last(subdirs, dir_names);
+	}
+    }
+
+  if (io_queue_flush(&queue) < 0)
+    ret = -1;
+
+  for (size_t i = 0; i < nb_reg; i++)
+    {
+      if (fds[i] >= 0)
+	close(fds[i]);
+    }
+  for (size_t i = 0; i < n; i++)
+    {
+      free(exts[i]);
+      free(maps[i]);
+    }
+  free(exts);
+  free(maps);
+  free(headers);
+
+  return ret;
+}
+
+/* Import the content of a directory at offset *end of a tar, and then its subdirectories */
+static int import_dir(int tar_fd, off_t *end, int dir_fd, const char *inside_tar_name, struct import_mem *mem)
+{
   struct dirent *lecture;
-  DIR *rep;
-  rep = opendir(filename);
-  if(rep == NULL){
-    closedir(rep);
+  char *names[IO_BATCH_MAX];
+  size_t n = 0;
+  int ret = 0;
+
+  int fd = dup(dir_fd);
+  if (fd < 0)
     return -1;
-  }
-  //Create a copy of the FILENAME
-  char copy[strlen(filename)+1];
-  strcpy(copy, filename);
-  //While there are files non-explored on the arborescence of FILENAME
+  DIR *rep = fdopendir(fd);
+  if (rep == NULL)
+    return error_pt(&fd, 1, errno);
+
+  // chaque sous-dossier : son nom dans le dossier et son nom dans le tar
+  arena_mark dirs_mark = arena_save(mem->dirs);
+  array *subdirs = array_create_in(mem->dirs, 2 * sizeof(char *));
+  arena_mark names_mark = arena_save(mem->names);
+
   while ((lecture = readdir(rep))) {
-    if(strcmp(lecture->d_name, ".") != 0 && strcmp(lecture->d_name, "..") != 0){
-      //Copy of the FILENAME and the name of the file discovered in the arborescence in filename
-      //It will be the source for add_ext_to_tar
-      char *copy2 = malloc(PATH_MAX);
-      int i = 0, j = 0;
-      for(i = 0; i < strlen(copy); i++)copy2[i] = copy[i];
-      if(copy2[i-1] != '/')copy2[i++] = '/';
-      for(j = 0; j < strlen(lecture->d_name); j++)copy2[i+j] = lecture->d_name[j];
-      if(copy2[i+j-1]!= '/' && lecture->d_type == 4)copy2[i+j++] = '/';
-      copy2[i+j] = '\0';
-
-      //a copy of inside_tar_name
-      char *copy_inside = malloc(PATH_MAX);
-      strcpy(copy_inside, inside_tar_name);
-      copy_inside[strlen(inside_tar_name)] = '\0';
-
-      //a copy of inside_tar_name and the name of the file discovered in the arborescence in filename
-      //It will be the FILENAME in add_ext_to_tar
-      char *copy3 = malloc(PATH_MAX);
-      for(i = 0; i < strlen(copy_inside); i++)copy3[i] = copy_inside[i];
-      if( i > 0 && copy3[i-1] != '/' && lecture->d_name[0] != '/')copy3[i++] = '/';
-      for(j = 0; j < strlen(lecture->d_name); j++)copy3[i+j] = lecture->d_name[j];
-      if(copy3[i+j-1]!= '/' && lecture->d_type == 4)copy3[i+j++] = '/';
-      copy3[i+j] = '\0';
-
-      add_ext_to_tar(tar_name, copy2, copy3);
-
-      if(lecture->d_type == 4 ){
-        add_ext_to_tar_rec(tar_name, copy2, copy3, it);
+    if(strcmp(lecture->d_name, ".") == 0 || strcmp(lecture->d_name, "..") == 0)
+      continue;
+
+    names[n++] = arena_strdup(mem->names, lecture->d_name);
+    if (n == IO_BATCH_MAX)
+      {
+	if (import_batch(tar_fd, end, dir_fd, names, n, inside_tar_name, subdirs, mem) < 0)
+	  ret = -1;
+	arena_restore(mem->names, names_mark);
+	n = 0;
       }
-      free(copy_inside);
-      free(copy2);
-      free(copy3);
-    }
   }
-  return 0;
+  if (n > 0 && import_batch(tar_fd, end, dir_fd, names, n, inside_tar_name, subdirs, mem) < 0)
+    ret = -1;
+  arena_restore(mem->names, names_mark);
+  closedir(rep);
+
+  for (int i = 0; i < array_size(subdirs); i++)
+    {
+      char **dir_names = array_at(subdirs, i);
+      int sub_fd = openat(dir_fd, dir_names[0], O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+
+      if (sub_fd < 0 || import_dir(tar_fd, end, sub_fd, dir_names[1], mem) < 0)
+	ret = -1;
+      if (sub_fd >= 0)
+	close(sub_fd);
+    }
+  arena_restore(mem->dirs, dirs_mark);
+
+  return ret;
+}
+
+int add_ext_to_tar_rec(const char *tar_name, const char *filename, const char *inside_tar_name, int it){
+  //it est toujours initialisé à 0;
+  if(it++ == 0)add_ext_to_tar(tar_name, filename, inside_tar_name);
+
+  int dir_fd = open(filename, O_RDONLY | O_DIRECTORY);
+  if (dir_fd < 0)
+    return -1;
+
+  int tar_fd = archive_open(tar_name, O_RDWR);
+  if (tar_fd < 0)
+    return error_pt(&dir_fd, 1, errno);
+
+  int fds[2] = {dir_fd, tar_fd};
+  if (seek_end_of_tar(tar_fd) < 0)
+    return error_pt(fds, 2, errno);
+
+  // tout le contenu est écrit à partir de la fin du tar, sans la rechercher pour chaque fichier
+  off_t end = lseek(tar_fd, 0, SEEK_CUR);
+  struct import_mem mem = { arena_create(), arena_create() };
+  int ret = import_dir(tar_fd, &end, dir_fd, inside_tar_name, &mem);
+  arena_free(mem.names);
+  arena_free(mem.dirs);
+
+  if (lseek(tar_fd, end, SEEK_SET) < 0 || add_empty_block(tar_fd) < 0)
+    ret = -1;
+
+  close(dir_fd);
+  archive_close(tar_fd);
+  return ret;
 }
 
 
 
 int tar_append_file(const char *tar_name, const char *filename, int src_fd)
 {
-  int tar_fd = open(tar_name, O_RDWR);
+  int tar_fd = archive_open(tar_name, O_RDWR);
   if (tar_fd < 0) {
     return -1;
   }
@@ -435,56 +813,59 @@ int tar_append_file(const char *tar_name, const char *filename, int src_fd)
   if (seek_header(tar_fd, filename, &hd) != 1) {
     return error_pt(&tar_fd, 1, ENOENT);
   }
-  int size = get_file_size(&hd);
+  off_t size = get_file_size(&hd);
   off_t src_cur = lseek(src_fd, 0, SEEK_CUR);
   off_t src_size = lseek(src_fd, 0, SEEK_END) - src_cur;
-  long unsigned int new_size = src_size + size;
+  off_t new_size = src_size + size;
   lseek(tar_fd, -BLOCKSIZE, SEEK_CUR);
   set_hd_time(&hd);
-  sprintf(hd.size, "%011lo", new_size);
+  set_file_size(&hd, new_size);
   set_checksum(&hd);
   write(tar_fd, &hd, BLOCKSIZE);
-  int padding = BLOCKSIZE - (size % BLOCKSIZE);
+  off_t padding = BLOCKSIZE - (size % BLOCKSIZE);
   off_t beg = lseek(tar_fd, size, SEEK_CUR);
   off_t tar_size = lseek(tar_fd, 0, SEEK_END);
 
-  int required_blocks = src_size <= padding ? 0 : number_of_block(src_size);
+  off_t required_blocks = src_size <= padding ? 0 : number_of_block(src_size);
   if (fmemmove(tar_fd, beg + padding, tar_size - (beg + padding), beg + padding + required_blocks*BLOCKSIZE)) {
-    close(tar_fd);
+    archive_close(tar_fd);
     return -1;
   }
   lseek(tar_fd, beg, SEEK_SET);
   lseek(src_fd, src_cur, SEEK_SET);
   if (read_write_buf_by_buf(src_fd, tar_fd, src_size, 512) != 0) {
-    close(tar_fd);
+    archive_close(tar_fd);
     return -1;
   }
 
-  close(tar_fd);
+  archive_close(tar_fd);
   return 0;
 }
 
 
 int move_file_to_end_of_tar(char *tar_name, char *filename)
 {
-  int tar_fd = open(tar_name, O_RDWR);
+  int tar_fd = archive_open(tar_name, O_RDWR);
   if (tar_fd < 0)
     return -1;
 
   seek_end_of_tar(tar_fd);
   off_t end_tar = lseek(tar_fd, 0, SEEK_CUR);
 
-  struct posix_header hd;
+  tar_file tf;
   lseek(tar_fd, 0, SEEK_SET);
-  if (seek_header(tar_fd, filename, &hd) != 1)
-    return -1;
+  if (seek_member(tar_fd, filename, &tf) != 1)
+    return error_pt(&tar_fd, 1, errno);
+  free_tar_file(&tf);
 
-  size_t move_size = BLOCKSIZE * (number_of_block(get_file_size(&hd)) + 1);
-  off_t whence = lseek(tar_fd, -BLOCKSIZE, SEEK_CUR);
+  // le fichier est déplacé avec ses en-têtes étendus
+  off_t whence = tf.ext_start;
+  size_t move_size = tf.data_start - whence + BLOCKSIZE * number_of_block(get_file_size(&tf.header));
+  lseek(tar_fd, whence, SEEK_SET);
   if (whence + move_size == end_tar)
     {
       // Le fichier est déjà le dernier fichier du tar
-      return 0;
+      return archive_close(tar_fd);
     }
   // On récupère le header et contenue du fichier
   char *move_buff = malloc(move_size);
@@ -500,5 +881,5 @@ int move_file_to_end_of_tar(char *tar_name, char *filename)
   write(tar_fd, move_buff, move_size);
   free(after_buff);
   free(move_buff);
-  return 0;
+  return archive_close(tar_fd);
 }
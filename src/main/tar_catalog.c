@@ -0,0 +1,349 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "archive.h"
+#include "hashmap.h"
+#include "tar.h"
+
+/** First bytes of a saved catalog */
+#define SAVED_CATALOG_MAGIC "TSHCAT01"
+
+/** Header of a saved catalog, followed by the records of the members, then by their names */
+struct saved_catalog
+{
+  char magic[8];
+  int64_t nb_members;
+  int64_t strings_size;
+};
+
+/** Record of a member in a saved catalog, its name, linkname, uname and gname follow in the names */
+struct saved_member
+{
+  int64_t ext_start;
+  int64_t data_start;
+  int64_t size;
+  int64_t real_size;
+  int64_t mtime;
+  uint32_t uid;
+  uint32_t gid;
+  uint32_t mode;
+  char typeflag;
+  char padding[3];
+};
+
+struct string_arena
+{
+  arena *mem;
+  hashmap *shared; // noms des propriétaires et des groupes déjà stockés
+};
+
+
+
+
+static struct string_arena *strings_create (void)
+{
+  struct string_arena *strings = malloc(sizeof(struct string_arena));
+  assert(strings);
+
+  strings->mem = arena_create();
+  strings->shared = hashmap_create();
+  return strings;
+}
+
+
+static void strings_free (struct string_arena *strings)
+{
+  if (!strings)
+    return;
+
+  arena_free(strings->mem);
+  hashmap_free(strings->shared, false);
+  free(strings);
+}
+
+
+/* Copy the LEN first characters of STR in STRINGS, with a '\0' */
+static const char *strings_add (struct string_arena *strings, const char *str, size_t len)
+{
+  return arena_strndup(strings->mem, str, len);
+}
+
+
+/* Same as strings_add, but a string already shared is not copied again */
+static const char *strings_share (struct string_arena *strings, const char *str, size_t len)
+{
+  char key[len + 1];
+  const char *shared;
+
+  memcpy(key, str, len);
+  key[len] = '\0';
+  if ((shared = hashmap_get(strings->shared, key)))
+    return shared;
+
+  shared = strings_add(strings, str, len);
+  hashmap_put(strings->shared, shared, (void *) shared);
+  return shared;
+}
+
+
+/* Value of an octal field of a header, which may not end with a '\0' */
+static long octal_field (const char *field, size_t len)
+{
+  char number[len + 1];
+
+  memcpy(number, field, len);
+  number[len] = '\0';
+  return strtol(number, NULL, 8);
+}
+
+
+/* Visitor of tar_catalog_read : the member is copied as a compact record */
+static bool add_member (tar_file *tf, void *data)
+{
+  tar_catalog *catalog = data;
+  struct posix_header *hd = &tf->header;
+
+  if ((catalog->nb_members & (catalog->nb_members - 1)) == 0 && catalog->nb_members >= 64)
+    {
+      catalog->members = realloc(catalog->members, 2 * catalog->nb_members * sizeof(tar_member));
+      assert(catalog->members);
+    }
+
+  catalog->members[catalog->nb_members++] = (tar_member)
+    {
+      .name = strings_add(catalog->strings, tf->name, strlen(tf->name)),
+      .linkname = *tf->linkname ? strings_add(catalog->strings, tf->linkname, strlen(tf->linkname)) : "",
+      .uname = strings_share(catalog->strings, hd->uname, strnlen(hd->uname, sizeof(hd->uname))),
+      .gname = strings_share(catalog->strings, hd->gname, strnlen(hd->gname, sizeof(hd->gname))),
+      .ext_start = tf->ext_start,
+      .data_start = tf->data_start,
+      .size = get_file_size(hd),
+      .real_size = tar_file_size(tf),
+      .mtime = octal_field(hd->mtime, sizeof(hd->mtime)),
+      .uid = octal_field(hd->uid, sizeof(hd->uid)),
+      .gid = octal_field(hd->gid, sizeof(hd->gid)),
+      .mode = octal_field(hd->mode, sizeof(hd->mode)) & 07777,
+      .typeflag = hd->typeflag
+    };
+
+  // le membre complet est libéré par tar_visit
+  return false;
+}
+
+
+
+
+tar_catalog *tar_catalog_read (int tar_fd)
+{
+  tar_catalog *catalog = malloc(sizeof(tar_catalog));
+  assert(catalog);
+
+  // la capacité double à chaque puissance de 2, à partir de 64
+  catalog->members = malloc(64 * sizeof(tar_member));
+  assert(catalog->members);
+  catalog->nb_members = 0;
+  catalog->strings = strings_create();
+  catalog->permissions = NULL;
+  catalog->refs = 1;
+
+  if (tar_visit(tar_fd, add_member, catalog) < 0)
+    {
+      int err = errno;
+      tar_catalog_free(catalog);
+      errno = err;
+      return NULL;
+    }
+
+  return catalog;
+}
+
+
+/* Write COUNT bytes of BUF in FD, even if write is interrupted */
+static int write_all (int fd, const void *buf, size_t count)
+{
+  for (size_t done = 0; done < count; )
+    {
+      ssize_t r = write(fd, (const char *) buf + done, count - done);
+      if (r < 0 && errno == EINTR)
+	continue;
+      if (r <= 0)
+	return -1;
+      done += r;
+    }
+
+  return 0;
+}
+
+
+int tar_catalog_save (const tar_catalog *catalog, int fd)
+{
+  struct saved_catalog hd = { SAVED_CATALOG_MAGIC, catalog->nb_members, 0 };
+  struct saved_member *records = calloc(catalog->nb_members ? catalog->nb_members : 1, sizeof(struct saved_member));
+  size_t capacity = 4096;
+  char *strings = malloc(capacity);
+  int ret = -1;
+
+  assert(records && strings);
+
+  for (size_t i = 0; i < catalog->nb_members; i++)
+    {
+      const tar_member *m = catalog->members + i;
+      const char *names[] = { m->name, m->linkname, m->uname, m->gname };
+
+      records[i] = (struct saved_member)
+	{
+	  m->ext_start, m->data_start, m->size, m->real_size, m->mtime, m->uid, m->gid, m->mode, m->typeflag, { 0 }
+	};
+
+      for (int j = 0; j < 4; j++)
+	{
+	  size_t len = strlen(names[j]) + 1;
+	  if (hd.strings_size + len > capacity)
+	    {
+	      capacity = 2 * capacity > hd.strings_size + len ? 2 * capacity : hd.strings_size + len;
+	      strings = realloc(strings, capacity);
+	      assert(strings);
+	    }
+	  memcpy(strings + hd.strings_size, names[j], len);
+	  hd.strings_size += len;
+	}
+    }
+
+  if (write_all(fd, &hd, sizeof(hd)) == 0
+      && write_all(fd, records, catalog->nb_members * sizeof(struct saved_member)) == 0
+      && write_all(fd, strings, hd.strings_size) == 0)
+    ret = 0;
+
+  free(records);
+  free(strings);
+  return ret;
+}
+
+
+/* Read exactly COUNT bytes of FD in BUF */
+static int read_all (int fd, void *buf, size_t count)
+{
+  for (size_t done = 0; done < count; )
+    {
+      ssize_t r = read(fd, (char *) buf + done, count - done);
+      if (r < 0 && errno == EINTR)
+	continue;
+      if (r <= 0)
+	return -1;
+      done += r;
+    }
+
+  return 0;
+}
+
+
+tar_catalog *tar_catalog_load (int fd)
+{
+  struct saved_catalog hd;
+  struct saved_member *records = NULL;
+  char *strings = NULL;
+  tar_catalog *catalog = NULL;
+
+  if (read_all(fd, &hd, sizeof(hd)) < 0 || memcmp(hd.magic, SAVED_CATALOG_MAGIC, sizeof(hd.magic))
+      || hd.nb_members < 0 || hd.strings_size < 0
+      || (uint64_t) hd.nb_members > SIZE_MAX / sizeof(struct saved_member))
+    return NULL;
+
+  records = malloc(hd.nb_members ? hd.nb_members * sizeof(struct saved_member) : 1);
+  strings = malloc(hd.strings_size ? hd.strings_size : 1);
+  if (!records || !strings
+      || read_all(fd, records, hd.nb_members * sizeof(struct saved_member)) < 0
+      || read_all(fd, strings, hd.strings_size) < 0
+      // les noms sont lus jusqu'au '\0' : le dernier doit être terminé
+      || (hd.strings_size > 0 && strings[hd.strings_size - 1] != '\0'))
+    goto exit;
+
+  catalog = malloc(sizeof(tar_catalog));
+  assert(catalog);
+  catalog->members = malloc(hd.nb_members ? hd.nb_members * sizeof(tar_member) : 1);
+  assert(catalog->members);
+  catalog->nb_members = 0;
+  catalog->strings = strings_create();
+  catalog->permissions = NULL;
+  catalog->refs = 1;
+
+  size_t offset = 0;
+  for (int64_t i = 0; i < hd.nb_members; i++)
+    {
+      const struct saved_member *r = records + i;
+      const char *names[4];
+
+      for (int j = 0; j < 4; j++)
+	{
+	  if (offset >= (size_t) hd.strings_size)
+	    {
+	      tar_catalog_free(catalog);
+	      catalog = NULL;
+	      goto exit;
+	    }
+	  names[j] = strings + offset;
+	  offset += strlen(names[j]) + 1;
+	}
+
+      catalog->members[catalog->nb_members++] = (tar_member)
+	{
+	  .name = strings_add(catalog->strings, names[0], strlen(names[0])),
+	  .linkname = *names[1] ? strings_add(catalog->strings, names[1], strlen(names[1])) : "",
+	  .uname = strings_share(catalog->strings, names[2], strlen(names[2])),
+	  .gname = strings_share(catalog->strings, names[3], strlen(names[3])),
+	  .ext_start = r->ext_start,
+	  .data_start = r->data_start,
+	  .size = r->size,
+	  .real_size = r->real_size,
+	  .mtime = r->mtime,
+	  .uid = r->uid,
+	  .gid = r->gid,
+	  .mode = r->mode,
+	  .typeflag = r->typeflag
+	};
+    }
+
+ exit:
+  free(records);
+  free(strings);
+  return catalog;
+}
+
+
+void tar_catalog_free (tar_catalog *catalog)
+{
+  if (!catalog)
+    return;
+
+  strings_free(catalog->strings);
+  tar_permissions_free(catalog->permissions);
+  free(catalog->members);
+  free(catalog);
+}
+
+
+const tar_member *tar_catalog_find (const tar_catalog *catalog, const char *name)
+{
+  for (size_t i = catalog->nb_members; i > 0; i--)
+    {
+      if (!strcmp(catalog->members[i - 1].name, name))
+	return catalog->members + i - 1;
+    }
+
+  return NULL;
+}
+
+
+int tar_member_read (int tar_fd, const tar_member *member, tar_file *tf)
+{
+  if (archive_lseek(tar_fd, member->ext_start, SEEK_SET) < 0)
+    return -1;
+
+  return read_member(tar_fd, tf);
+}
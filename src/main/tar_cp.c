@@ -2,117 +2,346 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <linux/limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "archive.h"
 #include "array.h"
 #include "errors.h"
+#include "hashmap.h"
+#include "io_engine.h"
 #include "utils.h"
 
 
-#define BUFSIZE BLOCKSIZE
+/** Directory whose attributes are restored once all of its content is extracted */
+struct pending_dir
+{
+  char *name;
+  mode_t mode;
+  struct timespec mtime;
+};
+
+/**
+ * Extraction planner
+ *
+ * Members are extracted in archive order (links last) so that the tar is read sequentially.
+ * Each directory is created only once, and directories attributes are applied in a final pass,
+ * otherwise creating their content would change their mtime.
+ */
+struct extract_plan
+{
+  int dest_fd;                 /**< the directory to extract in */
+  mode_t umask;                /**< file creation mask applied to restored modes */
+  const char *strip;           /**< prefix of archive names replaced by the extraction name */
+  size_t strip_len;            /**< length of `strip` */
+  hashmap *created_dirs;       /**< set of the directories known to exist (without trailing `/`) */
+  array *dirs;                 /**< array of struct pending_dir */
+};
 
 
-static int make_path(int dest_fd, char *path);
+static void init_plan (struct extract_plan *plan, int dest_fd, const char *full_path, const char *wanted);
+static void free_plan (struct extract_plan *plan);
+static int plan_make_dir (struct extract_plan *plan, const char *path);
+static int plan_make_parents (struct extract_plan *plan, const char *path);
+static int plan_restore_dirs (struct extract_plan *plan);
 
 static int extract_order(const void *lhs, const void *rhs);
+static int restore_order(const void *lhs, const void *rhs);
 
-static int extract_tar_file (const tar_file *tf, const char *extract_name, int dest_fd);
-static int extract_reg_file (const tar_file *tf, const char *extract_name, int dest_fd);
+static mode_t get_file_mode (const struct posix_header *hd);
+static struct timespec get_file_mtime (const struct posix_header *hd);
+
+static int extract_tar_file (const tar_file *tf, const char *extract_name, struct extract_plan *plan);
+static int extract_reg_file (const tar_file *tf, const char *extract_name, struct extract_plan *plan);
+static int extract_dir (const tar_file *tf, const char *extract_name, struct extract_plan *plan);
 static int ftar_extract_dir (int tar_fd, const char *full_path, const char *wanted_dir, int dest_fd);
 static int ftar_extract_file (int tar_fd, const char *full_path, const char *wanted_file, int dest_fd);
 
+
+static void init_plan (struct extract_plan *plan, int dest_fd, const char *full_path, const char *wanted)
+{
+  plan->dest_fd = dest_fd;
+  plan->umask = getumask();
+  plan->strip = full_path;
+  plan->strip_len = wanted - full_path;
+  plan->created_dirs = hashmap_create();
+  plan->dirs = array_create(sizeof(struct pending_dir));
+}
+
+static void free_plan (struct extract_plan *plan)
+{
+  ARRAY_FOREACH (struct pending_dir, dir, plan->dirs)
+    free(dir->name);
+
+  array_free(plan->dirs, false);
+  hashmap_free(plan->created_dirs, false);
+}
+
 /**
- * Create a path from a directory
+ * Create a directory if it was not already created during this extraction
  */
-static int make_path(int dest_fd, char *path)
+static int plan_make_dir (struct extract_plan *plan, const char *path)
 {
-  char *p = path;
+  if (hashmap_contains(plan->created_dirs, path))
+    return 0;
+
+  // on garde le droit d'écriture pour pouvoir extraire le contenu du dossier
+  if (mkdirat(plan->dest_fd, path, (0777 & ~plan->umask) | S_IRWXU) == -1 && errno != EEXIST)
+    return -1;
+
+  hashmap_put(plan->created_dirs, path, NULL);
+  return 0;
+}
+
+/**
+ * Create all the parent directories of a path
+ */
+static int plan_make_parents (struct extract_plan *plan, const char *path)
+{
+  char buf[PATH_MAX];
+  const char *p = path;
+
   while ((p = strchr(p, '/')) && p[1])
     {
-      *p = '\0';
+      memcpy(buf, path, p - path);
+      buf[p - path] = '\0';
 
-      if (mkdirat(dest_fd, path, 0777 & ~getumask()) == -1)
-	{
-	  if (errno != EEXIST)
-	    {
-	      *p = '/';
-	      return -1;
-	    }
-	}
+      if (plan_make_dir(plan, buf) < 0)
+	return -1;
 
-      *p = '/';
       p++;
     }
 
   return 0;
 }
 
+/**
+ * Apply modes and mtimes of all extracted directories
+ */
+static int plan_restore_dirs (struct extract_plan *plan)
+{
+  struct pending_dir *dir;
+  struct timespec times[2];
+  int fd, ret;
+
+  ret = 0;
+
+  // les sous-dossiers d'abord : un dossier sans droit d'exécution ne peut plus être traversé
+  array_sort(plan->dirs, restore_order);
+
+  for (int i = 0; i < array_size(plan->dirs); i++)
+    {
+      dir = array_at(plan->dirs, i);
+
+      fd = openat(plan->dest_fd, dir->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+      if (fd < 0)
+	{
+	  ret = -1;
+	}
+      else
+	{
+	  times[0].tv_sec = 0;
+	  times[0].tv_nsec = UTIME_OMIT;
+	  times[1] = dir->mtime;
+
+	  if (fchmod(fd, dir->mode) < 0 || futimens(fd, times) < 0)
+	    ret = -1;
+
+	  close(fd);
+	}
+    }
+
+  return ret;
+}
+
+
 static int extract_order(const void *lhs, const void *rhs)
 {
-  struct posix_header lhd = ((tar_file*)lhs)->header;
-  struct posix_header rhd = ((tar_file*)rhs)->header;
+  const tar_file *ltf = lhs;
+  const tar_file *rtf = rhs;
 
+  // les liens en dernier, leur cible doit déjà exister...
+  bool llink = ltf->header.typeflag == SYMTYPE || ltf->header.typeflag == LNKTYPE;
+  bool rlink = rtf->header.typeflag == SYMTYPE || rtf->header.typeflag == LNKTYPE;
 
-  // les liens symboliques en dernier...
-  if (lhd.typeflag == SYMTYPE)
-    return 1;
+  if (llink != rlink)
+    return llink ? 1 : -1;
 
-  if (rhd.typeflag == SYMTYPE)
-    return -1;
+  // ... sinon on suit l'ordre de l'archive pour la lire séquentiellement
+  return (ltf->file_start > rtf->file_start) - (ltf->file_start < rtf->file_start);
+}
 
-  // ... précédés des liens physiques
-  if (lhd.typeflag == LNKTYPE)
-    return 1;
+static int restore_order(const void *lhs, const void *rhs)
+{
+  return -strcmp(((struct pending_dir*)lhs)->name, ((struct pending_dir*)rhs)->name);
+}
 
-  if (rhd.typeflag == LNKTYPE)
-    return -1;
 
-  // sinon on utilise ordre lexicographique
-  return strcmp(lhd.name, rhd.name);
+static mode_t get_file_mode (const struct posix_header *hd)
+{
+  return strtol(hd->mode, NULL, 8) & 07777;
+}
+
+static struct timespec get_file_mtime (const struct posix_header *hd)
+{
+  struct timespec ts;
+
+  ts.tv_sec = strtol(hd->mtime, NULL, 8);
+  ts.tv_nsec = 0;
+
+  return ts;
 }
 
-static int extract_tar_file (const tar_file *tf, const char *extract_name, int dest_fd)
+
+static int extract_tar_file (const tar_file *tf, const char *extract_name, struct extract_plan *plan)
 {
+  const char *linkname;
+
   switch (tf->header.typeflag)
     {
     case AREGTYPE:
     case REGTYPE:
-      return extract_reg_file (tf, extract_name, dest_fd);
+      return extract_reg_file (tf, extract_name, plan);
 
     case DIRTYPE:
-      return mkdirat (dest_fd, extract_name, 0777 & ~getumask());
+      return extract_dir (tf, extract_name, plan);
 
     case SYMTYPE:
-      return symlinkat (tf->header.linkname, dest_fd, extract_name);
+      return symlinkat (tf->linkname, plan->dest_fd, extract_name);
 
     case LNKTYPE:
-      return linkat (dest_fd, tf->header.linkname, dest_fd, extract_name, 0);
+      // la cible a été extraite sous un autre nom si elle est dans le dossier extrait
+      linkname = tf->linkname;
+      if (plan->strip_len > 0 && is_prefix(plan->strip, linkname) == 1)
+	linkname += plan->strip_len;
+
+      return linkat (plan->dest_fd, linkname, plan->dest_fd, extract_name, 0);
 
     default:
       return 0;
     }
 }
 
+/**
+ * Extract several regular files from a tar
+ *
+ * The destination files are opened, filled and closed by batches through the I/O engine,
+ * each file is then left with the mode and mtime of its header.
+ * Only the data extents of a sparse file are written, its holes are left unallocated.
+ */
+static int extract_reg_files (const tar_file files[], char *const names[], size_t n, struct extract_plan *plan)
+{
+  int fds[IO_BATCH_MAX];
+  struct io_copy_queue queue;
+  struct timespec times[2];
+  int ret = 0;
+
+  io_queue_init(&queue);
+
+  for (size_t start = 0; start < n; start += IO_BATCH_MAX)
+    {
+      size_t batch = n - start < IO_BATCH_MAX ? n - start : IO_BATCH_MAX;
+
+      if (io_openat_batch(plan->dest_fd, names + start, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR, fds, batch) < 0)
+	ret = -1;
+
+      for (size_t i = 0; i < batch; i++)
+	{
+	  const tar_file *tf = files + start + i;
+	  const struct sparse_map *sparse = tf->sparse;
+
+	  if (fds[i] < 0)
+	    continue;
+
+	  if (!sparse)
+	    {
+	      io_queue_copy(&queue, (struct io_copy) { tf->tar_fd, tf->data_start, NULL, fds[i], 0, get_file_size(&tf->header) });
+	      continue;
+	    }
+
+	  // les extents sont stockés à la suite, chacun est écrit à son offset
+	  off_t stored = tf->data_start + sparse->map_size;
+	  for (size_t j = 0; j < sparse->nb_extents; j++)
+	    {
+	      const struct sparse_extent *extent = sparse->extents + j;
+
+	      if (extent->size > 0)
+		io_queue_copy(&queue, (struct io_copy) { tf->tar_fd, stored, NULL, fds[i], extent->offset, extent->size });
+	      stored += extent->size;
+	    }
+	}
+
+      if (io_queue_flush(&queue) < 0)
+	ret = -1;
+
+      // les fichiers sont encore ouverts : on restaure leurs attributs sans les rouvrir
+      for (size_t i = 0; i < batch; i++)
+	{
+	  const tar_file *tf = files + start + i;
+
+	  if (fds[i] < 0)
+	    continue;
+
+	  // un trou final n'est pas écrit : la taille est fixée sans allouer de blocs
+	  if (tf->sparse && ftruncate(fds[i], tf->sparse->real_size) < 0)
+	    ret = -1;
+
+	  times[0].tv_sec = 0;
+	  times[0].tv_nsec = UTIME_OMIT;
+	  times[1] = get_file_mtime(&tf->header);
+
+	  if (fchmod(fds[i], get_file_mode(&tf->header) & ~plan->umask) < 0 || futimens(fds[i], times) < 0)
+	    ret = -1;
+
+	  close(fds[i]);
+	}
+
+      if (ret < 0)
+	return -1;
+    }
+
+  return 0;
+}
+
 /**
  * Extract a regular file from a tar
  */
-static int extract_reg_file (const tar_file *tf, const char *extract_name, int dest_fd)
+static int extract_reg_file (const tar_file *tf, const char *extract_name, struct extract_plan *plan)
 {
-  lseek(tf->tar_fd, tf->file_start + BLOCKSIZE, SEEK_SET);
+  char *names[1] = { (char *) extract_name };
 
-  int fd = openat(dest_fd, extract_name, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
-  if (fd < 0)
-    return -1;
+  return extract_reg_files(tf, names, 1, plan);
+}
+
+/**
+ * Extract a directory from a tar, its attributes are restored by plan_restore_dirs
+ */
+static int extract_dir (const tar_file *tf, const char *extract_name, struct extract_plan *plan)
+{
+  struct pending_dir dir;
+  char *name = copy_string(extract_name);
 
-  size_t file_size = get_file_size(&tf->header);
+  remove_last_slash(name);
 
-  return read_write_buf_by_buf(tf->tar_fd, fd, file_size, BUFSIZE);
+  if (plan_make_dir(plan, name) < 0)
+    {
+      free(name);
+      return -1;
+    }
+
+  dir.name = name;
+  dir.mode = get_file_mode(&tf->header) & ~plan->umask;
+  dir.mtime = get_file_mtime(&tf->header);
+  array_insert_last(plan->dirs, &dir);
+
+  return 0;
 }
 
 
@@ -120,48 +349,97 @@ static int ftar_extract_dir (int tar_fd, const char *full_path, const char *want
 {
   array *arr;
   tar_file *tf;
-  char *extract_name;
-  size_t wanted_dir_start;
+  const char *extract_name;
+  struct extract_plan plan;
+  tar_file dir_tf;
+  tar_file *reg_files;
+  char **reg_names;
+  size_t nb_reg;
+  int ret, r;
 
   tf = NULL;
+  reg_files = NULL;
+  reg_names = NULL;
+  nb_reg = 0;
+  ret = 0;
 
   arr = tar_ls_dir(tar_fd, full_path, true);
   if (!arr)
-    goto error;
+    return -1;
 
-  wanted_dir_start = wanted_dir - full_path;
-  array_sort(arr, extract_order);
+  init_plan(&plan, dest_fd, full_path, wanted_dir);
 
-  // on extrait un par un les fichiers
-  for (int i=0; i < array_size(arr); i++)
+  // le dossier extrait lui-même n'est pas dans arr
+  if (!is_empty_string(full_path) && archive_lseek(tar_fd, 0, SEEK_SET) == 0
+      && seek_member(tar_fd, full_path, &dir_tf) == 1)
     {
-      tf = array_get(arr, i);
+      r = extract_dir(&dir_tf, wanted_dir, &plan);
+      free_tar_file(&dir_tf);
 
-      if (!tf)
+      if (r < 0)
 	goto error;
+    }
+
+  array_sort(arr, extract_order);
+
+  // les fichiers réguliers sont mis de côté et extraits par lots,
+  // les dossiers sont créés avant que leur contenu ne soit ouvert
+  reg_files = malloc(array_size(arr) * sizeof(tar_file));
+  reg_names = malloc(array_size(arr) * sizeof(char *));
+  if (array_size(arr) > 0 && (!reg_files || !reg_names))
+    goto error;
 
-      extract_name = tf->header.name + wanted_dir_start;
+  for (int i=0; i < array_size(arr); i++)
+    {
+      tf = array_at(arr, i);
+
+      extract_name = tf->name + plan.strip_len;
 
       // on crée le chemin d'extraction si besoin
-      if (make_path(dest_fd, tf->header.name) < 0)
+      if (plan_make_parents(&plan, extract_name) < 0)
 	goto error;
 
-      if (extract_tar_file (tf, extract_name, dest_fd) < 0)
-	goto error;
+      if (tf->header.typeflag == REGTYPE || tf->header.typeflag == AREGTYPE)
+	{
+	  reg_files[nb_reg] = *tf;
+	  reg_names[nb_reg] = reg_files[nb_reg].name + plan.strip_len;
+	  nb_reg++;
+	}
+      else
+	{
+	  // les liens sont en fin de tableau : leurs cibles doivent déjà être extraites
+	  if (tf->header.typeflag == LNKTYPE && nb_reg > 0)
+	    {
+	      if (extract_reg_files(reg_files, reg_names, nb_reg, &plan) < 0)
+		goto error;
+	      nb_reg = 0;
+	    }
 
-      free(tf);
+	  if (extract_tar_file (tf, extract_name, &plan) < 0)
+	    goto error;
+	}
     }
 
-  array_free(arr, false);
+  if (nb_reg > 0 && extract_reg_files(reg_files, reg_names, nb_reg, &plan) < 0)
+    goto error;
 
-  return 0;
+  if (plan_restore_dirs(&plan) < 0)
+    ret = -1;
+
+  tar_ls_free(arr);
+  free_plan(&plan);
+  free(reg_files);
+  free(reg_names);
+
+  return ret;
 
  error:
-  if (arr)
-    array_free(arr, false);
+  plan_restore_dirs(&plan);
 
-  if (tf)
-    free(tf);
+  tar_ls_free(arr);
+  free_plan(&plan);
+  free(reg_files);
+  free(reg_names);
 
   return -1;
 }
@@ -169,17 +447,24 @@ static int ftar_extract_dir (int tar_fd, const char *full_path, const char *want
 static int ftar_extract_file (int tar_fd, const char *full_path, const char *wanted_file, int dest_fd)
 {
   tar_file tf;
-  struct posix_header file_header;
-  int r = seek_header(tar_fd, full_path, &file_header);
+  struct extract_plan plan;
+  int r = seek_member(tar_fd, full_path, &tf);
 
   if (r < 0)
     return -1;
+  else if (r == 0)
+    return error_pt(NULL, 0, ENOENT);
+
+  init_plan(&plan, dest_fd, full_path, full_path);
 
-  tf.tar_fd = tar_fd;
-  tf.header = file_header;
-  tf.file_start = lseek (tar_fd, -BLOCKSIZE, SEEK_CUR);
+  r = extract_tar_file (&tf, wanted_file, &plan);
+  if (plan_restore_dirs(&plan) < 0)
+    r = -1;
 
-  return extract_tar_file (&tf, wanted_file, dest_fd);
+  free_plan(&plan);
+  free_tar_file(&tf);
+
+  return r;
 }
 
 
@@ -209,7 +494,7 @@ int tar_extract (const char *tar_name, const char *filename, const char *dest)
   int tar_fd, dest_fd, ret;
   const char *wanted_file;
 
-  tar_fd = open(tar_name, O_RDONLY);
+  tar_fd = archive_open(tar_name, O_RDONLY);
   if (tar_fd < 0)
     return -1;
 
@@ -217,7 +502,7 @@ int tar_extract (const char *tar_name, const char *filename, const char *dest)
   if (ftar_access (tar_fd, filename, R_OK) < 0)
     return error_pt (&tar_fd, 1, errno);
 
-  lseek(tar_fd, 0, SEEK_SET);
+  archive_lseek(tar_fd, 0, SEEK_SET);
 
   dest_fd = open(dest, O_DIRECTORY);
   if (dest_fd < 0)
@@ -235,7 +520,7 @@ int tar_extract (const char *tar_name, const char *filename, const char *dest)
   }
 
   close(dest_fd);
-  close(tar_fd);
+  archive_close(tar_fd);
 
   return ret;
 }
@@ -246,14 +531,13 @@ int tar_cp_file(const char *tar_name, const char *filename, int fd)
   if (tar_access (tar_name, filename, R_OK) < 0)
     return -1;
 
-  int tar_fd = open(tar_name, O_RDONLY);
+  int tar_fd = archive_open(tar_name, O_RDONLY);
 
   if (tar_fd < 0)
     return -1;
 
-  unsigned int file_size;
-  struct posix_header file_header;
-  int r = seek_header(tar_fd, filename, &file_header);
+  tar_file tf;
+  int r = seek_member(tar_fd, filename, &tf);
 
   if (r < 0) // erreur
   {
@@ -263,20 +547,46 @@ int tar_cp_file(const char *tar_name, const char *filename, int fd)
   {
     return error_pt(&tar_fd, 1, ENOENT);
   }
-  else if (file_header.typeflag == DIRTYPE)
-  {
-    return error_pt(&tar_fd, 1, EISDIR);
-  }
-  else if (file_header.typeflag != AREGTYPE && file_header.typeflag != REGTYPE && file_header.typeflag != LNKTYPE && file_header.typeflag != SYMTYPE)
-  {
-    return error_pt(&tar_fd, 1, EPERM);
-  }
 
-  file_size = get_file_size(&file_header);
-  if (read_write_buf_by_buf(tar_fd, fd, file_size, BUFSIZE) < 0)
+  if (tf.header.typeflag == DIRTYPE)
+    r = error_pt(NULL, 0, EISDIR);
+  else if (tf.header.typeflag != AREGTYPE && tf.header.typeflag != REGTYPE && tf.header.typeflag != LNKTYPE && tf.header.typeflag != SYMTYPE)
+    r = error_pt(NULL, 0, EPERM);
+  else
+    r = write_member_content(&tf, fd);
+
+  free_tar_file(&tf);
+  if (r < 0)
     return error_pt(&tar_fd, 1, errno);
 
-  close(tar_fd);
+  archive_close(tar_fd);
 
   return 0;
 }
+
+
+int members_cp_file(const tar_catalog *catalog, int tar_fd, const char *filename, int fd)
+{
+  if (members_access (catalog, filename, R_OK) < 0)
+    return -1;
+
+  const tar_member *member = tar_catalog_find (catalog, filename);
+  if (!member)
+    return error_pt(NULL, 0, ENOENT);
+
+  tar_file tf;
+  int r = tar_member_read(tar_fd, member, &tf);
+
+  if (r <= 0)
+    return error_pt(NULL, 0, r < 0 ? errno : EIO);
+
+  if (tf.header.typeflag == DIRTYPE)
+    r = error_pt(NULL, 0, EISDIR);
+  else if (tf.header.typeflag != AREGTYPE && tf.header.typeflag != REGTYPE && tf.header.typeflag != LNKTYPE && tf.header.typeflag != SYMTYPE)
+    r = error_pt(NULL, 0, EPERM);
+  else
+    r = write_member_content(&tf, fd);
+
+  free_tar_file(&tf);
+  return r < 0 ? -1 : 0;
+}
@@ -0,0 +1,303 @@
+#include "tar_glob.h"
+
+#include <ctype.h>
+#include <linux/limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hashmap.h"
+#include "utils.h"
+
+
+/** State of a call to tar_glob() */
+struct glob_search
+{
+  const tar_catalog *catalog;
+  const char *pattern;
+  int flags;
+  bool dirs_only;            // le motif finit par un /
+  hashmap *seen;             // noms déjà essayés, sans / final
+  array *matches;
+  arena *mem;
+};
+
+
+
+
+bool has_glob (const char *str)
+{
+  for (; *str; str++)
+    {
+      if (*str == '\\' && str[1])
+	str++;
+      else if (*str == '*' || *str == '?' || *str == '[')
+	return true;
+    }
+
+  return false;
+}
+
+
+void glob_unescape (char *str)
+{
+  char *to = str;
+
+  for (; *str; str++)
+    {
+      if (*str == '\\' && str[1])
+	str++;
+      *to++ = *str;
+    }
+  *to = '\0';
+}
+
+
+static bool same_char (char p, char c, int flags)
+{
+  if (flags & TAR_GLOB_NOCASE)
+    return tolower((unsigned char) p) == tolower((unsigned char) c);
+  return p == c;
+}
+
+
+static bool in_range (char lo, char hi, char c, int flags)
+{
+  int lower = tolower((unsigned char) c), upper = toupper((unsigned char) c);
+
+  if (c >= lo && c <= hi)
+    return true;
+
+  return (flags & TAR_GLOB_NOCASE) && ((lower >= lo && lower <= hi) || (upper >= lo && upper <= hi));
+}
+
+
+/* Match C against the set starting at P (after the `[`) ; the end of the set, or NULL if it has no `]` */
+static const char *match_set (const char *p, const char *end, char c, int flags, bool *ok)
+{
+  bool negated = false, found = false;
+
+  if (p < end && (*p == '!' || *p == '^'))
+    {
+      negated = true;
+      p++;
+    }
+
+  // un ] en tête fait partie de l'ensemble
+  for (const char *first = p; p < end && (*p != ']' || p == first); p++)
+    {
+      char lo = *p == '\\' && p + 1 < end ? *++p : *p;
+      char hi = lo;
+
+      if (p + 2 < end && p[1] == '-' && p[2] != ']')
+	{
+	  p += 2;
+	  hi = *p == '\\' && p + 1 < end ? *++p : *p;
+	}
+
+      if (in_range(lo, hi, c, flags))
+	found = true;
+    }
+
+  if (p >= end)
+    return NULL;
+
+  *ok = found != negated;
+  return p + 1;
+}
+
+
+/* Match the component [NAME, NAME_END) against the component [P, P_END) of a pattern */
+static bool match_component (const char *p, const char *p_end, const char *name, const char *name_end, int flags)
+{
+  const char *star_p = NULL, *star_name = NULL;
+
+  // un nom caché n'est trouvé que par un motif qui commence par un point
+  if (name < name_end && *name == '.' && (p == p_end || *p != '.'))
+    return false;
+
+  while (name < name_end)
+    {
+      bool ok = false;
+      const char *next = p;
+
+      if (p < p_end && *p == '*')
+	{
+	  star_p = ++p;
+	  star_name = name;
+	  continue;
+	}
+
+      if (p == p_end)
+	{
+	  ok = false;
+	}
+      else if (*p == '?')
+	{
+	  ok = true;
+	  next = p + 1;
+	}
+      else if (*p != '[' || !(next = match_set(p + 1, p_end, *name, flags, &ok)))
+	{
+	  // un [ sans ] est pris tel quel
+	  next = *p == '\\' && p + 1 < p_end ? p + 1 : p;
+	  ok = same_char(*next, *name, flags);
+	  next++;
+	}
+
+      if (ok)
+	{
+	  p = next;
+	  name++;
+	}
+      else if (star_p)
+	{
+	  // l'étoile prend un caractère de plus
+	  p = star_p;
+	  name = ++star_name;
+	}
+      else
+	{
+	  return false;
+	}
+    }
+
+  while (p < p_end && *p == '*')
+    p++;
+
+  return p == p_end;
+}
+
+
+static const char *component_end (const char *s)
+{
+  const char *slash = strchr(s, '/');
+  return slash ? slash : s + strlen(s);
+}
+
+
+static bool match_components (const char *pattern, const char *name, int flags)
+{
+  const char *p_end = component_end(pattern);
+  const char *p_next = *p_end ? p_end + 1 : p_end;
+  const char *name_end = component_end(name);
+  const char *name_next = *name_end ? name_end + 1 : name_end;
+
+  if (!*pattern)
+    return !*name;
+
+  if (p_end - pattern == 2 && !strncmp(pattern, "**", 2))
+    {
+      // aucun composant, ou un de plus
+      if (match_components(p_next, name, flags))
+	return true;
+      if (!*name || *name == '.')
+	return false;
+      return match_components(pattern, name_next, flags);
+    }
+
+  if (!*name || !match_component(pattern, p_end, name, name_end, flags))
+    return false;
+
+  // les deux doivent finir ensemble
+  if (!*p_end || !*name_end)
+    return !*p_end && !*name_end;
+
+  return match_components(p_next, name_next, flags);
+}
+
+
+bool tar_glob_match (const char *pattern, const char *name, int flags)
+{
+  return match_components(pattern, name, flags);
+}
+
+
+/* Try NAME (LEN first bytes), a directory if IS_DIR ; false if it was already tried */
+static bool try_name (struct glob_search *search, const char *name, size_t len, bool is_dir)
+{
+  char buf[PATH_MAX];
+
+  if (len >= sizeof(buf) - 1)
+    return true;
+
+  memcpy(buf, name, len);
+  buf[len] = '\0';
+
+  if (hashmap_contains(search->seen, buf))
+    return false;
+  hashmap_put(search->seen, buf, NULL);
+
+  if ((search->dirs_only && !is_dir) || !tar_glob_match(search->pattern, buf, search->flags))
+    return true;
+
+  // un dossier est vérifié avec son / final
+  if (is_dir)
+    {
+      buf[len] = '/';
+      buf[len + 1] = '\0';
+    }
+  if (members_access(search->catalog, buf, F_OK) < 0)
+    return true;
+
+  if (!search->dirs_only)
+    buf[len] = '\0';
+
+  char *match = search->mem ? arena_strdup(search->mem, buf) : copy_string(buf);
+  array_insert_last(search->matches, &match);
+
+  return true;
+}
+
+
+static int name_order (const void *lhs, const void *rhs)
+{
+  return strcmp(*(char *const *) lhs, *(char *const *) rhs);
+}
+
+
+
+
+array *tar_glob (arena *mem, const tar_catalog *catalog, const char *pattern, int flags)
+{
+  char buf[PATH_MAX];
+  size_t len = strlen(pattern);
+  struct glob_search search =
+    {
+      catalog, buf, flags, len > 0 && pattern[len - 1] == '/', hashmap_create(), array_create_in(mem, sizeof(char *)), mem
+    };
+
+  // le motif est comparé aux noms sans leur / final
+  snprintf(buf, sizeof(buf), "%s", pattern);
+  while (len > 0 && buf[len - 1] == '/')
+    buf[--len] = '\0';
+
+  for (size_t i = 0; i < catalog->nb_members; i++)
+    {
+      const char *name = catalog->members[i].name;
+      size_t end = strlen(name);
+      bool is_dir = catalog->members[i].typeflag == DIRTYPE;
+
+      if (end > 0 && name[end - 1] == '/')
+	{
+	  end--;
+	  is_dir = true;
+	}
+
+      // les dossiers parents sont essayés jusqu'au premier déjà vu : les siens l'ont été avec lui
+      while (end > 0 && try_name(&search, name, end, is_dir))
+	{
+	  while (end > 0 && name[end - 1] != '/')
+	    end--;
+	  if (end > 0)
+	    end--;
+	  is_dir = true;
+	}
+    }
+
+  hashmap_free(search.seen, false);
+  array_sort(search.matches, name_order);
+
+  return search.matches;
+}
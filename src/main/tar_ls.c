@@ -7,6 +7,7 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "archive.h"
 #include "array.h"
 #include "errors.h"
 #include "tar.h"
@@ -16,42 +17,79 @@
 char dir_name_glob[PATH_MAX];
 bool in_dir_rec;
 
-array* tar_ls_if (int tar_fd, bool (*predicate)(const struct posix_header *))
+int tar_visit (int tar_fd, tar_visitor visit, void *data)
 {
-  array *ret;
-  ssize_t size_read;
-  tar_file tf;
+  tar_iter it;
+  tar_file *tf;
+  off_t offset = 0;
+  int r, nb_threads;
 
-  lseek(tar_fd, 0, SEEK_SET);
-  ret = array_create (sizeof(tar_file));
-  tf.tar_fd = tar_fd;
+  // une grande archive stockée telle quelle est parcourue par plusieurs threads
+  if (archive_lseek(tar_fd, 0, SEEK_END) >= TAR_SCAN_MIN_SIZE && archive_backing(tar_fd, &offset, BLOCKSIZE) == tar_fd
+      && (nb_threads = tar_scan_threads()) > 1)
+    return tar_scan_visit(tar_fd, visit, data, nb_threads);
 
-  while ((size_read = read(tar_fd, &tf.header, BLOCKSIZE)))
+  archive_lseek(tar_fd, 0, SEEK_SET);
+
+  // les noms complets sont reconstruits une seule fois, ici
+  tar_iter_open(&it, tar_fd);
+  while ((r = tar_iter_next(&it, &tf)) == 1)
     {
-      if (size_read != BLOCKSIZE)
-	{
-	  array_free(ret, false);
-	  return NULL;
-	}
+      if (visit(tf, data))
+	tar_iter_keep(&it);
+    }
+  tar_iter_close(&it);
+
+  return r < 0 ? -1 : 0;
+}
 
-      if (tf.header.name[0] == '\0')
-	break;
 
-      if (predicate (&tf.header)) // on ajoute au tableau si le prédicat est vrai
-	{
-	  tf.file_start = lseek(tar_fd, 0, SEEK_CUR) - BLOCKSIZE;
+/** Listing of tar_ls_if() */
+struct listing
+{
+  array *members;
+  bool (*predicate)(const tar_file *);
+};
+
+static bool keep_if (tar_file *tf, void *data)
+{
+  struct listing *listing = data;
 
-	  array_insert_last (ret, &tf);
-	}
+  if (!listing->predicate(tf)) // on ajoute au tableau si le prédicat est vrai
+    return false;
 
-      skip_file_content(tar_fd, &tf.header);
+  array_insert_last(listing->members, tf);
+  return true;
+}
+
+
+array* tar_ls_if (int tar_fd, bool (*predicate)(const tar_file *))
+{
+  struct listing listing = { array_create(sizeof(tar_file)), predicate };
+
+  if (tar_visit(tar_fd, keep_if, &listing) < 0)
+    {
+      tar_ls_free(listing.members);
+      return NULL;
     }
 
-  return ret;
+  return listing.members;
 }
 
 
-static bool always_true (const struct posix_header *header)
+void tar_ls_free (array *arr)
+{
+  if (!arr)
+    return;
+
+  ARRAY_FOREACH (tar_file, tf, arr)
+    free_tar_file(tf);
+
+  array_free(arr, false);
+}
+
+
+static bool always_true (const tar_file *tf)
 {
   return true;
 }
@@ -63,15 +101,15 @@ array* tar_ls_all (int tar_fd)
 }
 
 
-static bool in_dir(const struct posix_header *header)
+static bool in_dir(const tar_file *tf)
 {
-  if (is_prefix(dir_name_glob, header->name) != 1)
+  if (is_prefix(dir_name_glob, tf->name) != 1)
     return false;
 
   if (in_dir_rec)
     return true;
 
-  char *c = strchr(header->name + strlen(dir_name_glob), '/');
+  char *c = strchr(tf->name + strlen(dir_name_glob), '/');
   return !c || !c[1]; // pas de '/' ou '/' à la fin
 
 }
@@ -95,29 +133,37 @@ array* tar_ls_dir (int tar_fd, const char *dir_name, bool rec)
 
 struct posix_header *tar_ls(const char *tar_name, int *nb_headers)
 {
-  int tar_fd = open(tar_name, O_RDONLY);
+  int tar_fd = archive_open(tar_name, O_RDONLY);
   if (tar_fd < 0)
-    return error_p(&tar_fd, 1, errno);
+    return NULL;
 
-  *nb_headers = nb_files_in_tar(tar_fd);
-  if( *nb_headers < 0)
-    return error_p(&tar_fd, 1, errno);
-  ssize_t size_read;
+  // un seul parcours : le tableau grandit au fur et à mesure
+  struct posix_header *list_header = NULL;
+  int capacity = 0, r;
+  tar_iter it;
+  tar_file *tf;
 
-  struct posix_header *list_header = malloc((*nb_headers) * sizeof(struct posix_header));
-  assert(list_header);
+  *nb_headers = 0;
+  tar_iter_open(&it, tar_fd);
+  while ((r = tar_iter_next(&it, &tf)) == 1)
+  {
+    if (*nb_headers == capacity)
+    {
+      capacity = capacity ? 2 * capacity : 64;
+      list_header = realloc(list_header, capacity * sizeof(struct posix_header));
+      assert(list_header);
+    }
+    list_header[(*nb_headers)++] = tf->header;
+  }
+  tar_iter_close(&it);
 
-  for(int i=0; i < *nb_headers; i++)
+  if (r < 0)
   {
-    size_read = read(tar_fd, list_header+i, BLOCKSIZE);
-
-    if(size_read != BLOCKSIZE)
-	  {
-	    free(list_header);
-	    return error_p(&tar_fd, 1, errno);
-	  }
-    skip_file_content(tar_fd, list_header+i);
+    free(list_header);
+    return error_p(&tar_fd, 1, errno);
   }
-  close(tar_fd);
-  return list_header;
+
+  archive_close(tar_fd);
+  // un tar vide donne un tableau vide, pas une erreur
+  return list_header ? list_header : malloc(0);
 }
@@ -0,0 +1,377 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "archive.h"
+#include "tar.h"
+#include "utils.h"
+
+
+/** Progress of a member read by tar_read_members() */
+enum read_state
+  {
+    READ_PENDING,   /**< not read yet, the forward pass has not reached it */
+    READ_DEFERRED,  /**< too big to be kept, read on its own at its turn */
+    READ_BUFFERED,  /**< read before its turn, kept in memory */
+    READ_FAILED     /**< not found or not readable */
+  };
+
+/** A member asked to tar_read_members() */
+struct member_read
+{
+  int index;                  // rang du membre dans la demande
+  off_t start;                // début du contenu stocké dans l'archive
+  off_t size;                 // taille du contenu stocké (carte et extents d'un fichier creux compris)
+  struct sparse_map *sparse;  // NULL si le fichier n'est pas creux
+  enum read_state state;
+  int err;
+  char *buffer;               // contenu lu avant son tour
+
+  // progression dans la carte d'un fichier creux
+  off_t skip;                 // octets de la carte pas encore passés
+  size_t extent;
+  off_t in_extent;
+  off_t written;              // taille du fichier déjà donnée, trous compris
+};
+
+/** State of a call to tar_read_members() */
+struct reader
+{
+  int tar_fd;
+  member_sink sink;
+  void *data;
+  char *chunk;                // tampon des lectures
+  size_t buffered;            // octets gardés pour les membres lus avant leur tour
+  bool stopped;               // le sink a arrêté la lecture
+};
+
+
+
+
+/* Find FILENAME in CATALOG and fill MR ; MR is marked READ_FAILED with the errno otherwise */
+static void resolve_member (int tar_fd, const tar_catalog *catalog, const char *filename, struct member_read *mr)
+{
+  char dir[PATH_MAX];
+  const tar_member *member = NULL;
+
+  if (is_empty_string(filename))
+    errno = EISDIR;
+  else if (members_access(catalog, filename, R_OK) >= 0 && !(member = tar_catalog_find(catalog, filename)))
+    errno = ENOENT;
+
+  if (!member)
+    {
+      // un dossier peut n'exister qu'à travers son contenu
+      snprintf(dir, sizeof(dir), "%s/", filename);
+      if (errno == ENOENT && members_access(catalog, dir, F_OK) > 0)
+	errno = EISDIR;
+      mr->state = READ_FAILED;
+      mr->err = errno;
+      return;
+    }
+
+  if (member->typeflag == DIRTYPE)
+    mr->err = EISDIR;
+  else if (member->typeflag != AREGTYPE && member->typeflag != REGTYPE && member->typeflag != LNKTYPE && member->typeflag != SYMTYPE)
+    mr->err = EPERM;
+
+  if (mr->err)
+    {
+      mr->state = READ_FAILED;
+      return;
+    }
+
+  mr->start = member->data_start;
+  mr->size = member->size;
+
+  // un fichier creux a des en-têtes étendus, ou des trous : sa carte est relue
+  if (member->ext_start + BLOCKSIZE != member->data_start || member->real_size != member->size)
+    {
+      tar_file tf;
+      int r = tar_member_read(tar_fd, member, &tf);
+
+      if (r <= 0)
+	{
+	  mr->state = READ_FAILED;
+	  mr->err = r < 0 ? errno : EIO;
+	  return;
+	}
+
+      mr->sparse = tf.sparse;
+      tf.sparse = NULL;
+      free_tar_file(&tf);
+
+      if (mr->sparse)
+	mr->skip = mr->sparse->map_size;
+    }
+}
+
+
+static int offset_order (const void *lhs, const void *rhs)
+{
+  const struct member_read *a = *(struct member_read *const *) lhs;
+  const struct member_read *b = *(struct member_read *const *) rhs;
+
+  if (a->start != b->start)
+    return a->start < b->start ? -1 : 1;
+  return a->index - b->index;
+}
+
+
+static int give (struct reader *r, int index, const void *buf, size_t count, int err)
+{
+  if (!r->stopped && r->sink(index, buf, count, err, r->data) < 0)
+    r->stopped = true;
+
+  return r->stopped ? -1 : 0;
+}
+
+
+/* Give COUNT bytes of the stored content of MR to the sink, split between the extents and the holes of a sparse file */
+static int feed (struct reader *r, struct member_read *mr, const char *buf, off_t count)
+{
+  struct sparse_map *sparse = mr->sparse;
+  off_t n;
+
+  if (!sparse)
+    return count > 0 ? give(r, mr->index, buf, count, 0) : 0;
+
+  while (count > 0 && mr->extent < sparse->nb_extents)
+    {
+      const struct sparse_extent *extent = sparse->extents + mr->extent;
+
+      // la carte au début du contenu n'est pas donnée
+      if (mr->skip > 0)
+	{
+	  n = mr->skip < count ? mr->skip : count;
+	  mr->skip -= n;
+	  buf += n;
+	  count -= n;
+	  continue;
+	}
+
+      if (mr->in_extent == 0 && extent->offset > mr->written)
+	{
+	  if (give(r, mr->index, NULL, extent->offset - mr->written, 0) < 0)
+	    return -1;
+	  mr->written = extent->offset;
+	}
+
+      n = extent->size - mr->in_extent < count ? extent->size - mr->in_extent : count;
+      if (n > 0 && give(r, mr->index, buf, n, 0) < 0)
+	return -1;
+
+      mr->in_extent += n;
+      mr->written += n;
+      buf += n;
+      count -= n;
+
+      if (mr->in_extent == extent->size)
+	{
+	  mr->extent++;
+	  mr->in_extent = 0;
+	}
+    }
+
+  return 0;
+}
+
+
+/* Give the end of MR to the sink : the hole at the end of a sparse file, then the end of the member */
+static int finish (struct reader *r, struct member_read *mr)
+{
+  if (!mr->err && mr->sparse && mr->sparse->real_size > mr->written
+      && give(r, mr->index, NULL, mr->sparse->real_size - mr->written, 0) < 0)
+    return -1;
+
+  return give(r, mr->index, NULL, 0, mr->err);
+}
+
+
+/* Arguments of feed_view() */
+struct view_feed
+{
+  struct reader *r;
+  struct member_read *mr;
+};
+
+static int feed_view (const void *view, size_t count, void *data)
+{
+  struct view_feed *vf = data;
+  return feed(vf->r, vf->mr, view, count);
+}
+
+
+/* Read MR from the archive and give it to the sink straight away, from the mapping of the archive if it is mapped */
+static int stream_member (struct reader *r, struct member_read *mr)
+{
+  const char *view = mr->size > 0 ? archive_view(r->tar_fd, mr->start, mr->size) : NULL;
+  struct view_feed vf = { r, mr };
+  ssize_t n;
+
+  if (view)
+    {
+      // l'archive a pu être raccourcie depuis sa projection
+      if (archive_view_read(view, mr->size, feed_view, &vf) < 0)
+	{
+	  if (r->stopped)
+	    return -1;
+	  mr->err = errno;
+	}
+    }
+  else
+    {
+      for (off_t done = 0; done < mr->size; done += n)
+	{
+	  n = archive_pread(r->tar_fd, r->chunk, mr->size - done < TAR_READ_CHUNK ? mr->size - done : TAR_READ_CHUNK, mr->start + done);
+	  if (n <= 0)
+	    {
+	      mr->err = n < 0 ? errno : EIO;
+	      break;
+	    }
+	  if (feed(r, mr, r->chunk, n) < 0)
+	    return -1;
+	}
+    }
+
+  return finish(r, mr);
+}
+
+
+/* Read MR into memory, before its turn */
+static void buffer_member (struct reader *r, struct member_read *mr)
+{
+  ssize_t n;
+
+  mr->buffer = malloc(mr->size > 0 ? mr->size : 1);
+  assert(mr->buffer);
+
+  for (off_t done = 0; done < mr->size; done += n)
+    {
+      if ((n = archive_pread(r->tar_fd, mr->buffer + done, mr->size - done, mr->start + done)) <= 0)
+	{
+	  mr->err = n < 0 ? errno : EIO;
+	  free(mr->buffer);
+	  mr->buffer = NULL;
+	  mr->state = READ_FAILED;
+	  return;
+	}
+    }
+
+  r->buffered += mr->size;
+  mr->state = READ_BUFFERED;
+}
+
+
+/* Give a member kept in memory to the sink, and free it */
+static int give_buffered (struct reader *r, struct member_read *mr)
+{
+  int ret = feed(r, mr, mr->buffer, mr->size);
+
+  free(mr->buffer);
+  mr->buffer = NULL;
+  r->buffered -= mr->size;
+
+  return ret < 0 ? -1 : finish(r, mr);
+}
+
+
+/* Tell the kernel that the members of ORDER from *AHEAD, up to LIMIT in the archive, are read soon */
+static void advise_ahead (int tar_fd, struct member_read **order, int nb, int *ahead, off_t limit)
+{
+  for (; *ahead < nb && order[*ahead]->start < limit; (*ahead)++)
+    {
+      off_t offset = order[*ahead]->start;
+      int fd = archive_backing(tar_fd, &offset, order[*ahead]->size);
+
+      // le contenu d'une archive compressée n'est pas dans un fichier
+      if (fd >= 0 && order[*ahead]->size > 0)
+	posix_fadvise(fd, offset, order[*ahead]->size, POSIX_FADV_WILLNEED);
+    }
+}
+
+
+
+
+int tar_read_members(int tar_fd, const tar_catalog *catalog, char *const filenames[], int nb_files, member_sink sink, void *data)
+{
+  struct member_read *reads = calloc(nb_files > 0 ? nb_files : 1, sizeof(struct member_read));
+  struct member_read **order = malloc((nb_files > 0 ? nb_files : 1) * sizeof(struct member_read *));
+  struct reader r = { tar_fd, sink, data, malloc(TAR_READ_CHUNK), 0, false };
+  int nb_order = 0, pos = 0, ahead = 0, ret = 0;
+
+  assert(reads && order && r.chunk);
+
+  for (int i = 0; i < nb_files; i++)
+    {
+      reads[i].index = i;
+      resolve_member(tar_fd, catalog, filenames[i], reads + i);
+      if (reads[i].state == READ_PENDING)
+	order[nb_order++] = reads + i;
+    }
+
+  qsort(order, nb_order, sizeof(struct member_read *), offset_order);
+
+  for (int next = 0; next < nb_files && !r.stopped; )
+    {
+      struct member_read *mr = reads + next;
+
+      switch (mr->state)
+	{
+	case READ_BUFFERED:
+	  give_buffered(&r, mr);
+	  next++;
+	  continue;
+
+	case READ_FAILED:
+	  finish(&r, mr);
+	  next++;
+	  continue;
+
+	case READ_DEFERRED:
+	  stream_member(&r, mr);
+	  next++;
+	  continue;
+
+	case READ_PENDING:
+	  break;
+	}
+
+      // le parcours avance dans l'archive jusqu'au membre attendu
+      struct member_read *current = order[pos++];
+      advise_ahead(tar_fd, order, nb_order, &ahead, current->start + current->size + TAR_READ_AHEAD);
+
+      if (current == mr)
+	{
+	  stream_member(&r, mr);
+	  next++;
+	}
+      else if (current->size <= TAR_READ_BUFFER_MAX - r.buffered)
+	{
+	  buffer_member(&r, current);
+	}
+      else
+	{
+	  current->state = READ_DEFERRED;
+	}
+    }
+
+  for (int i = 0; i < nb_files; i++)
+    {
+      if (reads[i].err)
+	ret = -1;
+      free(reads[i].buffer);
+      free(reads[i].sparse);
+    }
+
+  free(reads);
+  free(order);
+  free(r.chunk);
+
+  return r.stopped ? -1 : ret;
+}
@@ -1,4 +1,5 @@
 #include <fcntl.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -7,51 +8,53 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "archive.h"
 #include "errors.h"
+#include "hashmap.h"
 #include "tar.h"
 #include "utils.h"
 
 
 int tar_rm_dir(int tar_fd, const char *dirname)
 {
-  unsigned int file_size;
-  struct posix_header file_header;
-  ssize_t size_read;
-  off_t file_start, file_end, tar_end;
+  off_t file_size;
+  tar_file tf;
+  off_t file_end, tar_end;
+  int r;
 
   tar_end = lseek(tar_fd, 0, SEEK_END);
 
   lseek(tar_fd, 0, SEEK_SET);
 
-  while((size_read = read(tar_fd, &file_header, BLOCKSIZE)) > 0)
+  while((r = read_member(tar_fd, &tf)) == 1)
     {
-      if(size_read != BLOCKSIZE)
-	{
-	  return -1;
-	}
-      if(file_header.name[0] == '\0')
+      if(is_prefix(dirname, tf.name))
 	{
-	  ftruncate(tar_fd, tar_end);
-	  return 0;
-	}
-      else if(is_prefix(dirname, file_header.name))
-	{
-	  file_size  = get_file_size(&file_header);
-	  file_start = lseek(tar_fd, -BLOCKSIZE, SEEK_CUR); // on était à la fin d'un header, on se place donc au début
-	  file_end   = file_start + BLOCKSIZE + number_of_block(file_size)*BLOCKSIZE;
+	  // on supprime aussi les en-têtes étendus du fichier
+	  file_size  = get_file_size(&tf.header);
+	  file_end   = tf.data_start + number_of_block(file_size)*BLOCKSIZE;
 
-	  if( fmemmove(tar_fd, file_end, tar_end - file_end, file_start) < 0) // on décale le contenu
-	    return -1;
+	  if( fmemmove(tar_fd, file_end, tar_end - file_end, tf.ext_start) < 0) // on décale le contenu
+	    {
+	      free_tar_file(&tf);
+	      return -1;
+	    }
 
-	  tar_end -= file_end - file_start;    // on réduit virtuellement la taille
+	  tar_end -= file_end - tf.ext_start;    // on réduit virtuellement la taille
 	}
       else
 	{
-	  skip_file_content(tar_fd, &file_header);
+	  skip_file_content(tar_fd, &tf.header);
 	}
+
+      free_tar_file(&tf);
     }
 
-  return -1;
+  if (r < 0)
+    return -1;
+
+  ftruncate(tar_fd, tar_end);
+  return 0;
 }
 
 
@@ -63,30 +66,33 @@ int tar_rm_dir(int tar_fd, const char *dirname)
    -2 if FILENAME is not in the tar or FILENAME is a directory not finishing with '/' */
 static int tar_rm_file(int tar_fd, const char *filename)
 {
-  unsigned int file_size;
-  struct posix_header file_header;
-  int r = seek_header(tar_fd, filename, &file_header);
+  off_t file_size;
+  tar_file tf;
+  int r = seek_member(tar_fd, filename, &tf);
 
   if(r < 0) // erreur
     {
       return -1;
     }
-  else if( r == 0 || (file_header.typeflag == DIRTYPE) ) // Pas trouvé OU un dossier
+  else if( r == 0 ) // Pas trouvé
     {
       return -2;
     }
 
+  free_tar_file(&tf);
+  if (tf.header.typeflag == DIRTYPE) // un dossier
+    return -2;
 
-  file_size = get_file_size(&file_header);
+  file_size = get_file_size(&tf.header);
 
-  off_t file_start = lseek(tar_fd, -BLOCKSIZE, SEEK_CUR), // on était à la fin d'un header, on se place donc au début
-    file_end   = file_start + BLOCKSIZE + number_of_block(file_size)*BLOCKSIZE,
+  // on supprime aussi les en-têtes étendus du fichier
+  off_t file_end = tf.data_start + number_of_block(file_size)*BLOCKSIZE,
     tar_end    = lseek(tar_fd, 0, SEEK_END);
 
-  if(fmemmove(tar_fd, file_end, tar_end - file_end, file_start) < 0)
+  if(fmemmove(tar_fd, file_end, tar_end - file_end, tf.ext_start) < 0)
     return -1;
 
-  ftruncate(tar_fd, tar_end - (file_end - file_start));
+  ftruncate(tar_fd, tar_end - (file_end - tf.ext_start));
   return 0;
 }
 
@@ -94,7 +100,7 @@ static int tar_rm_file(int tar_fd, const char *filename)
 /* Open the tarball at path TAR_NAME and delete FILENAME if possible */
 int tar_rm(const char *tar_name, const char *filename)
 {
-  int tar_fd = open(tar_name, O_RDWR);
+  int tar_fd = archive_open(tar_name, O_RDWR);
 
   if (tar_fd < 0)
     return error_pt(&tar_fd, 1, errno);
@@ -113,6 +119,106 @@ int tar_rm(const char *tar_name, const char *filename)
   if(r == -1) // erreur appel système
     return error_pt(&tar_fd, 1, errno);
 
-  close(tar_fd);
+  archive_close(tar_fd);
   return r;
 }
+
+
+/* Check if the member NAME of type TYPEFLAG is one of the FILES, or is in one of the DIRS */
+static bool to_remove(const char *name, char typeflag, hashmap *files, hashmap *dirs)
+{
+  if (typeflag != DIRTYPE && hashmap_contains(files, name))
+    return true;
+
+  size_t len = strlen(name);
+  char prefix[len + 1];
+
+  // chaque dossier parent, le membre lui-même s'il finit par /
+  strcpy(prefix, name);
+  for (char *slash = strchr(prefix, '/'); slash; slash = strchr(slash + 1, '/'))
+    {
+      char c = slash[1];
+      slash[1] = '\0';
+      bool found = hashmap_contains(dirs, prefix);
+      slash[1] = c;
+      if (found)
+	return true;
+    }
+
+  return false;
+}
+
+
+/* Move the SIZE bytes at offset FROM of TAR_FD to offset TO, lower or equal */
+static int move_down(int tar_fd, off_t from, off_t size, off_t to)
+{
+  if (from == to || size == 0)
+    return 0;
+
+  return fmemmove(tar_fd, from, size, to);
+}
+
+
+int tar_rm_files(const char *tar_name, char *const filenames[], int nb_files)
+{
+  hashmap *files = hashmap_create(), *dirs = hashmap_create();
+  bool all = false;
+  tar_file tf;
+  int r, ret = -1;
+
+  for (int i = 0; i < nb_files; i++)
+    {
+      if (is_empty_string(filenames[i]))
+	all = true;
+      else
+	hashmap_put(is_dir_name(filenames[i]) ? dirs : files, filenames[i], NULL);
+    }
+
+  int tar_fd = archive_open(tar_name, O_RDWR);
+  if (tar_fd < 0)
+    goto exit;
+
+  off_t tar_end = lseek(tar_fd, 0, SEEK_END);
+  off_t dest = 0;   // fin de ce qui est gardé et déjà en place
+  off_t kept = 0;   // début des membres gardés qui restent à déplacer
+
+  lseek(tar_fd, 0, SEEK_SET);
+
+  // les membres gardés sont déplacés par blocs contigus, une seule fois chacun
+  while ((r = read_member(tar_fd, &tf)) == 1)
+    {
+      off_t file_end = tf.data_start + number_of_block(get_file_size(&tf.header))*BLOCKSIZE;
+
+      if (all || to_remove(tf.name, tf.header.typeflag, files, dirs))
+	{
+	  // on supprime aussi les en-têtes étendus du fichier
+	  if (move_down(tar_fd, kept, tf.ext_start - kept, dest) < 0)
+	    {
+	      free_tar_file(&tf);
+	      goto close;
+	    }
+	  dest += tf.ext_start - kept;
+	  kept = file_end;
+	}
+
+      free_tar_file(&tf);
+      lseek(tar_fd, file_end, SEEK_SET);
+    }
+
+  // la fin de l'archive suit le dernier membre gardé
+  if (r < 0 || move_down(tar_fd, kept, tar_end - kept, dest) < 0)
+    goto close;
+
+  ftruncate(tar_fd, dest + (tar_end - kept));
+  ret = 0;
+
+ close:
+  if (ret < 0)
+    error_pt(&tar_fd, 1, errno);
+  else
+    archive_close(tar_fd);
+ exit:
+  hashmap_free(files, false);
+  hashmap_free(dirs, false);
+  return ret;
+}
@@ -0,0 +1,315 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "archive.h"
+#include "tar.h"
+
+/** Size of the reads looking for the first header of a chunk */
+#define SCAN_BUFFER_SIZE (64 * 1024)
+
+
+/** State shared by the threads listing an archive */
+struct scan_job
+{
+  int tar_fd;
+  off_t position;          // premier en-tête de la vraie chaîne pas encore lu, croissant
+  pthread_mutex_t lock;
+  pthread_cond_t scanned;  // un morceau a été parcouru
+};
+
+/** Chains of members followed by a thread, from the headers it recognized in its chunk */
+struct scan_chunk
+{
+  struct scan_job *job;
+  off_t start;           // premier bloc du morceau
+  off_t end;             // fin du morceau, exclue
+  tar_file *members;     // membres des chaînes suivies, ext_start croissants
+  size_t nb_members;
+  size_t capacity;
+  bool threaded;
+  bool done;
+};
+
+
+
+
+int tar_scan_threads (void)
+{
+  char *forced = getenv("TSH_SCAN_THREADS");
+  long n = forced ? strtol(forced, NULL, 10) : sysconf(_SC_NPROCESSORS_ONLN);
+
+  return n < 1 ? 1 : n > TAR_SCAN_THREADS_MAX ? TAR_SCAN_THREADS_MAX : n;
+}
+
+
+/* Block classifier : the magic rejects almost every data block with one comparison,
+   the checksum is only computed for the blocks left */
+static bool looks_like_header (struct posix_header *hd)
+{
+  return !memcmp(hd->magic, TMAGIC, sizeof(TMAGIC) - 1) && check_checksum(hd);
+}
+
+
+static off_t true_position (struct scan_job *job)
+{
+  return __atomic_load_n(&job->position, __ATOMIC_ACQUIRE);
+}
+
+
+/* Offset of the first block of CHUNK from FROM which looks like a header ; -1 if there is none.
+   A header of the true chain is taken as soon as it is known */
+static off_t first_header (int fd, struct scan_chunk *chunk, off_t from)
+{
+  char *buffer = malloc(SCAN_BUFFER_SIZE);
+  off_t found = -1, position;
+  ssize_t n;
+
+  for (off_t offset = from; buffer && found < 0 && offset < chunk->end; offset += n)
+    {
+      // la vraie chaîne a déjà passé ce morceau, ou elle y est entrée plus loin
+      if ((position = true_position(chunk->job)) >= chunk->end)
+	break;
+      if (position >= offset)
+	{
+	  found = position;
+	  break;
+	}
+
+      size_t count = chunk->end - offset < SCAN_BUFFER_SIZE ? chunk->end - offset : SCAN_BUFFER_SIZE;
+      if ((n = pread(fd, buffer, count, offset)) < BLOCKSIZE)
+	break;
+      n -= n % BLOCKSIZE;
+
+      for (ssize_t b = 0; b < n && found < 0; b += BLOCKSIZE)
+	{
+	  if (looks_like_header((struct posix_header *) (buffer + b)))
+	    found = offset + b;
+	}
+    }
+
+  free(buffer);
+  return found;
+}
+
+
+static bool add_member (struct scan_chunk *chunk, const tar_file *tf)
+{
+  if (chunk->nb_members == chunk->capacity)
+    {
+      size_t capacity = chunk->capacity ? 2 * chunk->capacity : 64;
+      tar_file *members = realloc(chunk->members, capacity * sizeof(tar_file));
+      if (!members)
+	return false;
+      chunk->members = members;
+      chunk->capacity = capacity;
+    }
+
+  chunk->members[chunk->nb_members++] = *tf;
+  return true;
+}
+
+
+/* Scanning thread : follow the chain of headers from the first candidate of the chunk, until the end of the chunk.
+   The candidate may be data which looks like a header, the chains are checked when the chunks are stitched */
+static void *scan_chunk (void *arg)
+{
+  struct scan_chunk *chunk = arg;
+  bool full = false;
+  char path[32];
+  tar_file tf;
+  off_t offset;
+  int fd;
+
+  // chaque thread a sa propre position dans le fichier, read_member lit à la position courante
+  snprintf(path, sizeof(path), "/proc/self/fd/%d", chunk->job->tar_fd);
+  if ((fd = open(path, O_RDONLY)) >= 0)
+    {
+      // le premier morceau commence au vrai premier en-tête, même s'il n'a pas la signature ustar
+      offset = chunk->start == 0 ? 0 : first_header(fd, chunk, chunk->start);
+
+      while (!full && offset >= 0 && offset < chunk->end && lseek(fd, offset, SEEK_SET) >= 0)
+	{
+	  while (offset < chunk->end && true_position(chunk->job) < chunk->end && read_member(fd, &tf) == 1)
+	    {
+	      if (!add_member(chunk, &tf))
+		{
+		  free_tar_file(&tf);
+		  full = true;
+		  break;
+		}
+	      offset = skip_file_content(fd, &tf.header);
+	    }
+
+	  // une chaîne qui s'arrête avant la fin du morceau suivait souvent une archive stockée dans l'archive
+	  if (!full && offset < chunk->end)
+	    offset = first_header(fd, chunk, offset + BLOCKSIZE);
+	}
+      close(fd);
+    }
+
+  pthread_mutex_lock(&chunk->job->lock);
+  chunk->done = true;
+  pthread_cond_broadcast(&chunk->job->scanned);
+  pthread_mutex_unlock(&chunk->job->lock);
+
+  return NULL;
+}
+
+
+/* Index of the member of CHUNK starting at OFFSET ; -1 if its chain does not go through OFFSET */
+static ssize_t find_member (const struct scan_chunk *chunk, off_t offset)
+{
+  size_t low = 0, high = chunk->nb_members;
+
+  while (low < high)
+    {
+      size_t mid = low + (high - low) / 2;
+
+      if (chunk->members[mid].ext_start == offset)
+	return mid;
+      if (chunk->members[mid].ext_start < offset)
+	low = mid + 1;
+      else
+	high = mid;
+    }
+
+  return -1;
+}
+
+
+/* Offset of the header following TF */
+static off_t member_end (const tar_file *tf)
+{
+  return tf->data_start + number_of_block(get_file_size(&tf->header)) * BLOCKSIZE;
+}
+
+
+/* Give TF to VISIT, then free what it did not take */
+static void visit_member (tar_file *tf, tar_visitor visit, void *data)
+{
+  if (visit(tf, data))
+    {
+      tf->name = tf->linkname = NULL;
+      tf->sparse = NULL;
+    }
+  else
+    free_tar_file(tf);
+}
+
+
+/* Wait for the scan of the chunk K, unless the true chain has already passed it */
+static void wait_chunk (struct scan_job *job, struct scan_chunk *chunks, int k, off_t offset)
+{
+  pthread_mutex_lock(&job->lock);
+  __atomic_store_n(&job->position, offset, __ATOMIC_RELEASE);
+  while (!chunks[k].done)
+    pthread_cond_wait(&job->scanned, &job->lock);
+  pthread_mutex_unlock(&job->lock);
+}
+
+
+int tar_scan_visit (int tar_fd, tar_visitor visit, void *data, int nb_threads)
+{
+  struct scan_job job = { tar_fd, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+  off_t size = archive_lseek(tar_fd, 0, SEEK_END);
+  if (size < 0)
+    return -1;
+
+  if (nb_threads < 1)
+    nb_threads = 1;
+  off_t chunk_size = number_of_block(size / nb_threads) * BLOCKSIZE;
+  if (chunk_size == 0)
+    chunk_size = BLOCKSIZE;
+  int nb_chunks = (size + chunk_size - 1) / chunk_size;
+
+  struct scan_chunk *chunks = calloc(nb_chunks, sizeof(struct scan_chunk));
+  pthread_t *threads = malloc(nb_chunks * sizeof(pthread_t));
+  if (!chunks || !threads)
+    {
+      free(chunks);
+      free(threads);
+      errno = ENOMEM;
+      return -1;
+    }
+
+  for (int i = 0; i < nb_chunks; i++)
+    {
+      chunks[i].job = &job;
+      chunks[i].start = i * chunk_size;
+      chunks[i].end = i == nb_chunks - 1 ? size : (i + 1) * chunk_size;
+
+      // sans thread, le morceau est parcouru tout de suite
+      chunks[i].threaded = pthread_create(threads + i, NULL, scan_chunk, chunks + i) == 0;
+      if (!chunks[i].threaded)
+	scan_chunk(chunks + i);
+    }
+
+  // la vraie chaîne part de l'offset 0 : la chaîne d'un morceau n'est reprise que si elle passe par un vrai en-tête,
+  // ensuite les deux chaînes sont identiques. Sinon, on suit les en-têtes un par un jusqu'à rejoindre une chaîne.
+  // Les morceaux que la vraie chaîne a dépassés (le contenu d'un gros fichier) sont abandonnés par leur thread.
+  off_t offset = 0;
+  tar_file tf;
+  int r = 1, err = 0;
+
+  while (r == 1)
+    {
+      int k = offset / chunk_size;
+      ssize_t i = -1;
+
+      if (k < nb_chunks)
+	{
+	  wait_chunk(&job, chunks, k, offset);
+	  i = find_member(chunks + k, offset);
+	}
+
+      if (i >= 0)
+	{
+	  // les membres suivants de la chaîne sont vrais tant qu'ils se suivent
+	  for (; i < chunks[k].nb_members && chunks[k].members[i].ext_start == offset; i++)
+	    {
+	      chunks[k].members[i].tar_fd = tar_fd;
+	      offset = member_end(chunks[k].members + i);
+	      visit_member(chunks[k].members + i, visit, data);
+	    }
+	  continue;
+	}
+
+      archive_lseek(tar_fd, offset, SEEK_SET);
+      if ((r = read_member(tar_fd, &tf)) == 1)
+	{
+	  visit_member(&tf, visit, data);
+	  offset = skip_file_content(tar_fd, &tf.header);
+	}
+      else if (r < 0)
+	err = errno;
+    }
+
+  // plus aucun morceau n'est utile
+  __atomic_store_n(&job.position, size, __ATOMIC_RELEASE);
+  for (int k = 0; k < nb_chunks; k++)
+    {
+      if (chunks[k].threaded)
+	pthread_join(threads[k], NULL);
+
+      // les membres repris ont été déplacés, il ne reste que ceux des chaînes commencées sur des données
+      for (size_t i = 0; i < chunks[k].nb_members; i++)
+	free_tar_file(chunks[k].members + i);
+      free(chunks[k].members);
+    }
+  free(threads);
+  free(chunks);
+
+  if (r < 0)
+    {
+      errno = err;
+      return -1;
+    }
+
+  return 0;
+}
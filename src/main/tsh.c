@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <string.h>
 #include <linux/limits.h>
 #include <stdlib.h>
@@ -6,6 +7,7 @@
 
 #include "redirection.h"
 #include "path_lib.h"
+#include "catalog.h"
 #include "errors.h"
 #include "tar.h"
 #include "tsh.h"
@@ -201,9 +203,16 @@ static int cd(char **argv, int argc)
           setenv("PWD", path, 1);
         }
 
-        char *before_tar = strrchr(path, '/'); // Not NULL
-        *before_tar = '\0';
-        chdir(path);
+        // the catalog of the archive is built while the user types the next command
+        catalog_warm(path);
+
+        // the directory of the archive on the disk (the outermost one if archives are nested)
+        char *before_tar;
+        do
+        {
+          before_tar = strrchr(path, '/'); // Not NULL
+          *before_tar = '\0';
+        } while (chdir(path) != 0 && errno == ENOTDIR);
       }
     }
     return EXIT_SUCCESS;
@@ -11,6 +11,7 @@
 
 #include "path_lib.h"
 #include "errors.h"
+#include "output.h"
 #include "utils.h"
 
 static char **arg_info_to_argv (arg_info *info, char *arg);
@@ -22,6 +23,7 @@ static int handle_tokens (unary_command *cmd, struct arg *tokens, int argc, arg_
 static int handle_arg (unary_command *cmd, struct arg *token, arg_info *info, char *options);
 static int handle_reg_file (unary_command *cmd, arg_info *info, char *arg);
 static int handle_tar_file (unary_command *cmd, char *tar_name, char *filename, char *detected_options);
+static int handle_tar_batch (unary_command *cmd, struct arg *tokens, int nb_tokens, char *detected_options);
 static int handle_with_pwd (unary_command *cmd, char **argv, char *detected_options);
 
 static void free_all (struct arg *tokens, int argc, arg_info *info, char *options);
@@ -55,24 +57,27 @@ static void print_arg_before (unary_command *cmd, struct arg *token, int nb_vali
     {
       if (token->type == TAR_FILE)
 	{
-	  write_string (STDOUT_FILENO, token->tf.tar_name);
-	  write_string (STDOUT_FILENO, "/");
-	  write_string (STDOUT_FILENO, token->tf.filename);
+	  out_string (STDOUT_FILENO, token->tf.tar_name);
+	  out_string (STDOUT_FILENO, "/");
+	  out_string (STDOUT_FILENO, token->tf.filename);
 	}
       else
 	{
-	  write_string (STDOUT_FILENO, token->value);
+	  out_string (STDOUT_FILENO, token->value);
 	}
       
-      write_string (STDOUT_FILENO, ": \n");
+      out_string (STDOUT_FILENO, ": \n");
     }
+
+  // la commande peut écrire directement sur la sortie
+  out_flush (STDOUT_FILENO);
 }
 
 /** Prints `\n` on `STDOUT_FILENO` */
 static void print_arg_after (unary_command *cmd, int *rest)
 {
   if (--(*rest) > 0 && cmd->print_multiple_arg)
-    write_string(STDOUT_FILENO, "\n");
+    out_string(STDOUT_FILENO, "\n");
 }
 
 /** Main routine : handles all tokens */
@@ -101,6 +106,22 @@ static int handle_tokens (unary_command *cmd, struct arg *tokens, int argc, arg_
 	case TAR_FILE:
 	  if (!options)
 	    break;
+	  // les arguments d'un même tar sont traités ensemble ; s'il faut les afficher,
+	  // la commande affiche l'en-tête de chacun dès qu'elle en reçoit plusieurs
+	  if (cmd->in_tar_batch)
+	    {
+	      int n = tar_run_length (tokens, i, argc);
+
+	      if (n > 1 || !(cmd->print_multiple_arg && nb_valid_file > 1))
+		{
+		  out_flush (STDOUT_FILENO);
+		  ret = handle_tar_batch (cmd, tokens + i, n, options);
+		  rest -= n - 1;
+		  print_arg_after (cmd, &rest);
+		  i += n - 1;
+		  break;
+		}
+	    }
 	  // Attention on peut encore continuer
 	case REG_FILE:
 	  print_arg_before (cmd, tokens + i, nb_valid_file);
@@ -169,6 +190,17 @@ static int handle_tar_file (unary_command *cmd, char *tar_name, char *filename,
   return cmd->in_tar_func (tar_name, filename, detected_options);
 }
 
+/** Launches the batch function of `cmd` on `nb_tokens` tokens inside the same tar */
+static int handle_tar_batch (unary_command *cmd, struct arg *tokens, int nb_tokens, char *detected_options)
+{
+  char *filenames[nb_tokens];
+
+  for (int i = 0; i < nb_tokens; i++)
+    filenames[i] = tokens[i].tf.filename;
+
+  return cmd->in_tar_batch (tokens->tf.tar_name, filenames, nb_tokens, detected_options);
+}
+
 /** Handles a unary command with `PWD` */
 static int handle_with_pwd (unary_command *cmd, char **argv, char *detected_options)
 {
@@ -195,6 +227,7 @@ static int handle_with_pwd (unary_command *cmd, char **argv, char *detected_opti
   else
     {
       free(pwd);
+      out_flush_all();
       execvp(cmd->name, argv);
     }
 
@@ -7,10 +7,14 @@
 #include <fcntl.h>
 #include <errno.h>
 
+#include "archive.h"
 #include "tar.h"
 #include "utils.h"
 #include "errors.h"
 
+/* Taille des morceaux déplacés par fmemmove */
+#define FMEMMOVE_BUFSIZE (1 << 20)
+
 
 mode_t getumask(void)
 {
@@ -22,17 +26,17 @@ mode_t getumask(void)
 int read_write_buf_by_buf(int read_fd, int write_fd, size_t count, size_t bufsize)
 {
   char buffer[bufsize];
-  int nb_of_buf = count / bufsize, i = 0;
+  size_t nb_of_buf = count / bufsize, i = 0;
 
   for (; i < nb_of_buf; i++)
     {
-      if( read (read_fd,  buffer, bufsize) < 0 || write(write_fd, buffer, bufsize) < 0)
+      if( archive_read (read_fd,  buffer, bufsize) < 0 || write(write_fd, buffer, bufsize) < 0)
 	return -1;
     }
 
   if (i * bufsize != count)
     {
-      if (read (read_fd,  buffer, count % bufsize) < 0 || write(write_fd, buffer, count % bufsize) < 0)
+      if (archive_read (read_fd,  buffer, count % bufsize) < 0 || write(write_fd, buffer, count % bufsize) < 0)
 	return -1;
     }
 
@@ -41,21 +45,23 @@ int read_write_buf_by_buf(int read_fd, int write_fd, size_t count, size_t bufsiz
 
 int fmemmove(int fd, off_t whence, size_t size, off_t where)
 {
-  char *buffer = malloc(size); // TODO: On fait un gros malloc, peut-être en faire plusieurs...
+  char *buffer = malloc(FMEMMOVE_BUFSIZE);
   assert(buffer);
 
-  lseek(fd, whence, SEEK_SET);
-  if( read(fd, buffer, size) < 0 )
+  // comme memmove : si on recule les données on copie du début vers la fin, sinon de la fin vers le début
+  for (size_t done = 0; done < size; )
     {
-      free(buffer);
-      return -1;
-    }
+      size_t chunk = size - done < FMEMMOVE_BUFSIZE ? size - done : FMEMMOVE_BUFSIZE;
+      off_t offset = where <= whence ? (off_t) done : (off_t) (size - done - chunk);
 
-  lseek(fd, where, SEEK_SET);
-  if( write(fd, buffer, size) < 0)
-    {
-      free(buffer);
-      return -1;
+      if (pread(fd, buffer, chunk, whence + offset) != chunk
+	  || pwrite(fd, buffer, chunk, where + offset) != chunk)
+	{
+	  free(buffer);
+	  return -1;
+	}
+
+      done += chunk;
     }
 
   free(buffer);
@@ -109,11 +115,6 @@ int is_prefix (const char *prefix, const char *str)
   return 0;
 }
 
-int write_string (int fd, const char *string)
-{
-  return write(fd, string, strlen(string) + 1);
-}
-
 char *copy_string (const char *str)
 {
   char *cpy = malloc(strlen(str)+1);
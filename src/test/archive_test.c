@@ -0,0 +1,329 @@
+/* archive_test.c : Tests for compressed archives */
+#include "archive_test.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "archive.h"
+#include "array.h"
+#include "minunit.h"
+#include "path_lib.h"
+#include "tar.h"
+#include "tsh_test.h"
+
+
+static char* archive_gzip_random_access_test();
+static char* archive_gzip_tar_test();
+static char* archive_gzip_write_test();
+static char* archive_gzip_write_error_test();
+static char* archive_nested_test();
+static char* archive_union_test();
+static char* archive_map_test();
+
+extern int tests_run;
+
+static char *(*tests[])(void) =
+  {
+    archive_gzip_random_access_test,
+    archive_gzip_tar_test,
+    archive_gzip_write_test,
+    archive_gzip_write_error_test,
+    archive_nested_test,
+    archive_union_test,
+    archive_map_test
+  };
+
+
+static char *all_tests()
+{
+  for (int i = 0; i < ARCHIVE_TEST_SIZE; i++)
+    {
+      before();
+      mu_run_test(tests[i]);
+    }
+  return 0;
+}
+
+int launch_archive_tests()
+{
+  int prec_tests_run = tests_run;
+  char *results = all_tests();
+  if (results != 0)
+    {
+      printf(RED "%s\n" WHITE, results);
+    }
+  else
+    {
+      printf(GREEN "ALL ARCHIVE TESTS PASSED\n" WHITE);
+    }
+  printf("archive tests run: %d\n\n", tests_run - prec_tests_run);
+  return (results == 0);
+}
+
+
+/* Compare the content of the compressed archive GZ_NAME with the file PLAIN_NAME at several offsets */
+static int same_content(const char *gz_name, const char *plain_name)
+{
+  static char gz_buf[1 << 16], plain_buf[1 << 16];
+  int gz_fd = archive_open(gz_name, O_RDONLY), plain_fd = open(plain_name, O_RDONLY), same = 1;
+  off_t size = lseek(plain_fd, 0, SEEK_END);
+
+  if (gz_fd < 0 || plain_fd < 0 || archive_lseek(gz_fd, 0, SEEK_END) != size)
+    same = 0;
+
+  // en arrière, pour forcer la reprise depuis les points de l'index
+  for (off_t offset = size - 1000; same && offset > 0; offset -= 1234567)
+    {
+      ssize_t r = archive_pread(gz_fd, gz_buf, sizeof(gz_buf), offset);
+      same = r == pread(plain_fd, plain_buf, sizeof(gz_buf), offset) && !memcmp(gz_buf, plain_buf, r);
+    }
+
+  // puis une lecture séquentielle
+  archive_lseek(gz_fd, 0, SEEK_SET);
+  lseek(plain_fd, 0, SEEK_SET);
+  for (ssize_t r = 1; same && r > 0; )
+    {
+      r = archive_read(gz_fd, gz_buf, 10000);
+      same = r == read(plain_fd, plain_buf, 10000) && !memcmp(gz_buf, plain_buf, r);
+    }
+
+  archive_close(gz_fd);
+  close(plain_fd);
+  return same;
+}
+
+static char* archive_gzip_random_access_test()
+{
+  struct stat st;
+
+  // plusieurs points par membre, et une archive en plusieurs membres gzip
+  system("cd " TEST_DIR " && seq 1 3000000 > numbers && tar cf big.tar numbers test.tar && gzip -k big.tar"
+	 " && split -b 3000000 big.tar part_ && for f in part_*; do gzip -c $f; done > members.tar.gz");
+
+  mu_assert("A .tar.gz should be a tar", is_tar(TEST_DIR "/big.tar.gz") == 1);
+  mu_assert("The index should be stored next to the archive", stat(TEST_DIR "/big.tar.gz" GZ_INDEX_SUFFIX, &st) == 0);
+  mu_assert("Wrong content of a compressed archive", same_content(TEST_DIR "/big.tar.gz", TEST_DIR "/big.tar"));
+  mu_assert("Wrong content of a compressed archive in several members",
+	    same_content(TEST_DIR "/members.tar.gz", TEST_DIR "/big.tar"));
+
+  // l'index est reconstruit quand l'archive change
+  system("cd " TEST_DIR " && gzip -c test.tar > big.tar.gz");
+  mu_assert("The index of a modified archive should be rebuilt", same_content(TEST_DIR "/big.tar.gz", TEST_DIR "/test.tar"));
+
+  return 0;
+}
+
+static char* archive_gzip_tar_test()
+{
+  system("cd " TEST_DIR " && gzip -k test.tar && mkdir -p gz_out plain_out && tar xf test.tar -C plain_out");
+
+  int fd = archive_open(TEST_DIR "/test.tar.gz", O_RDONLY);
+  mu_assert("Can't open a compressed archive", fd >= 0);
+  mu_assert("Wrong number of members in a compressed archive", nb_files_in_tar(fd) == nb_files_in_tar_c(TAR_TEST));
+  array *members = tar_ls_all(fd);
+  mu_assert("Can't list a compressed archive", members && array_size(members) == nb_files_in_tar_c(TAR_TEST));
+  tar_ls_free(members);
+  archive_close(fd);
+
+  fd = open(TEST_DIR "/gz_hello", O_CREAT | O_TRUNC | O_WRONLY, 0644);
+  mu_assert("Can't copy a file of a compressed archive",
+	    tar_cp_file(TEST_DIR "/test.tar.gz", "dir1/subdir/subsubdir/hello", fd) == 0);
+  close(fd);
+  mu_assert("Wrong content of a file of a compressed archive",
+	    system("diff -q " TEST_DIR "/gz_hello " TEST_DIR "/plain_out/dir1/subdir/subsubdir/hello > /dev/null") == 0);
+
+  mu_assert("Can't extract a directory of a compressed archive",
+	    tar_extract(TEST_DIR "/test.tar.gz", "man_dir/", TEST_DIR "/gz_out") == 0);
+  mu_assert("Wrong content of a directory of a compressed archive",
+	    system("diff -r " TEST_DIR "/gz_out/man_dir " TEST_DIR "/plain_out/man_dir > /dev/null") == 0);
+
+  return 0;
+}
+
+static char* archive_gzip_write_test()
+{
+  system("cd " TEST_DIR " && seq 1 1000000 > numbers && gzip -k test.tar && : > empty.tar.gz");
+  setenv("TSH_GZIP_THREADS", "4", 1);
+
+  mu_assert("Can't add a file to a compressed archive", add_ext_to_tar(TEST_DIR "/test.tar.gz", TEST_DIR "/numbers", "numbers") == 0);
+  mu_assert("Can't remove a file of a compressed archive", tar_rm(TEST_DIR "/test.tar.gz", "dir1/subdir/subsubdir/hello") == 0);
+  mu_assert("A modified compressed archive should be read by tar",
+	    system("tar tzf " TEST_DIR "/test.tar.gz | grep -qx numbers"
+		   " && ! tar tzf " TEST_DIR "/test.tar.gz | grep -q subsubdir/hello") == 0);
+
+  // un bloc compressé par membre gzip : l'index a un point par bloc, sans rien décompresser
+  int fd = archive_open(TEST_DIR "/test.tar.gz", O_RDONLY);
+  off_t size = archive_lseek(fd, 0, SEEK_END);
+  archive_close(fd);
+  mu_assert("The content of a compressed archive should be split in blocks", size > 3 * GZ_BLOCK_SIZE);
+  // en-tête de l'index : magic, taille, date (2), taille décompressée, nombre de points
+  int64_t header[7];
+  fd = open(TEST_DIR "/test.tar.gz" GZ_INDEX_SUFFIX, O_RDONLY);
+  mu_assert("The index of a written archive should be stored next to it",
+	    fd >= 0 && read(fd, header, sizeof(header)) == sizeof(header));
+  close(fd);
+  mu_assert("Each block should be a gzip member", header[5] == (size + GZ_BLOCK_SIZE - 1) / GZ_BLOCK_SIZE);
+
+  mu_assert("An empty compressed archive should be a tar", is_tar(TEST_DIR "/empty.tar.gz") == 1);
+  mu_assert("Can't fill an empty compressed archive", add_ext_to_tar(TEST_DIR "/empty.tar.gz", TEST_DIR "/numbers", "numbers") == 0);
+  mu_assert("Wrong content of a filled compressed archive",
+	    system("cd " TEST_DIR " && mkdir -p filled && tar xzf empty.tar.gz -C filled && cmp -s numbers filled/numbers") == 0);
+
+  unsetenv("TSH_GZIP_THREADS");
+  return 0;
+}
+
+static char* archive_gzip_write_error_test()
+{
+  system("cd " TEST_DIR " && gzip -k test.tar && truncate -s 64M unreadable");
+  setenv("TSH_GZIP_THREADS", "4", 1);
+
+  int fd = archive_open(TEST_DIR "/test.tar.gz", O_RDWR);
+  mu_assert("Can't open a compressed archive for writing", fd >= 0);
+
+  // le contenu à compresser est remplacé par un fichier de 64 blocs qu'on ne peut pas lire :
+  // chaque compresseur échoue, pendant que les autres attendent que leurs blocs soient écrits
+  int unreadable = open(TEST_DIR "/unreadable", O_WRONLY);
+  mu_assert("Can't open the unreadable content", unreadable >= 0 && dup2(unreadable, fd) == fd);
+  close(unreadable);
+
+  mu_assert("A compression error should be returned", archive_close(fd) < 0 && errno == EBADF);
+  mu_assert("A failed compression should keep the archive",
+	    system("tar tzf " TEST_DIR "/test.tar.gz | grep -qx toto") == 0);
+
+  unsetenv("TSH_GZIP_THREADS");
+  return 0;
+}
+
+static char* archive_nested_test()
+{
+  system("cd " TEST_DIR " && mkdir -p plain_out && tar xf test.tar -C plain_out"
+	 " && mkdir -p d && cp test.tar d/ && tar cf inner.tar d && tar cf outer.tar inner.tar && gzip -k outer.tar");
+
+  int fd = archive_open(TEST_DIR "/outer.tar/inner.tar/d/test.tar", O_RDONLY);
+  mu_assert("Can't open a nested archive", fd >= 0);
+  mu_assert("Wrong number of members in a nested archive", nb_files_in_tar(fd) == nb_files_in_tar_c(TAR_TEST));
+
+  // le contenu est lu directement dans l'archive du disque
+  off_t offset = 0;
+  mu_assert("A nested archive should be a window of the archive on the disk",
+	    archive_backing(fd, &offset, BLOCKSIZE) >= 0 && offset > 2 * BLOCKSIZE);
+  archive_close(fd);
+
+  mu_assert("Can't read a nested archive", is_tar(TEST_DIR "/outer.tar.gz/inner.tar/d/test.tar") == 1);
+  fd = open(TEST_DIR "/nested_hello", O_CREAT | O_TRUNC | O_WRONLY, 0644);
+  mu_assert("Can't copy a file of a nested archive",
+	    tar_cp_file(TEST_DIR "/outer.tar.gz/inner.tar/d/test.tar", "dir1/subdir/subsubdir/hello", fd) == 0);
+  close(fd);
+  mu_assert("Wrong content of a file of a nested archive",
+	    system("diff -q " TEST_DIR "/nested_hello " TEST_DIR "/plain_out/dir1/subdir/subsubdir/hello > /dev/null") == 0);
+
+  char path[] = TEST_DIR "/outer.tar/inner.tar/d/test.tar/dir1/";
+  char *in_tar = split_tar_abs_path(path);
+  mu_assert("A path should be split after the innermost archive",
+	    in_tar && !strcmp(in_tar, "dir1/") && !strcmp(path, TEST_DIR "/outer.tar/inner.tar/d/test.tar"));
+
+  mu_assert("A nested archive should be read-only",
+	    archive_open(TEST_DIR "/outer.tar/inner.tar", O_RDWR) < 0 && errno == EROFS);
+  mu_assert("A missing nested archive should not be found",
+	    archive_open(TEST_DIR "/outer.tar/missing.tar", O_RDONLY) < 0 && errno == ENOENT);
+
+  return 0;
+}
+
+static char* archive_union_test()
+{
+  // trois archives qui ont chacune leur répertoire et une version de current
+  system("cd " TEST_DIR " && mkdir -p shards && cd shards"
+	 " && for d in 1 2 3; do mkdir -p day$d && echo $d > day$d/msg && echo $d > current"
+	 " && tar cf logs-$d.tar day$d current && rm -rf day$d current; done"
+	 " && gzip logs-1.tar && printf '# shards\\nshards/logs-*\\n\\nnothing-*.tar\\n' > ../all.union && mkdir -p ../union_out");
+
+  mu_assert("A union should be a tar", is_tar(TEST_DIR "/all.union") == 1);
+
+  int fd = archive_open(TEST_DIR "/all.union", O_RDONLY);
+  mu_assert("Can't open a union", fd >= 0);
+  // day1/, day1/msg, day2/, day2/msg, day3/, day3/msg et une seule version de current
+  mu_assert("Wrong number of members in a union", nb_files_in_tar(fd) == 7);
+  archive_close(fd);
+
+  fd = open(TEST_DIR "/union_current", O_CREAT | O_TRUNC | O_WRONLY, 0644);
+  mu_assert("Can't copy a file of a union", tar_cp_file(TEST_DIR "/all.union", "current", fd) == 0);
+  close(fd);
+  mu_assert("The last archive of a union should win",
+	    system("echo 3 | cmp -s - " TEST_DIR "/union_current") == 0);
+
+  mu_assert("Can't extract a directory of a union",
+	    tar_extract(TEST_DIR "/all.union", "day1/", TEST_DIR "/union_out") == 0);
+  mu_assert("Wrong content of a directory of a union",
+	    system("echo 1 | cmp -s - " TEST_DIR "/union_out/day1/msg") == 0);
+
+  mu_assert("A union should be read-only", archive_open(TEST_DIR "/all.union", O_RDWR) < 0 && errno == EROFS);
+
+  return 0;
+}
+
+static int copy_view(const void *view, size_t count, void *buf)
+{
+  memcpy(buf, view, count);
+  return 0;
+}
+
+static char* archive_map_test()
+{
+  char block[BLOCKSIZE], mapped[BLOCKSIZE];
+  tar_file tf;
+
+  system("cd " TEST_DIR " && mkdir -p plain_out && tar xf test.tar -C plain_out");
+
+  int fd = archive_open(TAR_TEST, O_RDONLY);
+  mu_assert("Can't open test.tar", fd >= 0);
+  mu_assert("Can't find hello", seek_member(fd, "dir1/subdir/subsubdir/hello", &tf) == 1);
+
+  const char *data = archive_view(fd, tf.data_start, get_file_size(&tf.header));
+  mu_assert("An archive opened read-only should be mapped", data && !memcmp(data, "Hello World!\n", 13));
+  free_tar_file(&tf);
+
+  // la position est gardée par le module, le descripteur n'est pas déplacé
+  off_t end = archive_lseek(fd, 0, SEEK_END);
+  mu_assert("Wrong size of a mapped archive", end > 0 && end == lseek(fd, 0, SEEK_END));
+  mu_assert("Wrong offset in a mapped archive", archive_lseek(fd, BLOCKSIZE, SEEK_SET) == BLOCKSIZE);
+  mu_assert("Wrong content read in a mapped archive",
+	    archive_read(fd, mapped, BLOCKSIZE) == BLOCKSIZE && pread(fd, block, BLOCKSIZE, BLOCKSIZE) == BLOCKSIZE
+	    && !memcmp(block, mapped, BLOCKSIZE) && archive_lseek(fd, 0, SEEK_CUR) == 2 * BLOCKSIZE);
+  mu_assert("A read should stop at the end of the mapping", archive_pread(fd, mapped, BLOCKSIZE, end) == 0);
+  archive_close(fd);
+
+  fd = archive_open(TAR_TEST, O_RDWR);
+  mu_assert("An archive opened for writing should not be mapped", fd >= 0 && !archive_view(fd, 0, BLOCKSIZE));
+  archive_close(fd);
+
+  fd = open(TEST_DIR "/mapped_hello", O_CREAT | O_TRUNC | O_WRONLY, 0644);
+  mu_assert("Can't copy a file from a mapped archive", tar_cp_file(TAR_TEST, "dir1/subdir/subsubdir/hello", fd) == 0);
+  close(fd);
+  mu_assert("Wrong content of a file copied from a mapped archive",
+	    system("diff -q " TEST_DIR "/mapped_hello " TEST_DIR "/plain_out/dir1/subdir/subsubdir/hello > /dev/null") == 0);
+
+  // une autre commande raccourcit l'archive pendant qu'elle est projetée
+  system("cp " TAR_TEST " " TEST_DIR "/truncated.tar");
+  fd = archive_open(TEST_DIR "/truncated.tar", O_RDONLY);
+  mu_assert("Can't open the archive to truncate", fd >= 0 && seek_member(fd, "dir1/subdir/subsubdir/hello", &tf) == 1);
+  data = archive_view(fd, tf.data_start, get_file_size(&tf.header));
+  mu_assert("The archive to truncate should be mapped", data != NULL);
+  free_tar_file(&tf);
+  mu_assert("Can't truncate the archive", truncate(TEST_DIR "/truncated.tar", 0) == 0);
+
+  mu_assert("A read beyond the end of a truncated archive should fail with EIO",
+	    archive_pread(fd, mapped, BLOCKSIZE, 0) < 0 && errno == EIO);
+  mu_assert("A view of a truncated archive should fail with EIO",
+	    archive_view_read(data, 13, copy_view, mapped) < 0 && errno == EIO);
+  archive_close(fd);
+
+  return 0;
+}
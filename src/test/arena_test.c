@@ -0,0 +1,142 @@
+/* arena_test.c : Tests for the arena allocator and the containers allocated in it */
+#include "arena_test.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "array.h"
+#include "list.h"
+#include "stack.h"
+#include "minunit.h"
+#include "tsh_test.h"
+
+
+
+static char* arena_alloc_test();
+static char* arena_mark_test();
+static char* arena_containers_test();
+
+extern int tests_run;
+
+static char *(*tests[])(void) =
+{
+  arena_alloc_test,
+  arena_mark_test,
+  arena_containers_test
+};
+
+
+static char *all_tests()
+{
+  for (int i = 0; i < ARENA_TEST_SIZE; i++)
+    {
+      mu_run_test(tests[i]);
+    }
+  return 0;
+}
+
+
+int launch_arena_tests()
+{
+  int prec_tests_run = tests_run;
+
+  char *results = all_tests();
+  if (results != 0)
+    {
+      printf(RED "%s\n" WHITE, results);
+    }
+  else
+    {
+      printf(GREEN "ALL ARENA TESTS PASSED\n" WHITE);
+    }
+
+  printf("arena tests run: %d\n\n", tests_run - prec_tests_run);
+
+  return (results == 0);
+}
+
+
+static char* arena_alloc_test()
+{
+  arena *a = arena_create();
+
+  char *s = arena_strdup(a, "hello");
+  double *d = arena_alloc(a, sizeof(double));
+  mu_assert("An allocation should be aligned", (uintptr_t) d % sizeof(double) == 0);
+  *d = 4.2;
+
+  // une allocation plus grande qu'un bloc a son propre bloc
+  char *big = arena_alloc(a, 2 * ARENA_BLOCK_SIZE);
+  memset(big, 'x', 2 * ARENA_BLOCK_SIZE);
+  mu_assert("Allocations should not overlap", !strcmp(s, "hello") && *d == 4.2);
+
+  // la dernière allocation grandit sur place
+  char *grown = arena_alloc(a, 10);
+  strcpy(grown, "012345678");
+  mu_assert("The last allocation should grow in place", arena_realloc(a, grown, 10, 100) == grown);
+  char *moved = arena_realloc(a, s, 6, 100);
+  mu_assert("An older allocation should be copied", moved != s && !strcmp(moved, "hello"));
+
+  mu_assert("Wrong copy of a part of a string", !strcmp(arena_strndup(a, "abcdef", 3), "abc"));
+
+  arena_free(a);
+
+  return 0;
+}
+
+
+static char* arena_mark_test()
+{
+  arena *a = arena_create();
+
+  char *kept = arena_strdup(a, "kept");
+  arena_mark mark = arena_save(a);
+  char *first = arena_strdup(a, "first");
+  for (int i = 0; i < 1000; i++)
+    arena_alloc(a, 1024);
+
+  arena_restore(a, mark);
+  mu_assert("Memory before a mark should be kept", !strcmp(kept, "kept"));
+  mu_assert("Memory after a mark should be given back", arena_strdup(a, "again") == first);
+
+  arena_reset(a);
+  mu_assert("A reset arena should reuse its first block", arena_strdup(a, "reset") == kept);
+
+  arena_free(a);
+
+  return 0;
+}
+
+
+static char* arena_containers_test()
+{
+  arena *a = arena_create();
+
+  array *arr = array_create_in(a, sizeof(int));
+  for (int i = 0; i < 1000; i++)
+    array_insert_last(arr, &i);
+  mu_assert("Wrong size of an array in an arena", array_size(arr) == 1000);
+  mu_assert("Wrong element of an array in an arena", *(int *) array_at(arr, 999) == 999);
+  free(array_remove_first(arr));
+  mu_assert("Wrong element after a removal", *(int *) array_at(arr, 0) == 1);
+  array_free(arr, false);
+
+  list *l = list_create_in(a);
+  stack *st = stack_create_in(a);
+  for (int i = 0; i < 100; i++)
+    {
+      list_insert_last(l, arena_strdup(a, "cell"));
+      stack_push(st, arena_strdup(a, "cell"));
+    }
+  mu_assert("Wrong size of a list in an arena", list_size(l) == 100 && stack_size(st) == 100);
+  mu_assert("Wrong element of a list in an arena", !strcmp(list_remove_first(l), "cell") && !strcmp(stack_pop(st), "cell"));
+  list_free(l, false);
+  stack_free(st, false);
+
+  arena_free(a);
+
+  return 0;
+}
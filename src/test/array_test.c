@@ -18,6 +18,7 @@ static char* array_insert_test();
 static char* array_remove_test();
 static char* array_sort_test();
 static char *array_free_test();
+static char *array_at_test();
 
 extern int tests_run;
 
@@ -28,7 +29,8 @@ static char *(*tests[])(void) =
     array_insert_test,
     array_remove_test,
     array_sort_test,
-    array_free_test
+    array_free_test,
+    array_at_test
   };
 
 
@@ -221,3 +223,40 @@ static char *array_free_test()
   
   return 0;
 }
+
+static char *array_at_test()
+{
+  array *arr = array_create(sizeof(int));
+  mu_assert("An empty array has no element", !array_at(arr, 0));
+
+  for (int i=0; i < 100; i++)
+    array_insert_last(arr, &i);
+
+  int *pi = array_at(arr, 42);
+  mu_assert("Wrong value of a borrowed element", pi && *pi == 42);
+  *pi = -42;
+  pi = array_get(arr, 42);
+  mu_assert("A borrowed element should be modified in place", *pi == -42);
+  free(pi);
+  mu_assert("An element out of bounds should not be borrowed", !array_at(arr, 100) && !array_at(NULL, 0));
+
+  mu_assert("The data should be the first element", array_data(arr) == array_at(arr, 0));
+
+  int n = 0, sum = 0;
+  ARRAY_FOREACH (int, elem, arr)
+    {
+      sum += *elem;
+      n++;
+    }
+  mu_assert("The iteration should visit every element in order", n == 100 && sum == 99 * 100 / 2 - 2 * 42);
+
+  n = 0;
+  array *none = NULL;
+  ARRAY_FOREACH (int, elem, none)
+    n++;
+  mu_assert("The iteration over no array should be empty", n == 0);
+
+  array_free(arr, false);
+
+  return 0;
+}
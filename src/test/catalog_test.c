@@ -0,0 +1,216 @@
+/* catalog_test.c : Tests for the session cache of archive catalogs */
+#include "catalog_test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "archive.h"
+#include "catalog.h"
+#include "minunit.h"
+#include "tar.h"
+#include "tsh_test.h"
+
+
+static char* catalog_invalidation_test();
+static char* catalog_warm_test();
+static char* catalog_union_test();
+static char* catalog_release_test();
+static char* catalog_saved_test();
+
+extern int tests_run;
+
+static char *(*tests[])(void) =
+  {
+    catalog_invalidation_test,
+    catalog_warm_test,
+    catalog_union_test,
+    catalog_release_test,
+    catalog_saved_test
+  };
+
+
+static char *all_tests()
+{
+  for (int i = 0; i < CATALOG_TEST_SIZE; i++)
+    {
+      before();
+      catalog_clear();
+      mu_run_test(tests[i]);
+    }
+  return 0;
+}
+
+int launch_catalog_tests()
+{
+  int prec_tests_run = tests_run;
+  char *results = all_tests();
+  if (results != 0)
+    {
+      printf(RED "%s\n" WHITE, results);
+    }
+  else
+    {
+      printf(GREEN "ALL CATALOG TESTS PASSED\n" WHITE);
+    }
+  printf("catalog tests run: %d\n\n", tests_run - prec_tests_run);
+  return (results == 0);
+}
+
+
+static char* catalog_invalidation_test()
+{
+  int nb_files = nb_files_in_tar_c(TAR_TEST);
+
+  mu_assert("A catalog should not be cached before it is read", !catalog_cached(TAR_TEST));
+  const tar_catalog *members = catalog_get(TAR_TEST);
+  mu_assert("Wrong catalog of an archive", members && members->nb_members == nb_files);
+  mu_assert("A catalog should be cached once it is read", catalog_cached(TAR_TEST));
+  const tar_catalog *again = catalog_get(TAR_TEST);
+  mu_assert("A cached catalog should be returned again", again == members);
+  catalog_release(again);
+
+  mu_assert("Can't add a file to a tar", add_ext_to_tar(TAR_TEST, NULL, "new_dir/") == 0);
+  mu_assert("A catalog should be invalidated when its archive is modified", !catalog_cached(TAR_TEST));
+  // le catalogue invalidé reste valide tant qu'il est tenu
+  mu_assert("A held catalog should stay valid once invalidated", members->nb_members == nb_files
+	    && tar_catalog_find(members, "toto") != NULL);
+  catalog_release(members);
+  members = catalog_get(TAR_TEST);
+  mu_assert("Wrong catalog of a modified archive", members && members->nb_members == nb_files + 1);
+  catalog_release(members);
+
+  // une autre archive renommée à sa place
+  system("cd " TEST_DIR " && cp bis_test.tar other.tar && mv other.tar test.tar");
+  mu_assert("A catalog should be invalidated when its archive is replaced", !catalog_cached(TAR_TEST));
+  members = catalog_get(TAR_TEST);
+  mu_assert("Wrong catalog of a replaced archive", members && members->nb_members == nb_files_in_tar_c(TAR_TEST));
+  catalog_release(members);
+
+  // un fils ne partage pas le cache de son parent
+  pid_t pid = fork();
+  if (pid == 0)
+    _exit(catalog_cached(TAR_TEST) ? EXIT_FAILURE : EXIT_SUCCESS);
+  int status;
+  waitpid(pid, &status, 0);
+  mu_assert("A child process should start with an empty cache", WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+
+  return 0;
+}
+
+static char* catalog_warm_test()
+{
+  int nb_files = nb_files_in_tar_c(TAR_TEST);
+
+  catalog_warm(TAR_TEST);
+  const tar_catalog *members = catalog_get(TAR_TEST);
+  mu_assert("Wrong catalog of a warmed archive", members && members->nb_members == nb_files);
+  catalog_release(members);
+  mu_assert("A warmed catalog should be cached", catalog_cached(TAR_TEST));
+  mu_assert("A cached archive should be a tar", is_tar(TAR_TEST) == 1);
+
+  // le catalogue d'un union est gardé tant que ses archives ne changent pas
+  system("cd " TEST_DIR " && echo test.tar > test.union");
+  members = catalog_get(TEST_DIR "/test.union");
+  mu_assert("Wrong catalog of a union", members && members->nb_members == nb_files);
+  catalog_release(members);
+  mu_assert("A union should be cached", catalog_cached(TEST_DIR "/test.union"));
+
+  return 0;
+}
+
+
+static char* catalog_union_test()
+{
+  unsigned long generation, again;
+
+  system("cd " TEST_DIR " && rm -rf shards && mkdir -p shards && cd shards"
+	 " && for d in 1 2 3 4; do mkdir -p day$d && echo $d > day$d/msg && echo $d > current"
+	 " && tar cf logs-$d.tar day$d current && rm -rf day$d current; done"
+	 " && gzip logs-1.tar && mv logs-4.tar ../later.tar && echo 'shards/logs-*' > ../cached.union");
+
+  const tar_catalog *members = catalog_get(TEST_DIR "/cached.union");
+  mu_assert("Wrong catalog of a union", members && members->nb_members == 7);
+  catalog_release(members);
+  mu_assert("The catalog of a union should be cached", catalog_cached(TEST_DIR "/cached.union"));
+  mu_assert("The generation of an unchanged union should not change",
+	    archive_union_stamp(TEST_DIR "/cached.union", &generation) == 0
+	    && archive_union_stamp(TEST_DIR "/cached.union", &again) == 0 && generation == again);
+
+  // une archive de l'union change
+  system("touch -d '2001-01-01' " TEST_DIR "/shards/logs-2.tar");
+  mu_assert("A union should be invalidated when one of its archives changes", !catalog_cached(TEST_DIR "/cached.union"));
+  members = catalog_get(TEST_DIR "/cached.union");
+  mu_assert("Wrong catalog of a union read again", members && members->nb_members == 7);
+  catalog_release(members);
+  mu_assert("The catalog of a union should be cached again", catalog_cached(TEST_DIR "/cached.union"));
+
+  // une nouvelle archive correspond au motif
+  system("mv " TEST_DIR "/later.tar " TEST_DIR "/shards/logs-4.tar");
+  mu_assert("A union should be invalidated when a pattern matches a new archive", !catalog_cached(TEST_DIR "/cached.union"));
+  members = catalog_get(TEST_DIR "/cached.union");
+  mu_assert("The new archive should be in the union", members && members->nb_members == 9);
+  catalog_release(members);
+  mu_assert("The generation of a union should change with its archives",
+	    archive_union_stamp(TEST_DIR "/cached.union", &again) == 0 && again != generation);
+
+  return 0;
+}
+
+
+static char* catalog_release_test()
+{
+  int nb_files = nb_files_in_tar_c(TAR_TEST), nb_bis = nb_files_in_tar_c(TEST_DIR "/bis_test.tar");
+
+  // les archives imbriquées ne sont pas en cache : chaque appelant a son propre catalogue
+  system("cd " TEST_DIR " && tar cf outer.tar test.tar bis_test.tar");
+  const tar_catalog *nested = catalog_get(TEST_DIR "/outer.tar/test.tar");
+  const tar_catalog *other = catalog_get(TEST_DIR "/outer.tar/bis_test.tar");
+  mu_assert("Wrong catalogs of nested archives", nested && other && nested != other
+	    && other->nb_members == nb_bis);
+  mu_assert("A nested catalog should stay valid after another one is read", nested->nb_members == nb_files
+	    && tar_catalog_find(nested, "toto") != NULL);
+  catalog_release(nested);
+  catalog_release(other);
+
+  // un catalogue tenu survit au vidage du cache
+  const tar_catalog *members = catalog_get(TAR_TEST);
+  catalog_clear();
+  mu_assert("A held catalog should stay valid after catalog_clear", members && members->nb_members == nb_files
+	    && tar_catalog_find(members, "toto") != NULL);
+  const tar_catalog *again = catalog_get(TAR_TEST);
+  mu_assert("The catalog should be read again after catalog_clear", again && again != members);
+  catalog_release(members);
+  catalog_release(again);
+
+  return 0;
+}
+
+
+static char* catalog_saved_test()
+{
+  const tar_catalog *members = catalog_get(TAR_TEST);
+  mu_assert("Can't read the catalog of an archive", members && tar_catalog_find(members, "dir1/tata"));
+  size_t nb_members = members->nb_members;
+  off_t data_start = tar_catalog_find(members, "dir1/tata")->data_start;
+  catalog_release(members);
+
+  // le premier nom est changé sans changer la taille ni la date : seul un catalogue sauvegardé connaît encore toto
+  system("cd " TEST_DIR " && touch -r test.tar date_ref && printf tutu | dd of=test.tar bs=1 conv=notrunc 2>/dev/null"
+	 " && touch -r date_ref test.tar");
+  catalog_clear();
+  members = catalog_get(TAR_TEST);
+  mu_assert("A saved catalog should be read by a process without cache", members && members->nb_members == nb_members
+	    && tar_catalog_find(members, "toto") && tar_catalog_find(members, "dir1/tata")->data_start == data_start);
+  catalog_release(members);
+
+  // une autre date de modification : le catalogue sauvegardé ne vaut plus
+  system("touch -d '2001-01-01' " TAR_TEST);
+  catalog_clear();
+  members = catalog_get(TAR_TEST);
+  mu_assert("A saved catalog should not be read once its archive changed", !members || !tar_catalog_find(members, "toto"));
+  catalog_release(members);
+
+  return 0;
+}
@@ -0,0 +1,91 @@
+/* credentials_test.c : Tests for the cache of the identity and of the user and group names */
+#include "credentials_test.h"
+
+#include <grp.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "credentials.h"
+#include "minunit.h"
+#include "tsh_test.h"
+
+/** A uid and a gid which have no name */
+#define UNKNOWN_ID 3999999
+
+
+
+static char* credentials_ids_test();
+static char* credentials_names_test();
+
+extern int tests_run;
+
+static char *(*tests[])(void) =
+{
+  credentials_ids_test,
+  credentials_names_test
+};
+
+
+static char *all_tests()
+{
+  for (int i = 0; i < CREDENTIALS_TEST_SIZE; i++)
+    {
+      mu_run_test(tests[i]);
+    }
+  return 0;
+}
+
+
+int launch_credentials_tests()
+{
+  int prec_tests_run = tests_run;
+
+  char *results = all_tests();
+  if (results != 0)
+    {
+      printf(RED "%s\n" WHITE, results);
+    }
+  else
+    {
+      printf(GREEN "ALL CREDENTIALS TESTS PASSED\n" WHITE);
+    }
+
+  printf("credentials tests run: %d\n\n", tests_run - prec_tests_run);
+
+  return (results == 0);
+}
+
+
+static char* credentials_ids_test()
+{
+  const credentials *creds = get_credentials();
+  gid_t groups[getgroups(0, NULL) + 1];
+  int nb_groups = getgroups(sizeof(groups) / sizeof(gid_t), groups);
+
+  mu_assert("Wrong ids of the process", creds->uid == getuid() && creds->gid == getgid());
+  mu_assert("The identity should be read once", get_credentials() == creds);
+  mu_assert("The process should be in its group", in_group(creds, getgid()));
+  for (int i = 0; i < nb_groups; i++)
+    mu_assert("The process should be in its supplementary groups", in_group(creds, groups[i]));
+  mu_assert("The process should not be in an unknown group", !in_group(creds, UNKNOWN_ID));
+
+  return 0;
+}
+
+
+static char* credentials_names_test()
+{
+  struct passwd *pw = getpwuid(getuid());
+  struct group *gr = getgrgid(getgid());
+  const char *name = user_name(getuid());
+
+  mu_assert("Wrong user name", pw && name && !strcmp(name, pw->pw_name));
+  mu_assert("A user name should be asked once", user_name(getuid()) == name);
+  mu_assert("Wrong group name", gr && group_name(getgid()) && !strcmp(group_name(getgid()), gr->gr_name));
+  mu_assert("An unknown user should have no name", !user_name(UNKNOWN_ID) && !user_name(UNKNOWN_ID));
+  mu_assert("An unknown group should have no name", !group_name(UNKNOWN_ID));
+
+  return 0;
+}
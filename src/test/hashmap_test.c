@@ -0,0 +1,160 @@
+/* hashmap_test.c : Tests for hashmap data types */
+#include "hashmap_test.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hashmap.h"
+#include "minunit.h"
+#include "tsh_test.h"
+
+
+static char* hashmap_create_test();
+static char* hashmap_put_get_test();
+static char* hashmap_remove_test();
+static char* hashmap_iter_test();
+
+extern int tests_run;
+
+static char *(*tests[])(void) =
+  {
+    hashmap_create_test,
+    hashmap_put_get_test,
+    hashmap_remove_test,
+    hashmap_iter_test
+  };
+
+
+static char *all_tests()
+{
+  for (int i = 0; i < HASHMAP_TEST_SIZE; i++)
+    {
+      mu_run_test(tests[i]);
+    }
+  return 0;
+}
+
+int launch_hashmap_tests()
+{
+  int prec_tests_run = tests_run;
+  char *results = all_tests();
+  if (results != 0)
+    {
+      printf(RED "%s\n" WHITE, results);
+    }
+  else
+    {
+      printf(GREEN "ALL HASHMAP TESTS PASSED\n" WHITE);
+    }
+  printf("hashmap tests run: %d\n\n", tests_run - prec_tests_run);
+  return (results == 0);
+}
+
+static char* hashmap_create_test()
+{
+  hashmap *map = hashmap_create();
+
+  mu_assert("Invalid hashmap size, should be 0", 0 == hashmap_size(map));
+  mu_assert("An empty hashmap shouldn't contain anything", !hashmap_contains(map, ""));
+
+  hashmap_free(map, false);
+
+  return 0;
+}
+
+
+static char* hashmap_put_get_test()
+{
+  hashmap *map = hashmap_create();
+  char key[32];
+
+  const int size = 4291;
+  static int values[4291];
+  for (int i=0; i < size; i++)
+    {
+      values[i] = i;
+      sprintf(key, "dir/%d/", i);
+      mu_assert("Key shouldn't be in the hashmap yet", hashmap_put(map, key, values + i) == NULL);
+    }
+
+  mu_assert("Invalid hashmap size, should be 4291", size == hashmap_size(map));
+
+  int *pi;
+  for (int i=0; i < size; i++)
+    {
+      sprintf(key, "dir/%d/", i);
+      pi = hashmap_get(map, key);
+      mu_assert("Wrong value after inserting", pi && i == *pi);
+    }
+
+  mu_assert("Replacing a value should return the old one", hashmap_put(map, "dir/0/", values + 1) == values);
+  mu_assert("Replacing a value shouldn't change the size", size == hashmap_size(map));
+  mu_assert("Wrong value after replacing", hashmap_get(map, "dir/0/") == values + 1);
+
+  mu_assert("Key \"dir/0\" shouldn't be in the hashmap", !hashmap_contains(map, "dir/0"));
+
+  hashmap_put(map, "null", NULL);
+  mu_assert("Key \"null\" should be in the hashmap", hashmap_contains(map, "null"));
+
+  hashmap_free(map, false);
+
+  return 0;
+}
+
+static char* hashmap_remove_test()
+{
+  hashmap *map = hashmap_create();
+  char key[2] = "a";
+
+  for (char c='a'; c <= 'z'; c++)
+    {
+      key[0] = c;
+      char *pc = malloc(1);
+      *pc = c;
+      hashmap_put(map, key, pc);
+    }
+
+  mu_assert("Invalid hashmap size, should be 26", 26 == hashmap_size(map));
+
+  char *pc;
+  for (char c='a'; c <= 'm'; c++)
+    {
+      key[0] = c;
+      pc = hashmap_remove(map, key);
+      mu_assert("Wrong value after removing", pc && c == *pc);
+      mu_assert("Key shouldn't be in the hashmap after removing", !hashmap_contains(map, key));
+      free(pc);
+    }
+
+  mu_assert("Removing a missing key should return NULL", hashmap_remove(map, "a") == NULL);
+  mu_assert("Invalid hashmap size, should be 13", 13 == hashmap_size(map));
+
+  hashmap_free(map, true);
+
+  return 0;
+}
+
+static void sum_values (const char *key, void *val, void *data)
+{
+  *(int*)data += *(int*)val;
+}
+
+static char* hashmap_iter_test()
+{
+  hashmap *map = hashmap_create();
+  int values[] = { 1, 2, 3, 4 };
+  char *keys[] = { "dir/", "dir/a", "dir/b/", "titi" };
+  int sum = 0;
+
+  for (int i=0; i < 4; i++)
+    hashmap_put(map, keys[i], values + i);
+
+  hashmap_iter(map, sum_values, &sum);
+  mu_assert("Iteration should visit every entry once", sum == 10);
+
+  hashmap_free(map, false);
+
+  return 0;
+}
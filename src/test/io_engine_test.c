@@ -0,0 +1,182 @@
+/* io_engine_test.c : Tests for batched I/O */
+#include "io_engine_test.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "io_engine.h"
+#include "minunit.h"
+#include "tsh_test.h"
+
+
+static char* io_openat_stat_batch_test();
+static char* io_copy_batch_test();
+static char* io_uring_failure_test();
+
+extern int tests_run;
+
+static char *(*tests[])(void) =
+  {
+    io_openat_stat_batch_test,
+    io_copy_batch_test,
+    io_uring_failure_test
+  };
+
+
+static char *all_tests()
+{
+  for (int i = 0; i < IO_ENGINE_TEST_SIZE; i++)
+    {
+      mu_run_test(tests[i]);
+    }
+  return 0;
+}
+
+int launch_io_engine_tests()
+{
+  int prec_tests_run = tests_run;
+  char *results = all_tests();
+  if (results != 0)
+    {
+      printf(RED "%s\n" WHITE, results);
+    }
+  else
+    {
+      printf(GREEN "ALL IO_ENGINE TESTS PASSED\n" WHITE);
+    }
+  printf("io_engine tests run: %d\n\n", tests_run - prec_tests_run);
+  return (results == 0);
+}
+
+static char* io_openat_stat_batch_test()
+{
+  char *names[] = { "io_a", "io_b", "io_missing/c" };
+  struct stat st[3];
+  int fds[3];
+
+  system("mkdir -p " TEST_DIR);
+  int dir_fd = open(TEST_DIR, O_RDONLY | O_DIRECTORY);
+  mu_assert("Can't open test directory", dir_fd >= 0);
+
+  mu_assert("Opening a file in a missing directory should fail",
+	    io_openat_batch(dir_fd, names, O_CREAT | O_TRUNC | O_WRONLY, 0644, fds, 3) < 0);
+  mu_assert("Existing directories should allow creation", fds[0] >= 0 && fds[1] >= 0);
+  mu_assert("Failed opening should be reported", fds[2] < 0);
+
+  mu_assert("Can't write in a created file", write(fds[1], "tsh", 3) == 3);
+  close(fds[0]);
+  close(fds[1]);
+
+  mu_assert("Status of a missing file should fail", io_stat_batch(dir_fd, names, 0, st, 3) < 0);
+  mu_assert("Invalid status", S_ISREG(st[0].st_mode) && st[0].st_size == 0);
+  mu_assert("Invalid status", S_ISREG(st[1].st_mode) && st[1].st_size == 3);
+  mu_assert("Failed status should be reported", st[2].st_mode == 0);
+
+  unlinkat(dir_fd, names[0], 0);
+  unlinkat(dir_fd, names[1], 0);
+  close(dir_fd);
+
+  return 0;
+}
+
+static char* io_copy_batch_test()
+{
+  char src_buf[100000], dst_buf[100000 + 4];
+  struct io_copy copies[3];
+
+  for (int i = 0; i < sizeof(src_buf); i++)
+    src_buf[i] = i % 251;
+
+  int src_fd = open(TEST_DIR "/io_src", O_CREAT | O_TRUNC | O_RDWR, 0644);
+  int dst_fd = open(TEST_DIR "/io_dst", O_CREAT | O_TRUNC | O_RDWR, 0644);
+  mu_assert("Can't create test files", src_fd >= 0 && dst_fd >= 0);
+  mu_assert("Can't write source file", write(src_fd, src_buf, sizeof(src_buf)) == sizeof(src_buf));
+
+  // une copie depuis la mémoire et deux copies depuis le fichier, dans le désordre
+  copies[0] = (struct io_copy) { src_fd, 50000, NULL, dst_fd, 50004, 50000 };
+  copies[1] = (struct io_copy) { -1, 0, "tsh!", dst_fd, 0, 4 };
+  copies[2] = (struct io_copy) { src_fd, 0, NULL, dst_fd, 4, 50000 };
+
+  mu_assert("Copies should succeed", io_copy_batch(copies, 3) == 0);
+  mu_assert("Invalid size of copy", pread(dst_fd, dst_buf, sizeof(dst_buf), 0) == sizeof(dst_buf));
+  mu_assert("Invalid content of copy",
+	    !memcmp(dst_buf, "tsh!", 4) && !memcmp(dst_buf + 4, src_buf, sizeof(src_buf)));
+
+  // lire au-delà de la fin du fichier est une erreur
+  copies[0] = (struct io_copy) { src_fd, sizeof(src_buf) - 10, NULL, dst_fd, 0, 20 };
+  mu_assert("A short copy should fail", io_copy_batch(copies, 1) < 0);
+
+  close(src_fd);
+  close(dst_fd);
+  unlink(TEST_DIR "/io_src");
+  unlink(TEST_DIR "/io_dst");
+
+  return 0;
+}
+
+/* File descriptor of the io_uring instance of the process, -1 if there is none */
+static int find_ring_fd()
+{
+  char path[PATH_MAX], target[64];
+  struct dirent *entry;
+  int ring_fd = -1;
+  DIR *dir = opendir("/proc/self/fd");
+
+  while (dir && ring_fd < 0 && (entry = readdir(dir)))
+    {
+      ssize_t len;
+
+      snprintf(path, sizeof(path), "/proc/self/fd/%s", entry->d_name);
+      if ((len = readlink(path, target, sizeof(target) - 1)) < 0)
+	continue;
+      target[len] = '\0';
+      if (!strcmp(target, "anon_inode:[io_uring]"))
+	ring_fd = atoi(entry->d_name);
+    }
+
+  if (dir)
+    closedir(dir);
+  return ring_fd;
+}
+
+static char* io_uring_failure_test()
+{
+  char *names[] = { "io_fail_a", "io_fail_b" };
+  struct stat st[2];
+  int fds[2];
+
+  if (io_engine_kind() != IO_ENGINE_URING)
+    return 0;
+
+  int dir_fd = open(TEST_DIR, O_RDONLY | O_DIRECTORY);
+  int ring_fd = find_ring_fd();
+  mu_assert("Can't find the io_uring instance", dir_fd >= 0 && ring_fd >= 0);
+
+  // io_uring_enter échoue tant que le descripteur de l'anneau est remplacé
+  int saved = dup(ring_fd), null_fd = open("/dev/null", O_RDONLY);
+  mu_assert("Can't replace the io_uring instance", saved >= 0 && null_fd >= 0 && dup2(null_fd, ring_fd) == ring_fd);
+  close(null_fd);
+
+  int open_ret = io_openat_batch(dir_fd, names, O_CREAT | O_TRUNC | O_WRONLY, 0644, fds, 2);
+  int stat_ret = io_stat_batch(dir_fd, names, 0, st, 2);
+  dup2(saved, ring_fd);
+  close(saved);
+
+  mu_assert("A failed submission should fail the openings", open_ret < 0 && fds[0] < 0 && fds[1] < 0);
+  mu_assert("A failed submission should fail the status", stat_ret < 0 && st[0].st_mode == 0 && st[1].st_mode == 0);
+
+  // les entrées qui n'ont pas été soumises ne le sont pas avec le lot suivant
+  mu_assert("The ring should work again", io_stat_batch(dir_fd, names, 0, st, 2) < 0);
+  mu_assert("Entries of a failed batch should not be submitted later",
+	    st[0].st_mode == 0 && st[1].st_mode == 0 && faccessat(dir_fd, names[0], F_OK, 0) < 0);
+  mu_assert("The engine should still be io_uring", io_engine_kind() == IO_ENGINE_URING);
+
+  close(dir_fd);
+  return 0;
+}
@@ -0,0 +1,137 @@
+/* output_test.c : Tests for the buffered output */
+#include "output_test.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "output.h"
+#include "minunit.h"
+#include "tsh_test.h"
+
+
+
+static char* out_buffered_test();
+static char* out_big_write_test();
+
+extern int tests_run;
+
+static char *(*tests[])(void) =
+{
+  out_buffered_test,
+  out_big_write_test
+};
+
+
+static char *all_tests()
+{
+  for (int i = 0; i < OUTPUT_TEST_SIZE; i++)
+    {
+      mu_run_test(tests[i]);
+    }
+  return 0;
+}
+
+
+int launch_output_tests()
+{
+  int prec_tests_run = tests_run;
+
+  char *results = all_tests();
+  if (results != 0)
+    {
+      printf(RED "%s\n" WHITE, results);
+    }
+  else
+    {
+      printf(GREEN "ALL OUTPUT TESTS PASSED\n" WHITE);
+    }
+
+  printf("output tests run: %d\n\n", tests_run - prec_tests_run);
+
+  return (results == 0);
+}
+
+
+/* Redirect the standard output to a pipe, the saved standard output is returned */
+static int capture_stdout (int pipefd[2])
+{
+  fflush(stdout);
+  out_flush(STDOUT_FILENO);
+
+  int saved = dup(STDOUT_FILENO);
+  if (pipe(pipefd) < 0)
+    return -1;
+  fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+  dup2(pipefd[1], STDOUT_FILENO);
+  close(pipefd[1]);
+
+  return saved;
+}
+
+
+static void restore_stdout (int pipefd[2], int saved)
+{
+  dup2(saved, STDOUT_FILENO);
+  close(saved);
+  close(pipefd[0]);
+}
+
+
+static char* out_buffered_test()
+{
+  int pipefd[2];
+  char buf[64];
+  ssize_t before, after;
+
+  int saved = capture_stdout(pipefd);
+  mu_assert("Impossible to redirect the standard output", saved >= 0);
+
+  // pas de '\n' : rien n'est écrit avant le flush, même sur un terminal
+  out_string(STDOUT_FILENO, "ab");
+  out_repeat(STDOUT_FILENO, ' ', 3);
+  out_string(STDOUT_FILENO, "cd");
+  before = read(pipefd[0], buf, sizeof(buf));
+  out_flush(STDOUT_FILENO);
+  after = read(pipefd[0], buf, sizeof(buf));
+
+  restore_stdout(pipefd, saved);
+
+  mu_assert("Nothing should be written before a flush", before < 0);
+  mu_assert("Wrong buffered output", after == 7 && !memcmp(buf, "ab   cd", 7));
+
+  return 0;
+}
+
+
+static char* out_big_write_test()
+{
+  int pipefd[2];
+  size_t size = OUTPUT_BUFFER_SIZE + 100;
+  char *big = malloc(size), *buf = malloc(size + 10);
+  ssize_t n = 0, r;
+
+  memset(big, 'x', size);
+
+  int saved = capture_stdout(pipefd);
+  mu_assert("Impossible to redirect the standard output", saved >= 0);
+
+  // ce qui ne tient pas dans le buffer passe après ce qui y attend
+  out_string(STDOUT_FILENO, "head");
+  out_write(STDOUT_FILENO, big, size);
+  out_flush(STDOUT_FILENO);
+  while ((r = read(pipefd[0], buf + n, size + 10 - n)) > 0)
+    n += r;
+
+  restore_stdout(pipefd, saved);
+
+  bool ok = n == size + 4 && !memcmp(buf, "head", 4) && !memcmp(buf + 4, big, size);
+  free(big);
+  free(buf);
+  mu_assert("Wrong order of a write bigger than the buffer", ok);
+
+  return 0;
+}
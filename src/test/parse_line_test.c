@@ -5,6 +5,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include "arena.h"
 #include "tokens.h"
 
 #include "parse_line_test.h"
@@ -18,12 +19,14 @@ extern int tests_run;
 static char *tokenize_test();
 static char *parse_tokens_success_test();
 static char *parse_tokens_err_test();
+static char *expand_globs_test();
 
 static char *(*tests[])(void) =
 {
   tokenize_test,
   parse_tokens_success_test,
   parse_tokens_err_test,
+  expand_globs_test,
 };
 
 static char *all_tests()
@@ -165,3 +168,28 @@ static char *parse_tokens_err_test()
 
   return 0;
 }
+
+static char *expand_globs_test()
+{
+  char line[] = "cat " TAR_TEST "/dir?/fic* " TAR_TEST "/none* " TAR_TEST "/di\\r2/f\\ic* dir/a\\*b > " TAR_TEST "/t*";
+  char *expected[] = { "cat", TAR_TEST "/dir2/fic1", TAR_TEST "/dir2/fic2", TAR_TEST "/none*",
+    TAR_TEST "/dir2/fic1", TAR_TEST "/dir2/fic2", "dir/a*b", NULL, TAR_TEST "/t*" };
+
+  before();
+  arena *mem = arena_create();
+  list *tokens = tokenize_in(mem, line);
+  expand_globs(mem, tokens);
+
+  array *cmd = list_first(tokens);
+  mu_assert("expand_globs test: the patterns should be replaced by 2 names each", array_size(cmd) == 10);
+  for (int i = 0; i < 9; i++)
+  {
+    token *tok = array_at(cmd, i);
+    if (expected[i])
+      mu_assert("expand_globs test: error on the expanded arguments", tok -> type == ARG && !strcmp(tok -> val.arg, expected[i]));
+  }
+
+  free_tokens_list(tokens);
+  arena_free(mem);
+  return 0;
+}
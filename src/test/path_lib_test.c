@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -5,6 +6,7 @@
 
 #include "minunit.h"
 #include "path_lib.h"
+#include "tar.h"
 #include "tsh_test.h"
 #include "path_lib_test.h"
 
@@ -16,6 +18,7 @@ static char *reduce_abs_path_titi_test();
 static char *reduce_abs_path_dir_test();
 static char *reduce_abs_path_non_existing_file();
 static char *type_of_file_test();
+static char *reduce_abs_path_cache_test();
 
 
 extern int tests_run;
@@ -27,7 +30,8 @@ static char *(*tests[])(void) = {
   reduce_abs_path_titi_test,
   reduce_abs_path_dir_test,
   reduce_abs_path_non_existing_file,
-  type_of_file_test
+  type_of_file_test,
+  reduce_abs_path_cache_test
 };
 
 
@@ -215,3 +219,23 @@ static char *type_of_file_test()
   mu_assert("type_of_file should always return NONE with toto/", type_of_file(TAR_TEST, "toto/", true) == NONE && type_of_file(TAR_TEST, "toto/", false) == NONE);
   return 0;
 }
+
+static char *reduce_abs_path_cache_test()
+{
+  char path[PATH_MAX];
+  const char *in_new_dir = TEST_DIR "/test.tar/new_dir/file";
+
+  errno = 0;
+  mu_assert("reduce_abs_path should fail with a directory missing in the tar", !reduce_abs_path(in_new_dir, path) && errno == ENOENT);
+  mu_assert("reduce_abs_path should fail again with the same directory", !reduce_abs_path(in_new_dir, path) && errno == ENOENT);
+
+  // l'archive modifiée par un autre processus
+  system("cd " TEST_DIR " && mkdir new_dir && tar -rf test.tar new_dir");
+  mu_assert("reduce_abs_path should see a directory added to the tar", reduce_abs_path(in_new_dir, path) && !strcmp(path, in_new_dir));
+
+  // l'archive modifiée par le processus
+  mu_assert("Can't remove new_dir/", tar_rm(TAR_TEST, "new_dir/") == 0);
+  mu_assert("reduce_abs_path should see a directory removed from the tar", !reduce_abs_path(in_new_dir, path) && errno == ENOENT);
+
+  return 0;
+}
@@ -0,0 +1,147 @@
+/* script_test.c : Tests for the reading of the lines of a script */
+#include "script_test.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "script.h"
+#include "minunit.h"
+#include "tsh_test.h"
+
+
+
+static char* script_next_line_test();
+static char* script_shared_file_test();
+static char* script_shared_pipe_test();
+
+extern int tests_run;
+
+static char *(*tests[])(void) =
+{
+  script_next_line_test,
+  script_shared_file_test,
+  script_shared_pipe_test
+};
+
+
+static char *all_tests()
+{
+  for (int i = 0; i < SCRIPT_TEST_SIZE; i++)
+    {
+      mu_run_test(tests[i]);
+    }
+  return 0;
+}
+
+
+int launch_script_tests()
+{
+  int prec_tests_run = tests_run;
+
+  char *results = all_tests();
+  if (results != 0)
+    {
+      printf(RED "%s\n" WHITE, results);
+    }
+  else
+    {
+      printf(GREEN "ALL SCRIPT TESTS PASSED\n" WHITE);
+    }
+
+  printf("script tests run: %d\n\n", tests_run - prec_tests_run);
+
+  return (results == 0);
+}
+
+
+/* Write CONTENT in a new file, opened for reading ; the file is already unlinked */
+static int script_file (const char *content)
+{
+  char name[] = "/tmp/tsh_script_XXXXXX";
+  int fd = mkstemp(name);
+
+  if (fd < 0)
+    return -1;
+
+  unlink(name);
+  if (write(fd, content, strlen(content)) < 0 || lseek(fd, 0, SEEK_SET) < 0)
+    {
+      close(fd);
+      return -1;
+    }
+
+  return fd;
+}
+
+
+/* Check that the next line of READER is EXPECTED (NULL for the end of the script) */
+static bool next_line_is (script_reader *reader, const char *expected)
+{
+  char *line = script_next_line(reader);
+  bool ok = expected ? line && !strcmp(line, expected) : !line;
+
+  free(line);
+  return ok;
+}
+
+
+static char *script_next_line_test()
+{
+  script_reader reader;
+  int fd = script_file("ls a.tar\n\n  cat a.tar/b\nlast");
+
+  mu_assert("script_next_line: could not create the script", fd >= 0);
+  script_reader_init(&reader, fd, false);
+
+  mu_assert("script_next_line: should give the first line", next_line_is(&reader, "ls a.tar"));
+  mu_assert("script_next_line: should give an empty line", next_line_is(&reader, ""));
+  mu_assert("script_next_line: should keep the spaces", next_line_is(&reader, "  cat a.tar/b"));
+  mu_assert("script_next_line: should give the last line without \\n", next_line_is(&reader, "last"));
+  mu_assert("script_next_line: should give NULL at the end", next_line_is(&reader, NULL));
+
+  close(fd);
+  return 0;
+}
+
+
+static char *script_shared_file_test()
+{
+  script_reader reader;
+  char rest[16] = { 0 };
+  int fd = script_file("cat\ninput of cat\n");
+
+  mu_assert("script_next_line: could not create the script", fd >= 0);
+  script_reader_init(&reader, fd, true);
+
+  mu_assert("script_next_line: should give the first line", next_line_is(&reader, "cat"));
+  // une commande qui lit le même fichier trouve la suite
+  mu_assert("script_next_line: should give back what follows the line", read(fd, rest, sizeof(rest) - 1) == 13);
+  mu_assert("script_next_line: the command should read the next line", !strcmp(rest, "input of cat\n"));
+
+  close(fd);
+  return 0;
+}
+
+
+static char *script_shared_pipe_test()
+{
+  script_reader reader;
+  char rest[16] = { 0 };
+  int pipefd[2];
+
+  mu_assert("script_next_line: pipe failed", pipe(pipefd) == 0);
+  mu_assert("script_next_line: write failed", write(pipefd[1], "cat\nrest", 8) == 8);
+  close(pipefd[1]);
+  script_reader_init(&reader, pipefd[0], true);
+
+  mu_assert("script_next_line: should give the first line", next_line_is(&reader, "cat"));
+  mu_assert("script_next_line: should not read after the line in a pipe", read(pipefd[0], rest, sizeof(rest) - 1) == 4);
+  mu_assert("script_next_line: the command should read the rest", !strcmp(rest, "rest"));
+
+  close(pipefd[0]);
+  return 0;
+}
@@ -15,11 +15,13 @@
 
 
 static char *tar_access_test();
+static char *members_access_test();
 
 extern int tests_run;
 
 static char *(*tests[])(void) = {
-  tar_access_test
+  tar_access_test,
+  members_access_test
 };
 
 static char *all_tests() {
@@ -93,3 +95,28 @@ static char *tar_access_test()
 
   return 0;
 }
+
+
+static char *members_access_test()
+{
+  int fd = open("/tmp/tsh_test/test.tar", O_RDONLY);
+  tar_catalog *catalog = tar_catalog_read(fd);
+  close(fd);
+  mu_assert("Impossible to read the catalog of test.tar", catalog);
+  mu_assert("The rights should not be built before a check", !catalog->permissions);
+
+  mu_assert("members_access(catalog, \"dir1/\", F_OK) != 1", members_access(catalog, "dir1/", F_OK) == 1);
+  struct tar_permissions *permissions = catalog->permissions;
+  mu_assert("The rights should be kept in the catalog", permissions);
+
+  mu_assert("members_access(catalog, \"dir2/\", F_OK) != 2", members_access(catalog, "dir2/", F_OK) == 2);
+  mu_assert("members_access(catalog, \"dir2/fic1\", F_OK) != 1", members_access(catalog, "dir2/fic1", F_OK) == 1);
+  errno = 0;
+  mu_assert("members_access(catalog, \"dir2/fic1/\", F_OK) != -1", members_access(catalog, "dir2/fic1/", F_OK) == -1);
+  mu_assert("errno != ENOENT after members_access(catalog, \"dir2/fic1/\", F_OK)", errno == ENOENT);
+  mu_assert("The rights should be built once", catalog->permissions == permissions);
+
+  tar_catalog_free(catalog);
+
+  return 0;
+}
@@ -5,6 +5,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <fcntl.h>
+#include <linux/limits.h>
 
 #include "tsh_test.h"
 #include "minunit.h"
@@ -20,6 +21,8 @@ static char *tar_append_file_test();
 static char *tar_add_file_no_source_test();
 static char *tar_add_file_link_test();
 static char *move_file_to_end_of_tar_test();
+static char *tar_add_file_long_name_test();
+static char *tar_add_sparse_file_test();
 
 static char *all_tests();
 
@@ -30,7 +33,9 @@ static char *(*tests[])(void) = {
   tar_add_file_rec_test,
   add_tar_file_in_tar_test,
   tar_append_file_test,
-  move_file_to_end_of_tar_test
+  move_file_to_end_of_tar_test,
+  tar_add_file_long_name_test,
+  tar_add_sparse_file_test
 };
 
 
@@ -228,3 +233,46 @@ static char *move_file_to_end_of_tar_test()
 
   return 0;
 }
+
+
+static char *tar_add_file_long_name_test() {
+  const char *name = "dir1/a_directory_with_a_rather_long_name/another_directory_with_a_long_name/"
+    "a_file_whose_path_does_not_fit_in_one_hundred_characters";
+  system("echo long > /tmp/tsh_test/long_name");
+  mu_assert("tar_add_file_long_name_test: error: add_ext_to_tar failed",
+	    add_ext_to_tar("/tmp/tsh_test/test.tar", "/tmp/tsh_test/long_name", name) == 0);
+  mu_assert("tar_add_file_long_name_test: error: the name isn't found in the tar",
+	    tar_access("/tmp/tsh_test/test.tar", name, F_OK) > 0);
+
+  // le nom complet doit être lu par GNU tar
+  char cmd[PATH_MAX];
+  sprintf(cmd, "tar -tf /tmp/tsh_test/test.tar | grep -qx '%s'", name);
+  mu_assert("tar_add_file_long_name_test: error: GNU tar doesn't read the full name", system(cmd) == 0);
+  system("rm /tmp/tsh_test/long_name");
+  return 0;
+}
+
+static char *tar_add_sparse_file_test() {
+  struct stat s1, s2;
+
+  // 64 Mio, dont deux extents de données
+  system("cd /tmp/tsh_test && truncate -s 64M vm.img && echo boot | dd of=vm.img conv=notrunc 2>/dev/null"
+	 " && echo data | dd of=vm.img bs=1M seek=32 conv=notrunc 2>/dev/null");
+  stat("/tmp/tsh_test/test.tar", &s1);
+  mu_assert("tar_add_sparse_file_test: error: add_ext_to_tar failed",
+	    add_ext_to_tar("/tmp/tsh_test/test.tar", "/tmp/tsh_test/vm.img", "dir1/vm.img") == 0);
+  stat("/tmp/tsh_test/test.tar", &s2);
+  mu_assert("tar_add_sparse_file_test: error: the holes are stored in the tar", s2.st_size - s1.st_size < 16 * BLOCKSIZE);
+
+  int tar_fd = open("/tmp/tsh_test/test.tar", O_RDONLY);
+  tar_file tf;
+  mu_assert("tar_add_sparse_file_test: error: the file isn't in the tar", seek_member(tar_fd, "dir1/vm.img", &tf) == 1);
+  mu_assert("tar_add_sparse_file_test: error: invalid map", tf.sparse && tf.sparse->real_size == 64 << 20 && tar_file_size(&tf) == 64 << 20);
+  free_tar_file(&tf);
+  close(tar_fd);
+
+  // GNU tar doit recréer le même fichier
+  system("mkdir -p /tmp/tsh_test/gnu && tar -C /tmp/tsh_test/gnu -xf /tmp/tsh_test/test.tar dir1/vm.img");
+  mu_assert("tar_add_sparse_file_test: error: content of file", system("cmp -s /tmp/tsh_test/vm.img /tmp/tsh_test/gnu/dir1/vm.img") == 0);
+  return 0;
+}
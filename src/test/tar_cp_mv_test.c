@@ -2,12 +2,17 @@
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "tsh_test.h"
 #include "minunit.h"
+#include "archive.h"
+#include "catalog.h"
 #include "tar.h"
+#include "copy.h"
 #include "tar_cp_mv_test.h"
 
 extern int tests_run;
@@ -16,13 +21,21 @@ static char *tar_cp_test();
 static char *tar_mv_test();
 static char *tar_extract_man_dir_test();
 static char *tar_extract_hello_test ();
+static char *tar_extract_metadata_test ();
+static char *tar_extract_sparse_test ();
+static char *tar_read_members_test ();
+static char *cp_tar_to_ext_batch_mode_test ();
 static char *all_tests();
 
 static char *(*tests[])(void) = {
   tar_cp_test,
   tar_mv_test,
   tar_extract_man_dir_test,
-  tar_extract_hello_test
+  tar_extract_hello_test,
+  tar_extract_metadata_test,
+  tar_extract_sparse_test,
+  tar_read_members_test,
+  cp_tar_to_ext_batch_mode_test
 };
 
 int launch_tar_cp_mv_tests() {
@@ -115,3 +128,133 @@ static char *tar_mv_test()
 
   return 0;
 }
+
+static char *tar_extract_metadata_test ()
+{
+  struct posix_header hd;
+  struct stat st;
+
+  system("mkdir -p /tmp/tsh_test/extract_dir");
+  int r = tar_extract("/tmp/tsh_test/test.tar", "dir1/subdir/", "/tmp/tsh_test/extract_dir");
+  mu_assert("Error during the extraction", r == 0);
+
+  mu_assert("\"subdir/subsubdir/hello\" should be extracted", stat("/tmp/tsh_test/extract_dir/subdir/subsubdir/hello", &st) == 0);
+  mu_assert("Only the extracted directory should be created", stat("/tmp/tsh_test/extract_dir/dir1", &st) < 0);
+
+  int tar_fd = open("/tmp/tsh_test/test.tar", O_RDONLY);
+  mu_assert("\"dir1/subdir/\" should be in the tar", seek_header(tar_fd, "dir1/subdir/", &hd) == 1);
+  close(tar_fd);
+
+  mu_assert("stat(\"/tmp/tsh_test/extract_dir/subdir\") failed", stat("/tmp/tsh_test/extract_dir/subdir", &st) == 0);
+  mu_assert("The mtime of the extracted directory should be restored", st.st_mtime == strtol(hd.mtime, NULL, 8));
+
+  return 0;
+}
+
+static char *tar_extract_sparse_test ()
+{
+  struct stat st;
+
+  // 3 extents de données dans un fichier de 8 Mio
+  system("cd /tmp/tsh_test && truncate -s 8M sparse && for i in 1 3 5; do echo data$i | dd of=sparse bs=1M seek=$i conv=notrunc 2>/dev/null; done");
+  system("cd /tmp/tsh_test && tar --format=gnu -S -cf sparse_gnu.tar sparse && tar --format=pax -S --sparse-version=1.0 -cf sparse_pax.tar sparse");
+  system("mkdir -p /tmp/tsh_test/sparse_gnu /tmp/tsh_test/sparse_pax");
+
+  mu_assert("Error during the extraction of the old GNU format", tar_extract("/tmp/tsh_test/sparse_gnu.tar", "sparse", "/tmp/tsh_test/sparse_gnu") == 0);
+  mu_assert("Error during the extraction of the PAX format", tar_extract("/tmp/tsh_test/sparse_pax.tar", "sparse", "/tmp/tsh_test/sparse_pax") == 0);
+  mu_assert("Invalid content (old GNU format)", system("cmp -s /tmp/tsh_test/sparse /tmp/tsh_test/sparse_gnu/sparse") == 0);
+  mu_assert("Invalid content (PAX format)", system("cmp -s /tmp/tsh_test/sparse /tmp/tsh_test/sparse_pax/sparse") == 0);
+
+  mu_assert("stat failed", stat("/tmp/tsh_test/sparse_pax/sparse", &st) == 0);
+  mu_assert("The holes should not be allocated", st.st_size == 8 << 20 && st.st_blocks * 512 < (1 << 20));
+
+  // cat vers un fichier régulier : les trous sont recréés aussi
+  int fd = open("/tmp/tsh_test/sparse_cat", O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
+  mu_assert("Open didn't work", fd > 0);
+  mu_assert("tar_cp_file failed", tar_cp_file("/tmp/tsh_test/sparse_gnu.tar", "sparse", fd) == 0);
+  close(fd);
+  mu_assert("Invalid content (cat)", system("cmp -s /tmp/tsh_test/sparse /tmp/tsh_test/sparse_cat") == 0);
+  mu_assert("stat failed", stat("/tmp/tsh_test/sparse_cat", &st) == 0);
+  mu_assert("The holes should not be written by cat", st.st_blocks * 512 < (1 << 20));
+
+  return 0;
+}
+
+/** What tar_read_members_test() received */
+struct read_result
+{
+  int fd;
+  int nb_ends;
+  int last_index;
+  int errors[5];
+};
+
+static int read_sink (int index, const void *buf, size_t count, int err, void *data)
+{
+  struct read_result *res = data;
+
+  // les membres doivent arriver dans l'ordre demandé
+  if (index < res->last_index)
+    return -1;
+  res->last_index = index;
+
+  if (buf)
+    return write(res->fd, buf, count) == count ? 0 : -1;
+
+  if (count == 0)
+    {
+      res->errors[index] = err;
+      res->nb_ends++;
+    }
+  return 0;
+}
+
+static char *tar_read_members_test ()
+{
+  char *names[] = { "man_dir/tar", "dont_exist", "toto", "man_dir/man", "dir1" };
+  struct read_result res = { .last_index = 0 };
+
+  res.fd = open("/tmp/tsh_test/read_members", O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
+  int expected = open("/tmp/tsh_test/read_members_diff", O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
+  mu_assert("Open didn't work", res.fd > 0 && expected > 0);
+
+  tar_cp_file("/tmp/tsh_test/test.tar", "man_dir/tar", expected);
+  tar_cp_file("/tmp/tsh_test/test.tar", "toto", expected);
+  tar_cp_file("/tmp/tsh_test/test.tar", "man_dir/man", expected);
+  close(expected);
+
+  int tar_fd = archive_open("/tmp/tsh_test/test.tar", O_RDONLY);
+  const tar_catalog *catalog = catalog_get("/tmp/tsh_test/test.tar");
+  mu_assert("Couldn't open the tar", tar_fd >= 0 && catalog);
+
+  mu_assert("tar_read_members should fail", tar_read_members(tar_fd, catalog, names, 5, read_sink, &res) == -1);
+  catalog_release(catalog);
+  archive_close(tar_fd);
+  close(res.fd);
+
+  mu_assert("Every member should have an end", res.nb_ends == 5);
+  mu_assert("Errors of the members", res.errors[0] == 0 && res.errors[1] == ENOENT && res.errors[2] == 0
+	    && res.errors[3] == 0 && res.errors[4] == EISDIR);
+  mu_assert("Invalid content", system("cmp -s /tmp/tsh_test/read_members /tmp/tsh_test/read_members_diff") == 0);
+
+  return 0;
+}
+
+static char *cp_tar_to_ext_batch_mode_test ()
+{
+  char *names[] = { "access/no_x_dir/a", "toto" };
+  struct stat st_exec, st_file;
+
+  system("rm -rf /tmp/tsh_test/batch && mkdir /tmp/tsh_test/batch");
+  mode_t mask = umask(022);
+  int ret = cp_tar_to_ext_batch("/tmp/tsh_test/test.tar", names, 2, "/tmp/tsh_test/batch", "");
+  umask(mask);
+  mu_assert("cp_tar_to_ext_batch failed", ret == 0);
+
+  mu_assert("The files should be extracted", stat("/tmp/tsh_test/batch/a", &st_exec) == 0
+	    && stat("/tmp/tsh_test/batch/toto", &st_file) == 0);
+  mu_assert("The executable should keep its mode", (st_exec.st_mode & 07777) == 0744);
+  mu_assert("The file should keep its mode", (st_file.st_mode & 07777) == 0644);
+
+  return 0;
+}
@@ -0,0 +1,131 @@
+/* tar_glob_test.c : Tests for the expansion of patterns against the catalog of a tar */
+#include "tar_glob_test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "catalog.h"
+#include "minunit.h"
+#include "tar_glob.h"
+#include "tsh_test.h"
+
+
+static char *tar_glob_match_test();
+static char *tar_glob_catalog_test();
+static char *tar_glob_dirs_test();
+static char *glob_unescape_test();
+
+extern int tests_run;
+
+static char *(*tests[])(void) =
+  {
+    tar_glob_match_test,
+    tar_glob_catalog_test,
+    tar_glob_dirs_test,
+    glob_unescape_test
+  };
+
+
+static char *all_tests()
+{
+  for (int i = 0; i < TAR_GLOB_TEST_SIZE; i++)
+    {
+      before();
+      mu_run_test(tests[i]);
+    }
+  return 0;
+}
+
+int launch_tar_glob_tests()
+{
+  int prec_tests_run = tests_run;
+  char *results = all_tests();
+  if (results != 0)
+    {
+      printf(RED "%s\n" WHITE, results);
+    }
+  else
+    {
+      printf(GREEN "ALL TAR GLOB TESTS PASSED\n" WHITE);
+    }
+  printf("tar glob tests run: %d\n\n", tests_run - prec_tests_run);
+  return (results == 0);
+}
+
+
+/* Check that the matches of PATTERN in the test tar are the names of EXPECTED, in this order */
+static bool same_matches (const char *pattern, int flags, char *expected[], int nb_expected)
+{
+  const tar_catalog *catalog = catalog_get(TAR_TEST);
+  array *matches = tar_glob(NULL, catalog, pattern, flags);
+  catalog_release(catalog);
+  bool same = array_size(matches) == nb_expected;
+
+  for (int i = 0; same && i < nb_expected; i++)
+    same = !strcmp(*(char **) array_at(matches, i), expected[i]);
+
+  array_free(matches, true);
+  return same;
+}
+
+
+static char *tar_glob_match_test()
+{
+  mu_assert("* should match a name", tar_glob_match("*.gz", "a.gz", 0));
+  mu_assert("* should not match a /", !tar_glob_match("*.gz", "logs/a.gz", 0));
+  mu_assert("? should match one character", tar_glob_match("a?c", "abc", 0) && !tar_glob_match("a?c", "ac", 0));
+  mu_assert("[...] should match a set", tar_glob_match("f[0-9][!a]", "f1b", 0) && !tar_glob_match("f[0-9][!a]", "f1a", 0));
+  mu_assert("[ without ] should be literal", tar_glob_match("a[b", "a[b", 0));
+  mu_assert("\\ should escape", tar_glob_match("a\\*", "a*", 0) && !tar_glob_match("a\\*", "ab", 0));
+  mu_assert("** should match zero component", tar_glob_match("logs/**/*.gz", "logs/a.gz", 0));
+  mu_assert("** should match several components", tar_glob_match("logs/**/*.gz", "logs/2020/01/a.gz", 0));
+  mu_assert("** should not enter hidden directories", !tar_glob_match("**/a.gz", ".cache/a.gz", 0));
+  mu_assert("* should not match a hidden name", !tar_glob_match("*", ".hidden", 0) && tar_glob_match(".*", ".hidden", 0));
+  mu_assert("Matching should be case sensitive", !tar_glob_match("A*", "abc", 0));
+  mu_assert("TAR_GLOB_NOCASE should ignore the case", tar_glob_match("A*", "abc", TAR_GLOB_NOCASE) && tar_glob_match("[A-C]b", "bB", TAR_GLOB_NOCASE));
+
+  return 0;
+}
+
+
+static char *tar_glob_catalog_test()
+{
+  char *top[] = { "access", "dir1", "dir2", "man_dir", "titi", "titi_link", "toto" };
+  char *t_anywhere[] = { "dir1/tata", "man_dir/tar", "titi", "titi_link", "toto" };
+  char *nocase[] = { "titi", "titi_link", "toto" };
+
+  mu_assert("tar_glob(\"*\") should give the names of the root, sorted", same_matches("*", 0, top, 7));
+  mu_assert("tar_glob(\"**/t*\") should search all the directories", same_matches("**/t*", 0, t_anywhere, 5));
+  mu_assert("tar_glob(\"T*\") should not match", same_matches("T*", 0, NULL, 0));
+  mu_assert("tar_glob(\"T*\", TAR_GLOB_NOCASE) should match", same_matches("T*", TAR_GLOB_NOCASE, nocase, 3));
+
+  return 0;
+}
+
+
+static char *tar_glob_dirs_test()
+{
+  // access/ n'existe qu'à travers son contenu
+  char *dirs[] = { "access/", "dir1/", "dir2/", "man_dir/" };
+  char *subdirs[] = { "dir1/subdir", "dir1/subdir/subsubdir" };
+
+  mu_assert("tar_glob(\"*/\") should give the directories", same_matches("*/", 0, dirs, 4));
+  mu_assert("tar_glob(\"dir1/**/sub*\") should give the directories through their content", same_matches("dir1/**/sub*", 0, subdirs, 2));
+
+  return 0;
+}
+
+
+static char *glob_unescape_test()
+{
+  char escaped[] = "dir/a\\*b\\\\c\\";
+  char plain[] = "dir/a*b";
+
+  glob_unescape(escaped);
+  mu_assert("glob_unescape should remove the \\ before a character", !strcmp(escaped, "dir/a*b\\c\\"));
+  glob_unescape(plain);
+  mu_assert("glob_unescape should keep a word without \\", !strcmp(plain, "dir/a*b"));
+
+  return 0;
+}
@@ -6,6 +6,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "archive.h"
 #include "tsh_test.h"
 #include "minunit.h"
 #include "tar.h"
@@ -22,6 +23,11 @@ static char *tar_ls_dir_root_test();
 static char *tar_ls_dir_man_dir_test();
 static char *tar_ls_dir_dir1_rec_test();
 static char *tar_ls_fail_test();
+static char *tar_ls_large_size_test();
+static char *tar_ls_long_names_test();
+static char *tar_scan_test();
+static char *tar_iter_test();
+static char *tar_catalog_test();
 
 static char *(*tests[])(void) = {
   tar_ls_test,
@@ -29,7 +35,12 @@ static char *(*tests[])(void) = {
   tar_ls_dir_root_test,
   tar_ls_dir_man_dir_test,
   tar_ls_dir_dir1_rec_test,
-  tar_ls_fail_test
+  tar_ls_fail_test,
+  tar_ls_large_size_test,
+  tar_ls_long_names_test,
+  tar_scan_test,
+  tar_iter_test,
+  tar_catalog_test
 };
 
 int launch_tar_ls_tests()
@@ -99,7 +110,7 @@ static char *tar_ls_test()
 
 static int sort_header_name(const void *lhs, const void *rhs)
 {
-  return strcmp(((tar_file*)lhs)->header.name, ((tar_file*)rhs)->header.name);
+  return strcmp(((tar_file*)lhs)->name, ((tar_file*)rhs)->name);
 }
   
 
@@ -140,11 +151,11 @@ static char *tar_ls_all_test()
     {
       tf = (tar_file*)array_get(arr, i);
       mu_assert("Wrong file descriptor", tf->tar_fd == tar_fd);
-      mu_assert("Invalid ls", !strcmp(tf->header.name, test[i]));
+      mu_assert("Invalid ls", !strcmp(tf->name, test[i]));
       free(tf);
     }
   
-  array_free(arr, false);
+  tar_ls_free(arr);
   close(tar_fd);
   
   return 0;
@@ -174,11 +185,11 @@ static char *tar_ls_dir_root_test()
     {
       tf = (tar_file*)array_get(arr, i);
       mu_assert("Wrong file descriptor", tf->tar_fd == tar_fd);
-      mu_assert("Invalid ls", !strcmp(tf->header.name, test[i]));
+      mu_assert("Invalid ls", !strcmp(tf->name, test[i]));
       free(tf);
     }
   
-  array_free(arr, false);
+  tar_ls_free(arr);
   close(tar_fd);
   
   return 0;
@@ -206,11 +217,11 @@ static char *tar_ls_dir_man_dir_test()
     {
       tf = (tar_file*)array_get(arr, i);
       mu_assert("Wrong file descriptor", tf->tar_fd == tar_fd);
-      mu_assert("Invalid ls", !strcmp(tf->header.name, test[i]));
+      mu_assert("Invalid ls", !strcmp(tf->name, test[i]));
       free(tf);
     }
   
-  array_free(arr, false);
+  tar_ls_free(arr);
   close(tar_fd);
   
   return 0;
@@ -239,11 +250,11 @@ static char *tar_ls_dir_dir1_rec_test()
     {
       tf = (tar_file*)array_get(arr, i);
       mu_assert("Wrong file descriptor", tf->tar_fd == tar_fd);
-      mu_assert("Invalid ls", !strcmp(tf->header.name, test[i]));
+      mu_assert("Invalid ls", !strcmp(tf->name, test[i]));
       free(tf);
     }
   
-  array_free(arr, false);
+  tar_ls_free(arr);
   close(tar_fd);
 
   return 0;
@@ -263,3 +274,294 @@ static char *tar_ls_fail_test()
   close(tar_fd);
   return 0;
 }
+
+
+static char *tar_ls_large_size_test()
+{
+  // 10 Gio en base 256, puis 12 Gio donnés par un en-tête PAX
+  const off_t big_size = 10LL << 30, pax_size = 12LL << 30;
+  const char pax_data[] = "20 size=12884901888\n";
+  struct posix_header hd;
+
+  int tar_fd = open("/tmp/tsh_test/large.tar", O_CREAT | O_TRUNC | O_RDWR, 0644);
+  mu_assert("Can't create large.tar", tar_fd >= 0);
+
+  memset(&hd, '\0', BLOCKSIZE);
+  strcpy(hd.name, "big");
+  strcpy(hd.mode, "0000644");
+  hd.typeflag = REGTYPE;
+  strcpy(hd.magic, TMAGIC);
+  set_file_size(&hd, big_size);
+  set_checksum(&hd);
+  mu_assert("A size of 10 GiB should be written in base 256", (unsigned char) hd.size[0] == 0x80);
+  mu_assert("Invalid size read", get_file_size(&hd) == big_size);
+  pwrite(tar_fd, &hd, BLOCKSIZE, 0);
+
+  off_t offset = BLOCKSIZE + big_size;
+  strcpy(hd.name, "PaxHeaders/pax_big");
+  hd.typeflag = XHDTYPE;
+  set_file_size(&hd, strlen(pax_data));
+  set_checksum(&hd);
+  pwrite(tar_fd, &hd, BLOCKSIZE, offset);
+  pwrite(tar_fd, pax_data, strlen(pax_data), offset + BLOCKSIZE);
+
+  offset += 2 * BLOCKSIZE;
+  strcpy(hd.name, "pax_big");
+  hd.typeflag = REGTYPE;
+  set_file_size(&hd, 0);
+  set_checksum(&hd);
+  pwrite(tar_fd, &hd, BLOCKSIZE, offset);
+
+  // le fichier est creux : seuls les en-têtes et les blocs de fin occupent de la place
+  ftruncate(tar_fd, offset + BLOCKSIZE + pax_size + 2 * BLOCKSIZE);
+
+  array *arr = tar_ls_all(tar_fd);
+  mu_assert("There should be 2 files in large.tar", arr && array_size(arr) == 2);
+
+  tar_file *tf = array_get(arr, 0);
+  mu_assert("Invalid size of big", !strcmp(tf->name, "big") && get_file_size(&tf->header) == big_size);
+  free(tf);
+
+  tf = array_get(arr, 1);
+  mu_assert("The PAX header should be applied to pax_big",
+	    !strcmp(tf->name, "pax_big") && get_file_size(&tf->header) == pax_size);
+  mu_assert("Invalid start of pax_big", tf->file_start == offset);
+  free(tf);
+
+  tar_ls_free(arr);
+  close(tar_fd);
+  unlink("/tmp/tsh_test/large.tar");
+
+  return 0;
+}
+
+
+static char *tar_ls_long_names_test()
+{
+  char long_name[201], prefix_name[181];
+  struct posix_header hd;
+  off_t offset = 0;
+
+  memset(long_name, 'a', 200);
+  long_name[200] = '\0';
+  memset(prefix_name, 'b', 180);
+  prefix_name[80] = '/';
+  prefix_name[180] = '\0';
+
+  int tar_fd = open("/tmp/tsh_test/long.tar", O_CREAT | O_TRUNC | O_RDWR, 0644);
+  mu_assert("Can't create long.tar", tar_fd >= 0);
+
+  // nom long GNU : un en-tête 'L' suivi du nom
+  memset(&hd, '\0', BLOCKSIZE);
+  strcpy(hd.name, "././@LongLink");
+  strcpy(hd.mode, "0000644");
+  hd.typeflag = GNUTYPE_LONGNAME;
+  strcpy(hd.magic, "ustar ");
+  set_file_size(&hd, sizeof(long_name));
+  set_checksum(&hd);
+  pwrite(tar_fd, &hd, BLOCKSIZE, offset);
+  pwrite(tar_fd, long_name, sizeof(long_name), offset + BLOCKSIZE);
+  offset += BLOCKSIZE + number_of_block(sizeof(long_name)) * BLOCKSIZE;
+
+  strncpy(hd.name, long_name, sizeof(hd.name));
+  hd.typeflag = REGTYPE;
+  set_file_size(&hd, 0);
+  set_checksum(&hd);
+  pwrite(tar_fd, &hd, BLOCKSIZE, offset);
+  offset += BLOCKSIZE;
+
+  // nom découpé dans le champ prefix d'un en-tête ustar
+  memset(&hd, '\0', BLOCKSIZE);
+  memcpy(hd.prefix, prefix_name, 80);
+  strcpy(hd.name, prefix_name + 81);
+  strcpy(hd.mode, "0000644");
+  hd.typeflag = REGTYPE;
+  memcpy(hd.magic, TMAGIC, TMAGLEN);
+  memcpy(hd.version, TVERSION, TVERSLEN);
+  set_file_size(&hd, 0);
+  set_checksum(&hd);
+  pwrite(tar_fd, &hd, BLOCKSIZE, offset);
+  offset += BLOCKSIZE;
+
+  // nom et cible de lien longs donnés par un en-tête PAX
+  char *ext;
+  memset(&hd, '\0', BLOCKSIZE);
+  strcpy(hd.mode, "0000777");
+  hd.typeflag = SYMTYPE;
+  memcpy(hd.magic, TMAGIC, TMAGLEN);
+  set_file_size(&hd, 0);
+  ssize_t ext_size = set_header_names(&hd, prefix_name, long_name, &ext);
+  mu_assert("An extended header should be needed", ext_size > 0 && ext_size % BLOCKSIZE == 0);
+  pwrite(tar_fd, ext, ext_size, offset);
+  free(ext);
+  offset += ext_size;
+  pwrite(tar_fd, &hd, BLOCKSIZE, offset);
+  offset += BLOCKSIZE;
+
+  char end[2 * BLOCKSIZE];
+  memset(end, '\0', sizeof(end));
+  pwrite(tar_fd, end, sizeof(end), offset);
+
+  array *arr = tar_ls_all(tar_fd);
+  mu_assert("There should be 3 files in long.tar", arr && array_size(arr) == 3);
+
+  tar_file *tf = array_get(arr, 0);
+  mu_assert("Invalid GNU long name", !strcmp(tf->name, long_name) && tf->ext_start == 0);
+  free(tf);
+
+  tf = array_get(arr, 1);
+  mu_assert("Invalid ustar prefixed name", !strcmp(tf->name, prefix_name) && tf->ext_start == tf->file_start);
+  free(tf);
+
+  tf = array_get(arr, 2);
+  mu_assert("Invalid PAX name", !strcmp(tf->name, prefix_name) && !strcmp(tf->linkname, long_name));
+  mu_assert("The PAX header should belong to the member", tf->file_start - tf->ext_start == ext_size);
+  free(tf);
+
+  tar_ls_free(arr);
+
+  tar_file member;
+  lseek(tar_fd, 0, SEEK_SET);
+  mu_assert("seek_member should find a long name", seek_member(tar_fd, long_name, &member) == 1);
+  mu_assert("seek_member: invalid name", !strcmp(member.name, long_name));
+  free_tar_file(&member);
+
+  close(tar_fd);
+
+  // GNU tar doit lire les noms écrits en PAX
+  mu_assert("GNU tar can't read long.tar", system("tar -tf /tmp/tsh_test/long.tar > /dev/null 2>&1") == 0);
+  unlink("/tmp/tsh_test/long.tar");
+
+  return 0;
+}
+
+
+static bool collect(tar_file *tf, void *data)
+{
+  array_insert_last(data, tf);
+  return true;
+}
+
+
+static char *tar_scan_test()
+{
+  // le contenu de inner.tar ressemble à des en-têtes : les chaînes qui y commencent doivent être rejetées
+  system("cd " TEST_DIR " && mkdir -p scan/many scan/a_very_long_directory_name_which_does_not_fit_in_the_name_field_of_a_ustar_header"
+	 " && for i in $(seq 1 300); do echo $i > scan/many/f$i; done && tar cf inner.tar scan/many && mv inner.tar scan"
+	 " && touch scan/a_very_long_directory_name_which_does_not_fit_in_the_name_field_of_a_ustar_header/file"
+	 " && tar cf scan.tar --format=pax scan/many/f1* scan/inner.tar scan");
+
+  int tar_fd = open(TEST_DIR "/scan.tar", O_RDONLY);
+  mu_assert("Can't open scan.tar", tar_fd >= 0);
+
+  array *expected = tar_ls_all(tar_fd);
+  mu_assert("Can't list scan.tar", expected && array_size(expected) > 400);
+
+  for (int nb_threads = 1; nb_threads <= 16; nb_threads++)
+    {
+      array *arr = array_create(sizeof(tar_file));
+      mu_assert("The scan should not fail", tar_scan_visit(tar_fd, collect, arr, nb_threads) == 0);
+      mu_assert("The scan should list the same number of files", array_size(arr) == array_size(expected));
+
+      for (int i = 0; i < array_size(arr); i++)
+	{
+	  tar_file *tf = array_get(arr, i), *etf = array_get(expected, i);
+	  int same = !strcmp(tf->name, etf->name) && tf->ext_start == etf->ext_start && tf->data_start == etf->data_start
+	    && tf->tar_fd == tar_fd;
+	  free(tf);
+	  free(etf);
+	  mu_assert("The scan should list the same files as tar_ls_all", same);
+	}
+      tar_ls_free(arr);
+    }
+
+  tar_ls_free(expected);
+  close(tar_fd);
+
+  return 0;
+}
+
+
+static char *tar_iter_test()
+{
+  char content[13];
+  tar_iter it;
+  tar_file *tf, kept;
+  int r, i = 0;
+  bool has_kept = false;
+
+  int tar_fd = open(TAR_TEST, O_RDONLY);
+  array *expected = tar_ls_all(tar_fd);
+  mu_assert("Can't list test.tar", expected);
+
+  archive_lseek(tar_fd, 0, SEEK_SET);
+  tar_iter_open(&it, tar_fd);
+  while ((r = tar_iter_next(&it, &tf)) == 1)
+    {
+      tar_file *etf = array_get(expected, i++);
+      int same = !strcmp(tf->name, etf->name) && tf->ext_start == etf->ext_start;
+      free(etf);
+      mu_assert("The iterator should give the members in order", same);
+
+      // le contenu peut être lu entre deux membres
+      if (!strcmp(tf->name, "dir1/subdir/subsubdir/hello"))
+	{
+	  mu_assert("Can't read the content of the current member",
+		    archive_read(tar_fd, content, sizeof(content)) == sizeof(content) && !memcmp(content, "Hello World!\n", 13));
+	  kept = *tf;
+	  tar_iter_keep(&it);
+	  has_kept = true;
+	}
+    }
+  tar_iter_close(&it);
+
+  mu_assert("The iteration should end without error", r == 0 && i == array_size(expected));
+  mu_assert("A kept member should outlive the iteration", has_kept && !strcmp(kept.name, "dir1/subdir/subsubdir/hello"));
+  free_tar_file(&kept);
+
+  tar_ls_free(expected);
+  close(tar_fd);
+
+  return 0;
+}
+
+
+static char *tar_catalog_test()
+{
+  char content[13];
+  tar_file tf;
+
+  int tar_fd = open(TAR_TEST, O_RDONLY);
+  array *expected = tar_ls_all(tar_fd);
+  tar_catalog *catalog = tar_catalog_read(tar_fd);
+  mu_assert("Can't build the catalog of test.tar", expected && catalog && catalog->nb_members == array_size(expected));
+
+  for (int i = 0; i < array_size(expected); i++)
+    {
+      tar_file *etf = array_get(expected, i);
+      const tar_member *m = catalog->members + i;
+      int same = !strcmp(m->name, etf->name) && !strcmp(m->linkname, etf->linkname) && m->ext_start == etf->ext_start
+	&& m->data_start == etf->data_start && m->size == get_file_size(&etf->header) && m->real_size == tar_file_size(etf)
+	&& m->typeflag == etf->header.typeflag && m->mode == (strtol(etf->header.mode, NULL, 8) & 07777)
+	&& m->uid == strtol(etf->header.uid, NULL, 8) && m->mtime == strtol(etf->header.mtime, NULL, 8)
+	&& !strcmp(m->uname, etf->header.uname) && !strcmp(m->gname, etf->header.gname);
+      free(etf);
+      mu_assert("The catalog should have the same members as tar_ls_all", same);
+    }
+
+  // les noms des propriétaires ne sont stockés qu'une fois
+  mu_assert("The owners should be shared", catalog->members[0].uname == catalog->members[catalog->nb_members - 1].uname);
+
+  const tar_member *hello = tar_catalog_find(catalog, "dir1/subdir/subsubdir/hello");
+  mu_assert("Can't find a member in the catalog", hello && !tar_catalog_find(catalog, "nope"));
+  mu_assert("Can't read the full member", tar_member_read(tar_fd, hello, &tf) == 1 && !strcmp(tf.name, hello->name));
+  mu_assert("The full member should be followed by its content",
+	    archive_read(tar_fd, content, sizeof(content)) == sizeof(content) && !memcmp(content, "Hello World!\n", 13));
+  free_tar_file(&tf);
+
+  tar_catalog_free(catalog);
+  tar_ls_free(expected);
+  close(tar_fd);
+
+  return 0;
+}
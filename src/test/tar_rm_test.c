@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include "tsh_test.h"
 #include "minunit.h"
@@ -9,12 +10,14 @@
 static char *all_tests();
 static char *tar_rm_file_test();
 static char *tar_rm_dir_test();
+static char *tar_rm_files_test();
 
 extern int tests_run;
 
 static char *(*tests[])(void) = {
   tar_rm_file_test,
-  tar_rm_dir_test
+  tar_rm_dir_test,
+  tar_rm_files_test
 };
 
 int launch_tar_rm_tests()
@@ -57,3 +60,18 @@ static char *tar_rm_dir_test()
 
   return 0;
 }
+
+static char *tar_rm_files_test()
+{
+  char *filenames[] = { "toto", "dir1/", "man_dir/man" };
+
+  mu_assert("Couldn't remove toto, dir1/ and man_dir/man", tar_rm_files("/tmp/tsh_test/test.tar", filenames, 3) == 0);
+  mu_assert("Error tar_rm_files corrupted the tar", is_tar("/tmp/tsh_test/test.tar") == 1);
+  mu_assert("toto is still in the tar", tar_access("/tmp/tsh_test/test.tar", "toto", F_OK) == -1);
+  mu_assert("dir1/tata is still in the tar", tar_access("/tmp/tsh_test/test.tar", "dir1/tata", F_OK) == -1);
+  mu_assert("man_dir/man is still in the tar", tar_access("/tmp/tsh_test/test.tar", "man_dir/man", F_OK) == -1);
+  mu_assert("titi was removed", tar_access("/tmp/tsh_test/test.tar", "titi", F_OK) > 0);
+  mu_assert("man_dir/open2 was removed", tar_access("/tmp/tsh_test/test.tar", "man_dir/open2", F_OK) > 0);
+
+  return 0;
+}
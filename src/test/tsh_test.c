@@ -13,9 +13,18 @@
 #include "tar_add_test.h"
 #include "tar_access_test.h"
 #include "array_test.h"
+#include "arena_test.h"
+#include "hashmap_test.h"
+#include "io_engine_test.h"
+#include "archive_test.h"
+#include "catalog_test.h"
+#include "credentials_test.h"
+#include "output_test.h"
+#include "script_test.h"
 #include "tar_ls_test.h"
 #include "tar_rm_test.h"
 #include "tar_cp_mv_test.h"
+#include "tar_glob_test.h"
 #include "utils_test.h"
 
 
@@ -27,11 +36,20 @@ static char *tests_names[] = {
   "tar_access",
   "tar_add",
   "tar_cp_mv",
+  "tar_glob",
   "path_lib",
   "parse_line",
   "list",
   "stack",
   "array",
+  "arena",
+  "hashmap",
+  "io_engine",
+  "archive",
+  "catalog",
+  "credentials",
+  "output",
+  "script",
   "utils"
 };
 
@@ -41,11 +59,20 @@ static int (*launch_tests[])(void) = {
   launch_tar_access_tests,
   launch_tar_add_tests,
   launch_tar_cp_mv_tests,
+  launch_tar_glob_tests,
   launch_path_lib_tests,
   launch_parse_line_tests,
   launch_list_tests,
   launch_stack_tests,
   launch_array_tests,
+  launch_arena_tests,
+  launch_hashmap_tests,
+  launch_io_engine_tests,
+  launch_archive_tests,
+  launch_catalog_tests,
+  launch_credentials_tests,
+  launch_output_tests,
+  launch_script_tests,
   launch_utils_tests
 };
 
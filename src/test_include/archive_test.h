@@ -0,0 +1,8 @@
+#ifndef ARCHIVE_TEST_H
+#define ARCHIVE_TEST_H
+
+#define ARCHIVE_TEST_SIZE 7
+
+int launch_archive_tests();
+
+#endif
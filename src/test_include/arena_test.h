@@ -0,0 +1,8 @@
+#ifndef ARENA_TEST_H
+#define ARENA_TEST_H
+
+#define ARENA_TEST_SIZE 3
+
+int launch_arena_tests();
+
+#endif
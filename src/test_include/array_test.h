@@ -1,7 +1,7 @@
 #ifndef ARRAY_TEST_H
 #define ARRAY_TEST_H
 
-#define ARRAY_TEST_SIZE 6
+#define ARRAY_TEST_SIZE 7
 
 int launch_array_tests();
 
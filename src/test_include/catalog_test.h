@@ -0,0 +1,8 @@
+#ifndef CATALOG_TEST_H
+#define CATALOG_TEST_H
+
+#define CATALOG_TEST_SIZE 5
+
+int launch_catalog_tests();
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef CREDENTIALS_TEST_H
+#define CREDENTIALS_TEST_H
+
+#define CREDENTIALS_TEST_SIZE 2
+
+int launch_credentials_tests();
+
+#endif
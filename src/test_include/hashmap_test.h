@@ -0,0 +1,8 @@
+#ifndef HASHMAP_TEST_H
+#define HASHMAP_TEST_H
+
+#define HASHMAP_TEST_SIZE 4
+
+int launch_hashmap_tests();
+
+#endif
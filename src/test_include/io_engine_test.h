@@ -0,0 +1,8 @@
+#ifndef IO_ENGINE_TEST_H
+#define IO_ENGINE_TEST_H
+
+#define IO_ENGINE_TEST_SIZE 3
+
+int launch_io_engine_tests();
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef OUTPUT_TEST_H
+#define OUTPUT_TEST_H
+
+#define OUTPUT_TEST_SIZE 2
+
+int launch_output_tests();
+
+#endif
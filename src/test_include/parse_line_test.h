@@ -1,7 +1,7 @@
 #ifndef PARSE_LINE_TEST_H
 #define PARSE_LINE_TEST_H
 
-#define PARSE_LINE_TEST_SIZE 3
+#define PARSE_LINE_TEST_SIZE 4
 
 int launch_parse_line_tests();
 
@@ -1,7 +1,7 @@
 #ifndef PATH_LIB_TEST_H
 #define PATH_LIB_TEST_H
 
-#define PATH_LIB_TEST_SIZE 7
+#define PATH_LIB_TEST_SIZE 8
 
 int launch_path_lib_tests();
 
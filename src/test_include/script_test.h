@@ -0,0 +1,8 @@
+#ifndef SCRIPT_TEST_H
+#define SCRIPT_TEST_H
+
+#define SCRIPT_TEST_SIZE 3
+
+int launch_script_tests();
+
+#endif
@@ -1,7 +1,7 @@
 #ifndef TAR_ACCESS_H
 #define TAR_ACCESS_H
 
-#define TAR_TEST_SIZE 1
+#define TAR_TEST_SIZE 2
 
 
 int launch_tar_access_tests();
@@ -1,7 +1,7 @@
 #ifndef TAR_ADD_TEST_H
 #define TAR_ADD_TEST_H
 
-#define TAR_ADD_FILE_TEST_SIZE 7
+#define TAR_ADD_FILE_TEST_SIZE 9
 #define TAR_ADD_TEST_SIZE_BUF 700
 
 int launch_tar_add_tests();
@@ -1,7 +1,7 @@
 #ifndef TAR_CP_MV_TEST_H
 #define TAR_CP_MV_TEST_H
 
-#define TAR_CP_MV_TEST_SIZE 4
+#define TAR_CP_MV_TEST_SIZE 8
 
 int launch_tar_cp_mv_tests();
 
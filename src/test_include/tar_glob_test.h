@@ -0,0 +1,8 @@
+#ifndef TAR_GLOB_TEST_H
+#define TAR_GLOB_TEST_H
+
+#define TAR_GLOB_TEST_SIZE 4
+
+int launch_tar_glob_tests();
+
+#endif
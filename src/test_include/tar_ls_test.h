@@ -1,7 +1,7 @@
 #ifndef TAR_LS_TEST_H
 #define TAR_LS_TEST_H
 
-#define TAR_LS_TEST_SIZE 6
+#define TAR_LS_TEST_SIZE 11
 
 int launch_tar_ls_tests();
 
@@ -1,7 +1,7 @@
 #ifndef TAR_RM_TEST_H
 #define TAR_RM_TEST_H
 
-#define TAR_RM_TEST_SIZE 2
+#define TAR_RM_TEST_SIZE 3
 
 int launch_tar_rm_tests();
 
@@ -3,7 +3,7 @@
 
 #define TEST_DIR "/tmp/tsh_test"
 #define TAR_TEST "/tmp/tsh_test/test.tar"
-#define NB_TESTS 11
+#define NB_TESTS 20
 
 #define WHITE "\e[m"
 #define RED "\e[0;31m"
@@ -0,0 +1,178 @@
+#include "arena.h"
+
+#include <assert.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Alignment of every allocation */
+#define ARENA_ALIGN alignof(max_align_t)
+
+struct arena_block
+{
+  struct arena_block *prev; // bloc précédent, plus ancien
+
+  size_t used;
+
+  size_t size;
+
+  alignas(ARENA_ALIGN) char data[];
+};
+
+struct arena
+{
+  struct arena_block *current; // dernier bloc, celui où l'on alloue
+};
+
+
+
+static size_t align_up (size_t n)
+{
+  return (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+
+static struct arena_block *new_block (arena *a, size_t size)
+{
+  size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+  struct arena_block *b = malloc(sizeof(struct arena_block) + block_size);
+  assert(b);
+
+  b->prev = a->current;
+  b->used = 0;
+  b->size = block_size;
+  a->current = b;
+
+  return b;
+}
+
+
+/* Free the blocks of A newer than LAST */
+static void free_blocks (arena *a, struct arena_block *last)
+{
+  struct arena_block *prev;
+
+  while (a->current != last)
+    {
+      prev = a->current->prev;
+      free(a->current);
+      a->current = prev;
+    }
+}
+
+
+
+
+arena *arena_create ()
+{
+  arena *a = malloc(sizeof(arena));
+  assert(a);
+
+  a->current = NULL;
+
+  return a;
+}
+
+
+void arena_free (arena *a)
+{
+  if (!a)
+    return;
+
+  free_blocks(a, NULL);
+  free(a);
+}
+
+
+/* Take SIZE bytes in A, at an offset aligned if ALIGNED */
+static void *bump (arena *a, size_t size, bool aligned)
+{
+  struct arena_block *b = a->current;
+  size_t start = !b ? 0 : aligned ? align_up(b->used) : b->used;
+
+  if (!b || start + size > b->size)
+    {
+      b = new_block(a, size);
+      start = 0;
+    }
+
+  b->used = start + size;
+
+  return b->data + start;
+}
+
+
+void *arena_alloc (arena *a, size_t size)
+{
+  return bump(a, size, true);
+}
+
+
+void *arena_realloc (arena *a, void *ptr, size_t old_size, size_t new_size)
+{
+  struct arena_block *b = a->current;
+
+  if (!ptr)
+    return arena_alloc(a, new_size);
+
+  // la dernière allocation du bloc grandit sur place
+  if (b && (char *) ptr + old_size == b->data + b->used && (char *) ptr - b->data + new_size <= b->size)
+    {
+      b->used = (char *) ptr - b->data + new_size;
+      return ptr;
+    }
+
+  void *copy = arena_alloc(a, new_size);
+  memcpy(copy, ptr, old_size < new_size ? old_size : new_size);
+
+  return copy;
+}
+
+
+char *arena_strdup (arena *a, const char *str)
+{
+  return arena_strndup(a, str, strlen(str));
+}
+
+
+char *arena_strndup (arena *a, const char *str, size_t len)
+{
+  // une chaîne n'a pas besoin d'être alignée
+  char *copy = bump(a, len + 1, false);
+
+  memcpy(copy, str, len);
+  copy[len] = '\0';
+
+  return copy;
+}
+
+
+arena_mark arena_save (arena *a)
+{
+  return (arena_mark) { a->current, a->current ? a->current->used : 0 };
+}
+
+
+void arena_restore (arena *a, arena_mark mark)
+{
+  free_blocks(a, mark.block);
+
+  if (a->current)
+    a->current->used = mark.used;
+}
+
+
+void arena_reset (arena *a)
+{
+  if (!a->current)
+    return;
+
+  // on garde le plus ancien bloc
+  struct arena_block *first = a->current;
+  while (first->prev)
+    first = first->prev;
+
+  free_blocks(a, first);
+  first->used = 0;
+}
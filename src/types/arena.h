@@ -0,0 +1,109 @@
+/**
+ * @file arena.h
+ * Arena (bump) allocator
+ *
+ * Memory is taken from large blocks by moving a pointer, and given back all at once :
+ * at the end of a command (arena_reset()), or at the end of an operation (arena_restore() to a mark
+ * saved with arena_save()). An address given by an arena is never freed with `free`.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/** Size of the blocks of an arena, a bigger allocation gets its own block */
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+typedef struct arena arena;
+
+/**
+ * Position in an arena, everything allocated after it is given back by arena_restore()
+ */
+typedef struct
+{
+  struct arena_block *block; /**< the block in use, `NULL` if nothing was allocated */
+  size_t used;               /**< bytes used in this block */
+} arena_mark;
+
+/**
+ * Create an empty arena
+ * @return a malloc'd empty arena
+ */
+arena *arena_create ();
+
+/**
+ * Free an arena and all the memory allocated in it
+ * @param a an arena, or `NULL`
+ */
+void arena_free (arena *a);
+
+/**
+ * Allocate memory in an arena
+ *
+ * The address is aligned for any type, as the addresses returned by `malloc`.
+ *
+ * @param a an arena
+ * @param size the number of bytes
+ * @return the address of the memory, valid until it is given back by arena_restore() or arena_reset()
+ */
+void *arena_alloc (arena *a, size_t size);
+
+/**
+ * Grow memory allocated in an arena
+ *
+ * The memory is extended in place if it is the last allocation and its block has room;
+ * otherwise it is copied at a new address (the old one is only given back with the arena).
+ *
+ * @param a an arena
+ * @param ptr an address returned by arena_alloc() or arena_realloc(), or `NULL`
+ * @param old_size the size of the memory at `ptr`
+ * @param new_size the new size
+ * @return the address of the memory
+ */
+void *arena_realloc (arena *a, void *ptr, size_t old_size, size_t new_size);
+
+/**
+ * Copy a string in an arena
+ * @param a an arena
+ * @param str a null-terminated string
+ * @return the copy
+ */
+char *arena_strdup (arena *a, const char *str);
+
+/**
+ * Copy the beginning of a string in an arena
+ *
+ * The copy is not aligned (see arena_alloc()), so consecutive strings are packed.
+ *
+ * @param a an arena
+ * @param str a string of at least `len` characters
+ * @param len the number of characters to copy
+ * @return the copy, null-terminated
+ */
+char *arena_strndup (arena *a, const char *str, size_t len);
+
+/**
+ * Save the current position of an arena
+ * @param a an arena
+ * @return the mark to give to arena_restore()
+ */
+arena_mark arena_save (arena *a);
+
+/**
+ * Give back all the memory allocated in an arena since a mark
+ *
+ * The marks must be restored in the reverse order they were saved.
+ *
+ * @param a an arena
+ * @param mark a mark returned by arena_save()
+ */
+void arena_restore (arena *a, arena_mark mark);
+
+/**
+ * Give back all the memory allocated in an arena, its first block is kept for the next allocations
+ * @param a an arena
+ */
+void arena_reset (arena *a);
+
+#endif
@@ -9,6 +9,8 @@
 
 struct array
 {
+  arena *mem; // NULL si le tableau est alloué par malloc
+
   size_t size;
   
   size_t capacity;
@@ -22,7 +24,10 @@ struct array
 
 static void array_resize (array *arr, size_t new_capacity)
 {
-  arr->data = realloc(arr->data, arr->elem_size * new_capacity);
+  if (arr->mem)
+    arr->data = arena_realloc(arr->mem, arr->data, arr->elem_size * arr->capacity, arr->elem_size * new_capacity);
+  else
+    arr->data = realloc(arr->data, arr->elem_size * new_capacity);
   assert(arr->data);
 
   arr->capacity = new_capacity;
@@ -32,17 +37,24 @@ static void array_resize (array *arr, size_t new_capacity)
 
 
 array *array_create (size_t elem_size)
+{
+  return array_create_in (NULL, elem_size);
+}
+
+
+array *array_create_in (arena *mem, size_t elem_size)
 {
   if (!elem_size)
     return NULL;
   
-  array *arr = malloc(sizeof(array));
+  array *arr = mem ? arena_alloc(mem, sizeof(array)) : malloc(sizeof(array));
   assert (arr);
 
+  arr->mem = mem;
   arr->size = 0;
   arr->capacity = ARRAY_INITIAL_CAPACITY;
   arr->elem_size = elem_size;
-  arr->data = malloc(arr->capacity * elem_size);
+  arr->data = mem ? arena_alloc(mem, arr->capacity * elem_size) : malloc(arr->capacity * elem_size);
   assert (arr->data);
   
   return arr;
@@ -61,6 +73,10 @@ void array_free (array *arr, bool full)
 	free (*(char**)(arr->data + i*arr->elem_size));
     }
 
+  // la mémoire d'une arène est rendue avec elle
+  if (arr->mem)
+    return;
+
   free(arr->data);
   free(arr);
 }
@@ -131,6 +147,21 @@ void *array_get (array *arr, size_t i)
 }
 
 
+void *array_at (array *arr, size_t i)
+{
+  if (!arr || arr->size <= i)
+    return NULL;
+
+  return arr->data + i*arr->elem_size;
+}
+
+
+void *array_data (array *arr)
+{
+  return arr ? arr->data : NULL;
+}
+
+
 void *array_remove (array *arr, size_t i)
 {
   if (!arr || arr->size <= i)
@@ -144,7 +175,7 @@ void *array_remove (array *arr, size_t i)
 
   arr->size--;
   
-  if (arr->capacity >= 4 * arr->size && arr->capacity > ARRAY_INITIAL_CAPACITY)
+  if (!arr->mem && arr->capacity >= 4 * arr->size && arr->capacity > ARRAY_INITIAL_CAPACITY)
     array_resize(arr, arr->capacity / 2);
   
   return ret;
@@ -9,6 +9,8 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "arena.h"
+
 typedef struct array array;
 
 /** 
@@ -19,6 +21,19 @@ typedef struct array array;
  */
 array *array_create (size_t elem_size);
 
+/**
+ * Create an empty array in an arena
+ *
+ * The array and its elements are allocated in `mem` and given back with it : array_free() only frees
+ * the elements themselves if `full` is `true`. The copies returned by array_get(), array_set() and
+ * array_remove() are still malloc'd.
+ *
+ * @param mem an arena, or `NULL` for a malloc'd array (same as array_create())
+ * @param elem_size the size of each element in bytes
+ * @return an empty array
+ */
+array *array_create_in (arena *mem, size_t elem_size);
+
 /**
  * Free the memory allocated for an array.
  *
@@ -84,6 +99,41 @@ void array_insert_last (array *arr, void *val);
  */
 void *array_get (array *arr, size_t i);
 
+/**
+ * Gets the address of the element at the given index in an array, without copying it.
+ *
+ * The address is valid until the next insertion or removal in the array.
+ *
+ * @param arr an array
+ * @param i the index of the element to access
+ * @return a pointer to the element, inside the array; `NULL` if `i` is out of bounds
+ */
+void *array_at (array *arr, size_t i);
+
+/**
+ * Gets the elements of an array, stored contiguously.
+ *
+ * The address is valid until the next insertion or removal in the array.
+ *
+ * @param arr an array
+ * @return a pointer to the first element, inside the array; `NULL` if `arr` is `NULL`
+ */
+void *array_data (array *arr);
+
+/**
+ * Iterates over the elements of an array, without copying them.
+ *
+ * `elem` is declared as a `type *` pointing to each element in turn. The array must not be modified by the loop.
+ *
+ * @code
+ * ARRAY_FOREACH (tar_file, tf, arr)
+ *   puts(tf->name);
+ * @endcode
+ */
+#define ARRAY_FOREACH(type, elem, arr)						\
+  for (type *elem = array_data(arr), *elem##_end = elem + ((arr) ? array_size(arr) : 0); \
+       elem < elem##_end; elem++)
+
 /**
  * Removes the element at the given index in an array. The following elements are moved down one place.
  *
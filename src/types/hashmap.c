@@ -0,0 +1,218 @@
+#include "hashmap.h"
+
+#define HASHMAP_INITIAL_CAPACITY 64
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct entry entry;
+struct entry
+{
+  entry *next;
+  uint64_t hash;
+  void *val;
+  char key[];
+};
+
+
+struct hashmap
+{
+  size_t size;
+
+  size_t capacity; // toujours une puissance de 2
+
+  entry **buckets;
+};
+
+
+
+/* FNV-1a */
+static uint64_t hash_string (const char *str)
+{
+  uint64_t h = 14695981039346656037ULL;
+
+  for (; *str; str++)
+    {
+      h ^= (unsigned char) *str;
+      h *= 1099511628211ULL;
+    }
+
+  return h;
+}
+
+
+static void hashmap_resize (hashmap *map, size_t new_capacity)
+{
+  entry **buckets = calloc(new_capacity, sizeof(entry*));
+  assert(buckets);
+
+  for (size_t i = 0; i < map->capacity; i++)
+    {
+      entry *e = map->buckets[i], *next;
+
+      for (; e; e = next)
+	{
+	  next = e->next;
+	  e->next = buckets[e->hash & (new_capacity - 1)];
+	  buckets[e->hash & (new_capacity - 1)] = e;
+	}
+    }
+
+  free(map->buckets);
+  map->buckets = buckets;
+  map->capacity = new_capacity;
+}
+
+
+static entry **find_entry (hashmap *map, const char *key, uint64_t hash)
+{
+  entry **e = map->buckets + (hash & (map->capacity - 1));
+
+  for (; *e; e = &(*e)->next)
+    {
+      if ((*e)->hash == hash && !strcmp((*e)->key, key))
+	break;
+    }
+
+  return e;
+}
+
+
+
+
+hashmap *hashmap_create ()
+{
+  hashmap *map = malloc(sizeof(hashmap));
+  assert(map);
+
+  map->size = 0;
+  map->capacity = HASHMAP_INITIAL_CAPACITY;
+  map->buckets = calloc(map->capacity, sizeof(entry*));
+  assert(map->buckets);
+
+  return map;
+}
+
+
+
+void hashmap_free (hashmap *map, bool full)
+{
+  if (!map)
+    return;
+
+  for (size_t i = 0; i < map->capacity; i++)
+    {
+      entry *e = map->buckets[i], *next;
+
+      for (; e; e = next)
+	{
+	  next = e->next;
+
+	  if (full)
+	    free(e->val);
+
+	  free(e);
+	}
+    }
+
+  free(map->buckets);
+  free(map);
+}
+
+
+
+int hashmap_size (hashmap *map)
+{
+  return map ? map->size : -1;
+}
+
+
+
+void *hashmap_put (hashmap *map, const char *key, void *val)
+{
+  if (!map)
+    return NULL;
+
+  uint64_t hash = hash_string(key);
+  entry **e = find_entry(map, key, hash);
+
+  if (*e)
+    {
+      void *old = (*e)->val;
+      (*e)->val = val;
+      return old;
+    }
+
+  size_t key_len = strlen(key);
+  entry *new = malloc(sizeof(entry) + key_len + 1);
+  assert(new);
+
+  new->next = NULL;
+  new->hash = hash;
+  new->val = val;
+  memcpy(new->key, key, key_len + 1);
+
+  *e = new;
+  map->size++;
+
+  // facteur de charge maximal de 3/4
+  if (4 * map->size > 3 * map->capacity)
+    hashmap_resize(map, 2 * map->capacity);
+
+  return NULL;
+}
+
+
+
+void *hashmap_get (hashmap *map, const char *key)
+{
+  if (!map)
+    return NULL;
+
+  entry *e = *find_entry(map, key, hash_string(key));
+
+  return e ? e->val : NULL;
+}
+
+
+bool hashmap_contains (hashmap *map, const char *key)
+{
+  return map && *find_entry(map, key, hash_string(key)) != NULL;
+}
+
+
+void *hashmap_remove (hashmap *map, const char *key)
+{
+  if (!map)
+    return NULL;
+
+  entry **e = find_entry(map, key, hash_string(key));
+  entry *removed = *e;
+
+  if (!removed)
+    return NULL;
+
+  void *val = removed->val;
+  *e = removed->next;
+  free(removed);
+  map->size--;
+
+  return val;
+}
+
+
+
+void hashmap_iter (hashmap *map, void (*f)(const char *key, void *val, void *data), void *data)
+{
+  if (!map)
+    return;
+
+  for (size_t i = 0; i < map->capacity; i++)
+    {
+      for (entry *e = map->buckets[i]; e; e = e->next)
+	f(e->key, e->val, data);
+    }
+}
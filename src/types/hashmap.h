@@ -0,0 +1,84 @@
+/**
+ * @file hashmap.h
+ * Hash map data structure with string keys
+ */
+
+#ifndef HASHMAP_H
+#define HASHMAP_H
+
+#include <stdbool.h>
+
+/**
+ * Hash map associating null-terminated strings to addresses.
+ * Keys are copied by the map, but the map holds only the address of the values and not the pointed data.
+ */
+typedef struct hashmap hashmap;
+
+/**
+ * Create an empty hash map
+ * @return a malloc'd empty hash map
+ */
+hashmap *hashmap_create ();
+
+/**
+ * Free the memory allocated for a hash map
+ * @param map a hash map
+ * @param full if `full` is `true` then free is used on values too
+ */
+void hashmap_free (hashmap *map, bool full);
+
+/**
+ * Get the number of entries of a hash map
+ * @param map a hash map
+ * @return the number of entries or -1 if `map` is `NULL`
+ */
+int hashmap_size (hashmap *map);
+
+/**
+ * Associate a value to a key in a hash map
+ *
+ * If `key` was already in the map, its value is replaced.
+ *
+ * @param map a hash map
+ * @param key a null-terminated string
+ * @param val the address to associate to `key`
+ * @return the address previously associated to `key`; `NULL` if there was none
+ */
+void *hashmap_put (hashmap *map, const char *key, void *val);
+
+/**
+ * Get the value associated to a key in a hash map
+ * @param map a hash map
+ * @param key a null-terminated string
+ * @return the address associated to `key`; `NULL` if `key` is not in `map`
+ */
+void *hashmap_get (hashmap *map, const char *key);
+
+/**
+ * Check if a key is in a hash map
+ * @param map a hash map
+ * @param key a null-terminated string
+ * @return `true` if `key` is in `map` (even if its value is `NULL`); `false` otherwise
+ */
+bool hashmap_contains (hashmap *map, const char *key);
+
+/**
+ * Remove a key from a hash map
+ * @param map a hash map
+ * @param key a null-terminated string
+ * @return the address that was associated to `key`; `NULL` if `key` was not in `map`
+ */
+void *hashmap_remove (hashmap *map, const char *key);
+
+/**
+ * Apply a function to all entries of a hash map
+ *
+ * The iteration order is unspecified. `f` must not modify `map`.
+ *
+ * @param map a hash map
+ * @param f a function called with each key, its value and `data`
+ * @param data an address passed to each call of `f`
+ */
+void hashmap_iter (hashmap *map, void (*f)(const char *key, void *val, void *data), void *data);
+
+#endif
@@ -14,14 +14,15 @@ struct cell
 
 struct list
 {
+  arena *mem; // NULL si la liste est allouée par malloc
   cell *first;
   cell *last;
 };
 
 
-static cell *create_cell(cell *p, cell *n, void *v)
+static cell *create_cell(list *l, cell *p, cell *n, void *v)
 {
-  cell *c = malloc(sizeof(cell));
+  cell *c = l->mem ? arena_alloc(l->mem, sizeof(cell)) : malloc(sizeof(cell));
 
   if (c)
     {
@@ -33,13 +34,26 @@ static cell *create_cell(cell *p, cell *n, void *v)
   return c;
 }
 
+/* Free a cell, or the list itself, unless it is in an arena */
+static void free_cell(list *l, void *c)
+{
+  if (!l->mem)
+    free(c);
+}
+
 
 list *list_create()
 {
-  list *l = malloc(sizeof(list));
+  return list_create_in(NULL);
+}
+
+list *list_create_in(arena *mem)
+{
+  list *l = mem ? arena_alloc(mem, sizeof(list)) : malloc(sizeof(list));
 
   if (l)
     {
+      l->mem   = mem;
       l->first = NULL;
       l->last  = NULL;
     }
@@ -56,7 +70,7 @@ void list_free(list *list, bool full)
   // liste vide
   if (!list->first)
     {
-      free (list);
+      free_cell (list, list);
       return;
     }
 
@@ -71,11 +85,11 @@ void list_free(list *list, bool full)
       if (full)
 	free(current->val);
 
-      free (current);
+      free_cell (list, current);
       current = next;
     }
 
-  free(list);
+  free_cell(list, list);
 }
 
 
@@ -110,12 +124,12 @@ void list_insert_first(list *list, void *val)
 
   if (!list->first)
     {
-      list->first = create_cell(NULL, NULL, val);
+      list->first = create_cell(list, NULL, NULL, val);
       list->last = list->first;
     }
   else
     {
-      list->first->prev = create_cell(NULL, list->first, val);
+      list->first->prev = create_cell(list, NULL, list->first, val);
       list->first = list->first->prev;
     }
 }
@@ -127,12 +141,12 @@ void list_insert_last(list *list, void *val)
 
   if (!list->last)
     {
-      list->last = create_cell(NULL, NULL, val);
+      list->last = create_cell(list, NULL, NULL, val);
       list->first = list->last;
     }
   else
     {
-      list->last->next = create_cell(list->last, NULL, val);
+      list->last->next = create_cell(list, list->last, NULL, val);
       list->last = list->last->next;
     }
 }
@@ -148,13 +162,13 @@ void *list_remove_first (list *list)
 
   if (next)
     {
-      free(list->first);
+      free_cell(list, list->first);
       next->prev  = NULL;
       list->first = next;
     }
   else
     {
-      free(list->first);
+      free_cell(list, list->first);
       list->first = NULL;
       list->last  = NULL;
     }
@@ -174,13 +188,13 @@ void *list_remove_last (list *list)
 
   if (prev)
     {
-      free(list->last);
+      free_cell(list, list->last);
       prev->next  = NULL;
       list->last  = prev;
     }
   else
     {
-      free(list->last);
+      free_cell(list, list->last);
       list->first = NULL;
       list->last  = NULL;
     }
@@ -243,7 +257,7 @@ void list_free_full(list *list, void (*free_func)(void *))
   // liste vide
   if (!list->first)
   {
-    free (list);
+    free_cell (list, list);
     return;
   }
 
@@ -257,10 +271,10 @@ void list_free_full(list *list, void (*free_func)(void *))
 
     free_func(current->val);
 
-    free (current);
+    free_cell (list, current);
     current = next;
   }
 
-  free(list);
+  free_cell(list, list);
 
 }
@@ -8,6 +8,8 @@
 
 #include <stdbool.h>
 
+#include "arena.h"
+
 /**
  * Doubly linked list.
  * Note that the list holds only address and not the pointed data
@@ -20,6 +22,17 @@ typedef struct list list;
  */
 list *list_create ();
 
+/**
+ * Create an empty list in an arena
+ *
+ * The list and its cells are allocated in `mem` and given back with it : list_free() and list_free_full()
+ * only free the data.
+ *
+ * @param mem an arena, or `NULL` for a malloc'd list (same as list_create())
+ * @return an empty list
+ */
+list *list_create_in (arena *mem);
+
 /**
  * Free the memory allocated for a list
  * @param list a list
@@ -7,6 +7,11 @@ stack *stack_create ()
   return list_create();
 }
 
+stack *stack_create_in (arena *mem)
+{
+  return list_create_in(mem);
+}
+
 void stack_free (stack *stack, bool full)
 {
   list_free(stack, full);
@@ -22,6 +22,13 @@ typedef list stack;
  */
 stack *stack_create ();
 
+/**
+ * Create an empty stack in an arena, see list_create_in()
+ * @param mem an arena, or `NULL` for a malloc'd stack
+ * @return an empty stack
+ */
+stack *stack_create_in (arena *mem);
+
 /**
  * Free the memory allocated for a stack
  * @param stack a stack